@@ -120,6 +120,17 @@ process_optvalue(const char *optname, struct arg *cur, const char *optval)
 	return ok;
 }
 
+/* Index of the option with the long name, args->count if there is none */
+static int
+find_long_arg(struct args *args, const char *name)
+{
+	int j = 0;
+
+	while ((j != args->count) && strcmp(name, args->arg[j].longarg))
+		j++;
+	return (j);
+}
+
 int
 read_args(struct args *args, int argc, const char *argv[])
 {
@@ -137,11 +148,9 @@ read_args(struct args *args, int argc, const char *argv[])
 			if (argv[i][1] == 0) {
 				printf("Error: Unknown option: -\n");
 				ok = False;
-			} else if (argv[i][1] == '-') {
-				j = 0;
-				while ((j != args->count) && strcmp(&argv[i][2], args->arg[j].longarg)) {
-					j++;
-				}
+			} else if ((argv[i][1] == '-') || (find_long_arg(args, &argv[i][1]) != args->count)) {
+				/* A long name also works with a single dash, like -MD */
+				j = find_long_arg(args, &argv[i][argv[i][1] == '-' ? 2 : 1]);
 				if (j == args->count) {
 					printf("Error: Unknown option: %s\n", argv[i]);
 					ok = False;
@@ -0,0 +1,159 @@
+/***********************************************************************
+ *
+ *  AVRA - Assembler for the Atmel AVR microcontroller series
+ *
+ *  Copyright (C) 1998-2020 The AVRA Authors
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; see the file COPYING.  If not, write to
+ *  the Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ *  Boston, MA 02111-1307, USA.
+ *
+ *
+ *  Authors of AVRA can be reached at:
+ *     email: jonah@omegav.ntnu.no, tobiw@suprafluid.com
+ *     www: https://github.com/Ro5bert/avra
+ */
+
+/*
+ * Identifiers are interned as atoms: each name gets a number the first
+ * time it is seen, folded to lower case once. The atom also holds the
+ * symbols known by that name, so looking one up is a hash probe and
+ * comparing names is comparing numbers. Atom 0 is no name.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+
+#include "misc.h"
+#include "avra.h"
+
+#define ATOM_INITIAL_SIZE 1024	/* Grows by doubling, stays a power of two */
+
+/* name equals folded, which is already lower case */
+static int
+folded_equal(const char *folded, const char *name)
+{
+	for (; *folded == tolower((unsigned char)*name); folded++, name++)
+		if (*folded == '\0')
+			return (True);
+	return (False);
+}
+
+static int
+grow_atoms(struct prog_info *pi)
+{
+	struct atom *atom;
+	int *bucket, size, i, b;
+
+	size = pi->atom_size ? pi->atom_size * 2 : ATOM_INITIAL_SIZE;
+	atom = realloc(pi->atom, size * sizeof(struct atom));
+	if (!atom)
+		return (False);
+	pi->atom = atom;
+	bucket = calloc(size, sizeof(int));
+	if (!bucket)
+		return (False);
+	free(pi->atom_bucket);
+	pi->atom_bucket = bucket;
+	pi->atom_size = size;
+	if (pi->atom_count == 0) {
+		memset(&pi->atom[0], 0, sizeof(struct atom));
+		pi->atom_count = 1;
+	}
+	for (i = 1; i < pi->atom_count; i++) {
+		b = pi->atom[i].hash & (size - 1);
+		pi->atom[i].next = bucket[b];
+		bucket[b] = i;
+	}
+	return (True);
+}
+
+/* Return the atom of name, or 0 if name has never been interned */
+int
+find_atom(struct prog_info *pi, const char *name)
+{
+	unsigned int hash;
+	int i;
+
+	if (pi->atom_size == 0)
+		return (0);
+	hash = nocase_hash(name);
+	for (i = pi->atom_bucket[hash & (pi->atom_size - 1)]; i; i = pi->atom[i].next)
+		if ((pi->atom[i].hash == hash) && folded_equal(pi->atom[i].name, name))
+			return (i);
+	return (0);
+}
+
+/* Return the atom of name, adding it if needed. 0 if out of memory */
+int
+intern(struct prog_info *pi, const char *name)
+{
+	struct atom *atom;
+	int i, b;
+
+	i = find_atom(pi, name);
+	if (i)
+		return (i);
+	if ((pi->atom_count >= pi->atom_size) && !grow_atoms(pi)) {
+		print_msg(pi, MSGTYPE_OUT_OF_MEM, NULL);
+		return (0);
+	}
+	atom = &pi->atom[pi->atom_count];
+	memset(atom, 0, sizeof(struct atom));
+	atom->name = malloc(strlen(name) + 1);
+	if (!atom->name) {
+		print_msg(pi, MSGTYPE_OUT_OF_MEM, NULL);
+		return (0);
+	}
+	for (i = 0; name[i] != '\0'; i++)
+		atom->name[i] = tolower((unsigned char)name[i]);
+	atom->name[i] = '\0';
+	atom->hash = nocase_hash(name);
+	b = atom->hash & (pi->atom_size - 1);
+	atom->next = pi->atom_bucket[b];
+	pi->atom_bucket[b] = pi->atom_count;
+	return (pi->atom_count++);
+}
+
+/* Intern the name of a new symbol. The first symbol of each kind
+ * defined by a name is the one found by search_symbol(). */
+int
+bind_symbol(struct prog_info *pi, int kind, struct label *label)
+{
+	label->atom = intern(pi, label->name);
+	if (!label->atom)
+		return (False);
+	if ((kind != SYMBOL_LOCAL) && !pi->atom[label->atom].symbol[kind])
+		pi->atom[label->atom].symbol[kind] = label;
+	return (True);
+}
+
+void
+free_atoms(struct prog_info *pi)
+{
+	int i;
+
+	for (i = 1; i < pi->atom_count; i++)
+		free(pi->atom[i].name);
+	free(pi->atom);
+	free(pi->atom_bucket);
+	pi->atom = NULL;
+	pi->atom_bucket = NULL;
+	pi->atom_count = 0;
+	pi->atom_size = 0;
+}
+
+/* end of atom.c */
@@ -49,7 +49,10 @@ const char *usage =
     "            [--define <symbol>[=<value>]]\n"
     "            [-I <dir>] [--listmac]\n"
     "            [--max_errors <number>] [--devices] [--version]\n"
-    "            [-O e|w|i]\n"
+    "            [-O e|w|i] [--listcycles] [--wcet] [--relax] [--module]\n"
+    "            [-MD] [-MF <depfile>] [--cache <dir>] [--cache_stats]\n"
+    "            [--elf] [--unused] [--stack] [--clobbers]\n"
+    "            [--budget <file>]\n"
     "            [-h] [--help] general help\n"
     "            <file to assemble>\n"
     "\n"
@@ -58,6 +61,19 @@ const char *usage =
     "   --define      -D : Define symbol.\n"
     "   --includedir  -I : Additional include paths. Default: %s\n"
     "   --listmac        : List macro expansion in listfile.\n"
+    "   --listcycles     : List cycle counts in listfile.\n"
+    "   --wcet           : Report worst case cycles of each routine.\n"
+    "   --relax          : Use the shortest jumps and calls, extend branches.\n"
+    "   --module         : Write a relocatable module (.rel) for avra-ld.\n"
+    "   -MD              : Write the included files as make dependencies (.d).\n"
+    "   -MF              : Name of the dependency file, implies -MD.\n"
+    "   --cache          : Restore unchanged outputs from, or store them in, a directory.\n"
+    "   --cache_stats    : Print the hits and misses of the --cache directory.\n"
+    "   --elf            : Write an ELF file with symbols and line numbers (.elf).\n"
+    "   --unused         : Report code that can't be reached from the vectors.\n"
+    "   --stack          : Report the stack bytes each routine needs.\n"
+    "   --clobbers       : Report the registers each routine writes.\n"
+    "   --budget         : Check the bytes used against the limits of a file.\n"
     "   --max_errors     : Maximum number of errors before exit\n"
     "                      (default: 10)\n"
     "   --devices        : List out supported devices.\n"
@@ -74,11 +90,50 @@ const struct dataset overlap_choice[4] = {
 
 const int SEG_BSS_DATA = 0x01;
 
-static struct prog_info PROG_INFO;
 static struct segment_info CODE_SEG;
 static struct segment_info DATA_SEG;
 static struct segment_info EEPROM_SEG;
 
+/* Shared with avra-sim, which adds its own arguments after ARG_COUNT */
+void
+define_args(struct args *args)
+{
+	define_arg(args, ARG_DEFINE,      ARGTYPE_STRING_MULTISINGLE,  'D', "define",      NULL, NULL);
+	define_arg(args, ARG_INCLUDEPATH, ARGTYPE_STRING_MULTISINGLE,  'I', "includedir",  NULL, NULL);
+	define_arg(args, ARG_LISTMAC,     ARGTYPE_BOOLEAN,              0,  "listmac",     "1",  NULL);
+	define_arg_int(args, ARG_MAX_ERRORS,  ARGTYPE_NUMERIC,               0,  "max_errors",  10, NULL);
+	define_arg(args, ARG_COFF,        ARGTYPE_BOOLEAN,              0,  "coff",        NULL, NULL);
+	define_arg(args, ARG_DEVICES,     ARGTYPE_BOOLEAN,              0,  "devices",     NULL, NULL);
+	define_arg(args, ARG_VER,         ARGTYPE_BOOLEAN,              0,  "version",     NULL, NULL);
+	define_arg(args, ARG_HELP,        ARGTYPE_BOOLEAN,             'h', "help",        NULL, NULL);
+	define_arg(args, ARG_WRAP,        ARGTYPE_BOOLEAN,             'w', "wrap",        NULL, NULL);	/* Not implemented ? B.A. */
+	define_arg(args, ARG_WARNINGS,    ARGTYPE_STRING_MULTISINGLE,  'W', "warn",        NULL, NULL);
+	define_arg(args, ARG_FILEFORMAT,  ARGTYPE_CHAR_ATTACHED,       'f', "filetype",    "0",	 NULL);	/* Not implemented ? B.A. */
+	define_arg(args, ARG_LISTFILE,    ARGTYPE_STRING,              'l', "listfile",    NULL, NULL);
+	define_arg(args, ARG_OUTFILE,     ARGTYPE_STRING,              'o', "outfile",     NULL, NULL);
+	define_arg(args, ARG_MAPFILE,     ARGTYPE_STRING,              'm', "mapfile",     NULL, NULL);
+	define_arg(args, ARG_DEBUGFILE,   ARGTYPE_STRING,              'd', "debugfile",   NULL, NULL);
+	define_arg(args, ARG_EEPFILE,     ARGTYPE_STRING,              'e', "eepfile",     NULL, NULL);
+	define_arg_int(args, ARG_OVERLAP, ARGTYPE_CHOICE,              'O', "overlap",     OVERLAP_ERROR, overlap_choice);
+	define_arg(args, ARG_LISTCYCLES,  ARGTYPE_BOOLEAN,              0,  "listcycles",  NULL, NULL);
+	define_arg(args, ARG_WCET,        ARGTYPE_BOOLEAN,              0,  "wcet",        NULL, NULL);
+	define_arg(args, ARG_RELAX,       ARGTYPE_BOOLEAN,              0,  "relax",       NULL, NULL);
+	define_arg(args, ARG_MODULE,      ARGTYPE_BOOLEAN,              0,  "module",      NULL, NULL);
+	define_arg(args, ARG_DEPEND,      ARGTYPE_BOOLEAN,              0,  "MD",          NULL, NULL);
+	define_arg(args, ARG_DEPFILE,     ARGTYPE_STRING,               0,  "MF",          NULL, NULL);
+	define_arg(args, ARG_CACHE,       ARGTYPE_STRING,               0,  "cache",       NULL, NULL);
+	define_arg(args, ARG_CACHE_STATS, ARGTYPE_BOOLEAN,              0,  "cache_stats", NULL, NULL);
+	define_arg(args, ARG_ELF,         ARGTYPE_BOOLEAN,              0,  "elf",         NULL, NULL);
+	define_arg(args, ARG_UNUSED,      ARGTYPE_BOOLEAN,              0,  "unused",      NULL, NULL);
+	define_arg(args, ARG_STACK,       ARGTYPE_BOOLEAN,              0,  "stack",       NULL, NULL);
+	define_arg(args, ARG_CLOBBERS,    ARGTYPE_BOOLEAN,              0,  "clobbers",    NULL, NULL);
+	define_arg(args, ARG_BUDGET,      ARGTYPE_STRING,               0,  "budget",      NULL, NULL);
+	define_arg(args, ARG_DROP_UNUSED, ARGTYPE_BOOLEAN,              0,  "drop_unused", NULL, NULL);
+}
+
+#ifndef AVRA_SIM
+static struct prog_info PROG_INFO;
+
 int
 main(int argc, const char *argv[])
 {
@@ -99,23 +154,7 @@ main(int argc, const char *argv[])
 
 	args = alloc_args(ARG_COUNT);
 	if (args) {
-		define_arg(args, ARG_DEFINE,      ARGTYPE_STRING_MULTISINGLE,  'D', "define",      NULL, NULL);
-		define_arg(args, ARG_INCLUDEPATH, ARGTYPE_STRING_MULTISINGLE,  'I', "includedir",  NULL, NULL);
-		define_arg(args, ARG_LISTMAC,     ARGTYPE_BOOLEAN,              0,  "listmac",     "1",  NULL);
-		define_arg_int(args, ARG_MAX_ERRORS,  ARGTYPE_NUMERIC,               0,  "max_errors",  10, NULL);
-		define_arg(args, ARG_COFF,        ARGTYPE_BOOLEAN,              0,  "coff",        NULL, NULL);
-		define_arg(args, ARG_DEVICES,     ARGTYPE_BOOLEAN,              0,  "devices",     NULL, NULL);
-		define_arg(args, ARG_VER,         ARGTYPE_BOOLEAN,              0,  "version",     NULL, NULL);
-		define_arg(args, ARG_HELP,        ARGTYPE_BOOLEAN,             'h', "help",        NULL, NULL);
-		define_arg(args, ARG_WRAP,        ARGTYPE_BOOLEAN,             'w', "wrap",        NULL, NULL);	/* Not implemented ? B.A. */
-		define_arg(args, ARG_WARNINGS,    ARGTYPE_STRING_MULTISINGLE,  'W', "warn",        NULL, NULL);
-		define_arg(args, ARG_FILEFORMAT,  ARGTYPE_CHAR_ATTACHED,       'f', "filetype",    "0",	 NULL);	/* Not implemented ? B.A. */
-		define_arg(args, ARG_LISTFILE,    ARGTYPE_STRING,              'l', "listfile",    NULL, NULL);
-		define_arg(args, ARG_OUTFILE,     ARGTYPE_STRING,              'o', "outfile",     NULL, NULL);
-		define_arg(args, ARG_MAPFILE,     ARGTYPE_STRING,              'm', "mapfile",     NULL, NULL);
-		define_arg(args, ARG_DEBUGFILE,   ARGTYPE_STRING,              'd', "debugfile",   NULL, NULL);
-		define_arg(args, ARG_EEPFILE,     ARGTYPE_STRING,              'e', "eepfile",     NULL, NULL);
-		define_arg_int(args, ARG_OVERLAP, ARGTYPE_CHOICE,              'O', "overlap",     OVERLAP_ERROR, overlap_choice);
+		define_args(args);
 
 
 		c = read_args(args, argc, argv);
@@ -123,12 +162,17 @@ main(int argc, const char *argv[])
 		if (c != 0) {
 			if (!GET_ARG_I(args, ARG_HELP) && (argc != 1))	{
 				if (!GET_ARG_I(args, ARG_VER)) {
-					if (!GET_ARG_I(args, ARG_DEVICES)) {
+					if (GET_ARG_I(args, ARG_CACHE_STATS)) {
+						print_cache_stats(args);
+					} else if (!GET_ARG_I(args, ARG_DEVICES)) {
 						pi = init_prog_info(&PROG_INFO, args);
 						if (pi) {
 							get_rootpath(pi, args);  /* get assembly root path */
-							if (assemble(pi) != 0) { /* the main assembly call */
-								exit(EXIT_FAILURE);
+							if (!restore_cached(pi)) {
+								if (assemble(pi) != 0) { /* the main assembly call */
+									exit(EXIT_FAILURE);
+								}
+								store_cached(pi);
 							}
 							free_pi(pi);             /* free all allocated memory */
 						}
@@ -154,6 +198,7 @@ main(int argc, const char *argv[])
 	exit(EXIT_SUCCESS);
 	return (0);
 }
+#endif /* AVRA_SIM */
 
 void
 get_rootpath(struct prog_info *pi, struct args *args)
@@ -194,6 +239,10 @@ assemble(struct prog_info *pi)
 {
 	unsigned char c;
 
+	if (pi->module && GET_ARG_I(pi->args, ARG_RELAX)) {
+		printf("Error: --relax can't be used with --module\n");
+		return -1;
+	}
 	if (pi->args->first_data) {
 		printf("Pass 1...\n");
 		if (load_arg_defines(pi)==False)
@@ -205,9 +254,18 @@ assemble(struct prog_info *pi)
 		def_orglist(pi->cseg);
 		c = parse_file(pi, pi->args->first_data->data);
 		fix_orglist(pi->segment);
+		if (pi->pool) {
+			print_msg(pi, MSGTYPE_ERROR, "Found no .ENDPOOL after .POOL");
+			pi->pool = NULL;
+		}
+		eval_pending_constants(pi);
+		if ((c != False) && (pi->error_count == 0) && (GET_ARG_I(pi->args, ARG_RELAX) || pi->clobbers_used))
+			relax_code(pi, pi->args->first_data->data);
 		test_orglist(pi->cseg);
 		test_orglist(pi->dseg);
 		test_orglist(pi->eseg);
+		if ((c != False) && (pi->error_count == 0) && GET_ARG_P(pi->args, ARG_BUDGET))
+			check_budget(pi, GET_ARG_P(pi->args, ARG_BUDGET));
 
 		if (c != False) {
 			/* if there are no further errors, we can continue with 2nd pass */
@@ -215,6 +273,8 @@ assemble(struct prog_info *pi)
 				pi->segment = pi->cseg;
 				rewind_segments(pi);
 				pi->pass=PASS_2;
+				pi->relax_index = 0;
+				pi->pool_index = 0;
 				if (load_arg_defines(pi)==False)
 					return -1;
 				if (predef_dev(pi)==False)
@@ -228,12 +288,24 @@ assemble(struct prog_info *pi)
 					printf("Pass 2...\n");
 					parse_file(pi, pi->args->first_data->data);
 					printf("done\n\n");
+					print_cycles_reports(pi);
+					print_wcet_report(pi);
+					print_stack_report(pi);
+					print_clobbers_report(pi);
+					print_unused_report(pi);
 					if (pi->list_file)
 						fprint_segments(pi->list_file, pi);
 					if (pi->coff_file && pi->error_count == 0) {
 						write_coff_file(pi);
 					}
+					if (pi->elf && pi->error_count == 0)
+						write_elf_file(pi);
 					write_map_file(pi);
+					if (pi->module && (pi->error_count == 0))
+						write_module_file(pi, pi->args->first_data->data);
+					if ((GET_ARG_I(pi->args, ARG_DEPEND) || GET_ARG_P(pi->args, ARG_DEPFILE))
+					        && (pi->error_count == 0))
+						write_dep_file(pi, pi->args->first_data->data);
 					if (pi->error_count) {
 						printf("\nAssembly aborted with %d errors and %d warnings.\n", pi->error_count, pi->warning_count);
 						unlink_out_files(pi, pi->args->first_data->data);
@@ -314,8 +386,9 @@ init_segment_size(struct prog_info *pi, struct device *device)
 	pi->cseg->hi_addr = device->flash_size;
 	pi->cseg->cellsize = 2;
 
-	pi->dseg->lo_addr = device->ram_start;
-	pi->dseg->hi_addr = device->ram_size+device->ram_start;
+	/* Sections of a module start at 0, avra-ld moves them */
+	pi->dseg->lo_addr = pi->module ? 0 : device->ram_start;
+	pi->dseg->hi_addr = device->ram_size+pi->dseg->lo_addr;
 	pi->dseg->cellsize = 1;
 
 	pi->eseg->hi_addr = device->eeprom_size;
@@ -331,6 +404,8 @@ init_prog_info(struct prog_info *pi, struct args *args)
 
 	memset(pi, 0, sizeof(struct prog_info));
 	pi->args = args;
+	pi->module = GET_ARG_I(args, ARG_MODULE);
+	pi->in_memory = pi->module;
 	pi->device = get_device(pi,NULL);
 	if (GET_ARG_P(args, ARG_LISTFILE) == NULL) {
 		pi->list_on = False;
@@ -383,6 +458,8 @@ init_prog_info(struct prog_info *pi, struct args *args)
 	pi->time=time(NULL);
 	pi->effective_overlap = GET_ARG_I(pi->args, ARG_OVERLAP);
 	pi->segment_overlap = SEG_DONT_OVERLAP;
+	pi->block_start = -1;
+	def_directives(pi);
 	return (pi);
 }
 
@@ -396,20 +473,46 @@ free_pi(struct prog_info *pi)
 	free_ifdef_blacklist(pi);
 	free_ifndef_blacklist(pi);
 	free_orglist(pi);
+	free_code(pi);
+	free_flow(pi);
+	free_relax(pi);
+	free_pools(pi);
+	free_relocs(pi);
+	free(pi->flash_image);
+	free(pi->eeprom_image);
+	free_atoms(pi);
+}
+
+/* SEGMENT_CODE, SEGMENT_DATA or SEGMENT_EEPROM */
+int
+segment_index(struct segment_info *si)
+{
+	if (si == si->pi->cseg)
+		return (SEGMENT_CODE);
+	if (si == si->pi->dseg)
+		return (SEGMENT_DATA);
+	return (SEGMENT_EEPROM);
 }
 
 void
 advance_ip(struct segment_info *si, int offset)
 {
+	struct prog_info *pi = si->pi;
+
 	si->addr += offset;
-	if (si->pi->pass == PASS_1)
+	if ((pi->pass == PASS_1) || pi->layout) {
 		si->count += offset;
+		if (pi->fi)
+			pi->fi->include_file->bytes[segment_index(si)] += (long)offset * si->cellsize;
+	}
 }
 
 void
 print_msg(struct prog_info *pi, int type, char *fmt, ...)
 {
 	char *pc;
+	if (pi->layout && (type != MSGTYPE_OUT_OF_MEM))
+		return;
 	if (type == MSGTYPE_OUT_OF_MEM) {
 		fprintf(stderr, "Error: Unable to allocate memory!\n");
 	} else {
@@ -434,8 +537,8 @@ print_msg(struct prog_info *pi, int type, char *fmt, ...)
 			fprintf(stderr, "Warning : ");
 			break;
 		case MSGTYPE_MESSAGE:
-			/*			case MSGTYPE_MESSAGE_NO_LF:
-						case MSGTYPE_APPEND: */
+		case MSGTYPE_MESSAGE_NO_LF:
+			pi->message_count++;
 			break;
 		}
 		if (type != MSGTYPE_APPEND) {
@@ -479,6 +582,23 @@ def_const(struct prog_info *pi, const char *name, int value)
 	}
 	strcpy(label->name, name);
 	label->value = value;
+	set_symbol_origin(pi, label, NULL);
+	return (bind_symbol(pi, SYMBOL_CONSTANT, label));
+}
+
+/* A .EQU constant whose expression is evaluated when it is first used */
+int
+def_equ(struct prog_info *pi, const char *name, const char *expr)
+{
+	if (def_const(pi, name, 0) == False)
+		return (False);
+	pi->last_constant->expr = malloc(strlen(expr) + 1);
+	if (!pi->last_constant->expr) {
+		print_msg(pi, MSGTYPE_OUT_OF_MEM, NULL);
+		return (False);
+	}
+	strcpy(pi->last_constant->expr, expr);
+	pi->last_constant->state = CONST_PENDING;
 	return (True);
 }
 
@@ -487,11 +607,11 @@ def_var(struct prog_info *pi, char *name, int value)
 {
 	struct label *label;
 
-	for (label = pi->first_variable; label; label = label->next)
-		if (!nocase_strcmp(label->name, name)) {
-			label->value = value;
-			return (True);
-		}
+	label = search_symbol(pi, SYMBOL_VARIABLE, name, NULL);
+	if (label) {
+		label->value = value;
+		return (True);
+	}
 	label = malloc(sizeof(struct label));
 	if (!label) {
 		print_msg(pi, MSGTYPE_OUT_OF_MEM, NULL);
@@ -510,9 +630,71 @@ def_var(struct prog_info *pi, char *name, int value)
 	}
 	strcpy(label->name, name);
 	label->value = value;
+	set_symbol_origin(pi, label, NULL);
+	return (bind_symbol(pi, SYMBOL_VARIABLE, label));
+}
+
+/* Remember where a symbol was defined. Used for the cross reference in the map file */
+void
+set_symbol_origin(struct prog_info *pi, struct label *label, struct segment_info *segment)
+{
+	label->segment = segment;
+	if (pi->fi != NULL) {
+		label->include_file = pi->fi->include_file;
+		label->line_number = pi->fi->line_number;
+	} else {
+		label->include_file = NULL;
+		label->line_number = 0;
+	}
+	label->first_ref = NULL;
+	label->last_ref = NULL;
+	label->expr = NULL;
+	label->state = CONST_EVALUATED;
+	label->uses_labels = False;
+	memset(&label->ref, 0, sizeof(struct reloc_ref));
+}
+
+/* Record a reference to a symbol. Only done in pass 2 and only when a map file is wanted */
+int
+add_symbol_ref(struct prog_info *pi, struct label *label)
+{
+	struct symbol_ref *ref;
+
+	if ((pi->pass != PASS_2) || pi->layout || !pi->map_on || (pi->fi == NULL))
+		return (True);
+	/* Several references in one line are listed only once */
+	if (label->last_ref && (label->last_ref->line_number == pi->fi->line_number)
+	        && (label->last_ref->include_file == pi->fi->include_file))
+		return (True);
+	ref = malloc(sizeof(struct symbol_ref));
+	if (!ref) {
+		print_msg(pi, MSGTYPE_OUT_OF_MEM, NULL);
+		return (False);
+	}
+	ref->next = NULL;
+	ref->include_file = pi->fi->include_file;
+	ref->line_number = pi->fi->line_number;
+	if (label->last_ref)
+		label->last_ref->next = ref;
+	else
+		label->first_ref = ref;
+	label->last_ref = ref;
 	return (True);
 }
 
+void
+free_symbol_refs(struct label *label)
+{
+	struct symbol_ref *ref, *temp_ref;
+	for (ref = label->first_ref; ref;) {
+		temp_ref = ref;
+		ref = ref->next;
+		free(temp_ref);
+	}
+	label->first_ref = NULL;
+	label->last_ref = NULL;
+}
+
 /* Store programmed areas for later check */
 int
 def_orglist(struct segment_info *si)
@@ -520,7 +702,7 @@ def_orglist(struct segment_info *si)
 	struct orglist *orglist;
 
 	si->pi->segment = si;
-	if (si->pi->pass != PASS_1)
+	if ((si->pi->pass != PASS_1) && !si->pi->layout)
 		return (True);
 	orglist = malloc(sizeof(struct orglist));
 	if (!orglist) {
@@ -544,7 +726,7 @@ def_orglist(struct segment_info *si)
 int
 fix_orglist(struct segment_info *si)
 {
-	if (si->pi->pass != PASS_1)
+	if ((si->pi->pass != PASS_1) && !si->pi->layout)
 		return (True);
 	if ((si->last_orglist == NULL) || (si->last_orglist->length!=0)) {
 		fprintf(stderr,"Internal Error: fix_orglist\n");
@@ -588,13 +770,107 @@ fprint_segments(FILE *file, struct prog_info *pi)
 	fprint_seg_orglist(file, pi->cseg);
 	fprint_seg_orglist(file, pi->dseg);
 	fprint_seg_orglist(file, pi->eseg);
+	if (pi->device->name != NULL) {
+		fprintf(file, "Free memory blocks:\n");
+		fprint_free_ranges(file, pi->cseg);
+		fprint_free_ranges(file, pi->dseg);
+		fprint_free_ranges(file, pi->eseg);
+	}
 }
 
 /* Test for overlapping segments and device space */
+static int
+compare_orglist(const void *a, const void *b)
+{
+	const struct orglist *x = *(struct orglist * const *)a;
+	const struct orglist *y = *(struct orglist * const *)b;
+
+	if (x->start != y->start)
+		return (x->start < y->start ? -1 : 1);
+	if (x->length != y->length)
+		return (x->length < y->length ? -1 : 1);
+	return (x->segment_overlap - y->segment_overlap);
+}
+
+static void
+fprint_range(FILE *file, struct segment_info *si, const char *what, long start, long end)
+{
+	fprintf(file, "   %-6s    :  Start = 0x%04lX, End = 0x%04lX, Length = 0x%04lX (%ld %s)\n",
+	        what, start, end - 1, end - start, end - start,
+	        end - start == 1 ? si->cellname : si->cellnames);
+}
+
+/* Mark the cells of every block in the occupancy bitmap of the segment */
+static int
+def_occupancy(struct segment_info *si, struct orglist **sorted, int count)
+{
+	int i;
+	long addr, end, size = 0;
+
+	free(si->occupancy);
+	si->occupancy = NULL;
+	si->occupancy_size = 0;
+	for (i = 0; i < count; i++)
+		if (sorted[i]->start + sorted[i]->length > size)
+			size = sorted[i]->start + sorted[i]->length;
+	if (size == 0)
+		return (True);
+	si->occupancy = calloc((size + 7) / 8, 1);
+	if (!si->occupancy) {
+		print_msg(si->pi, MSGTYPE_OUT_OF_MEM, NULL);
+		return (False);
+	}
+	si->occupancy_size = size;
+	for (i = 0; i < count; i++) {
+		addr = sorted[i]->start;
+		end = sorted[i]->start + sorted[i]->length;
+		for (; (addr < end) && (addr & 7); addr++)
+			si->occupancy[addr >> 3] |= 1 << (addr & 7);
+		for (; addr + 8 <= end; addr += 8)
+			si->occupancy[addr >> 3] = 0xff;
+		for (; addr < end; addr++)
+			si->occupancy[addr >> 3] |= 1 << (addr & 7);
+	}
+	return (True);
+}
+
+/* Return True if the cell at addr is programmed by some block. Valid after test_orglist() */
+int
+cell_used(struct segment_info *si, long addr)
+{
+	if ((addr < 0) || (addr >= si->occupancy_size))
+		return (False);
+	return ((si->occupancy[addr >> 3] >> (addr & 7)) & 1);
+}
+
+/* Print the unused ranges of the device address space of a segment */
+void
+fprint_free_ranges(FILE *file, struct segment_info *si)
+{
+	long addr, start;
+
+	if ((si->pi->device->name == NULL) || (si->hi_addr <= si->lo_addr))
+		return;
+	for (addr = si->lo_addr; addr < si->hi_addr;) {
+		if (cell_used(si, addr)) {
+			addr++;
+			continue;
+		}
+		start = addr;
+		while ((addr < si->hi_addr) && !cell_used(si, addr))
+			addr++;
+		fprint_range(file, si, si->name, start, addr);
+	}
+}
+
+/* The blocks are sorted by start address, so every block that overlaps
+ * sorted[i] from above directly follows it. */
 int
 test_orglist(struct segment_info *si)
 {
-	struct orglist *orglist, *orglist2;
+	struct orglist *orglist, *orglist2, **sorted;
+	int i, j, count = 0;
+	long end;
 
 	int error_count=0;
 	if (si->pi->device->name == NULL) {
@@ -602,9 +878,16 @@ test_orglist(struct segment_info *si)
 		si->pi->warning_count++;
 	}
 
-	for (orglist = si->first_orglist;
-	        orglist != NULL;
-	        orglist=orglist->next) {
+	for (orglist = si->first_orglist; orglist != NULL; orglist = orglist->next)
+		if (orglist->length > 0)
+			count++;
+	sorted = malloc((count + 1) * sizeof(struct orglist *));
+	if (!sorted) {
+		print_msg(si->pi, MSGTYPE_OUT_OF_MEM, NULL);
+		return (False);
+	}
+	count = 0;
+	for (orglist = si->first_orglist; orglist != NULL; orglist = orglist->next) {
 		if (orglist->length > 0) {
 			/* Make sure address area is valid */
 			if (orglist->start < si->lo_addr) {
@@ -619,32 +902,42 @@ test_orglist(struct segment_info *si)
 				fprint_orglist(stderr, si, orglist);
 				error_count ++;
 			}
-
-			/* Overlap-test */
-			if ((si->pi->effective_overlap != OVERLAP_IGNORE) &&
-			        (orglist->segment_overlap == SEG_DONT_OVERLAP)) {
-				for (orglist2 = orglist->next; orglist2 != NULL; orglist2 = orglist2->next) {
-					if ((orglist != orglist2) && (orglist2->length > 0)
-					        && (orglist2->segment_overlap == SEG_DONT_OVERLAP)) {
-
-						if ((orglist->start  < (orglist2->start + orglist2->length)) &&
-						        (orglist2->start < (orglist->start +  orglist->length))) {
-							fprintf(stderr,"%s: Overlapping %s segments:\n",
-							        si->pi->effective_overlap == OVERLAP_ERROR ? "Error" : "Warning",
-							        si->name);
-							fprint_orglist(stderr, si, orglist);
-							fprint_orglist(stderr, si, orglist2);
-							fprintf(stderr,"Please check your .ORG directives !\n");
-							if (si->pi->effective_overlap == OVERLAP_ERROR)
-								error_count++;
-							else
-								si->pi->warning_count++;
-						}
-					}
-				}
-			} /* Overlap-test */
+			sorted[count++] = orglist;
 		}
 	}
+	qsort(sorted, count, sizeof(struct orglist *), compare_orglist);
+
+	/* Overlap-test */
+	if (si->pi->effective_overlap != OVERLAP_IGNORE) {
+		for (i = 0; i < count; i++) {
+			orglist = sorted[i];
+			if (orglist->segment_overlap != SEG_DONT_OVERLAP)
+				continue;
+			end = orglist->start + orglist->length;
+			for (j = i + 1; (j < count) && (sorted[j]->start < end); j++) {
+				orglist2 = sorted[j];
+				if (orglist2->segment_overlap != SEG_DONT_OVERLAP)
+					continue;
+				fprintf(stderr,"%s: Overlapping %s segments:\n",
+				        si->pi->effective_overlap == OVERLAP_ERROR ? "Error" : "Warning",
+				        si->name);
+				fprint_orglist(stderr, si, orglist);
+				fprint_orglist(stderr, si, orglist2);
+				fprint_range(stderr, si, "Shared", orglist2->start,
+				             orglist2->start + orglist2->length < end ?
+				             orglist2->start + orglist2->length : end);
+				fprintf(stderr,"Please check your .ORG directives !\n");
+				if (si->pi->effective_overlap == OVERLAP_ERROR)
+					error_count++;
+				else
+					si->pi->warning_count++;
+			}
+		}
+	} /* Overlap-test */
+
+	if (def_occupancy(si, sorted, count) == False)
+		error_count++;
+	free(sorted);
 	si->pi->error_count += error_count;
 	return (error_count > 0 ? False : True);
 }
@@ -653,7 +946,7 @@ test_orglist(struct segment_info *si)
 int
 get_label(struct prog_info *pi,char *name,int *value)
 {
-	struct label *label=search_symbol(pi,pi->first_label,name,NULL);
+	struct label *label=search_symbol(pi,SYMBOL_LABEL,name,NULL);
 	if (label==NULL) return False;
 	if (value!=NULL)	*value=label->value;
 	return True;
@@ -662,8 +955,9 @@ get_label(struct prog_info *pi,char *name,int *value)
 int
 get_constant(struct prog_info *pi,char *name,int *value)
 {
-	struct label *label=search_symbol(pi,pi->first_constant,name,NULL);
+	struct label *label=test_constant(pi,name,NULL);
 	if (label==NULL) return False;
+	if ((value!=NULL) && !eval_constant(pi,label)) return False;
 	if (value!=NULL)	*value=label->value;
 	return True;
 }
@@ -671,7 +965,7 @@ get_constant(struct prog_info *pi,char *name,int *value)
 int
 get_variable(struct prog_info *pi,char *name,int *value)
 {
-	struct label *label=search_symbol(pi,pi->first_variable,name,NULL);
+	struct label *label=search_symbol(pi,SYMBOL_VARIABLE,name,NULL);
 	if (label==NULL) return False;
 	if (value!=NULL)	*value=label->value;
 	return True;
@@ -681,32 +975,54 @@ get_variable(struct prog_info *pi,char *name,int *value)
 /* If message != NULL print error message if symbol is defined */
 struct label *test_label(struct prog_info *pi,char *name,char *message)
 {
-	return search_symbol(pi,pi->first_label,name,message);
+	return search_symbol(pi,SYMBOL_LABEL,name,message);
 }
 
 struct label *test_constant(struct prog_info *pi,char *name,char *message)
 {
-	return search_symbol(pi,pi->first_constant,name,message);
+	struct label *label=search_symbol(pi,SYMBOL_CONSTANT,name,message);
+	if (label==NULL) {
+		label=get_device_symbol(pi,name);
+		if ((label!=NULL) && message)
+			print_msg(pi, MSGTYPE_ERROR, message, name);
+	}
+	return label;
 }
 
 struct label *test_variable(struct prog_info *pi,char *name,char *message)
 {
-	return search_symbol(pi,pi->first_variable,name,message);
+	return search_symbol(pi,SYMBOL_VARIABLE,name,message);
 }
 
-/* Search in label,constant,variable,blacklist - list for a matching entry */
-/* Use first = pi->first_label,first_constant,first_variable,first_blacklist to select list */
+/* Search for a label, constant or variable (kind = SYMBOL_LABEL, ...) */
 /* If message != NULL Print error message if symbol is defined */
-struct label *search_symbol(struct prog_info *pi,struct label *first,char *name,char *message)
+struct label *search_symbol(struct prog_info *pi,int kind,const char *name,char *message)
 {
 	struct label *label;
-	for (label = first; label; label = label->next)
-		if (!nocase_strcmp(label->name, name)) {
-			if (message) {
-				print_msg(pi, MSGTYPE_ERROR, message, name);
-			}
+	int atom = find_atom(pi, name);
+
+	if (!atom)
+		return (NULL);
+	label = pi->atom[atom].symbol[kind];
+	if (label && message)
+		print_msg(pi, MSGTYPE_ERROR, message, name);
+	return (label);
+}
+
+/* Search for a label local to the current macro call */
+struct label *search_local(struct prog_info *pi,const char *name)
+{
+	struct label *label;
+	int atom;
+
+	if (!pi->macro_call)
+		return (NULL);
+	atom = find_atom(pi, name);
+	if (!atom)
+		return (NULL);
+	for (label = pi->macro_call->first_label; label; label = label->next)
+		if (label->atom == atom)
 			return (label);
-		}
 	return (NULL);
 }
 
@@ -776,6 +1092,78 @@ search_location(struct location *first, int line_num, int file_num)
 	return False;
 }
 
+/* Find the .DEF alias name. Return NULL if there is none */
+struct def *
+search_def(struct prog_info *pi, const char *name)
+{
+	int atom = find_atom(pi, name);
+
+	return (atom ? pi->atom[atom].def : NULL);
+}
+
+/* Find the alias that was defined first for reg */
+static void
+fix_reg_def(struct prog_info *pi, int reg)
+{
+	struct def *def;
+
+	if ((reg < 0) || (reg > 31))
+		return;
+	for (def = pi->first_def; def && (def->reg != reg); def = def->next)
+		;
+	pi->reg_def[reg] = def;
+}
+
+struct def *
+def_register(struct prog_info *pi, const char *name, int reg)
+{
+	struct def *def;
+
+	def = malloc(sizeof(struct def));
+	if (!def) {
+		print_msg(pi, MSGTYPE_OUT_OF_MEM, NULL);
+		return (NULL);
+	}
+	def->name = malloc(strlen(name) + 1);
+	if (!def->name) {
+		free(def);
+		print_msg(pi, MSGTYPE_OUT_OF_MEM, NULL);
+		return (NULL);
+	}
+	strcpy(def->name, name);
+	def->atom = intern(pi, name);
+	if (!def->atom) {
+		free(def->name);
+		free(def);
+		return (NULL);
+	}
+	def->reg = reg;
+	def->next = NULL;
+	if (pi->last_def)
+		pi->last_def->next = def;
+	else
+		pi->first_def = def;
+	pi->last_def = def;
+	pi->atom[def->atom].def = def;
+	if ((reg >= 0) && (reg <= 31) && !pi->reg_def[reg])
+		pi->reg_def[reg] = def;
+	return (def);
+}
+
+/* Assign an existing alias to another register */
+void
+set_def_register(struct prog_info *pi, struct def *def, int reg)
+{
+	int old = def->reg;
+
+	if (old == reg)
+		return;
+	def->reg = reg;
+	if ((old >= 0) && (old <= 31) && (pi->reg_def[old] == def))
+		fix_reg_def(pi, old);
+	fix_reg_def(pi, reg);
+}
+
 void
 free_defs(struct prog_info *pi)
 {
@@ -788,6 +1176,7 @@ free_defs(struct prog_info *pi)
 	}
 	pi->first_def = NULL;
 	pi->last_def = NULL;
+	memset(pi->reg_def, 0, sizeof(pi->reg_def));
 }
 
 void
@@ -797,6 +1186,7 @@ free_labels(struct prog_info *pi)
 	for (label = pi->first_label; label;) {
 		temp_label = label;
 		label = label->next;
+		free_symbol_refs(temp_label);
 		free(temp_label->name);
 		free(temp_label);
 	}
@@ -811,7 +1201,9 @@ free_constants(struct prog_info *pi)
 	for (label = pi->first_constant; label;) {
 		temp_label = label;
 		label = label->next;
+		free_symbol_refs(temp_label);
 		free(temp_label->name);
+		free(temp_label->expr);
 		free(temp_label);
 	}
 	pi->first_constant = NULL;
@@ -851,6 +1243,7 @@ free_variables(struct prog_info *pi)
 	for (label = pi->first_variable; label;) {
 		temp_label = label;
 		label = label->next;
+		free_symbol_refs(temp_label);
 		free(temp_label->name);
 		free(temp_label);
 	}
@@ -861,14 +1254,25 @@ free_variables(struct prog_info *pi)
 void
 free_orglist(struct prog_info *pi)
 {
+	struct segment_info *si[3];
 	struct orglist *orglist, *temp_orglist;
-	for (orglist = pi->first_orglist; orglist;) {
-		temp_orglist = orglist;
-		orglist = orglist->next;
-		free(temp_orglist);
+	int i;
+
+	si[0] = pi->cseg;
+	si[1] = pi->dseg;
+	si[2] = pi->eseg;
+	for (i = 0; i < 3; i++) {
+		for (orglist = si[i]->first_orglist; orglist;) {
+			temp_orglist = orglist;
+			orglist = orglist->next;
+			free(temp_orglist);
+		}
+		free(si[i]->occupancy);
+		si[i]->occupancy = NULL;
+		si[i]->occupancy_size = 0;
+		si[i]->first_orglist = NULL;
+		si[i]->last_orglist = NULL;
 	}
-	pi->first_orglist = NULL;
-	pi->last_orglist = NULL;
 }
 
 
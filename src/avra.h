@@ -67,6 +67,20 @@ enum {
 	ARG_DEBUGFILE,		/* --debugfile */
 	ARG_EEPFILE,		/* --eepfile   */
 	ARG_OVERLAP,		/* -O [w|e|i]  */
+	ARG_LISTCYCLES,		/* --listcycles            */
+	ARG_WCET,		/* --wcet                  */
+	ARG_RELAX,		/* --relax                 */
+	ARG_MODULE,		/* --module                */
+	ARG_DEPEND,		/* -MD                     */
+	ARG_DEPFILE,		/* -MF                     */
+	ARG_CACHE,		/* --cache                 */
+	ARG_CACHE_STATS,	/* --cache_stats           */
+	ARG_ELF,		/* --elf                   */
+	ARG_UNUSED,		/* --unused                */
+	ARG_STACK,		/* --stack                 */
+	ARG_CLOBBERS,		/* --clobbers              */
+	ARG_BUDGET,		/* --budget                */
+	ARG_DROP_UNUSED,	/* --drop_unused (avra-ld) */
 	ARG_COUNT
 };
 
@@ -103,6 +117,26 @@ enum {
 	SEG_ALLOW_OVERLAP
 };
 
+/* Core families with different instruction timing */
+enum {
+	CORE_CLASSIC = 0,	/* AVR, AVRe, AVRe+ */
+	CORE_XMEGA,		/* AVRxm, AVRxt */
+	CORE_AVR8L,		/* AVRrc */
+	CORE_COUNT
+};
+
+/* How an instruction continues the program flow */
+enum {
+	FLOW_NEXT = 0,		/* Falls through to the next instruction */
+	FLOW_BRANCH,		/* Conditional relative branch */
+	FLOW_SKIP,		/* May skip the next instruction */
+	FLOW_JUMP,		/* RJMP, JMP */
+	FLOW_CALL,		/* RCALL, CALL */
+	FLOW_INDIRECT_JUMP,	/* IJMP, EIJMP */
+	FLOW_INDIRECT_CALL,	/* ICALL, EICALL */
+	FLOW_RETURN		/* RET, RETI */
+};
+
 enum {
 	TERM_END = 0,
 	TERM_SPACE,
@@ -113,10 +147,47 @@ enum {
 	TERM_COLON
 };
 
+/* Fields the linker fills in, see module.c */
+enum {
+	RELOC_BRANCH = 0,	/* 7 bit PC relative, BRxx */
+	RELOC_RJMP,		/* 12 bit PC relative, RJMP and RCALL */
+	RELOC_JMP,		/* 22 bit word address, JMP and CALL */
+	RELOC_LDI,		/* 8 bit immediate, LDI, SUBI, ... */
+	RELOC_WORD,		/* 16 bit word, LDS, STS and .DW */
+	RELOC_BYTE,		/* .DB */
+	RELOC_COUNT
+};
+
+/* Applied by the linker after the relocation */
+enum {
+	RELOC_FN_NONE = 0,
+	RELOC_FN_LOW,
+	RELOC_FN_HIGH
+};
+
 /* Structures */
 
 struct prog_info;
 
+/* In a module (--module) a value may depend on where the linker places
+ * a section or on an external symbol. The final value is
+ * function(addend + base * scale). */
+struct reloc_ref {
+	struct segment_info *segment;	/* Section base, or NULL */
+	struct label *symbol;		/* External symbol, or NULL */
+	int scale;			/* 2 for byte addresses of code */
+	int function;			/* RELOC_FN_xxx */
+	int addend;			/* Value before function, as assembled */
+};
+
+struct reloc {
+	struct reloc *next;
+	int type;			/* RELOC_xxx */
+	struct segment_info *segment;	/* Where the field is, code or EEPROM */
+	long offset;			/* In bytes */
+	struct reloc_ref ref;
+};
+
 extern const int SEG_BSS_DATA;
 
 struct segment_info {
@@ -133,6 +204,8 @@ struct segment_info {
 	struct hex_file_info *hfi;
 	struct orglist *first_orglist;
 	struct orglist *last_orglist;
+	unsigned char *occupancy; /* one bit per programmed cell, see test_orglist() */
+	long occupancy_size;      /* cells covered by occupancy */
 
 	const char *cellname;  /* byte  / word  */
 	const char *cellnames; /* bytes / words */
@@ -157,10 +230,18 @@ struct prog_info {
 	int error_count;
 	int max_errors;
 	int warning_count;
+	int message_count;
 	struct include_file *last_include_file;
 	struct include_file *first_include_file;
+	struct include_file *first_binary_file;	/* .INCBIN, only for -MD and --cache */
+	struct include_file *last_binary_file;
 	struct def *first_def;
 	struct def *last_def;
+	struct atom *atom;		/* Interned identifiers, see atom.c */
+	int atom_count;
+	int atom_size;
+	int *atom_bucket;		/* atom_size hash buckets */
+	struct def *reg_def[32];	/* First alias of each register */
 	struct label *first_label;
 	struct label *last_label;
 	struct label *first_constant;
@@ -183,9 +264,64 @@ struct prog_info {
 	time_t time;			/* Use a global timestamp for listing header and %hour% ... tags */
 	/* coff additions */
 	FILE *coff_file;
+	struct elf_info *elf;		/* --elf output, or NULL */
 	/* Warning additions */
 	int NoRegDef;
 	int pass;
+	int expr_labels;		/* The expression evaluated has used a label */
+	struct label *expr_label;	/* The last label it used */
+	int layout;			/* Layout pass: pass 2 without output */
+	/* branch relaxation */
+	struct relax *relax;		/* Jumps, calls and branches in source order */
+	int relax_count;
+	int relax_alloc;
+	int relax_index;
+	int relax_changed;
+	long relax_vectors_end;		/* Of the jumps from address 0 on, in pass 1 */
+	/* clobbers(), settled by layout passes */
+	int clobbers_used;		/* Found in pass 1 */
+	struct clobber_set *clobbers;
+	int clobbers_count;
+	int clobbers_alloc;
+	/* .POOL */
+	struct pool *first_pool;
+	struct pool *last_pool;
+	struct pool *pool;		/* Between .POOL and .ENDPOOL */
+	int pool_index;
+	/* cycle counting */
+	struct code_record *code;
+	int code_count;
+	int code_alloc;
+	long *long_insn;		/* Addresses of two word instructions, from pass 1 */
+	int long_insn_count;
+	int long_insn_alloc;
+	int long_insn_sorted;
+	int label_min_cycles;		/* Since the last label */
+	int label_max_cycles;
+	long block_start;		/* Current basic block */
+	int block_min_cycles;
+	int block_max_cycles;
+	struct cycles_report *first_cycles_report;
+	struct cycles_report *last_cycles_report;
+	struct loop_bound *first_loop_bound;
+	struct loop_bound *last_loop_bound;
+	struct keep *first_keep;
+	struct keep *last_keep;
+	struct indirect_target *first_indirect_target;
+	struct indirect_target *last_indirect_target;
+	/* avra-sim */
+	int in_memory;			/* Keep the images below instead of writing files */
+	unsigned short *flash_image;	/* Up to the last word programmed in pass 1 */
+	long flash_image_size;
+	unsigned char *eeprom_image;
+	/* relocatable modules */
+	int module;			/* --module: write a module for avra-ld */
+	struct reloc_ref expr_ref;	/* Of the last value of get_expr() or get_symbol() */
+	int expr_depth;			/* Nesting of get_expr() */
+	int expr_reloc;			/* The caller of get_expr() takes a relocatable value */
+	struct reloc *first_reloc;
+	struct reloc *last_reloc;
+	int uses_time;			/* Build date tags were replaced, see --cache */
 };
 
 struct file_info {
@@ -210,23 +346,68 @@ struct include_file {
 	struct include_file *next;
 	char *name;
 	int num;
+	long bytes[SEGMENT_EEPROM + 1];	/* Used by each inclusion, for --budget */
 };
 
 struct def {
 	struct def *next;
 	char *name;
+	int atom;
 	int reg;
 };
 
+/* Kinds of symbols an atom can name */
+enum {
+	SYMBOL_LABEL = 0,
+	SYMBOL_CONSTANT,
+	SYMBOL_VARIABLE,
+	SYMBOL_KINDS,
+	SYMBOL_LOCAL = SYMBOL_KINDS	/* Macro label, only found within its macro call */
+};
+
+struct atom {
+	char *name;			/* In lower case */
+	unsigned int hash;		/* nocase_hash() of name */
+	int next;			/* Next atom in the hash bucket, 0 ends */
+	struct label *symbol[SYMBOL_KINDS];
+	struct def *def;
+	struct macro *macro;
+	int directive;			/* DIRECTIVE_xxx + 1, 0 if name is no directive */
+	int global;			/* Exported from a module by .GLOBAL */
+};
+
 struct label {
 	struct label *next;
 	char *name;
+	int atom;
 	int value;
+	struct segment_info *segment;       /* NULL for constants and variables */
+	struct include_file *include_file;  /* Where the symbol was defined, NULL if predefined */
+	int line_number;
+	struct symbol_ref *first_ref;       /* References collected in pass 2 for the map file */
+	struct symbol_ref *last_ref;
+	char *expr;                         /* Of a .EQU constant evaluated when first used, else NULL */
+	char state;                         /* CONST_PENDING, CONST_EVALUATING or CONST_EVALUATED */
+	char uses_labels;                   /* The value depends on label addresses */
+	struct reloc_ref ref;               /* Of a constant in a module, see module.c */
+};
+
+enum {
+	CONST_EVALUATED = 0,
+	CONST_PENDING,
+	CONST_EVALUATING
+};
+
+struct symbol_ref {
+	struct symbol_ref *next;
+	struct include_file *include_file;
+	int line_number;
 };
 
 struct macro {
 	struct macro *next;
 	char *name;
+	int atom;
 	struct include_file *include_file;
 	int first_line_number;
 	struct macro_line *first_macro_line;
@@ -267,6 +448,86 @@ struct orglist {
 	int segment_overlap;
 };
 
+/* One instruction emitted in pass 2. Kept in pi->code in address order of
+ * assembly, for cycle counting and the flow analyses. */
+struct code_record {
+	long addr;
+	int mnemonic;
+	int size;	/* in words */
+	int flow;	/* FLOW_* */
+	int min_cycles;
+	int max_cycles;	/* Branch taken, skip skipping */
+	long target;	/* Of a branch, jump or call, -1 if none */
+	unsigned long written;	/* Registers written, bit n for Rn */
+};
+
+/* The registers written by a routine, for clobbers(name) */
+struct clobber_set {
+	char *name;	/* As written */
+	struct label *label;	/* The label it names, NULL if none */
+	long offset;	/* Of addr from the label */
+	long addr;
+	unsigned long registers;
+	int known;	/* Set by a layout pass */
+};
+
+/* A .LOOPBOUND directive: the loop starting at addr runs at most count times */
+struct loop_bound {
+	struct loop_bound *next;
+	long addr;
+	int count;
+};
+
+/* A .KEEP directive: the code at addr is used even if no code leads to it */
+struct keep {
+	struct keep *next;
+	long addr;
+};
+
+/* A .CALLS directive: the ijmp or icall at addr may go to target */
+struct indirect_target {
+	struct indirect_target *next;
+	long addr;
+	long target;
+};
+
+/* A jump, call or branch whose size is chosen by --relax */
+struct relax {
+	unsigned char size;	/* in words, only grows */
+	unsigned char written;	/* Size of the mnemonic in the source */
+	unsigned char branch;
+	unsigned char fixed;	/* In the vector table, kept as written */
+};
+
+/* The data of a label in a .POOL, up to the next label */
+struct pool_entry {
+	struct label *label;	/* NULL for the data before the first label */
+	unsigned char *data;	/* Padded to words */
+	int size;		/* in bytes */
+	int alloc;
+	long offset;		/* in words, from the start of the pool */
+	int host;		/* Index of the entry holding the data */
+};
+
+struct pool {
+	struct pool *next;
+	long start;
+	long size;		/* in words, after merging */
+	struct pool_entry *entry;
+	int entry_count;
+	int entry_alloc;
+};
+
+/* A .CYCLES directive, reported after pass 2 */
+struct cycles_report {
+	struct cycles_report *next;
+	struct include_file *include_file;
+	int line_number;
+	char *name;
+	long start;
+	long end;
+};
+
 struct location {
 	struct location *next;
 	int line_num;
@@ -281,31 +542,43 @@ struct prog_info *init_prog_info(struct prog_info *,struct args *args);
 void free_pi(struct prog_info *pi);
 void print_msg(struct prog_info *pi, int type, char *fmt, ...);
 void get_rootpath(struct prog_info *pi, struct args *args);
+void define_args(struct args *args);
 
 void init_segment_size(struct prog_info *pi, struct device *device);
 void rewind_segments(struct prog_info *pi);
 void advance_ip(struct segment_info *si, int offset);
+int segment_index(struct segment_info *si);
 
 int def_const(struct prog_info *pi, const char *name, int value);
+int def_equ(struct prog_info *pi, const char *name, const char *expr);
 int def_var(struct prog_info *pi, char *name, int value);
+void set_symbol_origin(struct prog_info *pi, struct label *label, struct segment_info *segment);
+int add_symbol_ref(struct prog_info *pi, struct label *label);
+void free_symbol_refs(struct label *label);
 int def_orglist(struct segment_info *si);
 int fix_orglist(struct segment_info *si);
 void fprint_orglist(FILE *file, struct segment_info *si, struct orglist *orglist);
 void fprint_sef_orglist(FILE *file, struct segment_info *si);
 void fprint_segments(FILE *file, struct prog_info *pi);
 int test_orglist(struct segment_info *si);
+int cell_used(struct segment_info *si, long addr);
+void fprint_free_ranges(FILE *file, struct segment_info *si);
 int get_label(struct prog_info *pi,char *name,int *value);
 int get_constant(struct prog_info *pi,char *name,int *value);
 int get_variable(struct prog_info *pi,char *name,int *value);
 struct label *test_label(struct prog_info *pi,char *name,char *message);
 struct label *test_constant(struct prog_info *pi,char *name,char *message);
 struct label *test_variable(struct prog_info *pi,char *name,char *message);
-struct label *search_symbol(struct prog_info *pi,struct label *first,char *name,char *message);
+struct label *search_symbol(struct prog_info *pi,int kind,const char *name,char *message);
+struct label *search_local(struct prog_info *pi,const char *name);
 int ifdef_blacklist(struct prog_info *pi);
 int ifndef_blacklist(struct prog_info *pi);
 int ifdef_is_blacklisted(struct prog_info *pi);
 int ifndef_is_blacklisted(struct prog_info *pi);
 int search_location(struct location *first, int line_num, int file_num);
+struct def *search_def(struct prog_info *pi, const char *name);
+struct def *def_register(struct prog_info *pi, const char *name, int reg);
+void set_def_register(struct prog_info *pi, struct def *def, int reg);
 void free_defs(struct prog_info *pi);
 void free_labels(struct prog_info *pi);
 void free_constants(struct prog_info *pi);
@@ -315,6 +588,8 @@ void free_variables(struct prog_info *pi);
 void free_orglist(struct prog_info *pi);
 
 /* parser.c */
+struct include_file *add_include_file(struct prog_info *pi, const char *filename);
+int add_binary_file(struct prog_info *pi, const char *filename);
 int parse_file(struct prog_info *pi, const char *filename);
 int parse_line(struct prog_info *pi, char *line);
 char *get_next_token(char *scratch, int term);
@@ -323,23 +598,33 @@ char *fgets_new(struct prog_info *pi, char *s, int size, FILE *stream);
 /* expr.c */
 int get_expr(struct prog_info *pi, char *data, int *value);
 int get_symbol(struct prog_info *pi, char *label_name, int *data);
+int eval_constant(struct prog_info *pi, struct label *label);
+void eval_pending_constants(struct prog_info *pi);
 int par_length(char *data);
 
 /* mnemonic.c */
 int parse_mnemonic(struct prog_info *pi);
 int get_mnemonic_type(struct prog_info *pi);
+int is_register_name(const char *name);
 int get_register(struct prog_info *pi, char *data);
 int get_bitnum(struct prog_info *pi, char *data, int *ret);
 int get_indirect(struct prog_info *pi, char *operand);
 int is_supported(struct prog_info *pi, char *name);
-int count_supported_instructions(int flags);
+int count_supported_instructions(long flags);
+int get_core(struct prog_info *pi);
+int get_flow(int mnemonic);
+void get_cycles(struct prog_info *pi, int mnemonic, long addr, int *min, int *max);
+const char *get_mnemonic_name(int mnemonic);
+int decode_opcode(struct prog_info *pi, int opcode);
 
 /* directiv.c */
 int parse_directive(struct prog_info *pi);
+void def_directives(struct prog_info *pi);
 int lookup_keyword(const char *const keyword_list[], const char *const keyword, int strict);
 char *term_string(struct prog_info *pi, char *string);
 int parse_db(struct prog_info *pi, char *next);
-void write_db(struct prog_info *pi, char byte, char *prev, int count);
+int parse_dw(struct prog_info *pi, char *next);
+int parse_incbin(struct prog_info *pi, char *next);
 int spool_conditional(struct prog_info *pi, int only_endif);
 int check_conditional(struct prog_info *pi, char *buff, int *current_depth, int *do_next, int only_endif);
 int test_include(const char *filename);
@@ -358,19 +643,85 @@ void close_out_files(struct prog_info *pi);
 struct hex_file_info *open_hex_file(const char *filename);
 void close_hex_file(struct hex_file_info *hfi);
 void write_ee_byte(struct prog_info *pi, int address, unsigned char data);
+void write_ee_data(struct prog_info *pi, int address, const unsigned char *data, int count);
 void write_prog_word(struct prog_info *pi, int address, int data);
+void write_prog_data(struct prog_info *pi, int address, const unsigned char *data, int count);
 void do_hex_line(struct hex_file_info *hfi);
 FILE *open_obj_file(struct prog_info *pi, const char *filename);
 void close_obj_file(struct prog_info *pi, FILE *fp);
-void write_obj_record(struct prog_info *pi, int address, int data);
+void write_obj_data(struct prog_info *pi, int address, const unsigned char *data, int count);
 void unlink_out_files(struct prog_info *pi, const char *filename);
+int write_dep_file(struct prog_info *pi, const char *basename);
+int first_inclusion(struct prog_info *pi, struct include_file *include_file);
+
+/* cache.c */
+int restore_cached(struct prog_info *pi);
+void store_cached(struct prog_info *pi);
+void print_cache_stats(struct args *args);
+
+/* cycles.c */
+struct code_record *add_code_record(struct prog_info *pi, int mnemonic, int size);
+int add_long_insn(struct prog_info *pi, long addr);
+int is_long_insn(struct prog_info *pi, long addr);
+void fprint_cycles(FILE *file, struct prog_info *pi, struct code_record *code);
+void cycles_label(struct prog_info *pi);
+void cycles_flow(struct prog_info *pi, struct code_record *code);
+int add_cycles_report(struct prog_info *pi, char *name, long start, long end);
+void print_cycles_reports(struct prog_info *pi);
+void free_code(struct prog_info *pi);
+
+/* module.c */
+int is_relocatable(const struct reloc_ref *ref);
+void symbol_ref(struct prog_info *pi, struct label *label);
+int get_reloc_expr(struct prog_info *pi, char *data, int *value);
+int reloc_operand(struct prog_info *pi, int type, struct segment_info *si, long offset);
+int def_extern(struct prog_info *pi, char *name);
+int def_global(struct prog_info *pi, char *name);
+int write_module_file(struct prog_info *pi, const char *basename);
+void free_relocs(struct prog_info *pi);
+
+/* relax.c */
+int add_relax(struct prog_info *pi, int written, int branch);
+struct relax *next_relax(struct prog_info *pi);
+struct label *relax_label(struct prog_info *pi, char *name);
+void relax_code(struct prog_info *pi, const char *filename);
+void free_relax(struct prog_info *pi);
+
+/* flow.c */
+int add_loop_bound(struct prog_info *pi, long addr, int count);
+void print_wcet_report(struct prog_info *pi);
+int add_keep(struct prog_info *pi, long addr);
+int add_indirect_target(struct prog_info *pi, long addr, long target);
+void print_stack_report(struct prog_info *pi);
+int get_clobbers(struct prog_info *pi, const char *name, struct label *label, long addr, int *value);
+int update_clobbers(struct prog_info *pi);
+void print_clobbers_report(struct prog_info *pi);
+void print_unused_report(struct prog_info *pi);
+void reset_flow(struct prog_info *pi);
+void free_flow(struct prog_info *pi);
+
+/* budget.c */
+int check_budget(struct prog_info *pi, const char *filename);
+
+/* pool.c */
+int begin_pool(struct prog_info *pi);
+int pool_label(struct prog_info *pi, struct label *label);
+int pool_data(struct prog_info *pi, char *next, int word);
+int end_pool(struct prog_info *pi);
+void free_pools(struct prog_info *pi);
+
+/* atom.c */
+int find_atom(struct prog_info *pi, const char *name);
+int intern(struct prog_info *pi, const char *name);
+int bind_symbol(struct prog_info *pi, int kind, struct label *label);
+void free_atoms(struct prog_info *pi);
 
 /* map.c */
 void write_map_file(struct prog_info *pi);
-char *Space(char *n);
 
 /* stdextra.c */
 int nocase_strcmp(const char *s, const char *t);
+unsigned int nocase_hash(const char *s);
 int nocase_strncmp(char *s, char *t, int n);
 char *nocase_strstr(char *s, char *t);
 int atox(char *s);
@@ -379,16 +730,26 @@ int atox_n(char *s, int n);
 char *my_strlwr(char *in);
 char *my_strupr(char *in);
 char *snprint_list(char *buf, size_t limit, const char *const list[]);
+char *hex_string(char *buf, const unsigned char *data, int count);
 
 /* coff.c */
 FILE *open_coff_file(struct prog_info *pi, char *filename);
 void write_coff_file(struct prog_info *pi);
-void write_coff_eeprom(struct prog_info *pi, int address, unsigned char data);
-void write_coff_program(struct prog_info *pi, int address, unsigned int data);
+void write_coff_eeprom(struct prog_info *pi, int address, const unsigned char *data, int count);
+void write_coff_program(struct prog_info *pi, int address, const unsigned char *data, int count);
 void close_coff_file(struct prog_info *pi, FILE *fp);
 int parse_stabs(struct prog_info *pi, char *p);
 int parse_stabn(struct prog_info *pi, char *p);
 
+/* elf.c */
+struct elf_info *open_elf_file(struct prog_info *pi, const char *filename);
+void write_elf_program(struct prog_info *pi, int address, const unsigned char *data, int count);
+void write_elf_macro_begin(struct prog_info *pi, struct macro *macro);
+void write_elf_macro_end(struct prog_info *pi);
+void write_elf_eeprom(struct prog_info *pi, int address, const unsigned char *data, int count);
+int write_elf_file(struct prog_info *pi);
+void close_elf_file(struct prog_info *pi);
+
 #endif /* end of avra.h */
 
 
@@ -0,0 +1,334 @@
+/***********************************************************************
+ *
+ *  AVRA - Assembler for the Atmel AVR microcontroller series
+ *
+ *  Copyright (C) 1998-2020 The AVRA Authors
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; see the file COPYING.  If not, write to
+ *  the Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ *  Boston, MA 02111-1307, USA.
+ *
+ *
+ *  Authors of AVRA can be reached at:
+ *     email: jonah@omegav.ntnu.no, tobiw@suprafluid.com
+ *     www: https://github.com/Ro5bert/avra
+ */
+
+/*
+ * Size budgets (--budget <file>), checked after pass 1.
+ *
+ * Each line of the budget file limits the bytes used in a segment, either
+ * in all of it, from one label up to another, or by an include file:
+ *
+ *     code    *                7680
+ *     code    boot..boot_end   512
+ *     code    "font.inc"       2K
+ *     data    *                900
+ *
+ * The bytes of a segment or label range are counted from the blocks of the
+ * orglist. Those of an include file are counted by advance_ip() while it is
+ * assembled, for every time it is included. A budget that is exceeded is
+ * an error; for a segment or label range the labels using the most of it
+ * follow.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "misc.h"
+#include "args.h"
+#include "avra.h"
+
+#define BUDGET_LINE_LENGTH 1024
+#define BUDGET_CONTRIBUTORS 5	/* Labels listed for a budget exceeded */
+
+enum {
+	BUDGET_ALL = 0,
+	BUDGET_RANGE,
+	BUDGET_FILE
+};
+
+/* A label and the cells up to the next label of its segment */
+struct span {
+	struct label *label;	/* NULL for the cells before the first label */
+	long start;
+	long end;
+	long bytes;		/* Used within the budget being checked */
+};
+
+/* An include file given as written in .INCLUDE or by its last part */
+static int
+same_file(const char *name, const char *given)
+{
+	size_t len = strlen(name), given_len = strlen(given);
+
+	if (!strcmp(name, given))
+		return (True);
+	return ((len > given_len) && ((name[len - given_len - 1] == '/') || (name[len - given_len - 1] == '\\'))
+	        && !strcmp(name + len - given_len, given));
+}
+
+/* Cells of the orglist blocks in [start, end) */
+static long
+used_cells(struct segment_info *si, long start, long end)
+{
+	struct orglist *orglist;
+	long a, b, count = 0;
+
+	for (orglist = si->first_orglist; orglist; orglist = orglist->next) {
+		a = orglist->start > start ? orglist->start : start;
+		b = orglist->start + orglist->length < end ? orglist->start + orglist->length : end;
+		if (b > a)
+			count += b - a;
+	}
+	return (count);
+}
+
+/* Bytes a segment got from every inclusion of an include file */
+static long
+file_bytes(struct prog_info *pi, struct segment_info *si, const char *name)
+{
+	struct include_file *include_file;
+	long bytes = 0;
+
+	for (include_file = pi->first_include_file; include_file; include_file = include_file->next)
+		if (same_file(include_file->name, name))
+			bytes += include_file->bytes[segment_index(si)];
+	return (bytes);
+}
+
+static int
+compare_span_start(const void *a, const void *b)
+{
+	const struct span *x = a, *y = b;
+
+	if (x->start != y->start)
+		return (x->start < y->start ? -1 : 1);
+	return (x->end < y->end ? -1 : (x->end > y->end ? 1 : 0));
+}
+
+static int
+compare_span_bytes(const void *a, const void *b)
+{
+	const struct span *x = a, *y = b;
+
+	if (x->bytes != y->bytes)
+		return (x->bytes > y->bytes ? -1 : 1);
+	return (x->start < y->start ? -1 : (x->start > y->start ? 1 : 0));
+}
+
+/* The spans of the labels of a segment in address order, after the cells
+ * before the first label. Of the labels at one address the one defined
+ * last owns the span, as a label before an .INCLUDE ends the code above. */
+static struct span *
+get_spans(struct prog_info *pi, struct segment_info *si, int *count)
+{
+	struct orglist *orglist;
+	struct label *label;
+	struct span *span;
+	long last = 0;
+	int i, n = 1;
+
+	*count = 0;
+	for (label = pi->first_label; label; label = label->next)
+		if (label->segment == si)
+			n++;
+	span = malloc(n * sizeof(struct span));
+	if (!span) {
+		print_msg(pi, MSGTYPE_OUT_OF_MEM, NULL);
+		return (NULL);
+	}
+	span[0].label = NULL;
+	span[0].start = 0;
+	span[0].end = -1;
+	n = 1;
+	/* end holds the order of definition until the spans are sorted */
+	for (label = pi->first_label; label; label = label->next)
+		if (label->segment == si) {
+			span[n].label = label;
+			span[n].start = label->value;
+			span[n].end = n;
+			n++;
+		}
+	qsort(span, n, sizeof(struct span), compare_span_start);
+	for (i = 1, *count = 1; i < n; i++) {
+		if (span[i].start == span[*count - 1].start)
+			span[*count - 1] = span[i];
+		else
+			span[(*count)++] = span[i];
+	}
+	for (orglist = si->first_orglist; orglist; orglist = orglist->next)
+		if (orglist->start + orglist->length > last)
+			last = orglist->start + orglist->length;
+	for (i = 0; i < *count; i++)
+		span[i].end = i + 1 < *count ? span[i + 1].start : last;
+	return (span);
+}
+
+static struct segment_info *
+get_budget_segment(struct prog_info *pi, const char *name)
+{
+	if (!nocase_strcmp(name, "code") || !nocase_strcmp(name, "flash"))
+		return (pi->cseg);
+	if (!nocase_strcmp(name, "data") || !nocase_strcmp(name, "ram"))
+		return (pi->dseg);
+	if (!nocase_strcmp(name, "eeprom"))
+		return (pi->eseg);
+	return (NULL);
+}
+
+static struct label *
+get_budget_label(struct prog_info *pi, struct segment_info *si, char *name)
+{
+	struct label *label = test_label(pi, name, NULL);
+
+	if (!label || (label->segment != si)) {
+		print_msg(pi, MSGTYPE_ERROR, "Found no label named %s in the %s segment", name, si->name);
+		return (NULL);
+	}
+	return (label);
+}
+
+/* Bytes of one budget line, and the labels that used the most of it */
+static void
+check_line(struct prog_info *pi, struct segment_info *si, int kind, char *what, long limit)
+{
+	struct label *start = NULL, *end = NULL;
+	struct span *span = NULL;
+	long bytes = 0, a, b;
+	int i, count = 0;
+	char *dots;
+
+	if (kind == BUDGET_RANGE) {
+		dots = strstr(what, "..");
+		*dots = '\0';
+		start = get_budget_label(pi, si, what);
+		end = get_budget_label(pi, si, dots + 2);
+		*dots = '.';
+		if (!start || !end)
+			return;
+	}
+	if (kind == BUDGET_FILE)
+		bytes = file_bytes(pi, si, what);
+	else {
+		span = get_spans(pi, si, &count);
+		if (!span)
+			return;
+	}
+	for (i = 0; i < count; i++) {
+		a = span[i].start;
+		b = span[i].end;
+		if (kind == BUDGET_RANGE) {
+			if (a < start->value)
+				a = start->value;
+			if (b > end->value)
+				b = end->value;
+		}
+		span[i].bytes = b > a ? used_cells(si, a, b) * si->cellsize : 0;
+		bytes += span[i].bytes;
+	}
+	printf("%-8s %-24s %7ld %7ld%s\n", si->name, what, bytes, limit, bytes > limit ? "  over" : "");
+	if (bytes > limit) {
+		print_msg(pi, MSGTYPE_ERROR, "%s budget for %s exceeded by %ld bytes (%ld of %ld)",
+		          si->name, what, bytes - limit, bytes, limit);
+		if (span)
+			qsort(span, count, sizeof(struct span), compare_span_bytes);
+		for (i = 0; (i < count) && (i < BUDGET_CONTRIBUTORS) && span[i].bytes; i++) {
+			if (!span[i].label)
+				printf("         %7ld bytes  (before the first label)\n", span[i].bytes);
+			else
+				printf("         %7ld bytes  %-20s %s(%d)\n", span[i].bytes, span[i].label->name,
+				       span[i].label->include_file ? span[i].label->include_file->name : "",
+				       span[i].label->line_number);
+		}
+	}
+	free(span);
+}
+
+/* Check the segment usage of pass 1 against the budget file */
+int
+check_budget(struct prog_info *pi, const char *filename)
+{
+	struct file_info fi, *saved_fi = pi->fi;
+	struct include_file include_file;
+	struct segment_info *si;
+	char line[BUDGET_LINE_LENGTH], *segment, *what, *value, *end;
+	long limit;
+	int kind, len;
+	FILE *fp;
+
+	fp = fopen(filename, "r");
+	if (!fp) {
+		fprintf(stderr, "Error: Cannot open budget file %s\n", filename);
+		pi->error_count++;
+		return (False);
+	}
+	memset(&fi, 0, sizeof(fi));
+	memset(&include_file, 0, sizeof(include_file));
+	include_file.name = (char *)filename;
+	fi.include_file = &include_file;
+	printf("Budget %s:\n", filename);
+	printf("%-8s %-24s %7s %7s\n", "Segment", "Range", "Bytes", "Limit");
+	while (fgets(line, sizeof(line), fp)) {
+		pi->fi = &fi;
+		fi.line_number++;
+		end = strpbrk(line, ";#\r\n");
+		if (end)
+			*end = '\0';
+		segment = strtok(line, " \t");
+		if (!segment)
+			continue;
+		what = strtok(NULL, " \t");
+		value = strtok(NULL, " \t");
+		if (!what || !value || strtok(NULL, " \t")) {
+			print_msg(pi, MSGTYPE_ERROR, "Expected a segment, a range and a limit");
+			continue;
+		}
+		si = get_budget_segment(pi, segment);
+		if (!si) {
+			print_msg(pi, MSGTYPE_ERROR, "Unknown segment %s, use code, data or eeprom", segment);
+			continue;
+		}
+		limit = strtol(value, &end, 0);
+		if ((*end == 'K') || (*end == 'k')) {
+			limit *= 1024;
+			end++;
+		}
+		if ((end == value) || *end || (limit < 0)) {
+			print_msg(pi, MSGTYPE_ERROR, "Illegal limit %s", value);
+			continue;
+		}
+		len = strlen(what);
+		if (!strcmp(what, "*"))
+			kind = BUDGET_ALL;
+		else if ((len > 2) && (what[0] == '"') && (what[len - 1] == '"')) {
+			kind = BUDGET_FILE;
+			what[len - 1] = '\0';
+			what++;
+		} else if (strstr(what, ".."))
+			kind = BUDGET_RANGE;
+		else {
+			print_msg(pi, MSGTYPE_ERROR, "Expected *, label..label or \"file\" instead of %s", what);
+			continue;
+		}
+		check_line(pi, si, kind, what, limit);
+	}
+	pi->fi = saved_fi;
+	fclose(fp);
+	printf("\n");
+	return (True);
+}
+
+/* end of budget.c */
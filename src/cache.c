@@ -0,0 +1,412 @@
+/***********************************************************************
+ *
+ *  AVRA - Assembler for the Atmel AVR microcontroller series
+ *
+ *  Copyright (C) 1998-2020 The AVRA Authors
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; see the file COPYING.  If not, write to
+ *  the Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ *  Boston, MA 02111-1307, USA.
+ *
+ *
+ *  Authors of AVRA can be reached at:
+ *     email: jonah@omegav.ntnu.no, tobiw@suprafluid.com
+ *     www: https://github.com/Ro5bert/avra
+ */
+
+/*
+ * Output cache (--cache <dir>).
+ *
+ * The outputs of an assembly are stored under a key made from everything
+ * that can change them: the assembler version, the options, the source
+ * and the files it includes. The included files are only known after
+ * assembling, so the key has two parts:
+ *
+ *   <dir>/<key1>/includes        the files the source included last time
+ *   <dir>/<key1>/<key2>/manifest the outputs, restored when nothing changed
+ *
+ * key1 covers the version, the options and the main source, key2 adds
+ * the names and contents of the included files. Sources using the build
+ * date tags (%YEAR% etc.) are not cached.
+ *
+ * Only files are stored, not what the assembly printed. So the cache is
+ * not used when a report is asked for, and an assembly that printed
+ * warnings, messages or .CYCLES reports is not stored.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#if defined(_WIN32)
+#include <direct.h>
+#define make_dir(path) _mkdir(path)
+#else
+#include <sys/stat.h>
+#define make_dir(path) mkdir(path, 0777)
+#endif
+
+#include "misc.h"
+#include "avra.h"
+#include "args.h"
+
+#define CACHE_PATH_LENGTH 4096
+#define CACHE_MAX_OUTPUTS 8
+#define CACHE_LINE_LENGTH 1024
+
+#define FNV_OFFSET 14695981039346656037ULL
+#define FNV_PRIME  1099511628211ULL
+
+typedef unsigned long long cache_hash;
+
+static cache_hash
+hash_bytes(cache_hash h, const void *data, size_t length)
+{
+	const unsigned char *p = data;
+
+	while (length--) {
+		h ^= *p++;
+		h *= FNV_PRIME;
+	}
+	return (h);
+}
+
+/* With its terminating 0, so "ab", "c" and "a", "bc" differ */
+static cache_hash
+hash_string(cache_hash h, const char *s)
+{
+	return (hash_bytes(h, s ? s : "", s ? strlen(s) + 1 : 1));
+}
+
+static int
+hash_file(cache_hash *h, const char *name)
+{
+	FILE *fp;
+	char buff[4096];
+	size_t n;
+
+	fp = fopen(name, "rb");
+	if (!fp)
+		return (False);
+	while ((n = fread(buff, 1, sizeof(buff), fp)) > 0)
+		*h = hash_bytes(*h, buff, n);
+	fclose(fp);
+	return (True);
+}
+
+/* Everything but the included files */
+static int
+first_key(struct prog_info *pi, cache_hash *h)
+{
+	struct args *args = pi->args;
+	struct data_list *data;
+	int i;
+
+	*h = hash_string(FNV_OFFSET, VERSION);
+#ifdef DEFAULT_INCLUDE_PATH
+	*h = hash_string(*h, DEFAULT_INCLUDE_PATH);
+#endif
+	for (i = 0; i < args->count; i++) {
+		if ((i == ARG_CACHE) || (i == ARG_CACHE_STATS))
+			continue;
+		switch (args->arg[i].type) {
+		case ARGTYPE_STRING:
+			*h = hash_string(*h, args->arg[i].data.p);
+			break;
+		case ARGTYPE_STRING_MULTI:
+		case ARGTYPE_STRING_MULTISINGLE:
+			for (data = args->arg[i].data.dl; data; data = data->next)
+				*h = hash_string(*h, data->data);
+			*h = hash_string(*h, NULL);
+			break;
+		case ARGTYPE_BOOLEAN: /* Some have a string as their default */
+			*h = hash_string(*h, args->arg[i].data.i ? "1" : "0");
+			break;
+		case ARGTYPE_CHAR_ATTACHED: /* -f, output file type is not implemented */
+			break;
+		default:
+			*h = hash_bytes(*h, &args->arg[i].data.i, sizeof(int));
+		}
+	}
+	for (data = args->first_data; data; data = data->next)
+		*h = hash_string(*h, data->data);
+	return (hash_file(h, args->first_data->data));
+}
+
+/* Options printing a report after the assembly */
+static int
+reports_wanted(struct args *args)
+{
+	return (GET_ARG_I(args, ARG_WCET) || GET_ARG_I(args, ARG_STACK)
+	        || GET_ARG_I(args, ARG_CLOBBERS) || GET_ARG_I(args, ARG_UNUSED)
+	        || GET_ARG_P(args, ARG_BUDGET));
+}
+
+static void
+key_path(char *path, const char *dir, cache_hash key1, const cache_hash *key2, const char *name)
+{
+	if (key2)
+		snprintf(path, CACHE_PATH_LENGTH, "%s/%016llx/%016llx/%s", dir, key1, *key2, name);
+	else
+		snprintf(path, CACHE_PATH_LENGTH, "%s/%016llx/%s", dir, key1, name);
+}
+
+/* key1 and the names and contents of the included files listed in fp */
+static cache_hash
+second_key(cache_hash key1, FILE *fp)
+{
+	char line[CACHE_LINE_LENGTH];
+	cache_hash h = hash_bytes(FNV_OFFSET, &key1, sizeof(key1));
+
+	while (fgets(line, sizeof(line), fp)) {
+		line[strcspn(line, "\r\n")] = '\0';
+		h = hash_string(h, line);
+		if (!hash_file(&h, line))
+			h = hash_string(h, "missing");
+	}
+	return (h);
+}
+
+static int
+copy_file(const char *from, const char *to)
+{
+	FILE *in, *out;
+	char buff[4096];
+	size_t n;
+	int ok = True;
+
+	in = fopen(from, "rb");
+	if (!in)
+		return (False);
+	out = fopen(to, "wb");
+	if (!out) {
+		fclose(in);
+		return (False);
+	}
+	while ((n = fread(buff, 1, sizeof(buff), in)) > 0)
+		if (fwrite(buff, 1, n, out) != n)
+			ok = False;
+	fclose(in);
+	if (fclose(out) != 0)
+		ok = False;
+	return (ok);
+}
+
+static void
+count_lookup(const char *dir, int hit)
+{
+	char path[CACHE_PATH_LENGTH];
+	long hits = 0, misses = 0;
+	FILE *fp;
+
+	make_dir(dir);
+	snprintf(path, sizeof(path), "%s/stats", dir);
+	fp = fopen(path, "r");
+	if (fp) {
+		if (fscanf(fp, "hits %ld misses %ld", &hits, &misses) != 2)
+			hits = misses = 0;
+		fclose(fp);
+	}
+	if (hit)
+		hits++;
+	else
+		misses++;
+	fp = fopen(path, "w");
+	if (fp) {
+		fprintf(fp, "hits %ld misses %ld\n", hits, misses);
+		fclose(fp);
+	}
+}
+
+/* The name open_out_files() and friends give an output */
+static char *
+output_name(const char *basename, const char *given, const char *ext)
+{
+	char *name;
+	int length = strlen(basename);
+
+	if (given) {
+		name = malloc(strlen(given) + 1);
+		if (name)
+			strcpy(name, given);
+		return (name);
+	}
+	name = malloc(length + strlen(ext) + 1);
+	if (!name)
+		return (NULL);
+	strcpy(name, basename);
+	if ((length >= 4) && !nocase_strcmp(&name[length - 4], ".asm"))
+		length -= 4;
+	strcpy(&name[length], ext);
+	return (name);
+}
+
+/* The files assemble() writes. Returns their number, -1 if out of memory */
+static int
+output_names(struct prog_info *pi, char *names[])
+{
+	struct args *args = pi->args;
+	const char *basename = args->first_data->data;
+	int i, count = 0;
+
+	if (pi->module)
+		names[count++] = output_name(basename, GET_ARG_P(args, ARG_OUTFILE), ".rel");
+	else {
+		names[count++] = output_name(basename, GET_ARG_P(args, ARG_OUTFILE), ".hex");
+		names[count++] = output_name(basename, GET_ARG_P(args, ARG_DEBUGFILE), ".obj");
+		names[count++] = output_name(basename, GET_ARG_P(args, ARG_EEPFILE), ".eep.hex");
+		if (GET_ARG_I(args, ARG_COFF))
+			names[count++] = output_name(basename, NULL, ".cof");
+		if (GET_ARG_I(args, ARG_ELF))
+			names[count++] = output_name(basename, NULL, ".elf");
+	}
+	if (GET_ARG_P(args, ARG_LISTFILE))
+		names[count++] = output_name(basename, GET_ARG_P(args, ARG_LISTFILE), "");
+	if (GET_ARG_P(args, ARG_MAPFILE))
+		names[count++] = output_name(basename, GET_ARG_P(args, ARG_MAPFILE), "");
+	if (GET_ARG_I(args, ARG_DEPEND) || GET_ARG_P(args, ARG_DEPFILE))
+		names[count++] = output_name(basename, GET_ARG_P(args, ARG_DEPFILE), ".d");
+	for (i = 0; i < count; i++)
+		if (!names[i]) {
+			while (count)
+				free(names[--count]);
+			return (-1);
+		}
+	return (count);
+}
+
+/* Restore the outputs of an earlier assembly. True if they were */
+int
+restore_cached(struct prog_info *pi)
+{
+	const char *dir = GET_ARG_P(pi->args, ARG_CACHE);
+	char path[CACHE_PATH_LENGTH], line[CACHE_LINE_LENGTH], *name;
+	cache_hash key1, key2;
+	FILE *fp;
+	int count = 0, ok = False;
+
+	if (!dir || !pi->args->first_data || reports_wanted(pi->args) || !first_key(pi, &key1))
+		return (False);
+	key_path(path, dir, key1, NULL, "includes");
+	fp = fopen(path, "r");
+	if (fp) {
+		key2 = second_key(key1, fp);
+		fclose(fp);
+		key_path(path, dir, key1, &key2, "manifest");
+		fp = fopen(path, "r");
+	}
+	if (fp) {
+		ok = fgets(line, sizeof(line), fp) && !strcmp(line, "AVRA cache 1\n");
+		while (ok && fgets(line, sizeof(line), fp)) {
+			line[strcspn(line, "\r\n")] = '\0';
+			name = strchr(line, ' ');
+			if (!name)
+				break;
+			*name++ = '\0';
+			key_path(path, dir, key1, &key2, line);
+			ok = copy_file(path, name);
+			count++;
+		}
+		fclose(fp);
+	}
+	count_lookup(dir, ok);
+	if (ok)
+		printf("Restored %d files from the cache.\n", count);
+	return (ok);
+}
+
+/* Store the outputs of a successful assembly */
+void
+store_cached(struct prog_info *pi)
+{
+	const char *dir = GET_ARG_P(pi->args, ARG_CACHE);
+	char path[CACHE_PATH_LENGTH], file[16], *names[CACHE_MAX_OUTPUTS];
+	struct include_file *include_file;
+	cache_hash key1, key2;
+	FILE *fp;
+	int i, count, ok = True;
+
+	if (!dir || pi->uses_time || pi->error_count || reports_wanted(pi->args))
+		return;
+	if (pi->warning_count || pi->message_count || pi->first_cycles_report || !first_key(pi, &key1))
+		return;
+	count = output_names(pi, names);
+	if (count < 0)
+		return;
+	/* The included and .INCBIN files, each once, main source excluded */
+	key_path(path, dir, key1, NULL, "");
+	make_dir(dir);
+	make_dir(path);
+	key_path(path, dir, key1, NULL, "includes");
+	fp = fopen(path, "w+");
+	if (!fp) {
+		printf("Warning : Could not write to cache %s\n", dir);
+		goto out;
+	}
+	for (include_file = pi->first_include_file->next; include_file; include_file = include_file->next)
+		if (first_inclusion(pi, include_file))
+			fprintf(fp, "%s\n", include_file->name);
+	for (include_file = pi->first_binary_file; include_file; include_file = include_file->next)
+		fprintf(fp, "%s\n", include_file->name);
+	rewind(fp);
+	key2 = second_key(key1, fp);
+	fclose(fp);
+	key_path(path, dir, key1, &key2, "");
+	make_dir(path);
+	for (i = 0; (i < count) && ok; i++) {
+		snprintf(file, sizeof(file), "%d", i);
+		key_path(path, dir, key1, &key2, file);
+		ok = copy_file(names[i], path);
+	}
+	/* Written last, so an entry is only used when it is complete */
+	key_path(path, dir, key1, &key2, "manifest");
+	fp = ok ? fopen(path, "w") : NULL;
+	if (fp) {
+		fprintf(fp, "AVRA cache 1\n");
+		for (i = 0; i < count; i++)
+			fprintf(fp, "%d %s\n", i, names[i]);
+		fclose(fp);
+	} else
+		printf("Warning : Could not write to cache %s\n", dir);
+out:
+	for (i = 0; i < count; i++)
+		free(names[i]);
+}
+
+/* --cache_stats */
+void
+print_cache_stats(struct args *args)
+{
+	const char *dir = GET_ARG_P(args, ARG_CACHE);
+	char path[CACHE_PATH_LENGTH];
+	long hits = 0, misses = 0;
+	FILE *fp;
+
+	if (!dir) {
+		printf("Error: --cache_stats needs --cache <dir>\n");
+		return;
+	}
+	snprintf(path, sizeof(path), "%s/stats", dir);
+	fp = fopen(path, "r");
+	if (fp) {
+		if (fscanf(fp, "hits %ld misses %ld", &hits, &misses) != 2)
+			hits = misses = 0;
+		fclose(fp);
+	}
+	printf("Cache %s: %ld hits, %ld misses", dir, hits, misses);
+	if (hits + misses)
+		printf(" (%ld%% hits)", hits * 100 / (hits + misses));
+	printf("\n");
+}
+
+/* end of cache.c */
@@ -84,67 +84,23 @@ FILE *
 open_coff_file(struct prog_info *pi, char *filename)
 {
 
-	int ok;
 	FILE *fp;
-	char *p;
 
 
 	ci = calloc(1, sizeof(struct coff_info));
 	if (!ci)
 		return (0);
 
-	ok = True;
 	/* default values */
-	ci->CurrentFileNumber = 0;
-	ci->pRomMemory = 0;
-	ci->pEEPRomMemory = 0;
-	ci->MaxRomAddress = 0;
-	ci->MaxEepromAddress = 0;
-	ci->NeedLineNumberFixup = 0;
 	ci->GlobalStartAddress = -1;
 	ci->GlobalEndAddress = 0;
 
-	/* Linked lists start out at zero */
-	InitializeList(&ci->ListOfSectionHeaders);
-	InitializeList(&ci->ListOfRawData);
-	InitializeList(&ci->ListOfRelocations);
-	InitializeList(&ci->ListOfLineNumbers);
-	InitializeList(&ci->ListOfSymbols);
-	InitializeList(&ci->ListOfGlobals);
-	InitializeList(&ci->ListOfSpecials);
-	InitializeList(&ci->ListOfUndefined);
-	InitializeList(&ci->ListOfStrings);
-	InitializeList(&ci->ListOfTypes);
-	InitializeList(&ci->ListOfSplitLines);
-
-	/* add two default sections to SectionHeaders */
-	if (!AllocateListObject(&ci->ListOfSectionHeaders, sizeof(struct external_scnhdr)) ||
-	        !AllocateListObject(&ci->ListOfSectionHeaders, sizeof(struct external_scnhdr))) {
-
-		fprintf(stderr, "\nOut of memory allocating section headers!");
-		return (0);
-	}
-
-	/* add to string table */
-	p = (char *)AllocateListObject(&ci->ListOfStrings,  4);
-	if (!p) {
+	/* add to string table, room for its size */
+	if (!AppendArrayObject(&ci->Strings, 4, 1)) {
 		fprintf(stderr, "\nOut of memory allocating string table space!");
 		return (0);
 	}
 
-	/* Allocate space for binary output into ROM, and EEPROM memory buffers for COFF output */
-	/* ASSUMES ci->device is accurate */
-	if ((ci->pRomMemory = AllocateListObject(&ci->ListOfRawData, pi->device->flash_size * 2)) != 0) {
-		if ((ci->pEEPRomMemory = AllocateListObject(&ci->ListOfRawData, pi->device->eeprom_size)) != 0) {
-			ok = True; /* only true if both buffers are properly allocated */
-			/* now fill them with 0xff's to simulate flash erasure */
-			memset((void *)ci->pRomMemory, 0xff, pi->device->flash_size * 2);
-			memset((void *)ci->pEEPRomMemory,    0xff,    pi->device->eeprom_size);
-		}
-	}
-	if (ok != True)
-		return (0);
-
 	fp = fopen(filename,"wb");
 	if (fp == NULL) {
 		fprintf(stderr,"Error: cannot write coff file\n");
@@ -160,19 +116,16 @@ void
 write_coff_file(struct prog_info *pi)
 {
 
-	char *p;
 	struct external_scnhdr *pSectionHdr;
 	struct syment *pEntry;
 	union auxent *pAux;
-	unsigned long *plong;
+	unsigned int *plong;
 	int NumberOfSymbols, SymbolIndex, LastFileIndex, LastFunctionIndex, LastFunctionAddress;
-	LISTNODE *pNode;
-	int LinesOffset, SymbolsOffset, RawOffset;
-	struct lineno *pLine;
+	int i, LinesOffset, SymbolsOffset, RawOffset;
 
 	/* add two special sections */
 	/* one for .text */
-	if ((pEntry = (struct syment *)AllocateTwoListObjects(&ci->ListOfSpecials, sizeof(struct syment) * 2)) == 0) {
+	if ((pEntry = (struct syment *)AppendArrayObject(&ci->Specials, sizeof(struct syment) * 2, 2)) == 0) {
 		fprintf(stderr, "\nOut of memory allocating special headers for .text!");
 		return;
 	}
@@ -187,9 +140,9 @@ write_coff_file(struct prog_info *pi)
 	pAux = (union auxent *)pEntry;
 	pAux->x_scn.x_scnlen = ci->MaxRomAddress + 2;
 	pAux->x_scn.x_nreloc = 0;
-	pAux->x_scn.x_nlinno = ci->ListOfLineNumbers.TotalItems;
+	pAux->x_scn.x_nlinno = ci->LineNumbers.TotalItems;
 	/* one for .bss */
-	if ((pEntry = (struct syment *)AllocateTwoListObjects(&ci->ListOfSpecials, sizeof(struct syment) * 2)) == 0) {
+	if ((pEntry = (struct syment *)AppendArrayObject(&ci->Specials, sizeof(struct syment) * 2, 2)) == 0) {
 		fprintf(stderr, "\nOut of memory allocating special header for .bss!");
 		return;
 	}
@@ -212,28 +165,24 @@ write_coff_file(struct prog_info *pi)
 	/* one more for .data - eeprom ??? */
 
 	/* Calculate common offsets into the file */
-	RawOffset = sizeof(struct external_filehdr) + ci->ListOfSectionHeaders.TotalBytes;
+	RawOffset = sizeof(struct external_filehdr) + sizeof(ci->SectionHeaders);
 	LinesOffset = RawOffset + ci->MaxRomAddress + 2; /* ignore eeprom for now */
-	SymbolsOffset = LinesOffset + ci->ListOfLineNumbers.TotalBytes;
+	SymbolsOffset = LinesOffset + ci->LineNumbers.TotalBytes;
 
 	/* Clean up loose ends in string table */
-	if (!(plong  = (unsigned long *)FindFirstListObject(&ci->ListOfStrings))) {
-		fprintf(stderr,"\nInternal error in string table!");
-		return;
-	}
-	*plong = ci->ListOfStrings.TotalBytes; /* Size of string table */
+	plong = (unsigned int *)ci->Strings.pData;
+	*plong = ci->Strings.TotalBytes; /* Size of string table */
 
 	/* Clean up loose ends in symbol table */
 
 	/*	symbol table - Filename value - index to next .file or global symbol */
 	/* The value of that symbol equals the symbol table entry index of the next .file symbol or .global */
 	LastFunctionAddress = ci->MaxRomAddress;
-	NumberOfSymbols = ci->ListOfSymbols.TotalItems + ci->ListOfSpecials.TotalItems + ci->ListOfGlobals.TotalItems;
+	NumberOfSymbols = ci->Symbols.TotalItems + ci->Specials.TotalItems + ci->Globals.TotalItems;
 	SymbolIndex = LastFileIndex = NumberOfSymbols;
 	LastFunctionIndex = 0; /* set to zero on last function */
-	for (pEntry = (struct syment *)FindLastListObject(&ci->ListOfSymbols);
-	        pEntry != 0;
-	        pEntry = (struct syment *)FindNextLastListObject(&ci->ListOfSymbols)) {
+	for (i = ci->Symbols.Count - 1; i >= 0; i--) {
+		pEntry = (struct syment *)GetArrayObject(&ci->Symbols, i);
 
 		/* Search for .file entries designated by C_FILE */
 		if (pEntry->n_sclass == C_FILE) {
@@ -261,8 +210,7 @@ write_coff_file(struct prog_info *pi)
 		/* else do nothing */
 
 		/* update current symbol index */
-		pNode = GetCurrentNode(&ci->ListOfSymbols);
-		SymbolIndex -= (pNode->Size / sizeof(struct syment));
+		SymbolIndex -= (GetArrayObjectSize(&ci->Symbols, i) / sizeof(struct syment));
 	}
 
 	/* File Header */
@@ -283,11 +231,7 @@ write_coff_file(struct prog_info *pi)
 	/* Optional Information */
 
 	/* Section 1 Header */
-	pSectionHdr = (struct external_scnhdr *)FindFirstListObject(&ci->ListOfSectionHeaders);
-	if (!pSectionHdr) {
-		fprintf(stderr, "\nInternal Coff error - cannot find section header .text!");
-		return;
-	}
+	pSectionHdr = &ci->SectionHeaders[0];
 	memset(&pSectionHdr->s_name[0], 0, sizeof(struct external_scnhdr));
 	strcpy(&pSectionHdr->s_name[0], ".text");
 	pSectionHdr->s_paddr = 0;
@@ -297,7 +241,7 @@ write_coff_file(struct prog_info *pi)
 	pSectionHdr->s_relptr = 0;
 	pSectionHdr->s_lnnoptr = LinesOffset;
 	pSectionHdr->s_nreloc = 0;
-	pSectionHdr->s_nlnno = ci->ListOfLineNumbers.TotalBytes/sizeof(struct lineno);
+	pSectionHdr->s_nlnno = ci->LineNumbers.TotalBytes/sizeof(struct lineno);
 	pSectionHdr->s_flags = STYP_TEXT;
 
 	/* write it out */
@@ -307,11 +251,7 @@ write_coff_file(struct prog_info *pi)
 	}
 
 	/* Section 2 Header */
-	pSectionHdr = (struct external_scnhdr *)FindNextListObject(&ci->ListOfSectionHeaders);
-	if (!pSectionHdr) {
-		fprintf(stderr, "\nInternal Coff error - cannot find section header .bss!");
-		return;
-	}
+	pSectionHdr = &ci->SectionHeaders[1];
 	memset(&pSectionHdr->s_name[0], 0, sizeof(struct external_scnhdr));
 	strcpy(&pSectionHdr->s_name[0], ".bss");
 	/* later expansion */
@@ -327,14 +267,8 @@ write_coff_file(struct prog_info *pi)
 
 	/* Section N Header - .data or eeprom */
 
-	/* Raw Data for Section 1 */
-	if ((p = FindFirstListObject(&ci->ListOfRawData)) == 0) {
-		fprintf(stderr,"\nInternal error - unable to find binary data!");
-		return;
-	}
-
-	/* write it out */
-	if (fwrite(p, 1, ci->MaxRomAddress + 2, pi->coff_file) != (size_t)(ci->MaxRomAddress + 2)) {
+	/* Raw Data for Section 1, up to the last instruction */
+	if (!WriteImage(&ci->RomMemory, ci->MaxRomAddress + 2, pi->coff_file)) {
 		fprintf(stderr,"\nFile error writing raw .text data ...(disk full?)");
 		return;
 	}
@@ -345,120 +279,83 @@ write_coff_file(struct prog_info *pi)
 	/* Relocation info for section n */
 
 	/* Line numbers for section 1 */
-	for (pLine = (struct lineno *)FindFirstListObject(&ci->ListOfLineNumbers);
-	        pLine != 0;
-	        pLine = (struct lineno *)FindNextListObject(&ci->ListOfLineNumbers)) {
-
-		pNode = GetCurrentNode(&ci->ListOfLineNumbers);
-
-		/* write it out */
-		if (fwrite(pLine, 1, pNode->Size, pi->coff_file) != pNode->Size) {
-			fprintf(stderr,"\nFile error writing line numbers ...(disk full?)");
-			return;
-		}
+	/* write it out */
+	if (!WriteArray(&ci->LineNumbers, pi->coff_file)) {
+		fprintf(stderr,"\nFile error writing line numbers ...(disk full?)");
+		return;
 	}
 
 
 	/* Line numbers for section n */
 
 	/* Symbol table */
-	for (pEntry = (struct syment *)FindFirstListObject(&ci->ListOfSymbols);
-	        pEntry != 0;
-	        pEntry = (struct syment *)FindNextListObject(&ci->ListOfSymbols)) {
-
-		pNode = GetCurrentNode(&ci->ListOfSymbols);
-
-		/* write it out */
-		if (fwrite(pEntry, 1, pNode->Size, pi->coff_file) != pNode->Size) {
-			fprintf(stderr,"\nFile error writing symbol table ...(disk full?)");
-			return;
-		}
+	/* write it out */
+	if (!WriteArray(&ci->Symbols, pi->coff_file)) {
+		fprintf(stderr,"\nFile error writing symbol table ...(disk full?)");
+		return;
 	}
 
 	/* Symbol table of Globals */
-	for (pEntry = (struct syment *)FindFirstListObject(&ci->ListOfGlobals);
-	        pEntry != 0;
-	        pEntry = (struct syment *)FindNextListObject(&ci->ListOfGlobals)) {
-
-		pNode = GetCurrentNode(&ci->ListOfGlobals);
-
-		/* write it out */
-		if (fwrite(pEntry, 1, pNode->Size, pi->coff_file) != pNode->Size) {
-			fprintf(stderr,"\nFile error writing global symbols ...(disk full?)");
-			return;
-		}
+	/* write it out */
+	if (!WriteArray(&ci->Globals, pi->coff_file)) {
+		fprintf(stderr,"\nFile error writing global symbols ...(disk full?)");
+		return;
 	}
 
 	/* Specials .text, .bss, .data */
 
-	for (pEntry = (struct syment *)FindFirstListObject(&ci->ListOfSpecials);
-	        pEntry != 0;
-	        pEntry = (struct syment *)FindNextListObject(&ci->ListOfSpecials)) {
-
-		pNode = GetCurrentNode(&ci->ListOfSpecials);
-
-		/* write it out */
-		if (fwrite(pEntry, 1, pNode->Size, pi->coff_file) != pNode->Size) {
-			fprintf(stderr,"\nFile error writing special symbols ...(disk full?)");
-			return;
-		}
+	/* write it out */
+	if (!WriteArray(&ci->Specials, pi->coff_file)) {
+		fprintf(stderr,"\nFile error writing special symbols ...(disk full?)");
+		return;
 	}
 
 	/* String Table */
-	for (p = (char *)FindFirstListObject(&ci->ListOfStrings);
-	        p != 0;
-	        p = (char *)FindNextListObject(&ci->ListOfStrings)) {
-
-		pNode = GetCurrentNode(&ci->ListOfStrings);
-
-		/* write it out */
-		if (fwrite(p, 1, pNode->Size, pi->coff_file) != pNode->Size) {
-			fprintf(stderr,"\nFile error writing strings data ...(disk full?)");
-			return;
-		}
+	/* write it out */
+	if (!WriteArray(&ci->Strings, pi->coff_file)) {
+		fprintf(stderr,"\nFile error writing strings data ...(disk full?)");
+		return;
 	}
 
 	return;
 }
 
 void
-write_coff_eeprom(struct prog_info *pi, int address, unsigned char data)
+write_coff_eeprom(struct prog_info *pi, int address, const unsigned char *data, int count)
 {
 
 	/* Coff output keeps track of binary data in memory buffers */
-	if (ci->pEEPRomMemory) {
-		if (address <= pi->device->eeprom_size) {
-			*(ci->pEEPRomMemory + address) = data;
-			if (address >= ci->MaxEepromAddress)
-				ci->MaxEepromAddress = address;   /* keep high water mark */
-		} else {
-			pi->error_count++;
-			fprintf(stderr, "Error: EEPROM address %d exceeds max range %ld", address, pi->device->eeprom_size);
+	if (address + count - 1 <= pi->device->eeprom_size) {
+		if (!SetImageBytes(&ci->EEPRomMemory, address, data, count)) {
+			print_msg(pi, MSGTYPE_OUT_OF_MEM, NULL);
+			return;
 		}
+		if (address + count - 1 >= ci->MaxEepromAddress)
+			ci->MaxEepromAddress = address + count - 1;   /* keep high water mark */
+	} else {
+		pi->error_count++;
+		fprintf(stderr, "Error: EEPROM address %d exceeds max range %ld", address + count - 1, pi->device->eeprom_size);
 	}
 }
 
 void
-write_coff_program(struct prog_info *pi, int address, unsigned int data)
+write_coff_program(struct prog_info *pi, int address, const unsigned char *data, int count)
 {
 
-	unsigned char *pByte;
-
 	/* Coff output keeps track of binary data in memory buffers, address is in bytes not words */
-	if (ci->pRomMemory) {
-		/* JEG	if ( address <= pi->device->flash_size ) {  */  /* JEG 4-23-03 */
-		if (address <= pi->device->flash_size*2) {
-			pByte = (unsigned char *)(ci->pRomMemory + address); /* point to low byte in memory */
-			*pByte++ = (data & 0xff);   /* low byte */
-			*pByte = ((data >> 8) & 0xff); /* high byte */
-
-			if (address >= ci->MaxRomAddress)
-				ci->MaxRomAddress = address;   /* keep high water mark */
-		} else {
-			pi->error_count++;
-			/* JEG		fprintf(stderr, "Error: FLASH address %d exceeds max range %d", address, pi->device->flash_size ); */
-			fprintf(stderr, "Error: FLASH address %d exceeds max range %ld", address, pi->device->flash_size*2);
+	/* JEG	if ( address <= pi->device->flash_size ) {  */  /* JEG 4-23-03 */
+	if (address + count - 2 <= pi->device->flash_size*2) {
+		if (!SetImageBytes(&ci->RomMemory, address, data, count)) {
+			print_msg(pi, MSGTYPE_OUT_OF_MEM, NULL);
+			return;
 		}
+
+		if (address + count - 2 >= ci->MaxRomAddress)
+			ci->MaxRomAddress = address + count - 2;   /* keep high water mark, the last word */
+	} else {
+		pi->error_count++;
+		/* JEG		fprintf(stderr, "Error: FLASH address %d exceeds max range %d", address, pi->device->flash_size ); */
+		fprintf(stderr, "Error: FLASH address %d exceeds max range %ld", address + count - 2, pi->device->flash_size*2);
 	}
 }
 
@@ -472,32 +369,52 @@ close_coff_file(struct prog_info *pi, FILE *fp)
 
 	/* free all the internal memory buffers used by ci */
 
-	FreeList(&ci->ListOfSectionHeaders);
-	FreeList(&ci->ListOfRawData);
-	FreeList(&ci->ListOfRelocations);
-	FreeList(&ci->ListOfLineNumbers);
-	FreeList(&ci->ListOfSymbols);
-	FreeList(&ci->ListOfGlobals);
-	FreeList(&ci->ListOfUndefined);
-	FreeList(&ci->ListOfStrings);
-	FreeList(&ci->ListOfTypes);
-	FreeList(&ci->ListOfSplitLines);
+	FreeImage(&ci->RomMemory);
+	FreeImage(&ci->EEPRomMemory);
+	FreeArray(&ci->LineNumbers);
+	FreeArray(&ci->Symbols);
+	FreeArray(&ci->Globals);
+	FreeArray(&ci->Specials);
+	FreeArray(&ci->Strings);
+	FreeArray(&ci->SplitLine);
+	while (ci->TypeCount)
+		free(ci->pTypes[--ci->TypeCount]);
+	free(ci->pTypes);
+	free(ci->pStringHash);
 
 	/* now free ci */
 	free(ci);
 	ci = 0;
 }
 
+/* Next comma separated field of a .stabs or .stabn line, without the
+ * blanks around it. Returns the character after the comma, NULL if the
+ * field ended the line. */
+static char *
+stab_field(char *p, char **pStart, int *pLength)
+{
+
+	if (!p)
+		return (0);
+	while (IS_HOR_SPACE(*p)) p++;
+	*pStart = p;
+	while ((*p != ',') && !IS_END_OR_COMMENT(*p)) p++;
+	for (*pLength = p - *pStart; (*pLength > 0) && IS_HOR_SPACE((*pStart)[*pLength - 1]); (*pLength)--);
+	if (*p != ',')
+		return (0);
+	return (p + 1);
+}
+
 int
 parse_stabs(struct prog_info *pi, char *p)
 {
 
 	int ok = True;
-	int TypeCode, n;
-	char *pString, *p2, *p3, *p4, *p5, *pType, *pp, *pJoined;
+	int TypeCode, n, n2, n3, n4, n5, Offset;
+	char *pString, *p2, *p3, *p4, *p5, *pType, *pp;
 
 
-	if (!GET_ARG_I(pi->args, ARG_COFF) || (pi->pass == PASS_1))
+	if (!GET_ARG_I(pi->args, ARG_COFF) || (pi->pass == PASS_1) || pi->layout)
 		return (True);
 
 	/* stabs debugging information is in the form:
@@ -525,56 +442,48 @@ parse_stabs(struct prog_info *pi, char *p)
 
 	/* Look for continuation lines per line */
 
-	/* Get String information as a token */
-	/* Parse the tokens in the stabn line buffer */
-	pString = get_next_token(p, TERM_DOUBLEQUOTE);      /* zap first doublequote */
-	p2 = get_next_token(pString, TERM_DOUBLEQUOTE);     /* zap last doublequote */
-	p2 = get_next_token(p2, TERM_COMMA);                /* zap comma */
-	p3 = get_next_token(p2, TERM_COMMA);
-	p4 = get_next_token(p3, TERM_COMMA);
-	p5 = get_next_token(p4, TERM_COMMA);
-	get_next_token(p5, TERM_END);  /* zap CR LF, make ASCIIZ */
-
-	if (!pString || !p2 || !p3 || !p4 || !p5)
+	/* The line is listed later, so it is read as is. The string and the
+	 * value are copied into the SplitLine buffer, which is kept. */
+	pString = p;
+	while ((*pString != '"') && !IS_ENDLINE(*pString)) pString++;
+	if (*pString++ != '"')
 		return (False);
-
-	/* Check for split lines */
-	n = strlen(pString);
-	if ((pString[n - 1] == '\\') && (pString[n - 2] == '\\')) {
-		/* We have a continuation string here */
-		pString[n - 2] = 0;
-		n -= 2;
-		if (!(pp = (char *)AllocateListObject(&ci->ListOfSplitLines, n + 1))) {
+	for (p = pString; (*p != '"') && !IS_ENDLINE(*p); p++);
+	if (*p != '"')
+		return (False);
+	n = p - pString;
+	if ((n >= 2) && (pString[n - 1] == '\\') && (pString[n - 2] == '\\')) {
+		/* We have a continuation string here, loose the continuation characters */
+		if (!(pp = (char *)AppendArrayObject(&ci->SplitLine, n - 2, 1))) {
 			fprintf(stderr, "\nOut of memory allocating continuation line!");
 			return (False);
 		}
-		strcpy(pp, pString);   /* loose the continuation characters */
+		memcpy(pp, pString, n - 2);
 		return (True);
 	}
-	if (ci->ListOfSplitLines.TotalItems > 0) {
-		/* Join lines together and process */
-		if (!(pJoined = calloc(1, n + ci->ListOfSplitLines.TotalBytes))) {
-			fprintf(stderr, "\nOut of memory joining continuation lines!");
-			return (False);
-		}
-		for (pp = (char *)FindFirstListObject(&ci->ListOfSplitLines);
-		        pp != 0;
-		        pp = (char *)FindNextListObject(&ci->ListOfSplitLines)) {
+	p = stab_field(p + 1, &p2, &n2);	/* past the string */
+	p = stab_field(p, &p2, &n2);		/* type */
+	p = stab_field(p, &p3, &n3);		/* other */
+	p = stab_field(p, &p4, &n4);		/* desc */
+	if (!p)
+		return (False);
+	stab_field(p, &p5, &n5);		/* value */
 
-			strcat(pJoined, pp);   /* connect the lines */
-		}
-		strcat(pJoined, pString);
-		FreeList(&ci->ListOfSplitLines);
-		if (!AddListObject(&ci->ListOfSplitLines, pJoined, n + ci->ListOfSplitLines.TotalBytes)) {
-			fprintf(stderr, "\nUnable to add joined continuation line");
-			return (False);
-		}
-		pString = pJoined;
+	/* Join lines together, if any, and process */
+	Offset = ci->SplitLine.TotalBytes;
+	if (!(pp = (char *)AppendArrayObject(&ci->SplitLine, n + 1 + n5 + 1, 1))) {
+		fprintf(stderr, "\nOut of memory joining continuation lines!");
+		return (False);
 	}
-
+	memcpy(pp, pString, n);
+	pp[n] = '\0';
+	memcpy(pp + n + 1, p5, n5);
+	pp[n + 1 + n5] = '\0';
+	pString = (char *)ci->SplitLine.pData;
+	p5 = (char *)ci->SplitLine.pData + Offset + n + 1;
 
 	if (*p2 == '0')
-		TypeCode = atox(p2);    /* presume to be hex 0x */
+		TypeCode = atox_n(p2, n2);    /* presume to be hex 0x */
 	else
 		TypeCode = atoi(p2);
 
@@ -634,8 +543,7 @@ parse_stabs(struct prog_info *pi, char *p)
 		ok = False;
 	}
 
-	if (ci->ListOfSplitLines.TotalItems > 0)
-		FreeList(&ci->ListOfSplitLines);
+	EmptyArray(&ci->SplitLine);
 
 	return (ok);
 }
@@ -645,7 +553,7 @@ parse_stabn(struct prog_info *pi, char *p)
 {
 
 	int ok = True;
-	int TypeCode, Level;
+	int TypeCode, Level, n1, n2, n3, n4;
 	char *p1, *p2, *p3, *p4, *pLabel, *pFunction;
 
 	/* stabn debugging information is in the form:
@@ -659,28 +567,37 @@ parse_stabn(struct prog_info *pi, char *p)
 	N_SLINE	0x44		src line: 0,,0,linenumber,address
 	*/
 
-	if (!GET_ARG_I(pi->args, ARG_COFF) || (pi->pass == PASS_1))
+	if (!GET_ARG_I(pi->args, ARG_COFF) || (pi->pass == PASS_1) || pi->layout)
 		return (True);
 
-	/* Parse the tokens in the stabn line buffer */
-	p1 = get_next_token(p, TERM_SPACE);
-	p2 = get_next_token(p1, TERM_COMMA);
-	p3 = get_next_token(p2, TERM_COMMA);
-	p4 = get_next_token(p3, TERM_COMMA);
-	get_next_token(p4, TERM_END);  /* zap CR LF, make ASCIIZ */
-
-	if (!p1 || !p2 || !p3 || !p4)
+	/* Parse the fields without changing the line, which is listed later */
+	for (p += 6; IS_HOR_SPACE(*p); p++);
+	p = stab_field(p, &p1, &n1);		/* type */
+	p = stab_field(p, &p2, &n2);		/* other */
+	p = stab_field(p, &p3, &n3);		/* desc */
+	if (!p)
 		return (False);
+	stab_field(p, &p4, &n4);		/* value */
 
 	/* first convert TypeCode to binary */
 	if (*p1 == '0')
-		TypeCode = atox(p1);    /* presume to be hex 0x */
+		TypeCode = atox_n(p1, n1);    /* presume to be hex 0x */
 	else
 		TypeCode = atoi(p1);
 
 	Level = atoi(p3);   /* line number or level */
-	pLabel = p4;                /* Assembly label */
-	pFunction = get_next_token(pLabel, TERM_DASH);   /* Function */
+	/* Assembly label - Function */
+	if (!(pLabel = (char *)AppendArrayObject(&ci->SplitLine, n4 + 1, 1))) {
+		print_msg(pi, MSGTYPE_OUT_OF_MEM, NULL);
+		return (False);
+	}
+	memcpy(pLabel, p4, n4);
+	pLabel[n4] = '\0';
+	for (pFunction = pLabel; *pFunction && (*pFunction != '-'); pFunction++);
+	if (*pFunction)
+		*pFunction++ = '\0';
+	else
+		pFunction = 0;
 
 	switch (TypeCode) {
 	case N_SLINE:           /* src line: 0,,0,linenumber,address */
@@ -699,6 +616,7 @@ parse_stabn(struct prog_info *pi, char *p)
 		fprintf(stderr, "\nUnknown .stabn TypeCode = 0x%x", TypeCode);
 		ok = False;
 	}
+	EmptyArray(&ci->SplitLine);
 	return (ok);
 }
 
@@ -706,13 +624,13 @@ int
 stab_add_lineno(struct prog_info *pi, int LineNumber, char *pLabel, char *pFunction)
 {
 
-	int Address;
+	int i, Address;
 	struct lineno *pln;
 	struct syment *pEntry;
 	union auxent *pAux;
 
 	/* Allocate LineNumber Table entry and fill it in */
-	pln = (struct lineno *)AllocateListObject(&ci->ListOfLineNumbers, sizeof(struct lineno));
+	pln = (struct lineno *)AppendArrayObject(&ci->LineNumbers, sizeof(struct lineno), 1);
 	if (!pln) {
 		fprintf(stderr, "\nOut of memory allocating lineno table for function %s", pFunction);
 		return (False);
@@ -733,9 +651,8 @@ stab_add_lineno(struct prog_info *pi, int LineNumber, char *pLabel, char *pFunct
 	ci->CurrentSourceLine = LineNumber; /* keep track of source line for .eb .ef arrays */
 	if (ci->NeedLineNumberFixup) {
 		/* need to go into symbol table and fix last NeedLineNumberFixup entries */
-		for (pEntry = (struct syment *)FindLastListObject(&ci->ListOfSymbols);
-		        (pEntry != 0) && (ci->NeedLineNumberFixup != 0);
-		        pEntry = (struct syment *)FindNextLastListObject(&ci->ListOfSymbols)) {
+		for (i = ci->Symbols.Count - 1; (i >= 0) && (ci->NeedLineNumberFixup != 0); i--) {
+			pEntry = (struct syment *)GetArrayObject(&ci->Symbols, i);
 
 			/* Fix up line number entries */
 			if ((pEntry->n_sclass == C_FCN) || (pEntry->n_sclass == C_BLOCK) || (pEntry->n_sclass == C_EXT)) {
@@ -764,7 +681,7 @@ stab_add_lbracket(struct prog_info *pi, int Level, char *pLabel, char *pFunction
 	}
 
 	/* Now create a .bb symbol table entry and aux entry too */
-	pEntry = (struct syment *)AllocateTwoListObjects(&ci->ListOfSymbols,  sizeof(struct syment) * 2);
+	pEntry = (struct syment *)AppendArrayObject(&ci->Symbols, sizeof(struct syment) * 2, 2);
 	if (!pEntry) {
 		fprintf(stderr, "\nOut of memory allocating symbol table entry for .bb %s", pLabel);
 		return (False);
@@ -800,7 +717,7 @@ stab_add_rbracket(struct prog_info *pi, int Level, char *pLabel, char *pFunction
 	}
 
 	/* Now create a .eb symbol table entry */
-	pEntry = (struct syment *)AllocateTwoListObjects(&ci->ListOfSymbols,  sizeof(struct syment) * 2);
+	pEntry = (struct syment *)AppendArrayObject(&ci->Symbols, sizeof(struct syment) * 2, 2);
 	if (!pEntry) {
 		fprintf(stderr, "\nOut of memory allocating symbol table entry for .eb %s", pLabel);
 		return (False);
@@ -821,7 +738,7 @@ stab_add_rbracket(struct prog_info *pi, int Level, char *pLabel, char *pFunction
 	if (Level == 0) {
 
 		/* Now create a .ef symbol table entry */
-		pEntry = (struct syment *)AllocateTwoListObjects(&ci->ListOfSymbols,  sizeof(struct syment) * 2);
+		pEntry = (struct syment *)AppendArrayObject(&ci->Symbols, sizeof(struct syment) * 2, 2);
 		if (!pEntry) {
 			fprintf(stderr, "\nOut of memory allocating symbol table entry for .ef %s", pLabel);
 			return (False);
@@ -848,7 +765,6 @@ stab_add_filename(char *pName, char *pLabel)
 	int ok, n;
 	struct syment *pEntry;
 	union auxent *pAux;
-	char *p;
 
 	/* if( pLabel == "Ltext0" ) then beginning of .text, pName = cwd, next pName = file */
 
@@ -865,8 +781,7 @@ stab_add_filename(char *pName, char *pLabel)
 
 
 	/* allocate entry in symbol table list */
-	pEntry = (struct syment *)AllocateTwoListObjects(
-	             &ci->ListOfSymbols,  sizeof(struct syment) * 2);  /* aux entry too */
+	pEntry = (struct syment *)AppendArrayObject(&ci->Symbols, sizeof(struct syment) * 2, 2);  /* aux entry too */
 	if (!pEntry) {
 		fprintf(stderr, "\nOut of memory allocating symbol table entry for global %s", pName);
 		return (False);
@@ -890,15 +805,12 @@ stab_add_filename(char *pName, char *pLabel)
 		memcpy(pAux->x_file.x_fname, pName, n);   /* might not be zero terminated */
 	} else {
 		pAux->x_file.x_n.x_zeroes = 0;  /* symbol name is in string table */
-		pAux->x_file.x_n.x_offset = ci->ListOfStrings.TotalBytes;
 
 		/* add to string table */
-		p = (char *)AllocateListObject(&ci->ListOfStrings,  n + 1);
-		if (!p) {
+		if ((pAux->x_file.x_n.x_offset = AddString(pName)) == 0) {
 			fprintf(stderr, "\nOut of memory allocating string table space!");
 			return (False);
 		}
-		strcpy(p, pName);
 	}
 	return (ok);
 }
@@ -922,8 +834,8 @@ stab_add_function(struct prog_info *pi, char *pName, char *pLabel)
 		return (False);
 	}
 	/* Get Current Symbol Index, Allocate Symbol Table entry and fill it in */
-	SymbolIndex = ci->ListOfSymbols.TotalItems;
-	pEntry = (struct syment *)AllocateTwoListObjects(&ci->ListOfSymbols, sizeof(struct syment) * 2);
+	SymbolIndex = ci->Symbols.TotalItems;
+	pEntry = (struct syment *)AppendArrayObject(&ci->Symbols, sizeof(struct syment) * 2, 2);
 	if (!pEntry) {
 		fprintf(stderr, "\nOut of memory allocating symbol table entry for function %s", pName);
 		return (False);
@@ -948,12 +860,12 @@ stab_add_function(struct prog_info *pi, char *pName, char *pLabel)
 	pAux = (union auxent *)pEntry;
 	pAux->x_sym.x_tagndx = SymbolIndex + 1; /* point to the .bf entry index */
 	pAux->x_sym.x_misc.x_fsize = 0; /* unknown till end */
-	pAux->x_sym.x_fcnary.x_fcn.x_lnnoptr = ci->ListOfLineNumbers.TotalBytes; /* relative offset to line number entry */
+	pAux->x_sym.x_fcnary.x_fcn.x_lnnoptr = ci->LineNumbers.TotalBytes; /* relative offset to line number entry */
 	pAux->x_sym.x_fcnary.x_fcn.x_endndx = 0; /* index to next entry */
 
 	/* Now add function entry into the line number table */
 	/* Allocate Symbol Table entry and fill it in */
-	pln = (struct lineno *)AllocateListObject(&ci->ListOfLineNumbers, sizeof(struct lineno));
+	pln = (struct lineno *)AppendArrayObject(&ci->LineNumbers, sizeof(struct lineno), 1);
 	if (!pln) {
 		fprintf(stderr, "\nOut of memory allocating lineno table for function %s", pName);
 		return (False);
@@ -965,7 +877,7 @@ stab_add_function(struct prog_info *pi, char *pName, char *pLabel)
 	ci->FunctionStartLine = 0;
 
 	/* Allocate Symbol Table entry and fill it in */
-	pEntry = (struct syment *)AllocateTwoListObjects(&ci->ListOfSymbols, sizeof(struct syment) * 2);
+	pEntry = (struct syment *)AppendArrayObject(&ci->Symbols, sizeof(struct syment) * 2, 2);
 	if (!pEntry) {
 		fprintf(stderr, "\nOut of memory allocating symbol table entry .bf for function %s", pName);
 		return (False);
@@ -1004,16 +916,16 @@ stab_add_global(struct prog_info *pi, char *pName, char *pType)
 		fprintf(stderr, "\nUnrecognized type found for global %s = %d", pName, Type);
 		return (False);
 	}
-	pMap = (STABCOFFMAP *)GetCurrentListObject(&ci->ListOfTypes);
+	pMap = FindStabType(Type);
 
-	SymbolIndex = ci->ListOfSymbols.TotalItems;
+	SymbolIndex = ci->Symbols.TotalItems;
 	/* Allocate Symbol Table entry and fill it in, Auxiliary table if its an array */
 	if (IsTypeArray(CoffType) == True) {
 		IsArray = True;
-		pEntry = (struct syment *)AllocateTwoListObjects(&ci->ListOfGlobals, sizeof(struct syment) * 2);
+		pEntry = (struct syment *)AppendArrayObject(&ci->Globals, sizeof(struct syment) * 2, 2);
 	} else {
 		IsArray = False;
-		pEntry = (struct syment *)AllocateListObject(&ci->ListOfGlobals, sizeof(struct syment));
+		pEntry = (struct syment *)AppendArrayObject(&ci->Globals, sizeof(struct syment), 1);
 	}
 	if ((n = AddNameToEntry(pName, pEntry)) == 0) {
 		fprintf(stderr,"\nOut of memory adding local %s to string table", pName);
@@ -1070,15 +982,15 @@ stab_add_local(struct prog_info *pi, char *pName, char *pType, char *pOffset)
 		fprintf(stderr, "\nUnrecognized type found for local %s = %d", pName, Type);
 		return (False);
 	}
-	pMap = (STABCOFFMAP *)GetCurrentListObject(&ci->ListOfTypes);
-	SymbolIndex = ci->ListOfSymbols.TotalItems;
+	pMap = FindStabType(Type);
+	SymbolIndex = ci->Symbols.TotalItems;
 	/* Allocate Symbol Table entry and fill it in, Auxiliary table if its an array */
 	if (IsTypeArray(CoffType) == True) {
 		IsArray = True;
-		pEntry = (struct syment *)AllocateTwoListObjects(&ci->ListOfGlobals, sizeof(struct syment) * 2);
+		pEntry = (struct syment *)AppendArrayObject(&ci->Globals, sizeof(struct syment) * 2, 2);
 	} else {
 		IsArray = False;
-		pEntry = (struct syment *)AllocateListObject(&ci->ListOfSymbols, sizeof(struct syment));
+		pEntry = (struct syment *)AppendArrayObject(&ci->Symbols, sizeof(struct syment), 1);
 	}
 	if ((n = AddNameToEntry(pName, pEntry)) == 0) {
 		fprintf(stderr,"\nOut of memory adding local %s to string table", pName);
@@ -1113,7 +1025,7 @@ stab_add_parameter_symbol(struct prog_info *pi, char *pName, char *pType, char *
 		return (False);
 	}
 	/* Allocate Symbol Table entry and fill it in */
-	pEntry = (struct syment *)AllocateListObject(&ci->ListOfSymbols, sizeof(struct syment));
+	pEntry = (struct syment *)AppendArrayObject(&ci->Symbols, sizeof(struct syment), 1);
 	if ((n = AddNameToEntry(pName, pEntry)) == 0) {
 		fprintf(stderr,"\nOut of memory adding local %s to string table", pName);
 	}
@@ -1140,7 +1052,7 @@ stab_add_static_symbol(struct prog_info *pi, char *pName, char *pType, char *pLa
 		return (False);
 	}
 	/* Allocate Symbol Table entry and fill it in */
-	pEntry = (struct syment *)AllocateListObject(&ci->ListOfSymbols, sizeof(struct syment));
+	pEntry = (struct syment *)AppendArrayObject(&ci->Symbols, sizeof(struct syment), 1);
 	if ((n = AddNameToEntry(pName, pEntry)) == 0) {
 		fprintf(stderr,"\nOut of memory adding local %s to string table", pName);
 	}
@@ -1173,7 +1085,7 @@ stab_add_local_register(struct prog_info *pi, char *pName, char *pType, char *pR
 	}
 	Size = GetCoffTypeSize(Type);   /* Silly requirement for avr studio */
 	/* Allocate Symbol Table entry and fill it in */
-	pEntry = (struct syment *)AllocateListObject(&ci->ListOfSymbols, sizeof(struct syment));
+	pEntry = (struct syment *)AppendArrayObject(&ci->Symbols, sizeof(struct syment), 1);
 	if ((n = AddNameToEntry(pName, pEntry)) == 0) {
 		fprintf(stderr,"\nOut of memory adding local %s to string table", pName);
 		return (False);
@@ -1372,11 +1284,10 @@ GetStabType(char *p, unsigned short *pType, char **pEnd)
 	p++;
 
 	/* Allocate space for new internal type */
-	if (!(pMap = (STABCOFFMAP *)AllocateListObject(&ci->ListOfTypes, sizeof(STABCOFFMAP)))) {
+	if (!(pMap = AllocateStabType(LStabType))) {
 		fprintf(stderr, "\nOut of memory allocating type info!");
 		return (False);
 	}
-	pMap->StabType = LStabType;
 
 	/* process items to right of equals */
 	for (extra = 0; extra < 6; extra++) {
@@ -1463,8 +1374,8 @@ stab_add_tag_type(char *pName, char *pString)
 		fprintf(stderr,"\nInvalid .stabs type format - no equals - > %s", p);
 		return (False);
 	}
-	SymbolIndex = ci->ListOfSymbols.TotalItems;
-	if ((pEntry = (struct syment *)AllocateTwoListObjects(&ci->ListOfGlobals, sizeof(struct syment) * 2)) == 0) {
+	SymbolIndex = ci->Symbols.TotalItems;
+	if ((pEntry = (struct syment *)AppendArrayObject(&ci->Globals, sizeof(struct syment) * 2, 2)) == 0) {
 		fprintf(stderr, "\nOut of memory allocating symbol tag entries");
 		return (False);
 	}
@@ -1473,11 +1384,10 @@ stab_add_tag_type(char *pName, char *pString)
 		fprintf(stderr,"\nOut of memory adding local %s to string table", pString);
 		return (False);
 	}
-	if (!(pMap = (STABCOFFMAP *)AllocateListObject(&ci->ListOfTypes, sizeof(STABCOFFMAP)))) {
+	if (!(pMap = AllocateStabType(StabType))) {
 		fprintf(stderr, "\nOut of memory allocating type info!");
 		return (False);
 	}
-	pMap->StabType = StabType;
 	pEntry->n_value = 0;
 	pEntry->n_scnum = N_DEBUG;
 	pEntry->n_numaux = 1;
@@ -1511,7 +1421,7 @@ stab_add_tag_type(char *pName, char *pString)
 	/* Process the items until the end of the line */
 	while (*pName) {
 
-		if ((pEntry = (struct syment *)AllocateTwoListObjects(&ci->ListOfGlobals, sizeof(struct syment) * 2)) == 0) {
+		if ((pEntry = (struct syment *)AppendArrayObject(&ci->Globals, sizeof(struct syment) * 2, 2)) == 0) {
 			fprintf(stderr, "\nOut of memory allocating symbol tag member entries");
 			return (False);
 		}
@@ -1554,7 +1464,7 @@ stab_add_tag_type(char *pName, char *pString)
 	}
 
 	/* End of Structures/Unions/Enumberations */
-	if ((pEntry = (struct syment *)AllocateTwoListObjects(&ci->ListOfGlobals, sizeof(struct syment) * 2)) == 0) {
+	if ((pEntry = (struct syment *)AppendArrayObject(&ci->Globals, sizeof(struct syment) * 2, 2)) == 0) {
 		fprintf(stderr, "\nOut of memory allocating special headers for structure!");
 		return (False);
 	}
@@ -1760,19 +1670,49 @@ GetSubRangeType(unsigned short Type, STABCOFFMAP *pMap, char *pLow, char *pHigh)
 	return (True);
 }
 
+STABCOFFMAP *
+FindStabType(unsigned short StabType)
+{
+
+	if (StabType >= ci->TypeCount)
+		return (0);
+	return (ci->pTypes[StabType]);
+}
+
+/* Type StabType, cleared. A type defined again starts over */
+STABCOFFMAP *
+AllocateStabType(unsigned short StabType)
+{
+
+	STABCOFFMAP **pTypes;
+	int n;
+
+	if (StabType >= ci->TypeCount) {
+		for (n = ci->TypeCount ? ci->TypeCount : 64; n <= StabType; n *= 2);
+		if ((pTypes = realloc(ci->pTypes, n * sizeof(STABCOFFMAP *))) == 0)
+			return (0);
+		memset(&pTypes[ci->TypeCount], 0, (n - ci->TypeCount) * sizeof(STABCOFFMAP *));
+		ci->pTypes = pTypes;
+		ci->TypeCount = n;
+	}
+	if (!ci->pTypes[StabType] && !(ci->pTypes[StabType] = malloc(sizeof(STABCOFFMAP))))
+		return (0);
+	memset(ci->pTypes[StabType], 0, sizeof(STABCOFFMAP));
+	ci->pTypes[StabType]->StabType = StabType;
+	return (ci->pTypes[StabType]);
+}
+
 int
 CopyStabCoffMap(unsigned short StabType, STABCOFFMAP *pMap)
 {
 
 	STABCOFFMAP *p;
 
-	for (p = FindFirstListObject(&ci->ListOfTypes); p != 0; p = FindNextListObject(&ci->ListOfTypes)) {
-		if (p->StabType == StabType) {
-			memcpy(pMap, p, sizeof(STABCOFFMAP));
-			return (True);
-		}
-	}
-	return (False);  /* Nothing found */
+	if ((p = FindStabType(StabType)) == 0)
+		return (False);  /* Nothing found */
+	if (p != pMap)
+		memcpy(pMap, p, sizeof(STABCOFFMAP));
+	return (True);
 }
 
 unsigned short
@@ -1781,10 +1721,8 @@ GetCoffType(unsigned short StabType)
 
 	STABCOFFMAP *p;
 
-	for (p = FindFirstListObject(&ci->ListOfTypes); p != 0; p = FindNextListObject(&ci->ListOfTypes)) {
-		if (p->StabType == StabType)
-			return (p->CoffType);
-	}
+	if ((p = FindStabType(StabType)) != 0)
+		return (p->CoffType);
 	return (0);  /* Nothing found */
 }
 
@@ -1794,10 +1732,8 @@ GetCoffTypeSize(unsigned short StabType)
 
 	STABCOFFMAP *p;
 
-	for (p = FindFirstListObject(&ci->ListOfTypes); p != 0; p = FindNextListObject(&ci->ListOfTypes)) {
-		if (p->StabType == StabType)
-			return (p->ByteSize);
-	}
+	if ((p = FindStabType(StabType)) != 0)
+		return (p->ByteSize);
 	return (0);  /* Nothing found */
 }
 
@@ -1886,23 +1822,61 @@ AddNameToEntry(char *pName, struct syment *pEntry)
 {
 
 	int n;
-	char *p;
 
 	n = strlen(pName);      /* see if it's 8 bytes or less */
 	if (n <= 8) {
 		strncpy(pEntry->n_name, pName, 8);
 	} else {
-		/* point to current offset in string table */
-		pEntry->n_offset = ci->ListOfStrings.TotalBytes;
-		/* Allocate string table entry */
-		if ((p = (char *)AllocateListObject(&ci->ListOfStrings, n + 1)) == 0) {
+		/* point to the offset in string table */
+		if ((pEntry->n_offset = AddString(pName)) == 0)
 			return (0);
-		}
-		strcpy(p, pName);
 	}
 	return (n); /* return size of string */
 }
 
+/* Offset of pName in the string table, added unless it is there already.
+ * Returns 0 if out of memory. */
+int
+AddString(char *pName)
+{
+
+	int i, n, *pHash;
+	unsigned int Hash;
+	char *p;
+
+	/* Keep the table at most half full */
+	if (ci->StringCount * 2 >= ci->StringHashSize) {
+		n = ci->StringHashSize ? ci->StringHashSize * 2 : 256;
+		if ((pHash = calloc(n, sizeof(int))) == 0)
+			return (0);
+		for (i = 0; i < ci->StringHashSize; i++) {
+			if (ci->pStringHash[i] == 0)
+				continue;
+			Hash = nocase_hash((char *)ci->Strings.pData + ci->pStringHash[i] - 1);
+			while (pHash[Hash & (n - 1)])
+				Hash++;
+			pHash[Hash & (n - 1)] = ci->pStringHash[i];
+		}
+		free(ci->pStringHash);
+		ci->pStringHash = pHash;
+		ci->StringHashSize = n;
+	}
+	/* Strings differing in case only share a chain */
+	for (Hash = nocase_hash(pName); ci->pStringHash[Hash & (ci->StringHashSize - 1)]; Hash++) {
+		i = ci->pStringHash[Hash & (ci->StringHashSize - 1)] - 1;
+		if (!strcmp((char *)ci->Strings.pData + i, pName))
+			return (i);
+	}
+	n = strlen(pName);
+	i = ci->Strings.TotalBytes;
+	if ((p = (char *)AppendArrayObject(&ci->Strings, n + 1, 1)) == 0)
+		return (0);
+	strcpy(p, pName);
+	ci->pStringHash[Hash & (ci->StringHashSize - 1)] = i + 1;
+	ci->StringCount++;
+	return (i);
+}
+
 char *
 SkipPastDigits(char *p)
 {
@@ -1915,179 +1889,140 @@ SkipPastDigits(char *p)
 	return (p);
 }
 
-void
-InitializeList(LISTNODEHEAD *pHead)
-{
-
-	pHead->Node.Next = &pHead->Node;
-	pHead->Node.Last = &pHead->Node;
-	pHead->TotalBytes = 0;
-	pHead->TotalItems = 0;
-	pHead->current = &pHead->Node;
-	return;
-}
-
+/* Room for an object of size bytes, zeroed, counting as items symbol
+ * table entries. The pointer is good until the next append. */
 void *
-AllocateTwoListObjects(LISTNODEHEAD *pHead, int size)
+AppendArrayObject(COFFARRAY *pArray, int size, int items)
 {
 
-	void *p;
-
-	if ((p = AllocateListObject(pHead, size)))
-		pHead->TotalItems++;   /* already incremented once in addtolist */
-	return (p);
-}
-
-void *
-AllocateListObject(LISTNODEHEAD *pHead, int size)
-{
+	unsigned char *pData;
+	int *pOffset, n;
 
-	void *pObject;
-
-	LISTNODE *pNode;
-
-	if ((pObject = calloc(1, size)) != 0) {
-		if (!(pNode = AddListObject(pHead, pObject, size))) {
-			free(pObject);
-			pObject = 0;
-		}
-	}
-	return (pObject);
-}
-
-LISTNODE  *
-AddListObject(LISTNODEHEAD *pHead, void *pObject, int size)
-{
-
-	LISTNODE *pNode;
-
-	if ((pNode = calloc(1, sizeof(LISTNODE))) != 0) {
-		pNode->pObject = pObject;
-		pNode->Size = size;
-		pNode->FileNumber = ci->CurrentFileNumber;
-		AddNodeToList(pHead, pNode);
-	}
-	return (pNode);
-}
-
-LISTNODE *
-AllocateListNode(void *pObject, int size)
-{
-
-	LISTNODE *pNew;
-
-	if ((pNew = calloc(1, sizeof(LISTNODE))) != 0) {
-		/* Then we initialize the node */
-		pNew->pObject = pObject;
-		pNew->Size = size;
-		pNew->FileNumber = ci->CurrentFileNumber;
+	if (pArray->TotalBytes + size > pArray->AllocBytes) {
+		for (n = pArray->AllocBytes ? pArray->AllocBytes : 256; n < pArray->TotalBytes + size; n *= 2);
+		if ((pData = realloc(pArray->pData, n)) == 0)
+			return (0);
+		pArray->pData = pData;
+		pArray->AllocBytes = n;
 	}
-	return (pNew);
-}
-
-void
-AddNodeToList(LISTNODEHEAD *pHead, LISTNODE *pNode)
-{
-
-	LISTNODE *p;
-
-	p = &pHead->Node;
-
-	pNode->Next = p->Last->Next;
-	p->Last->Next = pNode;
-	pNode->Last = p->Last;
-	p->Last = pNode;
-
-	/* and update current size of data contained in the list */
-	pHead->TotalBytes += pNode->Size;
-	pHead->TotalItems++;
+	if (pArray->Count == pArray->AllocCount) {
+		n = pArray->AllocCount ? pArray->AllocCount * 2 : 64;
+		if ((pOffset = realloc(pArray->pOffset, n * sizeof(int))) == 0)
+			return (0);
+		pArray->pOffset = pOffset;
+		pArray->AllocCount = n;
+	}
+	pData = pArray->pData + pArray->TotalBytes;
+	memset(pData, 0, size);
+	pArray->pOffset[pArray->Count++] = pArray->TotalBytes;
+	pArray->TotalBytes += size;
+	pArray->TotalItems += items;
+	return (pData);
 }
 
-void
-RemoveNodeFromList(LISTNODEHEAD *pHead, LISTNODE *pNode)
+/* Write the objects back to back, True if all went out */
+int
+WriteArray(COFFARRAY *pArray, FILE *fp)
 {
 
-	pNode->Last->Next = pNode->Next;
-	pNode->Next->Last = pNode->Last;
-
-	pHead->TotalBytes -= pNode->Size;
-	pHead->TotalItems--;
+	if (pArray->TotalBytes == 0)
+		return (True);
+	return (fwrite(pArray->pData, 1, pArray->TotalBytes, fp) == (size_t)pArray->TotalBytes);
 }
 
 void *
-FindFirstListObject(LISTNODEHEAD *pHead)
+GetArrayObject(COFFARRAY *pArray, int index)
 {
 
-	if (pHead->Node.Next == &pHead->Node)
-		return (0); /* Nothing in list */
-
-	pHead->current = pHead->Node.Next;
-	return (pHead->current->pObject);
+	return (pArray->pData + pArray->pOffset[index]);
 }
 
-void *
-FindNextListObject(LISTNODEHEAD *pHead)
+int
+GetArrayObjectSize(COFFARRAY *pArray, int index)
 {
 
-	if (pHead->current->Next == &pHead->Node)
-		return (0);
-
-	pHead->current = pHead->current->Next;
-
-	return (pHead->current->pObject);
+	if (index + 1 < pArray->Count)
+		return (pArray->pOffset[index + 1] - pArray->pOffset[index]);
+	return (pArray->TotalBytes - pArray->pOffset[index]);
 }
 
-LISTNODE *
-GetCurrentNode(LISTNODEHEAD *pHead)
+/* Remove all objects, keep the memory */
+void
+EmptyArray(COFFARRAY *pArray)
 {
 
-	return (pHead->current);
+	pArray->TotalBytes = 0;
+	pArray->TotalItems = 0;
+	pArray->Count = 0;
 }
 
-void *
-GetCurrentListObject(LISTNODEHEAD *pHead)
+void
+FreeArray(COFFARRAY *pArray)
 {
 
-	return (pHead->current->pObject);
+	free(pArray->pData);
+	free(pArray->pOffset);
+	memset(pArray, 0, sizeof(COFFARRAY));
 }
 
-void *
-FindLastListObject(LISTNODEHEAD *pHead)
+/* Store count bytes, allocating their pages erased to 0xff. False if out of
+ * memory */
+int
+SetImageBytes(PAGEDIMAGE *pImage, int address, const unsigned char *data, int count)
 {
 
-	if (pHead->Node.Last == &pHead->Node)
-		return (0); /* Nothing in list */
+	unsigned char **pPages, *pPage;
+	int page, n, offset;
 
-	pHead->current = pHead->Node.Last;
-	return (pHead->current->pObject);
+	for (; count > 0; address += n, data += n, count -= n) {
+		page = address / COFF_PAGE_SIZE;
+		offset = address % COFF_PAGE_SIZE;
+		if (page >= pImage->PageCount) {
+			for (n = pImage->PageCount ? pImage->PageCount : 16; n <= page; n *= 2);
+			if ((pPages = realloc(pImage->pPages, n * sizeof(unsigned char *))) == 0)
+				return (False);
+			memset(&pPages[pImage->PageCount], 0, (n - pImage->PageCount) * sizeof(unsigned char *));
+			pImage->pPages = pPages;
+			pImage->PageCount = n;
+		}
+		if ((pPage = pImage->pPages[page]) == 0) {
+			if ((pPage = malloc(COFF_PAGE_SIZE)) == 0)
+				return (False);
+			memset(pPage, 0xff, COFF_PAGE_SIZE);
+			pImage->pPages[page] = pPage;
+		}
+		n = COFF_PAGE_SIZE - offset;
+		if (n > count)
+			n = count;
+		memcpy(&pPage[offset], data, n);
+	}
+	return (True);
 }
 
-void *
-FindNextLastListObject(LISTNODEHEAD *pHead)
+/* Write the first length bytes, pages never written as 0xff */
+int
+WriteImage(PAGEDIMAGE *pImage, int length, FILE *fp)
 {
 
-	if (pHead->current->Last == &pHead->Node)
-		return (0);
-
-	pHead->current = pHead->current->Last;
+	static unsigned char Erased[COFF_PAGE_SIZE];
+	int page, n;
 
-	return (pHead->current->pObject);
+	memset(Erased, 0xff, COFF_PAGE_SIZE);
+	for (page = 0; length > 0; page++, length -= n) {
+		n = (length < COFF_PAGE_SIZE) ? length : COFF_PAGE_SIZE;
+		if (fwrite(((page < pImage->PageCount) && pImage->pPages[page]) ? pImage->pPages[page] : Erased,
+		           1, n, fp) != (size_t)n)
+			return (False);
+	}
+	return (True);
 }
 
 void
-FreeList(LISTNODEHEAD *pHead)
+FreeImage(PAGEDIMAGE *pImage)
 {
 
-	LISTNODE *pNode;
-
-	for (pNode = pHead->Node.Last; pNode->Next != &pHead->Node; pNode = pHead->Node.Last) {
-
-		RemoveNodeFromList(pHead, pNode);
-		free(pNode->pObject);
-		free(pNode);
-	}
-	pHead->TotalBytes = 0;
-	pHead->TotalItems = 0;
-	pHead->current = &pHead->Node;
+	while (pImage->PageCount)
+		free(pImage->pPages[--pImage->PageCount]);
+	free(pImage->pPages);
+	pImage->pPages = 0;
 }
-
@@ -73,9 +73,9 @@
 struct external_filehdr {
 	unsigned short f_magic;		/* magic number			*/
 	unsigned short f_nscns;		/* number of sections		*/
-	unsigned long f_timdat;	/* time & date stamp		*/
-	unsigned long f_symptr;	/* file pointer to symtab	*/
-	unsigned long f_nsyms;		/* number of symtab entries	*/
+	unsigned int f_timdat;	/* time & date stamp		*/
+	unsigned int f_symptr;	/* file pointer to symtab	*/
+	unsigned int f_nsyms;		/* number of symtab entries	*/
 	unsigned short f_opthdr;	/* sizeof(optional hdr)		*/
 	unsigned short f_flags;		/* flags			*/
 };
@@ -94,15 +94,15 @@ struct external_filehdr {
 
 struct external_scnhdr {
 	char		s_name[8];	/* section name			*/
-	unsigned long		s_paddr;	/* physical address, aliased s_nlib */
-	unsigned long		s_vaddr;	/* virtual address		*/
-	unsigned long		s_size;		/* section size			*/
-	unsigned long		s_scnptr;	/* file ptr to raw data for section */
-	unsigned long		s_relptr;	/* file ptr to relocation	*/
-	unsigned long		s_lnnoptr;	/* file ptr to line numbers	*/
+	unsigned int		s_paddr;	/* physical address, aliased s_nlib */
+	unsigned int		s_vaddr;	/* virtual address		*/
+	unsigned int		s_size;		/* section size			*/
+	unsigned int		s_scnptr;	/* file ptr to raw data for section */
+	unsigned int		s_relptr;	/* file ptr to relocation	*/
+	unsigned int		s_lnnoptr;	/* file ptr to line numbers	*/
 	unsigned short		s_nreloc;	/* number of relocation entries	*/
 	unsigned short		s_nlnno;	/* number of line number entries*/
-	unsigned long		s_flags;	/* flags			*/
+	unsigned int		s_flags;	/* flags			*/
 };
 
 #define	SCNHDR	struct external_scnhdr
@@ -123,8 +123,8 @@ struct external_scnhdr {
 
 struct lineno {
 	union {
-		long  l_symndx;  /* symtbl index of func name */
-		long  l_paddr;   /* paddr of line number */
+		int  l_symndx;  /* symtbl index of func name */
+		int  l_paddr;   /* paddr of line number */
 	} l_addr;
 	unsigned short  l_lnno;    /* line number */
 };
@@ -179,13 +179,12 @@ struct syment {
 	union {
 		char          _n_name[E_SYMNMLEN];  /* symbol name*/
 		struct {
-			long    _n_zeroes;          /* symbol name */
+			int    _n_zeroes;          /* symbol name */
 
-			long    _n_offset;          /* location in string table */
+			int    _n_offset;          /* location in string table */
 		} _n_n;
-		char          *_n_nptr[2];        /* allows overlaying */
 	} _n;
-	unsigned long     n_value;            /* value of symbol */
+	unsigned int     n_value;            /* value of symbol */
 
 	short             n_scnum;            /* section number */
 
@@ -199,25 +198,24 @@ struct syment {
 #define  n_name          _n._n_name
 #define  n_zeroes        _n._n_n._n_zeroes
 #define  n_offset        _n._n_n._n_offset
-#define  n_nptr          _n._n_nptr[1]
 
 #define  SYMNMLEN  8
 #define  SYMESZ    18                    /* size of a symbol table entry */
 
 union auxent {
 	struct {
-		long   x_tagndx;
+		int   x_tagndx;
 		union {
 			struct {
 				unsigned short   x_lnno;
 				unsigned short   x_size;
 			} x_lnsz;
-			long    x_fsize;
+			int    x_fsize;
 		} x_misc;
 		union {
 			struct {
-				long    x_lnnoptr;
-				long    x_endndx;
+				int    x_lnnoptr;
+				int    x_endndx;
 			} x_fcn;
 			struct {
 				unsigned short   x_dimen[E_DIMNUM];
@@ -228,17 +226,17 @@ union auxent {
 	union {
 		char   x_fname[E_FILNMLEN];
 		struct {
-			unsigned long x_zeroes;
-			unsigned long x_offset;
+			unsigned int x_zeroes;
+			unsigned int x_offset;
 		} x_n;
 	} x_file;
 	struct {
-		long   x_scnlen;
+		int   x_scnlen;
 		unsigned short   x_nreloc;
 		unsigned short   x_nlinno;
 	} x_scn;
 	struct {
-		long   x_tvfill;
+		int   x_tvfill;
 		unsigned short   x_tvlen;
 		unsigned short   x_tvran[2];
 	} x_tv;
@@ -251,20 +249,23 @@ union auxent {
 
 
 /* Coff additions */
-typedef struct ListNodeTag {
-	struct ListNodeTag *Next;	/* Double Linked List */
-	struct ListNodeTag *Last;	/* Double Linked List */
-	void *pObject;	/* points to list object */
-	unsigned long Size;
-	int FileNumber;		/* corresponds to individual file(s) */
-} LISTNODE;
-
-typedef struct ListNodeHeadTag {
-	LISTNODE Node;
+typedef struct {
+	unsigned char *pData;	/* objects, back to back */
 	int TotalBytes;	/* size of allocated object(s) */
-	int TotalItems; /* number of allocated objects */
-	LISTNODE *current;	/* pointer for FindFirst/FindNext */
-} LISTNODEHEAD ;
+	int AllocBytes;
+	int TotalItems; /* number of entries, aux entries included */
+	int *pOffset;	/* start of each object in pData */
+	int Count;	/* number of objects */
+	int AllocCount;
+} COFFARRAY;
+
+/* Flash or EEPROM contents, pages allocated on first write */
+#define COFF_PAGE_SIZE 256
+
+typedef struct {
+	unsigned char **pPages;	/* NULL for pages never written, erased */
+	int PageCount;		/* entries in pPages */
+} PAGEDIMAGE;
 
 
 typedef struct  {
@@ -277,32 +278,32 @@ typedef struct  {
 
 struct coff_info {
 
-	int CurrentFileNumber;
 	int FunctionStartLine;	/* used in Line number table */
 	int CurrentSourceLine;
 
 	/* Internal */
-	unsigned char *pRomMemory;	/* 16 bit wide words/addresses */
-	unsigned char *pEEPRomMemory;	/* 8 bit wide words/addresses */
+	PAGEDIMAGE RomMemory;		/* 16 bit wide words/addresses */
+	PAGEDIMAGE EEPRomMemory;	/* 8 bit wide words/addresses */
 	int MaxRomAddress;
 	int MaxEepromAddress;
 	int NeedLineNumberFixup;
 	int GlobalStartAddress;
 	int GlobalEndAddress;
-	LISTNODEHEAD ListOfSplitLines;
+	COFFARRAY SplitLine;		/* continued .stabs string so far */
+	STABCOFFMAP **pTypes;		/* indexed by stab type number */
+	int TypeCount;
+	int *pStringHash;		/* offsets + 1 into Strings, 0 is free */
+	int StringHashSize;		/* power of two */
+	int StringCount;
 
 	/* External */
 	struct external_filehdr FileHeader;		/* Only one of these per output file */
-	LISTNODEHEAD ListOfSectionHeaders;	/* .text, .bss */
-	LISTNODEHEAD ListOfRawData;			/* Program, EEPROM */
-	LISTNODEHEAD ListOfRelocations;		/* Not used now */
-	LISTNODEHEAD ListOfLineNumbers;
-	LISTNODEHEAD ListOfSymbols;
-	LISTNODEHEAD ListOfGlobals;
-	LISTNODEHEAD ListOfSpecials;
-	LISTNODEHEAD ListOfUndefined;
-	LISTNODEHEAD ListOfStrings;
-	LISTNODEHEAD ListOfTypes;
+	struct external_scnhdr SectionHeaders[2];	/* .text, .bss */
+	COFFARRAY LineNumbers;
+	COFFARRAY Symbols;
+	COFFARRAY Globals;
+	COFFARRAY Specials;
+	COFFARRAY Strings;
 };
 
 /* Internal routines */
@@ -320,6 +321,9 @@ int stab_add_local_type(char *pString, char *pType);
 int stab_add_tag_type(char *pName, char *pDesciptor);
 
 int GetStabType(char *p, unsigned short *pType, char **pEnd);
+STABCOFFMAP *FindStabType(unsigned short StabType);
+STABCOFFMAP *AllocateStabType(unsigned short StabType);
+int AddString(char *pName);
 int AddNameToEntry(char *pName, struct syment *pEntry);
 int GetArrayType(char *p, char **pEnd, STABCOFFMAP *pMap, unsigned short *DerivedBits, int ExtraLevels);
 int GetEnumTagItem(char *p, char **pEnd, char **pEnumName, int *pEnumValue);
@@ -337,19 +341,14 @@ int GetSubRangeType(unsigned short Type, STABCOFFMAP *pMap, char *pLow, char *pH
 char *SkipPastDigits(char *p);
 int GetDigitLength(char *p);
 
-/* List management routines */
-
-void InitializeList(LISTNODEHEAD *pNode);
-void *AllocateTwoListObjects(LISTNODEHEAD *pHead, int size);
-void *AllocateListObject(LISTNODEHEAD *pHead, int size);
-LISTNODE *AllocateListNode(void *pObject, int size);
-void AddNodeToList(LISTNODEHEAD *pHead, LISTNODE *pNode);
-void *FindFirstListObject(LISTNODEHEAD *pHead);
-void *FindNextListObject(LISTNODEHEAD *pHead);
-LISTNODE *GetCurrentNode(LISTNODEHEAD *pHead);
-void *GetCurrentListObject(LISTNODEHEAD *pHead);
-void *FindLastListObject(LISTNODEHEAD *pHead);
-void *FindNextLastListObject(LISTNODEHEAD *pHead);
-void FreeList(LISTNODEHEAD *pHead);
-LISTNODE  *AddListObject(LISTNODEHEAD *pHead, void *pObject, int size);
-
+/* Array management routines */
+
+void *AppendArrayObject(COFFARRAY *pArray, int size, int items);
+void *GetArrayObject(COFFARRAY *pArray, int index);
+int GetArrayObjectSize(COFFARRAY *pArray, int index);
+int WriteArray(COFFARRAY *pArray, FILE *fp);
+void EmptyArray(COFFARRAY *pArray);
+void FreeArray(COFFARRAY *pArray);
+int SetImageBytes(PAGEDIMAGE *pImage, int address, const unsigned char *data, int count);
+int WriteImage(PAGEDIMAGE *pImage, int length, FILE *fp);
+void FreeImage(PAGEDIMAGE *pImage);
@@ -0,0 +1,253 @@
+/***********************************************************************
+ *
+ *  AVRA - Assembler for the Atmel AVR microcontroller series
+ *
+ *  Copyright (C) 1998-2020 The AVRA Authors
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; see the file COPYING.  If not, write to
+ *  the Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ *  Boston, MA 02111-1307, USA.
+ *
+ *
+ *  Authors of AVRA can be reached at:
+ *     email: jonah@omegav.ntnu.no, tobiw@suprafluid.com
+ *     www: https://github.com/Ro5bert/avra
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "misc.h"
+#include "args.h"
+#include "avra.h"
+
+#define CODE_ALLOC_STEP 1024
+
+static void
+sprint_cycles(char *buf, int min, int max)
+{
+	if (min == max)
+		sprintf(buf, "%d", min);
+	else
+		sprintf(buf, "%d-%d", min, max);
+}
+
+/* Print the cycle summary of the current basic block to the list file */
+static void
+close_block(struct prog_info *pi)
+{
+	struct code_record *last;
+	char buf[32];
+
+	if (pi->block_start < 0)
+		return;
+	if (pi->list_on && pi->list_file && GET_ARG_I(pi->args, ARG_LISTCYCLES)) {
+		last = &pi->code[pi->code_count - 1];
+		sprint_cycles(buf, pi->block_min_cycles, pi->block_max_cycles);
+		fprintf(pi->list_file, "          ; block %06lx-%06lx: %s cycles\n",
+		        pi->block_start, last->addr + last->size - 1, buf);
+	}
+	pi->block_start = -1;
+}
+
+/* Remember an instruction emitted in pass 2 and account for its cycles */
+struct code_record *
+add_code_record(struct prog_info *pi, int mnemonic, int size)
+{
+	struct code_record *code;
+
+	if (pi->code_count == pi->code_alloc) {
+		code = realloc(pi->code, (pi->code_alloc + CODE_ALLOC_STEP) * sizeof(struct code_record));
+		if (!code) {
+			print_msg(pi, MSGTYPE_OUT_OF_MEM, NULL);
+			return (NULL);
+		}
+		pi->code = code;
+		pi->code_alloc += CODE_ALLOC_STEP;
+	}
+	code = &pi->code[pi->code_count++];
+	code->addr = pi->cseg->addr;
+	code->mnemonic = mnemonic;
+	code->size = size;
+	code->flow = get_flow(mnemonic);
+	code->target = -1;
+	code->written = 0;
+	get_cycles(pi, mnemonic, code->addr, &code->min_cycles, &code->max_cycles);
+
+	if (pi->block_start < 0) {
+		pi->block_start = code->addr;
+		pi->block_min_cycles = 0;
+		pi->block_max_cycles = 0;
+	}
+	pi->block_min_cycles += code->min_cycles;
+	pi->block_max_cycles += code->max_cycles;
+	pi->label_min_cycles += code->min_cycles;
+	pi->label_max_cycles += code->max_cycles;
+	return (code);
+}
+
+/* Two word instructions are collected in pass 1, so the cost of a skip is
+ * known when the skip itself is assembled in pass 2. */
+int
+add_long_insn(struct prog_info *pi, long addr)
+{
+	long *long_insn;
+
+	if (pi->long_insn_count == pi->long_insn_alloc) {
+		long_insn = realloc(pi->long_insn, (pi->long_insn_alloc + CODE_ALLOC_STEP) * sizeof(long));
+		if (!long_insn) {
+			print_msg(pi, MSGTYPE_OUT_OF_MEM, NULL);
+			return (False);
+		}
+		pi->long_insn = long_insn;
+		pi->long_insn_alloc += CODE_ALLOC_STEP;
+	}
+	pi->long_insn[pi->long_insn_count++] = addr;
+	pi->long_insn_sorted = False;
+	return (True);
+}
+
+static int
+compare_addr(const void *a, const void *b)
+{
+	long x = *(const long *)a, y = *(const long *)b;
+
+	return (x < y ? -1 : (x > y ? 1 : 0));
+}
+
+int
+is_long_insn(struct prog_info *pi, long addr)
+{
+	if (pi->long_insn_count == 0)
+		return (False);
+	if (!pi->long_insn_sorted) {
+		qsort(pi->long_insn, pi->long_insn_count, sizeof(long), compare_addr);
+		pi->long_insn_sorted = True;
+	}
+	return (bsearch(&addr, pi->long_insn, pi->long_insn_count, sizeof(long), compare_addr) != NULL);
+}
+
+/* Cycle columns of the list file: cycles of this line and cycles since the last label */
+void
+fprint_cycles(FILE *file, struct prog_info *pi, struct code_record *code)
+{
+	char line[32], total[32];
+
+	sprint_cycles(line, code->min_cycles, code->max_cycles);
+	sprint_cycles(total, pi->label_min_cycles, pi->label_max_cycles);
+	fprintf(file, "%-5s %-9s ", line, total);
+}
+
+/* A label in the code segment starts a new basic block and a new count */
+void
+cycles_label(struct prog_info *pi)
+{
+	if (pi->pass != PASS_2 || pi->segment != pi->cseg)
+		return;
+	close_block(pi);
+	pi->label_min_cycles = 0;
+	pi->label_max_cycles = 0;
+}
+
+/* Anything but a call or a plain instruction ends the basic block */
+void
+cycles_flow(struct prog_info *pi, struct code_record *code)
+{
+	if ((code->flow != FLOW_NEXT) && (code->flow != FLOW_CALL))
+		close_block(pi);
+}
+
+int
+add_cycles_report(struct prog_info *pi, char *name, long start, long end)
+{
+	struct cycles_report *report;
+
+	if (pi->layout)
+		return (True);
+	report = malloc(sizeof(struct cycles_report));
+	if (!report) {
+		print_msg(pi, MSGTYPE_OUT_OF_MEM, NULL);
+		return (False);
+	}
+	report->name = malloc(strlen(name) + 1);
+	if (!report->name) {
+		free(report);
+		print_msg(pi, MSGTYPE_OUT_OF_MEM, NULL);
+		return (False);
+	}
+	strcpy(report->name, name);
+	report->next = NULL;
+	report->include_file = pi->fi->include_file;
+	report->line_number = pi->fi->line_number;
+	report->start = start;
+	report->end = end;
+	if (pi->last_cycles_report)
+		pi->last_cycles_report->next = report;
+	else
+		pi->first_cycles_report = report;
+	pi->last_cycles_report = report;
+	return (True);
+}
+
+/* Print the .CYCLES reports. The cost of a range is the sum of all
+ * instructions in it, without following branches. */
+void
+print_cycles_reports(struct prog_info *pi)
+{
+	struct cycles_report *report;
+	int i, count, min, max;
+	char buf[32];
+
+	if (!pi->first_cycles_report)
+		return;
+	printf("Cycle counts:\n");
+	for (report = pi->first_cycles_report; report; report = report->next) {
+		count = min = max = 0;
+		for (i = 0; i < pi->code_count; i++)
+			if ((pi->code[i].addr >= report->start) && (pi->code[i].addr < report->end)) {
+				count++;
+				min += pi->code[i].min_cycles;
+				max += pi->code[i].max_cycles;
+			}
+		sprint_cycles(buf, min, max);
+		printf("%s(%d) : %s: %s cycles in %d instruction%s\n",
+		       report->include_file->name, report->line_number, report->name,
+		       buf, count, count == 1 ? "" : "s");
+	}
+	printf("\n");
+}
+
+void
+free_code(struct prog_info *pi)
+{
+	struct cycles_report *report, *temp_report;
+
+	for (report = pi->first_cycles_report; report;) {
+		temp_report = report;
+		report = report->next;
+		free(temp_report->name);
+		free(temp_report);
+	}
+	pi->first_cycles_report = NULL;
+	pi->last_cycles_report = NULL;
+	free(pi->code);
+	pi->code = NULL;
+	pi->code_count = pi->code_alloc = 0;
+	free(pi->long_insn);
+	pi->long_insn = NULL;
+	pi->long_insn_count = pi->long_insn_alloc = 0;
+}
+
+/* end of cycles.c */
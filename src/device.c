@@ -148,7 +148,7 @@ struct device device_list[] = {
 	{"ATmega1284PA",  65536, 0x100, 16384, 4096, DF_NO_EICALL|DF_NO_EIJMP|DF_NO_ESPM},
 	{"ATmega2560"  , 131072, 0x200,  8192, 4096, DF_NO_ESPM},
 	{"ATmega2561"  , 131072, 0x200,  8192, 4096, DF_NO_ESPM},
-	{"ATmega4809"  ,  24000, 0x2800,  6000,  256, DF_NO_ELPM|DF_NO_ESPM|DF_NO_EICALL|DF_NO_EIJMP},
+	{"ATmega4809"  ,  24000, 0x2800,  6000,  256, DF_NO_ELPM|DF_NO_ESPM|DF_NO_EICALL|DF_NO_EIJMP|DF_XMEGA},
 
 	/* Other */
 	{"AT94K"       ,   8192, 0x060, 16384,    0, DF_NO_ELPM|DF_NO_SPM|DF_NO_ESPM|DF_NO_BREAK|DF_NO_EICALL|DF_NO_EIJMP},
@@ -168,25 +168,98 @@ def_dev(struct prog_info *pi)
 	def_var(pi,RAM_VAR,device_list[LastDevice].ram_size);
 }
 
-struct device *get_device(struct prog_info *pi, char *name)
+/* Device numbers sorted by name, for find_device() */
+static int DeviceIndex[sizeof(device_list) / sizeof(struct device)];
+static int DeviceCount = 0;
+
+static int
+compare_devices(const void *a, const void *b)
 {
-	int i = 1;
+	return (nocase_strcmp(device_list[*(const int *)a].name, device_list[*(const int *)b].name));
+}
 
-	LastDevice = 0;
-	if (name == NULL) {
-		def_dev(pi);
-		return (&device_list[0]);
+/* Number of a device in device_list[], 0 if there is none by that name */
+static int
+find_device(const char *name)
+{
+	int low, high, middle, cmp;
+
+	if (DeviceCount == 0) {
+		while (device_list[DeviceCount + 1].name)
+			DeviceCount++;
+		for (low = 0; low < DeviceCount; low++)
+			DeviceIndex[low] = low + 1;
+		qsort(DeviceIndex, DeviceCount, sizeof(int), compare_devices);
 	}
-	while (device_list[i].name) {
-		if (!nocase_strcmp(name, device_list[i].name)) {
-			LastDevice=i;
+	low = 0;
+	high = DeviceCount - 1;
+	while (low <= high) {
+		middle = (low + high) / 2;
+		cmp = nocase_strcmp(name, device_list[DeviceIndex[middle]].name);
+		if (cmp == 0)
+			return (DeviceIndex[middle]);
+		if (cmp < 0)
+			high = middle - 1;
+		else
+			low = middle + 1;
+	}
+	return (0);
+}
+
+struct device *get_device(struct prog_info *pi, char *name)
+{
+	LastDevice = 0;
+	if (name != NULL) {
+		LastDevice = find_device(name);
+		if (LastDevice == 0) {
 			def_dev(pi);
-			return (&device_list[i]);
+			return (NULL);
 		}
-		i++;
 	}
 	def_dev(pi);
-	return (NULL);
+	return (&device_list[LastDevice]);
+}
+
+/* Number of the device of a symbol __<device>__, -1 if it isn't one */
+static int
+get_device_number(const char *name)
+{
+	char temp[MAX_DEV_NAME+1];
+	int length = strlen(name) - strlen(DEV_PREFIX) - strlen(DEV_SUFFIX);
+
+	if ((length <= 0) || (length > MAX_DEV_NAME)
+	        || strncmp(name, DEV_PREFIX, strlen(DEV_PREFIX))
+	        || strcmp(name + strlen(name) - strlen(DEV_SUFFIX), DEV_SUFFIX))
+		return (-1);
+	strncpy(temp, name + strlen(DEV_PREFIX), length);
+	temp[length] = '\0';
+	if (!nocase_strcmp(temp, DEF_DEV_NAME))
+		return (0);
+	length = find_device(temp);
+	return ((length == 0) ? -1 : length);
+}
+
+/* Predefined, so without an origin in the source */
+static struct label *
+def_dev_const(struct prog_info *pi, const char *name, int number)
+{
+	if (def_const(pi, name, number) == False)
+		return (NULL);
+	pi->last_constant->include_file = NULL;
+	pi->last_constant->line_number = 0;
+	return (pi->last_constant);
+}
+
+/* The device symbols __<device>__ are constants defined when first used.
+ * Called by test_constant() for a name that isn't defined. */
+struct label *
+get_device_symbol(struct prog_info *pi, const char *name)
+{
+	int i = get_device_number(name);
+
+	if (i < 0)
+		return (NULL);
+	return (def_dev_const(pi, name, i));
 }
 
 /* Pre-define devices. */
@@ -195,33 +268,20 @@ predef_dev(struct prog_info *pi)
 {
 	int i;
 	char temp[MAX_DEV_NAME+1];
+
 	def_dev(pi);
-	for (i=0; (!i)||(device_list[i].name); i++) {
-		strncpy(temp,DEV_PREFIX,MAX_DEV_NAME);
-		if (!i) strncat(temp,DEF_DEV_NAME,MAX_DEV_NAME);
-		else strncat(temp,device_list[i].name,MAX_DEV_NAME);
-		strncat(temp,DEV_SUFFIX,MAX_DEV_NAME);
-		/* Forward references allowed. But check, if everything is ok ... */
-		if (pi->pass==PASS_1) { /* Pass 1 */
-			if (test_constant(pi,temp,NULL)!=NULL) {
-				fprintf(stderr,"Error: Can't define symbol %s twice. Please don't use predefined symbols !\n", temp);
+	/* The map file lists all device symbols, else they are defined when
+	 * first used. --define already refuses their names. */
+	if ((pi->pass == PASS_1) && pi->map_on)
+		for (i=0; (!i)||(device_list[i].name); i++) {
+			strncpy(temp,DEV_PREFIX,MAX_DEV_NAME);
+			if (!i) strncat(temp,DEF_DEV_NAME,MAX_DEV_NAME);
+			else strncat(temp,device_list[i].name,MAX_DEV_NAME);
+			strncat(temp,DEV_SUFFIX,MAX_DEV_NAME);
+			if (!search_symbol(pi, SYMBOL_CONSTANT, temp, NULL)
+			        && (def_dev_const(pi, temp, i) == NULL))
 				return (False);
-			}
-			if (def_const(pi, temp, i)==False)
-				return (False);
-		} else { /* Pass 2 */
-			int j;
-			if (get_constant(pi, temp, &j)==False) {  /* Defined in Pass 1 and now missing ? */
-				fprintf(stderr,"Constant %s is missing in pass 2\n",temp);
-				return (False);
-			}
-			if (i != j) {
-				fprintf(stderr,"Constant %s changed value from %d in pass1 to %d in pass 2\n",temp,j,i);
-				return (False);
-			}
-			/* OK. definition is unchanged */
 		}
-	}
 	return (True);
 }
 
@@ -45,9 +45,10 @@
 #define DF_AVR8L     0x8000 /* Also known as AVRrc (reduced core)?
                              * ATtiny4,5,9,10,20,40,102,104: No ADIW, SBIW;
                              * one word LDS/STS */
-/* If more flags are added, the size of the flag field in struct device must
- * be increased! C ints are only guaranteed to be at least 16 bits, and we're
- * currently using all of them. */
+#define DF_XMEGA    0x10000L /* XMEGA (AVRxm) and AVRxt timing: single cycle
+                             * PUSH, ST, SBI, CBI, faster calls */
+/* The flag field in struct device is a long, which is guaranteed to be at
+ * least 32 bits. */
 
 struct device {
 	char *name;
@@ -55,10 +56,11 @@ struct device {
 	long ram_start;
 	long ram_size;
 	long eeprom_size;
-	int flag;
+	long flag;
 };
 
 /* device.c */
 struct device *get_device(struct prog_info *pi,char *name);
 int predef_dev(struct prog_info *pi);
+struct label *get_device_symbol(struct prog_info *pi, const char *name);
 void list_devices(void);
@@ -72,6 +72,15 @@ enum {
 	DIRECTIVE_PRAGMA,
 	DIRECTIVE_OVERLAP,
 	DIRECTIVE_NOOVERLAP,
+	DIRECTIVE_CYCLES,
+	DIRECTIVE_LOOPBOUND,
+	DIRECTIVE_KEEP,
+	DIRECTIVE_CALLS,
+	DIRECTIVE_GLOBAL,
+	DIRECTIVE_EXTERN,
+	DIRECTIVE_POOL,
+	DIRECTIVE_ENDPOOL,
+	DIRECTIVE_INCBIN,
 	DIRECTIVE_COUNT
 };
 
@@ -112,6 +121,15 @@ static const char *const directive_list[] = {
 	"PRAGMA",
 	"OVERLAP",
 	"NOOVERLAP",
+	"CYCLES",
+	"LOOPBOUND",
+	"KEEP",
+	"CALLS",
+	"GLOBAL",
+	"EXTERN",
+	"POOL",
+	"ENDPOOL",
+	"INCBIN",
 	NULL
 };
 
@@ -152,26 +170,119 @@ joinpaths(const char *dirname, const char *fname)
 	return res;
 }
 
+/* Whether a .EQU expression can be evaluated when the constant is first
+ * used: it must not use PC, .SET variables, defined(), supported() or the
+ * labels of a macro, which depend on where it stands. */
+static int
+is_deferrable(struct prog_info *pi, char *data)
+{
+	int i, length, ok;
+	char c;
+
+	if (pi->macro_call)
+		return (False);
+	for (i = 0; data[i] != '\0'; i += length) {
+		length = 1;
+		if (data[i] == '\'') { /* 'A' */
+			if ((data[i + 1] != '\0') && (data[i + 2] != '\0'))
+				length = 3;
+		} else if (IS_LABEL(data[i])) {
+			while (IS_LABEL(data[i + length]))
+				length++;
+			if (isdigit(data[i]))
+				continue;
+			c = data[i + length];
+			data[i + length] = '\0';
+			ok = nocase_strcmp(&data[i], "PC") && nocase_strcmp(&data[i], "defined")
+			     && nocase_strcmp(&data[i], "supported") && !test_variable(pi, &data[i], NULL);
+			data[i + length] = c;
+			if (!ok)
+				return (False);
+		}
+	}
+	return (True);
+}
+
+/* *path is the file in dirname, or NULL if there is none */
+static int
+try_include(struct prog_info *pi, const char *dirname, const char *name, char **path)
+{
+	*path = joinpaths(dirname, name);
+	if (!*path) {
+		print_msg(pi, MSGTYPE_OUT_OF_MEM, NULL);
+		return (False);
+	}
+	if (!test_include(*path)) {
+		free(*path);
+		*path = NULL;
+	}
+	return (True);
+}
+
+/* Look for a file in the current directory and then in the include paths.
+ * *path is NULL if it isn't found; False is only returned without memory. */
+static int
+find_include(struct prog_info *pi, const char *name, char **path)
+{
+	struct data_list *incpath;
+
+	*path = NULL;
+	if (test_include(name)) {
+		*path = malloc(strlen(name) + 1);
+		if (!*path) {
+			print_msg(pi, MSGTYPE_OUT_OF_MEM, NULL);
+			return (False);
+		}
+		strcpy(*path, name);
+		return (True);
+	}
+#ifdef DEFAULT_INCLUDE_PATH
+	if (!try_include(pi, DEFAULT_INCLUDE_PATH, name, path))
+		return (False);
+#endif
+	for (incpath = GET_ARG_LIST(pi->args, ARG_INCLUDEPATH); incpath && !*path; incpath = incpath->next)
+		if (!try_include(pi, incpath->data, name, path))
+			return (False);
+	return (True);
+}
+
 int
 parse_directive(struct prog_info *pi)
 {
 	int directive, pragma;
 	int ok = True;
-	int i;
+	int i, j;
 	char *next, *data, buf[140];
 	struct file_info *fi_bak;
 
 	struct def *def;
+	struct label *label;
 	struct data_list *incpath, *dl;
 
 	next = get_next_token(pi->fi->scratch, TERM_SPACE);
 
 	my_strupr(pi->fi->scratch);
-	directive = lookup_keyword(directive_list, pi->fi->scratch + 1, True);
+	i = find_atom(pi, pi->fi->scratch + 1);
+	directive = i ? pi->atom[i].directive - 1 : -1;
 	if (directive == -1) {
 		print_msg(pi, MSGTYPE_ERROR, "Unknown directive: %s", pi->fi->scratch);
 		return (True);
 	}
+	if (pi->pool) {
+		switch (directive) {
+		case DIRECTIVE_DB:
+		case DIRECTIVE_DW:
+			return (pool_data(pi, next, directive == DIRECTIVE_DW));
+		case DIRECTIVE_BYTE:
+		case DIRECTIVE_CSEG:
+		case DIRECTIVE_DSEG:
+		case DIRECTIVE_ESEG:
+		case DIRECTIVE_ORG:
+		case DIRECTIVE_INCBIN:
+			print_msg(pi, MSGTYPE_ERROR, ".%s can't be used in a .POOL", directive_list[directive]);
+			return (True);
+		}
+	}
 	switch (directive) {
 	case DIRECTIVE_BYTE:
 		if (!next) {
@@ -223,22 +334,24 @@ parse_directive(struct prog_info *pi)
 		/* check range of given register */
 		if (i > 31)
 			print_msg(pi, MSGTYPE_ERROR, "R%d is not a valid register", i);
+		/* rNN always names the register itself */
+		if (is_register_name(next)) {
+			print_msg(pi, MSGTYPE_ERROR, "%s is a register and can't be used as an alias", next);
+			return (True);
+		}
 		/* check if this reg is already assigned */
-		for (def = pi->first_def; def; def = def->next) {
-			if (def->reg == i && pi->pass == PASS_1 && !pi->NoRegDef) {
-				print_msg(pi, MSGTYPE_WARNING, "r%d is already assigned to '%s'!", i, def->name);
-				return (True);
-			}
+		if ((i <= 31) && pi->reg_def[i] && pi->pass == PASS_1 && !pi->NoRegDef) {
+			print_msg(pi, MSGTYPE_WARNING, "r%d is already assigned to '%s'!", i, pi->reg_def[i]->name);
+			return (True);
 		}
 		/* check if this regname is already defined */
-		for (def = pi->first_def; def; def = def->next) {
-			if (!nocase_strcmp(def->name, next)) {
-				if (pi->pass == PASS_1 && !pi->NoRegDef) {
-					print_msg(pi, MSGTYPE_WARNING, "'%s' is already assigned as r%d but will now be set to r%i!", next, def->reg, i);
-				}
-				def->reg = i;
-				return (True);
+		def = search_def(pi, next);
+		if (def) {
+			if (pi->pass == PASS_1 && !pi->NoRegDef) {
+				print_msg(pi, MSGTYPE_WARNING, "'%s' is already assigned as r%d but will now be set to r%i!", next, def->reg, i);
 			}
+			set_def_register(pi, def, i);
+			return (True);
 		}
 		/* Check, if symbol is already defined as a label or constant */
 		if (pi->pass == PASS_2) {
@@ -248,24 +361,8 @@ parse_directive(struct prog_info *pi)
 				print_msg(pi, MSGTYPE_WARNING, "Name '%s' is used for a register and a constant", next);
 		}
 
-		def = malloc(sizeof(struct def));
-		if (!def) {
-			print_msg(pi, MSGTYPE_OUT_OF_MEM, NULL);
-			return (False);
-		}
-		def->next = NULL;
-		if (pi->last_def)
-			pi->last_def->next = def;
-		else
-			pi->first_def = def;
-		pi->last_def = def;
-		def->name = malloc(strlen(next) + 1);
-		if (!def->name) {
-			print_msg(pi, MSGTYPE_OUT_OF_MEM, NULL);
+		if (!def_register(pi, next, i))
 			return (False);
-		}
-		strcpy(def->name, next);
-		def->reg = i;
 		break;
 	case DIRECTIVE_DEVICE:
 		if (pi->pass == PASS_2)
@@ -313,40 +410,7 @@ parse_directive(struct prog_info *pi)
 		}
 		break;
 	case DIRECTIVE_DW:
-		if (pi->segment->flags & SEG_BSS_DATA) {
-			print_msg(pi, MSGTYPE_ERROR, "Can't use .DW directive in data segment (.DSEG)");
-			return (True);
-		}
-		while (next) {
-			data = get_next_token(next, TERM_COMMA);
-			if (pi->pass == PASS_2) {
-				if (!get_expr(pi, next, &i))
-					return (False);
-				if ((i < -32768) || (i > 65535))
-					print_msg(pi, MSGTYPE_WARNING, "Value %d is out of range (-32768 <= k <= 65535). Will be masked", i);
-			}
-			if (pi->pass == PASS_2) {
-				if (pi->list_line && pi->list_on) {
-					fprintf(pi->list_file, "          %s\n", pi->list_line);
-					pi->list_line = NULL;
-					fprintf(pi->list_file, "%c:%06lx %04x\n",
-					        pi->segment->ident, pi->segment->addr, i);
-				}
-				if (pi->segment == pi->eseg) {
-					write_ee_byte(pi, pi->eseg->addr, (unsigned char)i);
-					write_ee_byte(pi, pi->eseg->addr + 1, (unsigned char)(i >> 8));
-				}
-				if (pi->segment == pi->cseg) {
-					write_prog_word(pi, pi->cseg->addr, i);
-				}
-			}
-			if (pi->segment == pi->eseg)
-				advance_ip(pi->eseg, 2);
-			if (pi->segment == pi->cseg)
-				advance_ip(pi->cseg, 1);
-			next = data;
-		}
-		break;
+		return (parse_dw(pi, next));
 	case DIRECTIVE_ENDM:
 	case DIRECTIVE_ENDMACRO:
 		print_msg(pi, MSGTYPE_ERROR, "No .MACRO found before .ENDMACRO");
@@ -362,8 +426,6 @@ parse_directive(struct prog_info *pi)
 			return (True);
 		}
 		get_next_token(data, TERM_END);
-		if (!get_expr(pi, data, &i))
-			return (False);
 		if (test_label(pi,next,"%s have already been defined as a label")!=NULL)
 			return (True);
 		if (test_variable(pi,next,"%s have already been defined as a .SET variable")!=NULL)
@@ -372,17 +434,30 @@ parse_directive(struct prog_info *pi)
 		if (pi->pass==PASS_1) { /* Pass 1 */
 			if (test_constant(pi,next,"Can't redefine constant %s, use .SET instead")!=NULL)
 				return (True);
+			if (is_deferrable(pi, data))
+				return (def_equ(pi, next, data));
+			if (!get_reloc_expr(pi, data, &i))
+				return (False);
 			if (def_const(pi, next, i)==False)
 				return (False);
+			pi->last_constant->ref = pi->expr_ref;
 		} else { /* Pass 2 */
-			int j;
-			if (get_constant(pi, next, &j)==False) {  /* Defined in Pass 1 and now missing ? */
+			label = test_constant(pi, next, NULL);
+			if (label==NULL) {  /* Defined in Pass 1 and now missing ? */
 				print_msg(pi, MSGTYPE_ERROR, "Constant %s is missing in pass 2", next);
 				return (False);
 			}
-			if (i != j) {
-				print_msg(pi, MSGTYPE_ERROR, "Constant %s changed value from %d in pass1 to %d in pass 2", next,j,i);
-				return (False);
+			/* A deferred constant is evaluated when used and only changes with
+			 * the labels it uses. Others are checked again. */
+			if (!label->expr || ((label->state == CONST_EVALUATED) && label->uses_labels)) {
+				if (!get_reloc_expr(pi, data, &i))
+					return (False);
+				if (pi->layout) /* Labels may have moved */
+					label->value = i;
+				else if (i != label->value) {
+					print_msg(pi, MSGTYPE_ERROR, "Constant %s changed value from %d in pass1 to %d in pass 2", next,label->value,i);
+					return (False);
+				}
 			}
 			/* OK. Definition is unchanged */
 		}
@@ -411,35 +486,22 @@ parse_directive(struct prog_info *pi)
 			fprintf(pi->list_file, "          %s\n", pi->list_line);
 			pi->list_line = NULL;
 		}
-		/* Test if include is in local directory */
-		ok = test_include(next);
-		data = NULL;
-		if (!ok) {
-#ifdef DEFAULT_INCLUDE_PATH
-			data = joinpaths(DEFAULT_INCLUDE_PATH, next);
-			ok = test_include(data);
-#endif
-			for (incpath = GET_ARG_LIST(pi->args, ARG_INCLUDEPATH); incpath && !ok; incpath = incpath->next) {
-				if (data != NULL) {
-					free(data);
-				}
-				data = joinpaths(incpath->data, next);
-				if (data == NULL) {
-					print_msg(pi, MSGTYPE_OUT_OF_MEM, NULL);
-					return (False);
-				}
-				ok = test_include(data);
-			}
-		}
-		if (ok) {
+		if (!find_include(pi, next, &data))
+			return (False);
+		if (data) {
 			fi_bak = pi->fi;
-			ok = parse_file(pi, data ? data : next);
+			ok = parse_file(pi, data);
 			pi->fi = fi_bak;
+			free(data);
 		} else
 			print_msg(pi, MSGTYPE_ERROR, "Cannot find include file: %s", next);
-		if (data)
-			free(data);
 		break;
+	case DIRECTIVE_INCBIN:
+		if (!next) {
+			print_msg(pi, MSGTYPE_ERROR, ".INCBIN needs a file name");
+			return (True);
+		}
+		return (parse_incbin(pi, next));
 	case DIRECTIVE_INCLUDEPATH:
 		if (!next) {
 			print_msg(pi, MSGTYPE_ERROR, ".INCLUDEPATH needs an operand");
@@ -561,7 +623,9 @@ parse_directive(struct prog_info *pi)
 				print_msg(pi, MSGTYPE_ERROR, "Constant %s is missing in pass 2", next);
 				return (False);
 			}
-			if (i != j) {
+			if (pi->layout) /* Labels may have moved */
+				test_constant(pi, next, NULL)->value = i;
+			else if (i != j) {
 				print_msg(pi, MSGTYPE_ERROR, "Constant %s changed value from %d in pass1 to %d in pass 2", next,j,i);
 				return (False);
 			}
@@ -573,14 +637,14 @@ parse_directive(struct prog_info *pi)
 		}
 		break;
 	case DIRECTIVE_NOOVERLAP:
-		if (pi->pass == PASS_1) {
+		if ((pi->pass == PASS_1) || pi->layout) {
 			fix_orglist(pi->segment);
 			pi->segment_overlap = SEG_DONT_OVERLAP;
 			def_orglist(pi->segment);
 		}
 		break;
 	case DIRECTIVE_OVERLAP:
-		if (pi->pass == PASS_1) {
+		if ((pi->pass == PASS_1) || pi->layout) {
 			fix_orglist(pi->segment);
 			pi->segment_overlap = SEG_ALLOW_OVERLAP;
 			def_orglist(pi->segment);
@@ -630,6 +694,119 @@ parse_directive(struct prog_info *pi)
 			return (True);
 		}
 		break;
+	case DIRECTIVE_CYCLES:
+		if (!next) {
+			print_msg(pi, MSGTYPE_ERROR, ".CYCLES needs a start and an end address");
+			return (True);
+		}
+		data = get_next_token(next, TERM_COMMA);
+		if (!data) {
+			print_msg(pi, MSGTYPE_ERROR, ".CYCLES needs an end address (e.g. .CYCLES isr, isr_end)");
+			return (True);
+		}
+		get_next_token(data, TERM_END);
+		if (pi->pass == PASS_2) {
+			if (!get_expr(pi, next, &i))
+				return (False);
+			if (!get_expr(pi, data, &j))
+				return (False);
+			snprintf(buf, sizeof(buf), "%s..%s", next, data);
+			if (!add_cycles_report(pi, buf, i, j))
+				return (False);
+		}
+		break;
+	case DIRECTIVE_LOOPBOUND:
+		if (!next) {
+			print_msg(pi, MSGTYPE_ERROR, ".LOOPBOUND needs an iteration count");
+			return (True);
+		}
+		if (pi->segment != pi->cseg) {
+			print_msg(pi, MSGTYPE_ERROR, ".LOOPBOUND is only allowed in the code segment");
+			return (True);
+		}
+		get_next_token(next, TERM_END);
+		if (pi->pass == PASS_2) {
+			if (!get_expr(pi, next, &i))
+				return (False);
+			if (i < 1) {
+				print_msg(pi, MSGTYPE_ERROR, ".LOOPBOUND needs an iteration count of at least 1");
+				return (True);
+			}
+			if (!add_loop_bound(pi, pi->cseg->addr, i))
+				return (False);
+		}
+		break;
+	case DIRECTIVE_KEEP:
+		if (!next && (pi->segment != pi->cseg)) {
+			print_msg(pi, MSGTYPE_ERROR, ".KEEP without a label is only allowed in the code segment");
+			return (True);
+		}
+		if (pi->pass == PASS_2) {
+			if (!next && !add_keep(pi, pi->cseg->addr))
+				return (False);
+			while (next) {
+				data = get_next_token(next, TERM_COMMA);
+				/* In a module, the code address relative to the module */
+				if (!get_reloc_expr(pi, next, &i))
+					return (False);
+				if (pi->expr_ref.symbol || (pi->expr_ref.segment && (pi->expr_ref.segment != pi->cseg))) {
+					print_msg(pi, MSGTYPE_ERROR, ".KEEP needs a code address of this module");
+					return (True);
+				}
+				if (!add_keep(pi, i))
+					return (False);
+				next = data;
+			}
+		}
+		break;
+	case DIRECTIVE_CALLS:
+		if (!next) {
+			print_msg(pi, MSGTYPE_ERROR, ".CALLS needs the targets of the next ijmp or icall");
+			return (True);
+		}
+		if (pi->segment != pi->cseg) {
+			print_msg(pi, MSGTYPE_ERROR, ".CALLS is only allowed in the code segment");
+			return (True);
+		}
+		if (pi->pass == PASS_2) {
+			while (next) {
+				data = get_next_token(next, TERM_COMMA);
+				if (!get_reloc_expr(pi, next, &i))
+					return (False);
+				if (pi->expr_ref.symbol || (pi->expr_ref.segment && (pi->expr_ref.segment != pi->cseg))) {
+					print_msg(pi, MSGTYPE_ERROR, ".CALLS needs code addresses of this module");
+					return (True);
+				}
+				if (!add_indirect_target(pi, pi->cseg->addr, i))
+					return (False);
+				next = data;
+			}
+		}
+		break;
+	case DIRECTIVE_GLOBAL:
+	case DIRECTIVE_EXTERN:
+		if (!next) {
+			print_msg(pi, MSGTYPE_ERROR, ".%s needs a symbol name", directive_list[directive]);
+			return (True);
+		}
+		while (next) {
+			data = get_next_token(next, TERM_COMMA);
+			if (directive == DIRECTIVE_GLOBAL) {
+				if (!def_global(pi, next))
+					return (False);
+			} else if (!def_extern(pi, next))
+				return (False);
+			next = data;
+		}
+		break;
+	case DIRECTIVE_POOL:
+		if ((pi->pass == PASS_2) && pi->list_line && pi->list_on) {
+			fprintf(pi->list_file, "          %s\n", pi->list_line);
+			pi->list_line = NULL;
+		}
+		return (begin_pool(pi));
+	case DIRECTIVE_ENDPOOL:
+		return (end_pool(pi));
 	case DIRECTIVE_UNDEF: /* TODO */
 		break;
 	case DIRECTIVE_IFDEF:
@@ -756,6 +933,19 @@ parse_directive(struct prog_info *pi)
 }
 
 
+/* Intern the directive names, parse_directive() finds them by atom */
+void
+def_directives(struct prog_info *pi)
+{
+	int i, atom;
+
+	for (i = 0; directive_list[i] != NULL; i++) {
+		atom = intern(pi, directive_list[i]);
+		if (atom)
+			pi->atom[atom].directive = i + 1;
+	}
+}
+
 int
 lookup_keyword(const char *const keyword_list[], const char *const keyword, int strict)
 {
@@ -792,14 +982,31 @@ term_string(struct prog_info *pi, char *string)
 	return (string);
 }
 
-/* Parse data byte directive */
+/* Hex digits of the bytes to the list file, in as few writes as the
+ * buffer allows */
+static void
+list_hex(struct prog_info *pi, const unsigned char *data, int count)
+{
+	char buff[2 * 256 + 1];
+	int n;
+
+	for (; count > 0; data += n, count -= n) {
+		n = count < 256 ? count : 256;
+		fputs(hex_string(buff, data, n), pi->list_file);
+	}
+}
+
+/* Parse data byte directive. Pass 2 collects the bytes of the line and
+ * writes them at once. */
 int
 parse_db(struct prog_info *pi, char *next)
 {
 	int i;
 	int count;
+	int pad = 0;
 	char *data;
-	char prev = 0;
+	unsigned char *bytes = NULL;
+	long addr = pi->segment->addr;
 
 	/* check if .db is allowed in this segment type */
 	if (pi->segment->flags & SEG_BSS_DATA) {
@@ -807,10 +1014,15 @@ parse_db(struct prog_info *pi, char *next)
 		return True ;
 	}
 
-	count = 0;
-	if (pi->pass == PASS_2 && pi->list_on) {
-		fprintf(pi->list_file, "%c:%06lX ", pi->segment->ident, pi->segment->addr);
+	/* A string or an expression makes at most one byte per character */
+	if (pi->pass == PASS_2) {
+		bytes = malloc((next ? strlen(next) : 0) + 2);
+		if (!bytes) {
+			print_msg(pi, MSGTYPE_OUT_OF_MEM, NULL);
+			return (False);
+		}
 	}
+	count = 0;
 	/* get each db token */
 	while (next) {
 		data = get_next_token(next, TERM_COMMA);
@@ -818,64 +1030,218 @@ parse_db(struct prog_info *pi, char *next)
 		if (next[0] == '\"') {
 			next = term_string(pi, next);
 			while (*next != '\0') {
+				if (bytes) {
+					bytes[count] = *next;
+					if ((unsigned char)*next > 127)
+						print_msg(pi, MSGTYPE_WARNING, "Found .DB string with characters > code 127. Be careful !"); /* Print warning for codes > 127 */
+				}
 				count++;
-				write_db(pi, *next, &prev, count);
-				if (pi->pass == PASS_2 && pi->list_on)
-					fprintf(pi->list_file, "%02X", (unsigned char)*next);
-				if ((unsigned char)*next > 127 && pi->pass == PASS_2)
-					print_msg(pi, MSGTYPE_WARNING, "Found .DB string with characters > code 127. Be careful !"); /* Print warning for codes > 127 */
 				next++;
 			}
 		} else {
 			if (pi->pass == PASS_2) {
-				if (!get_expr(pi, next, &i))
+				if (!get_reloc_expr(pi, next, &i)) {
+					free(bytes);
 					return (False);
+				}
+				if (pi->segment == pi->eseg)
+					reloc_operand(pi, RELOC_BYTE, pi->eseg, addr + count);
+				else
+					reloc_operand(pi, RELOC_BYTE, pi->cseg, addr * 2 + count);
 				if ((i < -128) || (i > 255))
 					print_msg(pi, MSGTYPE_WARNING, "Value %d is out of range (-128 <= k <= 255). Will be masked", i);
-				if (pi->list_on) fprintf(pi->list_file, "%02X", i);
+				bytes[count] = i;
 			}
 			count++;
-			write_db(pi, (char)i, &prev, count);
 		}
 		next = data;
 	}
-	if (pi->segment == pi->cseg) { /* XXX PAD */
-		if ((count % 2) == 1) {
-			if (pi->pass == PASS_2)  {
-				if (pi->list_on) fprintf(pi->list_file, "00 ; zero byte added");
-				write_prog_word(pi, pi->segment->addr, prev & 0xFF);
-				print_msg(pi, MSGTYPE_WARNING, "A .DB segment with an odd number of bytes is detected. A zero byte is added.");
-			}
-			advance_ip(pi->cseg, 1);
-		}
+	if ((pi->segment == pi->cseg) && ((count % 2) == 1)) { /* XXX PAD */
+		pad = 1;
+		if (bytes)
+			bytes[count] = 0;
 	}
-	if (pi->pass == PASS_2 && pi->list_on) {
-		fprintf(pi->list_file, "\n");
-		pi->list_line = NULL;
+	if (pi->pass == PASS_2) {
+		if (pi->list_on) {
+			fprintf(pi->list_file, "%c:%06lX ", pi->segment->ident, addr);
+			list_hex(pi, bytes, count);
+			if (pad)
+				fprintf(pi->list_file, "00 ; zero byte added");
+			fprintf(pi->list_file, "\n");
+			pi->list_line = NULL;
+		}
+		if (pi->segment == pi->cseg)
+			write_prog_data(pi, addr, bytes, count + pad);
+		else
+			write_ee_data(pi, addr, bytes, count);
+		if (pad)
+			print_msg(pi, MSGTYPE_WARNING, "A .DB segment with an odd number of bytes is detected. A zero byte is added.");
+		free(bytes);
 	}
+	advance_ip(pi->segment, pi->segment == pi->cseg ? (count + pad) / 2 : count);
 	return True;
 }
 
-
-void
-write_db(struct prog_info *pi, char byte, char *prev, int count)
+/* Parse data word directive, the words of a line are written at once */
+int
+parse_dw(struct prog_info *pi, char *next)
 {
-	if (pi->segment == pi->eseg)	{
+	int i;
+	int count = 0;
+	char *data;
+	unsigned char *bytes = NULL;
+	long addr = pi->segment->addr;
+
+	if (pi->segment->flags & SEG_BSS_DATA) {
+		print_msg(pi, MSGTYPE_ERROR, "Can't use .DW directive in data segment (.DSEG)");
+		return (True);
+	}
+	/* An expression makes one word of at least one character */
+	if (pi->pass == PASS_2) {
+		bytes = malloc(2 * (next ? strlen(next) : 0) + 2);
+		if (!bytes) {
+			print_msg(pi, MSGTYPE_OUT_OF_MEM, NULL);
+			return (False);
+		}
+	}
+	while (next) {
+		data = get_next_token(next, TERM_COMMA);
 		if (pi->pass == PASS_2) {
-			write_ee_byte(pi, pi->eseg->addr, byte);
+			if (!get_reloc_expr(pi, next, &i)) {
+				free(bytes);
+				return (False);
+			}
+			if (pi->segment == pi->eseg)
+				reloc_operand(pi, RELOC_WORD, pi->eseg, addr + count);
+			else
+				reloc_operand(pi, RELOC_WORD, pi->cseg, addr * 2 + count);
+			if ((i < -32768) || (i > 65535))
+				print_msg(pi, MSGTYPE_WARNING, "Value %d is out of range (-32768 <= k <= 65535). Will be masked", i);
+			bytes[count] = i & 0xff;
+			bytes[count + 1] = (i >> 8) & 0xff;
+		}
+		count += 2;
+		next = data;
+	}
+	if (pi->pass == PASS_2) {
+		if (pi->list_line && pi->list_on) {
+			fprintf(pi->list_file, "          %s\n", pi->list_line);
+			pi->list_line = NULL;
 		}
-		advance_ip(pi->eseg, 1);
+		if (pi->list_on && count) {
+			fprintf(pi->list_file, "%c:%06lx", pi->segment->ident, addr);
+			for (i = 0; i < count; i += 2)
+				fprintf(pi->list_file, " %02x%02x", bytes[i + 1], bytes[i]);
+			fprintf(pi->list_file, "\n");
+		}
+		if (pi->segment == pi->cseg)
+			write_prog_data(pi, addr, bytes, count);
+		else
+			write_ee_data(pi, addr, bytes, count);
+		free(bytes);
 	}
-	if (pi->segment == pi->cseg) {
-		if ((count % 2) == 0) {
-			if (pi->pass == PASS_2) {
-				write_prog_word(pi, pi->cseg->addr, (byte << 8) | (*prev & 0xff));
+	advance_ip(pi->segment, pi->segment == pi->cseg ? count / 2 : count);
+	return (True);
+}
+
+/* Parse .INCBIN "file"[, offset[, length]]. The bytes are read in one go in
+ * pass 2; pass 1 only needs the size of the file. */
+int
+parse_incbin(struct prog_info *pi, char *next)
+{
+	char *data, *name, *path;
+	unsigned char *buff;
+	int offset = 0, length = 0, have_length = False, padded, i;
+	long size, addr = pi->segment->addr;
+	FILE *fp;
+
+	if (pi->segment->flags & SEG_BSS_DATA) {
+		print_msg(pi, MSGTYPE_ERROR, "Can't use .INCBIN directive in data segment (.DSEG)");
+		return (True);
+	}
+	data = get_next_token(next, TERM_COMMA);
+	name = term_string(pi, next);
+	if (data) {
+		next = data;
+		data = get_next_token(next, TERM_COMMA);
+		if (!get_expr(pi, next, &offset))
+			return (False);
+		if (data) {
+			next = data;
+			data = get_next_token(next, TERM_COMMA);
+			if (!get_expr(pi, next, &length))
+				return (False);
+			have_length = True;
+			if (data) {
+				print_msg(pi, MSGTYPE_ERROR, ".INCBIN takes a file name, an offset and a length");
+				return (True);
 			}
-			advance_ip(pi->cseg, 1);
-		} else {
-			*prev = byte;
 		}
 	}
+	if (!find_include(pi, name, &path))
+		return (False);
+	if (!path) {
+		print_msg(pi, MSGTYPE_ERROR, "Cannot find binary file: %s", name);
+		return (True);
+	}
+	fp = fopen(path, "rb");
+	if (!fp || fseek(fp, 0, SEEK_END) || ((size = ftell(fp)) < 0)) {
+		print_msg(pi, MSGTYPE_ERROR, "Cannot read binary file: %s", path);
+		if (fp)
+			fclose(fp);
+		free(path);
+		return (True);
+	}
+	if ((pi->pass == PASS_1) && !add_binary_file(pi, path)) {
+		fclose(fp);
+		free(path);
+		return (False);
+	}
+	if ((offset < 0) || (offset > size)) {
+		print_msg(pi, MSGTYPE_ERROR, ".INCBIN offset %d is outside of %s (%ld bytes)", offset, path, size);
+		length = 0;
+	} else if (!have_length)
+		length = size - offset;
+	else if ((length < 0) || (length > size - offset)) {
+		print_msg(pi, MSGTYPE_ERROR, ".INCBIN length %d is beyond the end of %s (%ld bytes)", length, path, size);
+		length = 0;
+	}
+	/* Flash is written in words, an odd length gets a zero byte */
+	padded = (pi->segment == pi->cseg) ? length + (length % 2) : length;
+	if ((pi->pass == PASS_2) && !pi->layout && padded) {
+		buff = malloc(padded);
+		if (!buff) {
+			print_msg(pi, MSGTYPE_OUT_OF_MEM, NULL);
+			fclose(fp);
+			free(path);
+			return (False);
+		}
+		buff[padded - 1] = 0;
+		if (fseek(fp, offset, SEEK_SET) || (fread(buff, 1, length, fp) != (size_t)length))
+			print_msg(pi, MSGTYPE_ERROR, "Cannot read binary file: %s", path);
+		else {
+			if (pi->list_line && pi->list_on) {
+				fprintf(pi->list_file, "          %s\n", pi->list_line);
+				pi->list_line = NULL;
+			}
+			if (pi->list_on)
+				for (i = 0; i < padded; i += 16) {
+					fprintf(pi->list_file, "%c:%06lX ", pi->segment->ident,
+					        addr + (pi->segment == pi->cseg ? i / 2 : i));
+					list_hex(pi, &buff[i], padded - i < 16 ? padded - i : 16);
+					fprintf(pi->list_file, "\n");
+				}
+			if (pi->segment == pi->cseg)
+				write_prog_data(pi, addr, buff, padded);
+			else
+				write_ee_data(pi, addr, buff, length);
+		}
+		free(buff);
+	}
+	fclose(fp);
+	free(path);
+	advance_ip(pi->segment, pi->segment == pi->cseg ? padded / 2 : length);
+	return (True);
 }
 
 
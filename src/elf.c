@@ -0,0 +1,873 @@
+/***********************************************************************
+ *
+ *  AVRA - Assembler for the Atmel AVR microcontroller series
+ *
+ *  Copyright (C) 1998-2020 The AVRA Authors
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; see the file COPYING.  If not, write to
+ *  the Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ *  Boston, MA 02111-1307, USA.
+ *
+ *
+ *  Authors of AVRA can be reached at:
+ *     email: jonah@omegav.ntnu.no, tobiw@suprafluid.com
+ *     www: https://github.com/Ro5bert/avra
+ */
+
+/*
+ * ELF output (--elf).
+ *
+ * An ELF32 executable for avr-objdump, gdb and simulators, written next to
+ * the hex files: .text with the code, .eeprom, .bss for the data segment,
+ * a symbol table and DWARF debug information. Addresses follow avr-gcc:
+ * code in bytes from 0, data at 0x800000 and EEPROM at 0x810000.
+ *
+ * The line table maps each code word to the line it came from, in a macro
+ * to the line of the macro body. Each macro expansion is an inlined
+ * subroutine in .debug_info, with the line it was called from, so
+ * debuggers can step over it or into it. Code labels are DW_TAG_label.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "misc.h"
+#include "avra.h"
+#include "args.h"
+#include "device.h"
+
+#define EM_AVR 83
+#define ELF_DATA_OFFSET   0x800000
+#define ELF_EEPROM_OFFSET 0x810000
+
+#define ELF_HEADER_SIZE  52
+#define ELF_PHDR_SIZE    32
+#define ELF_SHDR_SIZE    40
+#define ELF_SYM_SIZE     16
+
+enum {
+	SHT_NULL = 0,
+	SHT_PROGBITS,
+	SHT_SYMTAB,
+	SHT_STRTAB,
+	SHT_NOBITS = 8
+};
+
+#define SHF_WRITE     0x1
+#define SHF_ALLOC     0x2
+#define SHF_EXECINSTR 0x4
+#define SHN_ABS       0xfff1
+
+#define STB_LOCAL  0
+#define STB_GLOBAL 1
+
+/* DWARF 2 line number program */
+#define DW_LNS_copy         1
+#define DW_LNS_advance_pc   2
+#define DW_LNS_advance_line 3
+#define DW_LNS_set_file     4
+#define DW_LNE_end_sequence 1
+#define DW_LNE_set_address  2
+#define LINE_OPCODE_BASE    13
+
+/* DWARF 3 .debug_info, just what is needed for labels and macros */
+#define DW_TAG_label              0x0a
+#define DW_TAG_compile_unit       0x11
+#define DW_TAG_inlined_subroutine 0x1d
+#define DW_TAG_subprogram         0x2e
+#define DW_AT_name            0x03
+#define DW_AT_stmt_list       0x10
+#define DW_AT_low_pc          0x11
+#define DW_AT_high_pc         0x12
+#define DW_AT_language        0x13
+#define DW_AT_inline          0x20
+#define DW_AT_producer        0x25
+#define DW_AT_abstract_origin 0x31
+#define DW_AT_decl_file       0x3a
+#define DW_AT_decl_line       0x3b
+#define DW_AT_call_file       0x58
+#define DW_AT_call_line       0x59
+#define DW_FORM_addr   0x01
+#define DW_FORM_data2  0x05
+#define DW_FORM_data4  0x06
+#define DW_FORM_string 0x08
+#define DW_FORM_data1  0x0b
+#define DW_FORM_udata  0x0f
+#define DW_FORM_ref4   0x13
+#define DW_LANG_Mips_Assembler 0x8001
+#define DW_INL_declared_inlined 3
+
+enum {
+	ABBREV_COMPILE_UNIT = 1,
+	ABBREV_LABEL,
+	ABBREV_MACRO,
+	ABBREV_EXPANSION,
+	ABBREV_LEAF_EXPANSION	/* Without expansions inside */
+};
+
+struct elf_buffer {
+	unsigned char *data;
+	long size;
+	long alloc;
+};
+
+/* Code words and the source line they came from */
+struct elf_line {
+	long address;		/* In bytes */
+	int size;		/* In bytes, a word or the data of a line */
+	int file;		/* include_file->num */
+	int line;
+};
+
+/* A macro expansion, in the order they started */
+struct elf_expansion {
+	struct macro *macro;
+	int parent;		/* Expansion it is in, or -1 */
+	int call_file;
+	int call_line;
+	long low_pc;		/* In bytes */
+	long high_pc;
+};
+
+struct elf_info {
+	FILE *fp;
+	struct elf_buffer text;
+	struct elf_buffer eeprom;
+	struct elf_line *line;
+	int line_count;
+	int line_alloc;
+	struct elf_expansion *expansion;
+	int expansion_count;
+	int expansion_alloc;
+	int current;		/* Innermost open expansion, or -1 */
+};
+
+enum {
+	SECTION_NULL = 0,
+	SECTION_TEXT,
+	SECTION_BSS,
+	SECTION_EEPROM,
+	SECTION_SYMTAB,
+	SECTION_STRTAB,
+	SECTION_DEBUG_LINE,
+	SECTION_DEBUG_INFO,
+	SECTION_DEBUG_ABBREV,
+	SECTION_SHSTRTAB,
+	SECTION_COUNT
+};
+
+static const char *const section_name[SECTION_COUNT] = {
+	"", ".text", ".bss", ".eeprom", ".symtab", ".strtab", ".debug_line", ".debug_info",
+	".debug_abbrev", ".shstrtab"
+};
+
+/* Grow buf to hold size bytes, new bytes are fill */
+static int
+buffer_reserve(struct elf_buffer *buf, long size, int fill)
+{
+	unsigned char *data;
+	long alloc;
+
+	if (size > buf->alloc) {
+		alloc = buf->alloc ? buf->alloc : 256;
+		while (alloc < size)
+			alloc *= 2;
+		data = realloc(buf->data, alloc);
+		if (!data)
+			return (False);
+		buf->data = data;
+		buf->alloc = alloc;
+	}
+	if (size > buf->size) {
+		memset(&buf->data[buf->size], fill, size - buf->size);
+		buf->size = size;
+	}
+	return (True);
+}
+
+static int
+put_bytes(struct elf_buffer *buf, const void *data, long length)
+{
+	if (!buffer_reserve(buf, buf->size + length, 0))
+		return (False);
+	memcpy(&buf->data[buf->size - length], data, length);
+	return (True);
+}
+
+static int
+put8(struct elf_buffer *buf, int value)
+{
+	unsigned char c = value;
+
+	return (put_bytes(buf, &c, 1));
+}
+
+static int
+put16(struct elf_buffer *buf, int value)
+{
+	unsigned char c[2];
+
+	c[0] = value;
+	c[1] = value >> 8;
+	return (put_bytes(buf, c, 2));
+}
+
+static int
+put32(struct elf_buffer *buf, unsigned long value)
+{
+	unsigned char c[4];
+
+	c[0] = value;
+	c[1] = value >> 8;
+	c[2] = value >> 16;
+	c[3] = value >> 24;
+	return (put_bytes(buf, c, 4));
+}
+
+static void
+patch32(struct elf_buffer *buf, long offset, unsigned long value)
+{
+	buf->data[offset] = value;
+	buf->data[offset + 1] = value >> 8;
+	buf->data[offset + 2] = value >> 16;
+	buf->data[offset + 3] = value >> 24;
+}
+
+static int
+put_uleb128(struct elf_buffer *buf, unsigned long value)
+{
+	int ok = True;
+
+	do {
+		ok &= put8(buf, (value & 0x7f) | (value >= 0x80 ? 0x80 : 0));
+		value >>= 7;
+	} while (value);
+	return (ok);
+}
+
+static int
+put_sleb128(struct elf_buffer *buf, long value)
+{
+	int ok = True, more;
+
+	do {
+		more = !(((value >= -64) && (value < 64)));
+		ok &= put8(buf, (value & 0x7f) | (more ? 0x80 : 0));
+		value >>= 7;
+	} while (more);
+	return (ok);
+}
+
+static int
+put_string(struct elf_buffer *buf, const char *s)
+{
+	return (put_bytes(buf, s, strlen(s) + 1));
+}
+
+struct elf_info *
+open_elf_file(struct prog_info *pi, const char *filename)
+{
+	struct elf_info *elf;
+
+	elf = calloc(1, sizeof(struct elf_info));
+	if (!elf) {
+		print_msg(pi, MSGTYPE_OUT_OF_MEM, NULL);
+		return (NULL);
+	}
+	elf->fp = fopen(filename, "wb");
+	if (!elf->fp) {
+		free(elf);
+		return (NULL);
+	}
+	elf->current = -1;
+	return (elf);
+}
+
+/* File and line of the source being assembled, the macro body line in a macro */
+static void
+source_position(struct prog_info *pi, int *file, int *line)
+{
+	if (pi->macro_call) {
+		*file = pi->macro_call->macro->include_file->num;
+		*line = pi->macro_call->macro->first_line_number + pi->macro_call->line_index;
+	} else {
+		*file = pi->fi->include_file->num;
+		*line = pi->fi->line_number;
+	}
+}
+
+void
+write_elf_program(struct prog_info *pi, int address, const unsigned char *data, int count)
+{
+	struct elf_info *elf = pi->elf;
+	struct elf_line *line;
+
+	if (!buffer_reserve(&elf->text, address + count, 0xff)) {
+		print_msg(pi, MSGTYPE_OUT_OF_MEM, NULL);
+		return;
+	}
+	memcpy(&elf->text.data[address], data, count);
+	if (elf->line_count == elf->line_alloc) {
+		line = realloc(elf->line, (elf->line_alloc ? elf->line_alloc * 2 : 256) * sizeof(struct elf_line));
+		if (!line) {
+			print_msg(pi, MSGTYPE_OUT_OF_MEM, NULL);
+			return;
+		}
+		elf->line = line;
+		elf->line_alloc = elf->line_alloc ? elf->line_alloc * 2 : 256;
+	}
+	line = &elf->line[elf->line_count++];
+	line->address = address;
+	line->size = count;
+	source_position(pi, &line->file, &line->line);
+}
+
+/* Called before the lines of a macro are expanded, in pass 2 */
+void
+write_elf_macro_begin(struct prog_info *pi, struct macro *macro)
+{
+	struct elf_info *elf = pi->elf;
+	struct elf_expansion *expansion;
+	int alloc;
+
+	if (elf->expansion_count == elf->expansion_alloc) {
+		alloc = elf->expansion_alloc ? elf->expansion_alloc * 2 : 64;
+		expansion = realloc(elf->expansion, alloc * sizeof(struct elf_expansion));
+		if (!expansion) {
+			print_msg(pi, MSGTYPE_OUT_OF_MEM, NULL);
+			return;
+		}
+		elf->expansion = expansion;
+		elf->expansion_alloc = alloc;
+	}
+	expansion = &elf->expansion[elf->expansion_count];
+	expansion->macro = macro;
+	expansion->parent = elf->current;
+	source_position(pi, &expansion->call_file, &expansion->call_line);
+	expansion->low_pc = expansion->high_pc = pi->cseg->addr * 2;
+	elf->current = elf->expansion_count++;
+}
+
+void
+write_elf_macro_end(struct prog_info *pi)
+{
+	struct elf_info *elf = pi->elf;
+
+	if (elf->current < 0)
+		return;
+	elf->expansion[elf->current].high_pc = pi->cseg->addr * 2;
+	elf->current = elf->expansion[elf->current].parent;
+}
+
+void
+write_elf_eeprom(struct prog_info *pi, int address, const unsigned char *data, int count)
+{
+	if (!buffer_reserve(&pi->elf->eeprom, address + count, 0xff)) {
+		print_msg(pi, MSGTYPE_OUT_OF_MEM, NULL);
+		return;
+	}
+	memcpy(&pi->elf->eeprom.data[address], data, count);
+}
+
+/* e_flags, the avr-gcc architecture of the device */
+static int
+elf_arch(struct device *device)
+{
+	if (device->flag & DF_AVR8L)
+		return (100);
+	if (device->flag & DF_XMEGA)
+		return (device->flash_size > 65536 ? 106 : device->flash_size > 32768 ? 104 : 102);
+	if (device->flash_size > 65536)
+		return (6);
+	if (device->flash_size > 32768)
+		return (51);
+	if (!(device->flag & DF_NO_JMP))
+		return ((device->flag & DF_NO_MUL) ? 3 : 5);
+	if (!(device->flag & DF_NO_MUL))
+		return (4);
+	if (device->flag & DF_TINY1X)
+		return (1);
+	return ((device->flag & DF_NO_MOVW) ? 2 : 25);
+}
+
+static int
+add_symbol(struct elf_buffer *symtab, struct elf_buffer *strtab, const char *name,
+           unsigned long value, int bind, int section)
+{
+	int ok;
+
+	ok = put32(symtab, strtab->size);
+	ok &= put32(symtab, value);
+	ok &= put32(symtab, 0);
+	ok &= put8(symtab, bind << 4);
+	ok &= put8(symtab, 0);
+	ok &= put16(symtab, section);
+	return (ok & put_string(strtab, name));
+}
+
+static int
+is_global(struct prog_info *pi, struct label *label)
+{
+	return (label->atom && pi->atom[label->atom].global);
+}
+
+/* Labels, constants and variables; local ones first, as ELF wants.
+ * Returns the index of the first global symbol. */
+static int
+make_symtab(struct prog_info *pi, struct elf_buffer *symtab, struct elf_buffer *strtab,
+            const int *index, int *ok)
+{
+	struct label *label;
+	int bind, first_global = 1, section;
+	unsigned long value;
+
+	*ok = put_bytes(symtab, "\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0", ELF_SYM_SIZE);
+	*ok &= put8(strtab, 0);
+	for (bind = STB_LOCAL; bind <= STB_GLOBAL; bind++) {
+		for (label = pi->first_label; label; label = label->next) {
+			if (is_global(pi, label) != (bind == STB_GLOBAL))
+				continue;
+			if (label->segment == pi->cseg) {
+				value = label->value * 2;
+				section = index[SECTION_TEXT];
+			} else if (label->segment == pi->dseg) {
+				value = ELF_DATA_OFFSET + label->value;
+				section = index[SECTION_BSS] ? index[SECTION_BSS] : SHN_ABS;
+			} else {
+				value = ELF_EEPROM_OFFSET + label->value;
+				section = index[SECTION_EEPROM] ? index[SECTION_EEPROM] : SHN_ABS;
+			}
+			*ok &= add_symbol(symtab, strtab, label->name, value, bind, section);
+		}
+		/* Device symbols have no origin */
+		for (label = pi->first_constant; label; label = label->next)
+			if (label->include_file && (is_global(pi, label) == (bind == STB_GLOBAL)))
+				*ok &= add_symbol(symtab, strtab, label->name, label->value, bind, SHN_ABS);
+		for (label = pi->first_variable; label; label = label->next)
+			if (label->include_file && (bind == STB_LOCAL))
+				*ok &= add_symbol(symtab, strtab, label->name, label->value, bind, SHN_ABS);
+		if (bind == STB_LOCAL)
+			first_global = symtab->size / ELF_SYM_SIZE;
+	}
+	return (first_global);
+}
+
+static int
+compare_line(const void *a, const void *b)
+{
+	const struct elf_line *la = a, *lb = b;
+
+	if (la->address != lb->address)
+		return (la->address < lb->address ? -1 : 1);
+	return (0);
+}
+
+static int
+end_sequence(struct elf_buffer *buf, long advance)
+{
+	int ok;
+
+	ok = put8(buf, DW_LNS_advance_pc);
+	ok &= put_uleb128(buf, advance);
+	ok &= put8(buf, 0);
+	ok &= put8(buf, 1);
+	return (ok & put8(buf, DW_LNE_end_sequence));
+}
+
+/* DWARF 2 .debug_line: a row where the file or line changes, a new
+ * sequence where the code has a gap */
+static int
+make_debug_line(struct prog_info *pi, struct elf_buffer *buf)
+{
+	static const unsigned char opcode_lengths[LINE_OPCODE_BASE - 1] = {0, 1, 1, 1, 1, 0, 0, 0, 1, 0, 0, 1};
+	struct elf_info *elf = pi->elf;
+	struct include_file *include_file;
+	struct elf_line *line;
+	long header_start, address = 0, next = -1;
+	int i, ok, file = 1, line_number = 1;
+
+	ok = put32(buf, 0);		/* unit_length, patched */
+	ok &= put16(buf, 2);		/* version */
+	ok &= put32(buf, 0);		/* header_length, patched */
+	header_start = buf->size;
+	ok &= put8(buf, 1);		/* minimum_instruction_length */
+	ok &= put8(buf, 1);		/* default_is_stmt */
+	ok &= put8(buf, -5);		/* line_base */
+	ok &= put8(buf, 14);		/* line_range */
+	ok &= put8(buf, LINE_OPCODE_BASE);
+	ok &= put_bytes(buf, opcode_lengths, sizeof(opcode_lengths));
+	ok &= put8(buf, 0);		/* no include_directories */
+	for (include_file = pi->first_include_file; include_file; include_file = include_file->next) {
+		ok &= put_string(buf, include_file->name);
+		ok &= put8(buf, 0);	/* directory, time, length */
+		ok &= put8(buf, 0);
+		ok &= put8(buf, 0);
+	}
+	ok &= put8(buf, 0);
+	patch32(buf, header_start - 4, buf->size - header_start);
+
+	qsort(elf->line, elf->line_count, sizeof(struct elf_line), compare_line);
+	for (i = 0; i < elf->line_count; i++) {
+		line = &elf->line[i];
+		if (line->address == next) {
+			next += line->size;
+			if ((line->file + 1 == file) && (line->line == line_number))
+				continue;
+			ok &= put8(buf, DW_LNS_advance_pc);
+			ok &= put_uleb128(buf, line->address - address);
+		} else {
+			if (next >= 0) {
+				ok &= end_sequence(buf, next - address);
+				file = 1;
+				line_number = 1;
+			}
+			ok &= put8(buf, 0);
+			ok &= put8(buf, 5);
+			ok &= put8(buf, DW_LNE_set_address);
+			ok &= put32(buf, line->address);
+			next = line->address + line->size;
+		}
+		address = line->address;
+		if (line->file + 1 != file) {
+			file = line->file + 1;
+			ok &= put8(buf, DW_LNS_set_file);
+			ok &= put_uleb128(buf, file);
+		}
+		if (line->line != line_number) {
+			ok &= put8(buf, DW_LNS_advance_line);
+			ok &= put_sleb128(buf, line->line - line_number);
+			line_number = line->line;
+		}
+		ok &= put8(buf, DW_LNS_copy);
+	}
+	if (next >= 0)
+		ok &= end_sequence(buf, next - address);
+	patch32(buf, 0, buf->size - 4);
+	return (ok);
+}
+
+static int
+make_debug_abbrev(struct elf_buffer *buf)
+{
+	static const unsigned char abbrev[] = {
+		ABBREV_COMPILE_UNIT, DW_TAG_compile_unit, 1,
+		DW_AT_producer, DW_FORM_string, DW_AT_language, DW_FORM_data2,
+		DW_AT_name, DW_FORM_string, DW_AT_stmt_list, DW_FORM_data4,
+		DW_AT_low_pc, DW_FORM_addr, DW_AT_high_pc, DW_FORM_addr, 0, 0,
+		ABBREV_LABEL, DW_TAG_label, 0,
+		DW_AT_name, DW_FORM_string, DW_AT_decl_file, DW_FORM_udata,
+		DW_AT_decl_line, DW_FORM_udata, DW_AT_low_pc, DW_FORM_addr, 0, 0,
+		ABBREV_MACRO, DW_TAG_subprogram, 0,
+		DW_AT_name, DW_FORM_string, DW_AT_decl_file, DW_FORM_udata,
+		DW_AT_decl_line, DW_FORM_udata, DW_AT_inline, DW_FORM_data1, 0, 0,
+		ABBREV_EXPANSION, DW_TAG_inlined_subroutine, 1,
+		DW_AT_abstract_origin, DW_FORM_ref4, DW_AT_low_pc, DW_FORM_addr,
+		DW_AT_high_pc, DW_FORM_addr, DW_AT_call_file, DW_FORM_udata,
+		DW_AT_call_line, DW_FORM_udata, 0, 0,
+		ABBREV_LEAF_EXPANSION, DW_TAG_inlined_subroutine, 0,
+		DW_AT_abstract_origin, DW_FORM_ref4, DW_AT_low_pc, DW_FORM_addr,
+		DW_AT_high_pc, DW_FORM_addr, DW_AT_call_file, DW_FORM_udata,
+		DW_AT_call_line, DW_FORM_udata, 0, 0,
+		0
+	};
+	return (put_bytes(buf, abbrev, sizeof(abbrev)));
+}
+
+static int
+is_inside(struct elf_info *elf, int inner, int outer)
+{
+	while (inner > outer)
+		inner = elf->expansion[inner].parent;
+	return (inner == outer);
+}
+
+/* Whether an expansion that made code has one inside that did too. Those
+ * inside directly follow it. */
+static int
+has_inner(struct elf_info *elf, int outer)
+{
+	int i;
+
+	for (i = outer + 1; i < elf->expansion_count; i++)
+		if (elf->expansion[i].high_pc > elf->expansion[i].low_pc)
+			return (is_inside(elf, i, outer));
+	return (False);
+}
+
+/* DWARF 3 .debug_info: one compile unit with the code labels, an abstract
+ * subprogram for each macro and an inlined subroutine for each expansion
+ * that made code. Expansions nest as the macros did. */
+static int
+make_debug_info(struct prog_info *pi, struct elf_buffer *buf)
+{
+	struct elf_info *elf = pi->elf;
+	struct elf_expansion *expansion;
+	struct macro *macro;
+	struct label *label;
+	long *origin;
+	int *open;
+	int i, depth = 0, inner, ok;
+
+	origin = calloc(pi->atom_count + 1, sizeof(long));
+	open = malloc((elf->expansion_count + 1) * sizeof(int));
+	if (!origin || !open) {
+		free(origin);
+		free(open);
+		return (False);
+	}
+
+	ok = put32(buf, 0);		/* unit_length, patched */
+	ok &= put16(buf, 3);		/* version */
+	ok &= put32(buf, 0);		/* debug_abbrev_offset */
+	ok &= put8(buf, 4);		/* address_size */
+	ok &= put_uleb128(buf, ABBREV_COMPILE_UNIT);
+	ok &= put_bytes(buf, "AVRA " VERSION, sizeof("AVRA " VERSION));
+	ok &= put16(buf, DW_LANG_Mips_Assembler);
+	ok &= put_string(buf, pi->first_include_file->name);
+	ok &= put32(buf, 0);		/* stmt_list */
+	ok &= put32(buf, 0);
+	ok &= put32(buf, elf->text.size);
+
+	for (label = pi->first_label; label; label = label->next) {
+		if ((label->segment != pi->cseg) || !label->include_file)
+			continue;
+		ok &= put_uleb128(buf, ABBREV_LABEL);
+		ok &= put_string(buf, label->name);
+		ok &= put_uleb128(buf, label->include_file->num + 1);
+		ok &= put_uleb128(buf, label->line_number);
+		ok &= put32(buf, label->value * 2);
+	}
+
+	/* origin[] holds the offset of each macro's DIE, by atom */
+	for (i = 0; i < elf->expansion_count; i++) {
+		expansion = &elf->expansion[i];
+		macro = expansion->macro;
+		if ((expansion->high_pc <= expansion->low_pc) || origin[macro->atom])
+			continue;
+		origin[macro->atom] = buf->size;
+		ok &= put_uleb128(buf, ABBREV_MACRO);
+		ok &= put_string(buf, macro->name);
+		ok &= put_uleb128(buf, macro->include_file->num + 1);
+		ok &= put_uleb128(buf, macro->first_line_number);
+		ok &= put8(buf, DW_INL_declared_inlined);
+	}
+
+	for (i = 0; i < elf->expansion_count; i++) {
+		expansion = &elf->expansion[i];
+		if (expansion->high_pc <= expansion->low_pc)
+			continue;
+		while (depth && !is_inside(elf, i, open[depth - 1])) {
+			ok &= put8(buf, 0);
+			depth--;
+		}
+		inner = has_inner(elf, i);
+		ok &= put_uleb128(buf, inner ? ABBREV_EXPANSION : ABBREV_LEAF_EXPANSION);
+		ok &= put32(buf, origin[expansion->macro->atom]);
+		ok &= put32(buf, expansion->low_pc);
+		ok &= put32(buf, expansion->high_pc);
+		ok &= put_uleb128(buf, expansion->call_file + 1);
+		ok &= put_uleb128(buf, expansion->call_line);
+		if (inner)
+			open[depth++] = i;
+	}
+	while (depth--)
+		ok &= put8(buf, 0);
+	ok &= put8(buf, 0);		/* end of the compile unit's children */
+	patch32(buf, 0, buf->size - 4);
+	free(origin);
+	free(open);
+	return (ok);
+}
+
+static int
+put_section_header(struct elf_buffer *buf, long name, int type, int flags, unsigned long addr,
+                   long offset, long size, int link, int info, int align, int entsize)
+{
+	int ok;
+
+	ok = put32(buf, name);
+	ok &= put32(buf, type);
+	ok &= put32(buf, flags);
+	ok &= put32(buf, addr);
+	ok &= put32(buf, offset);
+	ok &= put32(buf, size);
+	ok &= put32(buf, link);
+	ok &= put32(buf, info);
+	ok &= put32(buf, align);
+	return (ok & put32(buf, entsize));
+}
+
+static int
+put_program_header(struct elf_buffer *buf, long offset, unsigned long addr, long filesz, long memsz, int flags)
+{
+	int ok;
+
+	ok = put32(buf, 1);		/* PT_LOAD */
+	ok &= put32(buf, offset);
+	ok &= put32(buf, addr);
+	ok &= put32(buf, addr);
+	ok &= put32(buf, filesz);
+	ok &= put32(buf, memsz);
+	ok &= put32(buf, flags);
+	return (ok & put32(buf, 1));
+}
+
+int
+write_elf_file(struct prog_info *pi)
+{
+	struct elf_info *elf = pi->elf;
+	struct elf_buffer file, symtab, strtab, debug_line, debug_info, debug_abbrev, shstrtab;
+	int index[SECTION_COUNT], name[SECTION_COUNT];
+	long offset[SECTION_COUNT], size[SECTION_COUNT];
+	int i, ok, count = 0, phnum = 0, first_global;
+	long shoff;
+
+	memset(&file, 0, sizeof(file));
+	memset(&symtab, 0, sizeof(symtab));
+	memset(&strtab, 0, sizeof(strtab));
+	memset(&debug_line, 0, sizeof(debug_line));
+	memset(&debug_info, 0, sizeof(debug_info));
+	memset(&debug_abbrev, 0, sizeof(debug_abbrev));
+	memset(&shstrtab, 0, sizeof(shstrtab));
+	/* Sections in use, and their numbers */
+	for (i = 0; i < SECTION_COUNT; i++) {
+		index[i] = 0;
+		if (((i == SECTION_TEXT) && !elf->text.size)
+		        || ((i == SECTION_BSS) && !pi->dseg->count)
+		        || ((i == SECTION_EEPROM) && !elf->eeprom.size))
+			continue;
+		index[i] = count++;
+	}
+	phnum = (index[SECTION_TEXT] != 0) + (index[SECTION_BSS] != 0) + (index[SECTION_EEPROM] != 0);
+	first_global = make_symtab(pi, &symtab, &strtab, index, &ok);
+	ok &= make_debug_line(pi, &debug_line);
+	ok &= make_debug_info(pi, &debug_info);
+	ok &= make_debug_abbrev(&debug_abbrev);
+	for (i = 0; i < SECTION_COUNT; i++) {
+		name[i] = shstrtab.size;
+		ok &= put_string(&shstrtab, section_name[i]);
+	}
+
+	/* File layout: header, program headers, section contents, section headers */
+	offset[SECTION_NULL] = 0;
+	size[SECTION_NULL] = 0;
+	offset[SECTION_TEXT] = ELF_HEADER_SIZE + phnum * ELF_PHDR_SIZE;
+	size[SECTION_TEXT] = elf->text.size;
+	offset[SECTION_BSS] = offset[SECTION_TEXT] + size[SECTION_TEXT];
+	size[SECTION_BSS] = pi->dseg->count;
+	offset[SECTION_EEPROM] = offset[SECTION_BSS];
+	size[SECTION_EEPROM] = elf->eeprom.size;
+	offset[SECTION_SYMTAB] = (offset[SECTION_EEPROM] + size[SECTION_EEPROM] + 3) & ~3L;
+	size[SECTION_SYMTAB] = symtab.size;
+	offset[SECTION_STRTAB] = offset[SECTION_SYMTAB] + size[SECTION_SYMTAB];
+	size[SECTION_STRTAB] = strtab.size;
+	offset[SECTION_DEBUG_LINE] = offset[SECTION_STRTAB] + size[SECTION_STRTAB];
+	size[SECTION_DEBUG_LINE] = debug_line.size;
+	offset[SECTION_DEBUG_INFO] = offset[SECTION_DEBUG_LINE] + size[SECTION_DEBUG_LINE];
+	size[SECTION_DEBUG_INFO] = debug_info.size;
+	offset[SECTION_DEBUG_ABBREV] = offset[SECTION_DEBUG_INFO] + size[SECTION_DEBUG_INFO];
+	size[SECTION_DEBUG_ABBREV] = debug_abbrev.size;
+	offset[SECTION_SHSTRTAB] = offset[SECTION_DEBUG_ABBREV] + size[SECTION_DEBUG_ABBREV];
+	size[SECTION_SHSTRTAB] = shstrtab.size;
+	shoff = (offset[SECTION_SHSTRTAB] + size[SECTION_SHSTRTAB] + 3) & ~3L;
+
+	ok &= put_bytes(&file, "\177ELF\1\1\1\0\0\0\0\0\0\0\0\0", 16);
+	ok &= put16(&file, 2);		/* ET_EXEC */
+	ok &= put16(&file, EM_AVR);
+	ok &= put32(&file, 1);		/* EV_CURRENT */
+	ok &= put32(&file, 0);		/* entry */
+	ok &= put32(&file, phnum ? ELF_HEADER_SIZE : 0);
+	ok &= put32(&file, shoff);
+	ok &= put32(&file, elf_arch(pi->device));
+	ok &= put16(&file, ELF_HEADER_SIZE);
+	ok &= put16(&file, ELF_PHDR_SIZE);
+	ok &= put16(&file, phnum);
+	ok &= put16(&file, ELF_SHDR_SIZE);
+	ok &= put16(&file, count);
+	ok &= put16(&file, index[SECTION_SHSTRTAB]);
+	if (index[SECTION_TEXT])
+		ok &= put_program_header(&file, offset[SECTION_TEXT], 0, size[SECTION_TEXT], size[SECTION_TEXT], 5);
+	if (index[SECTION_BSS])
+		ok &= put_program_header(&file, offset[SECTION_BSS], ELF_DATA_OFFSET + pi->dseg->lo_addr,
+		                         0, size[SECTION_BSS], 6);
+	if (index[SECTION_EEPROM])
+		ok &= put_program_header(&file, offset[SECTION_EEPROM], ELF_EEPROM_OFFSET,
+		                         size[SECTION_EEPROM], size[SECTION_EEPROM], 6);
+	ok &= put_bytes(&file, elf->text.data, elf->text.size);
+	ok &= put_bytes(&file, elf->eeprom.data, elf->eeprom.size);
+	ok &= buffer_reserve(&file, offset[SECTION_SYMTAB], 0);
+	ok &= put_bytes(&file, symtab.data, symtab.size);
+	ok &= put_bytes(&file, strtab.data, strtab.size);
+	ok &= put_bytes(&file, debug_line.data, debug_line.size);
+	ok &= put_bytes(&file, debug_info.data, debug_info.size);
+	ok &= put_bytes(&file, debug_abbrev.data, debug_abbrev.size);
+	ok &= put_bytes(&file, shstrtab.data, shstrtab.size);
+	ok &= buffer_reserve(&file, shoff, 0);
+
+	ok &= put_section_header(&file, 0, SHT_NULL, 0, 0, 0, 0, 0, 0, 0, 0);
+	if (index[SECTION_TEXT])
+		ok &= put_section_header(&file, name[SECTION_TEXT], SHT_PROGBITS, SHF_ALLOC | SHF_EXECINSTR, 0,
+		                         offset[SECTION_TEXT], size[SECTION_TEXT], 0, 0, 2, 0);
+	if (index[SECTION_BSS])
+		ok &= put_section_header(&file, name[SECTION_BSS], SHT_NOBITS, SHF_ALLOC | SHF_WRITE,
+		                         ELF_DATA_OFFSET + pi->dseg->lo_addr, offset[SECTION_BSS],
+		                         size[SECTION_BSS], 0, 0, 1, 0);
+	if (index[SECTION_EEPROM])
+		ok &= put_section_header(&file, name[SECTION_EEPROM], SHT_PROGBITS, SHF_ALLOC | SHF_WRITE,
+		                         ELF_EEPROM_OFFSET, offset[SECTION_EEPROM], size[SECTION_EEPROM], 0, 0, 1, 0);
+	ok &= put_section_header(&file, name[SECTION_SYMTAB], SHT_SYMTAB, 0, 0, offset[SECTION_SYMTAB],
+	                         size[SECTION_SYMTAB], index[SECTION_STRTAB], first_global, 4, ELF_SYM_SIZE);
+	ok &= put_section_header(&file, name[SECTION_STRTAB], SHT_STRTAB, 0, 0, offset[SECTION_STRTAB],
+	                         size[SECTION_STRTAB], 0, 0, 1, 0);
+	ok &= put_section_header(&file, name[SECTION_DEBUG_LINE], SHT_PROGBITS, 0, 0, offset[SECTION_DEBUG_LINE],
+	                         size[SECTION_DEBUG_LINE], 0, 0, 1, 0);
+	ok &= put_section_header(&file, name[SECTION_DEBUG_INFO], SHT_PROGBITS, 0, 0, offset[SECTION_DEBUG_INFO],
+	                         size[SECTION_DEBUG_INFO], 0, 0, 1, 0);
+	ok &= put_section_header(&file, name[SECTION_DEBUG_ABBREV], SHT_PROGBITS, 0, 0,
+	                         offset[SECTION_DEBUG_ABBREV], size[SECTION_DEBUG_ABBREV], 0, 0, 1, 0);
+	ok &= put_section_header(&file, name[SECTION_SHSTRTAB], SHT_STRTAB, 0, 0, offset[SECTION_SHSTRTAB],
+	                         size[SECTION_SHSTRTAB], 0, 0, 1, 0);
+
+	if (!ok)
+		print_msg(pi, MSGTYPE_OUT_OF_MEM, NULL);
+	else if (fwrite(file.data, 1, file.size, elf->fp) != (size_t)file.size) {
+		print_msg(pi, MSGTYPE_ERROR, "Could not write ELF file!");
+		ok = False;
+	}
+	free(file.data);
+	free(symtab.data);
+	free(strtab.data);
+	free(debug_line.data);
+	free(debug_info.data);
+	free(debug_abbrev.data);
+	free(shstrtab.data);
+	return (ok);
+}
+
+void
+close_elf_file(struct prog_info *pi)
+{
+	struct elf_info *elf = pi->elf;
+
+	fclose(elf->fp);
+	free(elf->text.data);
+	free(elf->eeprom.data);
+	free(elf->line);
+	free(elf->expansion);
+	free(elf);
+	pi->elf = NULL;
+}
+
+/* end of elf.c */
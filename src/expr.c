@@ -78,6 +78,7 @@ enum {
 struct element {
 	struct element *next;
 	int data;
+	struct reloc_ref ref;	/* Only with --module */
 };
 
 char *function_list[] = {
@@ -249,6 +250,61 @@ calc(struct prog_info *pi, int left, int operator, int right) /* TODO: Sjekk lit
 	}
 }
 
+/* The relocation of left operator right, in module mode. Only what the
+ * linker can patch is allowed: adding to or subtracting from an address,
+ * the difference of two addresses in the same section and making a byte
+ * address out of a code address. */
+static void
+calc_ref(struct prog_info *pi, struct element *left, int operator, struct element *right)
+{
+	struct reloc_ref *ref = NULL;
+
+	if (!is_relocatable(&left->ref) && !is_relocatable(&right->ref))
+		return;
+	if ((left->ref.function == RELOC_FN_NONE) && (right->ref.function == RELOC_FN_NONE)) {
+		switch (operator) {
+		case OPERATOR_ADD:
+			if (!is_relocatable(&right->ref))
+				ref = &left->ref;
+			else if (!is_relocatable(&left->ref))
+				ref = &right->ref;
+			break;
+		case OPERATOR_SUB:
+			if (!is_relocatable(&right->ref))
+				ref = &left->ref;
+			else if ((left->ref.segment == right->ref.segment)
+			         && (left->ref.symbol == right->ref.symbol)
+			         && (left->ref.scale == right->ref.scale)) {
+				memset(&left->ref, 0, sizeof(struct reloc_ref));
+				return;
+			}
+			break;
+		case OPERATOR_MUL:
+			if (!is_relocatable(&right->ref) && (right->data == 2))
+				ref = &left->ref;
+			else if (!is_relocatable(&left->ref) && (left->data == 2))
+				ref = &right->ref;
+			if (ref && (ref->scale == 1))
+				ref->scale = 2;
+			else
+				ref = NULL;
+			break;
+		case OPERATOR_SHIFT_LEFT:
+			if (!is_relocatable(&right->ref) && (right->data == 1) && (left->ref.scale == 1)) {
+				ref = &left->ref;
+				ref->scale = 2;
+			}
+			break;
+		}
+	}
+	if (!ref) {
+		print_msg(pi, MSGTYPE_ERROR, "The linker can't calculate this expression with an address");
+		memset(&left->ref, 0, sizeof(struct reloc_ref));
+		return;
+	}
+	left->ref = *ref;
+}
+
 /* If found, return the ID of the internal function */
 int
 get_function(char *function)
@@ -271,6 +327,28 @@ get_function(char *function)
 	return (-1);
 }
 
+/* Functions the linker applies after relocating */
+static void
+function_ref(struct prog_info *pi, int function, struct reloc_ref *ref)
+{
+	if (ref->function == RELOC_FN_NONE) {
+		switch (function) {
+		case FUNCTION_LOW:
+		case FUNCTION_BYTE1:
+			ref->function = RELOC_FN_LOW;
+			return;
+		case FUNCTION_HIGH:
+		case FUNCTION_BYTE2:
+			ref->function = RELOC_FN_HIGH;
+			return;
+		case FUNCTION_LWRD:
+			return;
+		}
+	}
+	print_msg(pi, MSGTYPE_ERROR, "The linker can't calculate %s() of an address", function_list[function]);
+	memset(ref, 0, sizeof(struct reloc_ref));
+}
+
 unsigned int
 do_function(int function, int value)
 {
@@ -301,26 +379,100 @@ do_function(int function, int value)
 }
 
 
+/* Evaluates a .EQU constant when it is first used. Whether its value
+ * depends on labels is passed on to the expression using it. Errors are
+ * reported once, at the line of the .EQU. */
+int
+eval_constant(struct prog_info *pi, struct label *label)
+{
+	struct file_info fi, *saved_fi = pi->fi;
+	struct macro_call *macro_call = pi->macro_call;
+	char *buff;
+	int ok;
+	int expr_labels = pi->expr_labels;
+	int error_count = pi->error_count;
+
+	if (label->state == CONST_EVALUATING) {
+		print_msg(pi, MSGTYPE_ERROR, "Constant %s is defined in terms of itself", label->name);
+		return (False);
+	}
+	if (label->state == CONST_PENDING) {
+		buff = malloc(strlen(label->expr) + 1);
+		if (!buff) {
+			print_msg(pi, MSGTYPE_OUT_OF_MEM, NULL);
+			return (False);
+		}
+		strcpy(buff, label->expr);
+		if (label->include_file) {
+			memset(&fi, 0, sizeof(fi));
+			fi.include_file = label->include_file;
+			fi.line_number = label->line_number;
+			pi->fi = &fi;
+		}
+		pi->macro_call = NULL; /* Deferred constants don't use macro labels */
+		label->state = CONST_EVALUATING;
+		pi->expr_labels = False;
+		ok = get_reloc_expr(pi, buff, &label->value) && (pi->error_count == error_count);
+		free(buff);
+		pi->fi = saved_fi;
+		pi->macro_call = macro_call;
+		label->state = CONST_EVALUATED;
+		label->uses_labels = pi->expr_labels;
+		label->ref = pi->expr_ref;
+		pi->expr_labels = expr_labels;
+		if (!ok)
+			return (False);
+	}
+	if (label->uses_labels)
+		pi->expr_labels = True;
+	return (True);
+}
+
+/* After pass 1, the .EQU constants nothing used are checked as well */
+void
+eval_pending_constants(struct prog_info *pi)
+{
+	struct label *label;
+
+	for (label = pi->first_constant; label; label = label->next)
+		if (label->state == CONST_PENDING)
+			eval_constant(pi, label);
+}
+
 int
 get_symbol(struct prog_info *pi, char *label_name, int *data)
 {
 	struct label *label;
 	struct macro_call *macro_call;
 
-	if (get_constant(pi,label_name,data)) return (True);
-	if (get_variable(pi,label_name,data)) return (True);
-
-	for (macro_call = pi->macro_call; macro_call; macro_call = macro_call->prev_on_stack) {
-		for (label = pi->macro_call->first_label; label; label = label->next)
-			if (!nocase_strcmp(label->name, label_name)) {
+	label = test_constant(pi, label_name, NULL);
+	if ((label != NULL) && data)
+		eval_constant(pi, label); /* Errors are reported, the symbol exists */
+	if (label == NULL)
+		label = test_variable(pi, label_name, NULL);
+	if (label == NULL) {
+		for (macro_call = pi->macro_call; macro_call; macro_call = macro_call->prev_on_stack) {
+			label = search_local(pi, label_name);
+			if (label) {
 				if (data)
 					*data = label->value;
+				symbol_ref(pi, label);
+				pi->expr_labels = True;
+				pi->expr_label = label;
 				return (True);
 			}
+		}
+		label = test_label(pi, label_name, NULL);
+		if (label == NULL)
+			return (False);
+		pi->expr_labels = True;
+		pi->expr_label = label;
 	}
-
-	if (get_label(pi,label_name,data)) return (True);
-	return (False);
+	if (data)
+		*data = label->value;
+	symbol_ref(pi, label);
+	add_symbol_ref(pi, label);
+	return (True);
 }
 
 
@@ -346,12 +498,13 @@ int
 get_expr(struct prog_info *pi, char *data, int *value)
 {
 	/* Definition */
-	int ok, end, i, count, first_flag, length, function;
+	int ok, end, i, count, first_flag, length, function, addr;
 	char unary, *label;
 	struct element *element, *first_element = NULL, *temp_element;
 	struct element **last_element = &first_element;
 
 	/* Initialisation */
+	pi->expr_depth++;
 	first_flag  = True;
 	ok          = True;
 	end         = False;
@@ -406,6 +559,7 @@ get_expr(struct prog_info *pi, char *data, int *value)
 				break;
 			}
 			element->next = NULL;
+			memset(&element->ref, 0, sizeof(struct reloc_ref));
 			length = 0;
 			if (isdigit(data[i])) {
 				if (tolower(data[i + 1]) == 'x') {
@@ -446,6 +600,7 @@ get_expr(struct prog_info *pi, char *data, int *value)
 				ok = get_expr(pi, &data[i], &element->data);
 				if (!ok)
 					break;
+				element->ref = pi->expr_ref;
 			}
 			/* test for internal function */
 			else if ((function = get_function(&data[i])) != -1) {
@@ -461,6 +616,9 @@ get_expr(struct prog_info *pi, char *data, int *value)
 				ok = get_expr(pi, &data[i], &element->data);
 				if (!ok)
 					break;
+				element->ref = pi->expr_ref;
+				if (is_relocatable(&element->ref))
+					function_ref(pi, function, &element->ref);
 				element->data = do_function(function, element->data);
 			} else if (!nocase_strncmp(&data[i], "defined(", 8)) {
 				i += 8;
@@ -497,11 +655,34 @@ get_expr(struct prog_info *pi, char *data, int *value)
 						element->data = 0;
 					}
 				}
+			} else if (!nocase_strncmp(&data[i], "clobbers(", 9)) {
+				i += 9;
+				length = par_length(&data[i]);
+				if (length == -1) {
+					print_msg(pi, MSGTYPE_ERROR, "Missing ')'");
+					break;
+				}
+				data[i + length++] = '\0';
+				/* The label may follow, the layout passes give the value */
+				element->data = 0;
+				if (pi->pass == PASS_1)
+					pi->clobbers_used = True;
+				else {
+					pi->expr_label = NULL;
+					ok = get_expr(pi, &data[i], &addr)
+					     && get_clobbers(pi, &data[i], pi->expr_label, addr, &element->data);
+					if (!ok)
+						break;
+				}
 			} else {
 				while (IS_LABEL(data[i + length])) length++;
-				if ((length == 2) && !nocase_strncmp(&data[i], "PC", 2))
+				if ((length == 2) && !nocase_strncmp(&data[i], "PC", 2)) {
 					element->data = pi->cseg->addr;
-				else {
+					if (pi->module) {
+						element->ref.segment = pi->cseg;
+						element->ref.scale = 1;
+					}
+				} else {
 					label = malloc(length + 1);
 					if (!label) {
 						print_msg(pi, MSGTYPE_OUT_OF_MEM, NULL);
@@ -510,9 +691,10 @@ get_expr(struct prog_info *pi, char *data, int *value)
 					}
 					strncpy(label, &data[i], length);
 					label[length] = '\0';
-					if (get_symbol(pi, label, &element->data))
+					if (get_symbol(pi, label, &element->data)) {
+						element->ref = pi->expr_ref;
 						free(label);
-					else {
+					} else {
 						print_msg(pi, MSGTYPE_ERROR, "Found no label/variable/constant named %s", label);
 						free(label);
 						break;
@@ -521,6 +703,10 @@ get_expr(struct prog_info *pi, char *data, int *value)
 			}
 			/* now the expression has been evaluated */
 			i += length - 1;
+			if (unary && is_relocatable(&element->ref)) {
+				print_msg(pi, MSGTYPE_ERROR, "The linker can't calculate %c of an address", unary);
+				memset(&element->ref, 0, sizeof(struct reloc_ref));
+			}
 			switch (unary) { /* TODO: Få den til å takle flere unary på rad. */
 			case '-':
 				element->data = -element->data;
@@ -541,6 +727,8 @@ get_expr(struct prog_info *pi, char *data, int *value)
 		for (i = 13; (i >= 4) && (count != 1); i--) {
 			for (element = first_element; element->next;) {
 				if (test_operator_at_precedence(element->next->data, i)) { /* TODO: Vurder en hi_i for kjapphet */
+					if (pi->module)
+						calc_ref(pi, element, element->next->data, element->next->next);
 					element->data = calc(pi, element->data, element->next->data, element->next->next->data);
 					temp_element = element->next->next->next;
 					free(element->next->next);
@@ -552,7 +740,16 @@ get_expr(struct prog_info *pi, char *data, int *value)
 			}
 		}
 		*value = first_element->data;
-	}
+		pi->expr_ref = first_element->ref;
+		if (pi->expr_ref.function == RELOC_FN_NONE)
+			pi->expr_ref.addend = *value;
+		if ((pi->expr_depth == 1) && !pi->expr_reloc && is_relocatable(&pi->expr_ref)) {
+			print_msg(pi, MSGTYPE_ERROR, "This value is only known after linking");
+			memset(&pi->expr_ref, 0, sizeof(struct reloc_ref));
+		}
+	} else
+		memset(&pi->expr_ref, 0, sizeof(struct reloc_ref));
+	pi->expr_depth--;
 	for (element = first_element; element;) {
 		temp_element = element;
 		element = element->next;
@@ -35,6 +35,7 @@
 #include "misc.h"
 #include "avra.h"
 #include "args.h"
+#include "device.h"
 
 int
 open_out_files(struct prog_info *pi, const char *basename, const char *outputfile,
@@ -59,31 +60,55 @@ open_out_files(struct prog_info *pi, const char *basename, const char *outputfil
 		buff[length] = '\0';
 	}
 
-	/* open files for code output */
-	strcpy(&buff[length], ".hex");
-	if (!(pi->cseg->hfi = open_hex_file((outputfile == NULL) ? buff : outputfile))) {
-		print_msg(pi, MSGTYPE_ERROR, "Could not create output hex file!");
-		ok = False;
-	}
+	if (pi->in_memory) {
+		/* avra-sim: keep flash and EEPROM in memory, erased. Flash only up
+		 * to the end of the code, as the device may be the 4M word default. */
+		pi->flash_image_size = pi->cseg->occupancy_size;
+		pi->flash_image = malloc((pi->flash_image_size + 1) * sizeof(unsigned short));
+		pi->eeprom_image = malloc(pi->device->eeprom_size + 1);
+		if ((pi->flash_image == NULL) || (pi->eeprom_image == NULL)) {
+			print_msg(pi, MSGTYPE_OUT_OF_MEM, NULL);
+			free(buff);
+			return (False);
+		}
+		memset(pi->flash_image, 0xff, (pi->flash_image_size + 1) * sizeof(unsigned short));
+		memset(pi->eeprom_image, 0xff, pi->device->eeprom_size + 1);
+		pi->coff_file = 0;
+	} else {
+		/* open files for code output */
+		strcpy(&buff[length], ".hex");
+		if (!(pi->cseg->hfi = open_hex_file((outputfile == NULL) ? buff : outputfile))) {
+			print_msg(pi, MSGTYPE_ERROR, "Could not create output hex file!");
+			ok = False;
+		}
 
-	strcpy(&buff[length], ".obj");
-	if (!(pi->obj_file = open_obj_file(pi, (debugfile == NULL) ? buff : debugfile))) {
-		print_msg(pi, MSGTYPE_ERROR, "Could not create object file!");
-		ok = False;
-	}
+		strcpy(&buff[length], ".obj");
+		if (!(pi->obj_file = open_obj_file(pi, (debugfile == NULL) ? buff : debugfile))) {
+			print_msg(pi, MSGTYPE_ERROR, "Could not create object file!");
+			ok = False;
+		}
 
-	/* open files for eeprom output */
-	strcpy(&buff[length], ".eep.hex");
-	if (!(pi->eseg->hfi = open_hex_file((eepfile == NULL) ? buff : eepfile))) {
-		print_msg(pi, MSGTYPE_ERROR, "Could not create eeprom hex file!");
-		ok = False;
-	}
+		/* open files for eeprom output */
+		strcpy(&buff[length], ".eep.hex");
+		if (!(pi->eseg->hfi = open_hex_file((eepfile == NULL) ? buff : eepfile))) {
+			print_msg(pi, MSGTYPE_ERROR, "Could not create eeprom hex file!");
+			ok = False;
+		}
 
-	if (GET_ARG_I(pi->args, ARG_COFF) == True) {
-		strcpy(&buff[length], ".cof");
-		pi->coff_file = open_coff_file(pi, buff);
-	} else
-		pi->coff_file = 0;
+		if (GET_ARG_I(pi->args, ARG_COFF) == True) {
+			strcpy(&buff[length], ".cof");
+			pi->coff_file = open_coff_file(pi, buff);
+		} else
+			pi->coff_file = 0;
+
+		if (GET_ARG_I(pi->args, ARG_ELF) == True) {
+			strcpy(&buff[length], ".elf");
+			if (!(pi->elf = open_elf_file(pi, buff))) {
+				print_msg(pi, MSGTYPE_ERROR, "Could not create ELF file!");
+				ok = False;
+			}
+		}
+	}
 
 	/* open list file */
 	if (pi->list_on) {
@@ -117,6 +142,8 @@ unlink_out_files(struct prog_info *pi, const char *filename)
 	int length;
 
 	close_out_files(pi);
+	if (pi->in_memory)
+		return;
 
 	length = strlen(filename);
 	buff = malloc(length + 9);
@@ -137,12 +164,102 @@ unlink_out_files(struct prog_info *pi, const char *filename)
 	unlink(buff);
 	strcpy(&buff[length], ".cof");
 	unlink(buff);
+	strcpy(&buff[length], ".elf");
+	unlink(buff);
 	strcpy(&buff[length], ".lst");
 	unlink(buff);
 	strcpy(&buff[length], ".map");
 	unlink(buff);
 }
 
+/* Write a file name for make, which splits words at spaces */
+static void
+fprint_make_name(FILE *fp, const char *name)
+{
+	for (; *name; name++) {
+		if ((*name == ' ') || (*name == '#'))
+			fputc('\\', fp);
+		else if (*name == '$')
+			fputc('$', fp);
+		fputc(*name, fp);
+	}
+}
+
+/* A file included more than once is listed once */
+int
+first_inclusion(struct prog_info *pi, struct include_file *include_file)
+{
+	struct include_file *prev;
+
+	for (prev = pi->first_include_file; prev != include_file; prev = prev->next)
+		if (!strcmp(prev->name, include_file->name))
+			return (False);
+	return (True);
+}
+
+/* -MD: a make rule with the source and every included or .INCBIN file as
+ * the prerequisites of the output, and an empty rule for each of those
+ * files, so make doesn't stop when one of them is removed. */
+int
+write_dep_file(struct prog_info *pi, const char *basename)
+{
+	struct include_file *include_file;
+	const char *target;
+	char *buff;
+	FILE *fp;
+	int length;
+
+	length = strlen(basename);
+	buff = malloc(length + 5);
+	if (!buff) {
+		print_msg(pi, MSGTYPE_OUT_OF_MEM, NULL);
+		return (False);
+	}
+	strcpy(buff, basename);
+	if ((length >= 4) && !nocase_strcmp(&buff[length - 4], ".asm"))
+		length -= 4;
+	strcpy(&buff[length], ".d");
+	fp = fopen(GET_ARG_P(pi->args, ARG_DEPFILE) ? GET_ARG_P(pi->args, ARG_DEPFILE) : buff, "w");
+	if (!fp) {
+		print_msg(pi, MSGTYPE_ERROR, "Could not create dependency file!");
+		free(buff);
+		return (False);
+	}
+	target = GET_ARG_P(pi->args, ARG_OUTFILE);
+	if (!target) {
+		strcpy(&buff[length], pi->module ? ".rel" : ".hex");
+		target = buff;
+	}
+	fprint_make_name(fp, target);
+	fprintf(fp, ":");
+	for (include_file = pi->first_include_file; include_file; include_file = include_file->next) {
+		if (!first_inclusion(pi, include_file))
+			continue;
+		fprintf(fp, " \\\n ");
+		fprint_make_name(fp, include_file->name);
+	}
+	for (include_file = pi->first_binary_file; include_file; include_file = include_file->next) {
+		fprintf(fp, " \\\n ");
+		fprint_make_name(fp, include_file->name);
+	}
+	fprintf(fp, "\n");
+	for (include_file = pi->first_include_file->next; include_file; include_file = include_file->next) {
+		if (!first_inclusion(pi, include_file))
+			continue;
+		fprintf(fp, "\n");
+		fprint_make_name(fp, include_file->name);
+		fprintf(fp, ":\n");
+	}
+	for (include_file = pi->first_binary_file; include_file; include_file = include_file->next) {
+		fprintf(fp, "\n");
+		fprint_make_name(fp, include_file->name);
+		fprintf(fp, ":\n");
+	}
+	fclose(fp);
+	free(buff);
+	return (True);
+}
+
 void
 close_out_files(struct prog_info *pi)
 {
@@ -171,6 +288,8 @@ close_out_files(struct prog_info *pi)
 		close_obj_file(pi, pi->obj_file);
 	if (pi->coff_file)
 		close_coff_file(pi, pi->coff_file);
+	if (pi->elf)
+		close_elf_file(pi);
 }
 
 struct hex_file_info *
@@ -202,63 +321,126 @@ close_hex_file(struct hex_file_info *hfi)
 	free(hfi);
 }
 
+/* Add count bytes at the byte address to the hex file, starting a line where
+ * the address jumps and, with segments, a segment record at each 64 KB */
+static void
+put_hex_data(struct hex_file_info *hfi, int address, const unsigned char *data, int count, int segments)
+{
+	int n;
+
+	while (count > 0) {
+		if (segments && (hfi->segment != (address >> 16))) {
+			if (hfi->count != 0)
+				do_hex_line(hfi);
+			hfi->segment = address >> 16;
+			if (hfi->segment >= 16) /* Use 04 record for addresses above 1 meg since 02 can support max 1 meg */
+				fprintf(hfi->fp, ":02000004%04X%02X\x0d\x0a", hfi->segment & 0xffff,
+				        (0 - 2 - 4 - ((hfi->segment >> 8) & 0xff) - (hfi->segment & 0xff)) & 0xff);
+			else /* Use 02 record for addresses below 1 meg since more programmers know about the 02 instead of the 04 */
+				fprintf(hfi->fp, ":02000002%04X%02X\x0d\x0a", (hfi->segment << 12) & 0xffff,
+				        (0 - 2 - 2 - ((hfi->segment << 4) & 0xf0)) & 0xff);
+		}
+		if ((hfi->count == sizeof(hfi->hex_line))
+		        || ((address != (hfi->linestart_addr + hfi->count)) && (hfi->count != 0)))
+			do_hex_line(hfi);
+		if (hfi->count == 0)
+			hfi->linestart_addr = address;
+		n = sizeof(hfi->hex_line) - hfi->count;
+		if (n > count)
+			n = count;
+		if (segments && (n > 0x10000 - (address & 0xffff)))
+			n = 0x10000 - (address & 0xffff);
+		memcpy(&hfi->hex_line[hfi->count], data, n);
+		hfi->count += n;
+		address += n;
+		data += n;
+		count -= n;
+	}
+}
+
 void
 write_ee_byte(struct prog_info *pi, int address, unsigned char data)
 {
-	if ((pi->eseg->hfi->count == 16)
-	        || ((address != (pi->eseg->hfi->linestart_addr + pi->eseg->hfi->count))
-	            && (pi->eseg->hfi->count != 0)))
-		do_hex_line(pi->eseg->hfi);
-	if (pi->eseg->hfi->count == 0)
-		pi->eseg->hfi->linestart_addr = address;
-	pi->eseg->hfi->hex_line[pi->eseg->hfi->count++] = data;
+	write_ee_data(pi, address, &data, 1);
+}
 
+/* Write count bytes of EEPROM from address on */
+void
+write_ee_data(struct prog_info *pi, int address, const unsigned char *data, int count)
+{
+	int i;
+
+	if (count <= 0)
+		return;
+	if (pi->eeprom_image && !pi->layout) {
+		for (i = 0; (i < count) && (address + i < pi->device->eeprom_size); i++)
+			pi->eeprom_image[address + i] = data[i];
+		return;
+	}
+	if (!pi->eseg->hfi) /* Layout pass of --relax */
+		return;
+	put_hex_data(pi->eseg->hfi, address, data, count, False);
 	if (pi->coff_file)
-		write_coff_eeprom(pi, address, data);
+		write_coff_eeprom(pi, address, data, count);
+	if (pi->elf)
+		write_elf_eeprom(pi, address, data, count);
 }
 
 void
 write_prog_word(struct prog_info *pi, int address, int data)
+{
+	unsigned char bytes[2];
+
+	bytes[0] = data & 0xff;
+	bytes[1] = (data >> 8) & 0xff;
+	write_prog_data(pi, address, bytes, 2);
+}
+
+/* Write count bytes of code, low byte first, from the word address on.
+ * count is even. */
+void
+write_prog_data(struct prog_info *pi, int address, const unsigned char *data, int count)
 {
 	struct hex_file_info *hfi = pi->cseg->hfi;
-	write_obj_record(pi, address, data);
-	address *= 2;
-	if (hfi->segment != (address >> 16))	{
-		if (hfi->count != 0)
-			do_hex_line(hfi);
-		hfi->segment = address >> 16;
-		if (hfi->segment >= 16) /* Use 04 record for addresses above 1 meg since 02 can support max 1 meg */
-			fprintf(hfi->fp, ":02000004%04X%02X\x0d\x0a", hfi->segment & 0xffff,
-			        (0 - 2 - 4 - ((hfi->segment >> 8) & 0xff) - (hfi->segment & 0xff)) & 0xff);
-		else /* Use 02 record for addresses below 1 meg since more programmers know about the 02 instead of the 04 */
-			fprintf(hfi->fp, ":02000002%04X%02X\x0d\x0a", (hfi->segment << 12) & 0xffff,
-			        (0 - 2 - 2 - ((hfi->segment << 4) & 0xf0)) & 0xff);
-	}
-	if ((hfi->count == 16) || ((address != (hfi->linestart_addr + hfi->count)) && (hfi->count != 0)))
-		do_hex_line(hfi);
-	if (hfi->count == 0)
-		hfi->linestart_addr = address;
-	hfi->hex_line[hfi->count++] = data & 0xff;
-	hfi->hex_line[hfi->count++] = (data >> 8) & 0xff;
+	int i;
 
+	if (count <= 0)
+		return;
+	if (pi->flash_image && !pi->layout) {
+		for (i = 0; (i < count) && (address + i / 2 < pi->flash_image_size); i += 2)
+			pi->flash_image[address + i / 2] = data[i] | (data[i + 1] << 8);
+		return;
+	}
+	if (!hfi) /* Layout pass of --relax */
+		return;
+	if (pi->obj_file) /* Not written by avra-ld */
+		write_obj_data(pi, address, data, count);
+	put_hex_data(hfi, address * 2, data, count, True);
 	if (pi->coff_file)
-		write_coff_program(pi, address, data);
+		write_coff_program(pi, address * 2, data, count);
+	if (pi->elf)
+		write_elf_program(pi, address * 2, data, count);
 }
 
 
 void
 do_hex_line(struct hex_file_info *hfi)
 {
-	int i;
+	unsigned char record[4 + sizeof(hfi->hex_line) + 1];
+	char buff[2 * sizeof(record) + 1];
 	unsigned char checksum = 0;
-
-	fprintf(hfi->fp, ":%02X%04X00", hfi->count, hfi->linestart_addr & 0xffff);
-	checksum -= hfi->count + ((hfi->linestart_addr >> 8) & 0xff) + (hfi->linestart_addr & 0xff);
-	for (i = 0; i < hfi->count; i++)	{
-		fprintf(hfi->fp, "%02X", hfi->hex_line[i]);
-		checksum -= hfi->hex_line[i];
-	}
-	fprintf(hfi->fp, "%02X\x0d\x0a", checksum);
+	int i, length;
+
+	record[0] = hfi->count;
+	record[1] = (hfi->linestart_addr >> 8) & 0xff;
+	record[2] = hfi->linestart_addr & 0xff;
+	record[3] = 0;
+	memcpy(&record[4], hfi->hex_line, hfi->count);
+	length = 4 + hfi->count;
+	for (i = 0; i < length; i++)
+		checksum -= record[i];
+	record[length++] = checksum;
+	fprintf(hfi->fp, ":%s\x0d\x0a", hex_string(buff, record, length));
 	hfi->count = 0;
 }
 
@@ -308,21 +490,29 @@ close_obj_file(struct prog_info *pi, FILE *fp)
 }
 
 
+/* One record per word of count bytes, the words written together */
 void
-write_obj_record(struct prog_info *pi, int address, int data)
+write_obj_data(struct prog_info *pi, int address, const unsigned char *data, int count)
 {
-	fputc((address >> 16) & 0xff, pi->obj_file);
-	fputc((address >> 8) & 0xff, pi->obj_file);
-	fputc(address & 0xff, pi->obj_file);
-	fputc((data >> 8) & 0xff, pi->obj_file);
-	fputc(data & 0xff, pi->obj_file);
-	fputc(pi->fi->include_file->num & 0xff, pi->obj_file);
-	fputc((pi->fi->line_number >> 8) & 0xff, pi->obj_file);
-	fputc(pi->fi->line_number & 0xff, pi->obj_file);
-	if (pi->macro_call)
-		fputc(1, pi->obj_file);
-	else
-		fputc(0, pi->obj_file);
+	unsigned char record[9 * 32], *p;
+	int i;
+
+	while (count > 0) {
+		for (p = record, i = 0; (i < count) && (p < record + sizeof(record)); i += 2, p += 9, address++) {
+			p[0] = (address >> 16) & 0xff;
+			p[1] = (address >> 8) & 0xff;
+			p[2] = address & 0xff;
+			p[3] = data[i + 1];
+			p[4] = data[i];
+			p[5] = pi->fi->include_file->num & 0xff;
+			p[6] = (pi->fi->line_number >> 8) & 0xff;
+			p[7] = pi->fi->line_number & 0xff;
+			p[8] = pi->macro_call ? 1 : 0;
+		}
+		fwrite(record, 1, p - record, pi->obj_file);
+		data += i;
+		count -= i;
+	}
 }
 
 /* end of file.c */
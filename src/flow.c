@@ -0,0 +1,1555 @@
+/***********************************************************************
+ *
+ *  AVRA - Assembler for the Atmel AVR microcontroller series
+ *
+ *  Copyright (C) 1998-2020 The AVRA Authors
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; see the file COPYING.  If not, write to
+ *  the Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ *  Boston, MA 02111-1307, USA.
+ *
+ *
+ *  Authors of AVRA can be reached at:
+ *     email: jonah@omegav.ntnu.no, tobiw@suprafluid.com
+ *     www: https://github.com/Ro5bert/avra
+ */
+
+/*
+ * Control flow analysis of the code emitted in pass 2.
+ *
+ * The instructions in pi->code are sorted by address and split into basic
+ * blocks at labels used as targets, after branches, skips, jumps and returns.
+ * Routines start at call targets and at the interrupt vectors.
+ *
+ * --wcet reports the worst case cycles of each routine, --stack the stack
+ * each routine needs, --clobbers the registers each routine writes and
+ * --unused the code that can't be reached from the vectors and .KEEP
+ * addresses. .CALLS gives the targets of ijmp and icall.
+ *
+ * clobbers(label) gives the registers written to the assembler. It is
+ * settled by the layout passes, see relax.c.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "misc.h"
+#include "args.h"
+#include "avra.h"
+#include "device.h"
+#include "mnemonic.h"
+
+#define NO_PATH    -1L	/* Cycles of a path that never returns */
+#define UNKNOWN    -2L
+
+/* Bytes of the return address pushed by a call or an interrupt */
+#define RETURN_SIZE(pi) ((pi)->device->flash_size > 65536 ? 3 : 2)
+
+/* Successors other than blocks */
+#define SUCC_RETURN   -1
+#define SUCC_INDIRECT -2	/* ijmp, eijmp */
+#define SUCC_OUTSIDE  -3	/* Target without code */
+
+/* Routine notes */
+#define NOTE_LOOP          0	/* Loop without .LOOPBOUND */
+#define NOTE_ENDLESS       1
+#define NOTE_RECURSION     2
+#define NOTE_INDIRECT_JUMP 3
+#define NOTE_INDIRECT_CALL 4
+#define NOTE_OUTSIDE       5
+#define NOTE_COUNT         6
+
+/* Stack notes */
+#define STACK_UNBOUNDED  0	/* Grows in a loop */
+#define STACK_RECURSION  1
+#define STACK_INDIRECT   2	/* ijmp or icall without .CALLS */
+#define STACK_UNBALANCED 3	/* Returns with pushed bytes left */
+#define STACK_NOTE_COUNT 4
+
+/* Clobber notes, each makes all registers written */
+#define CLOBBERS_INDIRECT   0	/* ijmp or icall without .CALLS */
+#define CLOBBERS_OUTSIDE    1	/* Target without code */
+#define CLOBBERS_NOTE_COUNT 2
+
+#define ALL_REGISTERS 0xffffffffUL
+
+#define CLOBBERS_ALLOC_STEP 16
+
+#define ROUTINE_NEW      0
+#define ROUTINE_BUSY     1
+#define ROUTINE_DONE     2
+
+#define BLOCK_NEW   0
+#define BLOCK_BUSY  1
+#define BLOCK_DONE  2
+
+struct block {
+	long start;
+	int first;		/* Indices into flow->code */
+	int last;
+	int bound;		/* From .LOOPBOUND, 0 if none */
+	int succ_count;
+	int succ[2];		/* Fall through or not taken first */
+	int cost[2];		/* Cycles of the last instruction along each edge */
+};
+
+struct routine {
+	long addr;
+	long vector;		/* Address of the vector, -1 if none */
+	int state;
+	long cycles;
+	long note[NOTE_COUNT];	/* Address of the first occurrence, -1 if none */
+	int stack_state;
+	long stack;		/* Bytes pushed, including calls, NO_PATH if unbounded */
+	long stack_note[STACK_NOTE_COUNT];
+	unsigned long clobbers;	/* Registers written, including by calls */
+	long clobbers_note[CLOBBERS_NOTE_COUNT];
+};
+
+struct flow {
+	struct prog_info *pi;
+	struct code_record *code;	/* Sorted by address */
+	int code_count;
+	struct block *block;
+	int block_count;
+	struct routine *routine;
+	int routine_count;
+	int routine_alloc;
+	struct indirect_target *target;	/* Sorted by address */
+	int target_count;
+};
+
+/* State of the longest path search in one routine */
+struct walk {
+	struct flow *flow;
+	struct routine *routine;
+	unsigned char *state;
+	unsigned char *back;	/* Bit per edge: edge closes a loop */
+	unsigned char *header;
+	unsigned char *bound_used;
+	long *base;		/* Cycles of a block without its last instruction */
+	long *wcet;		/* Longest path from the block to a return */
+	long *extra;		/* Further iterations of a loop headed by the block */
+	long *dist;		/* Longest path around the loop being closed */
+};
+
+static const char *const note_text[NOTE_COUNT] = {
+	"unbounded loop at %06lx",
+	"no return",
+	"recursion at %06lx",
+	"indirect jump at %06lx",
+	"indirect call at %06lx",
+	"leaves code at %06lx"
+};
+
+static const char *const stack_note_text[STACK_NOTE_COUNT] = {
+	"grows in a loop at %06lx",
+	"recursion at %06lx",
+	"indirect jump or call at %06lx",
+	"returns with bytes pushed at %06lx"
+};
+
+static const char *const clobbers_note_text[CLOBBERS_NOTE_COUNT] = {
+	"indirect jump or call at %06lx",
+	"leaves code at %06lx"
+};
+
+static struct routine *get_routine(struct flow *flow, long addr);
+
+static int
+compare_code(const void *a, const void *b)
+{
+	const struct code_record *x = a, *y = b;
+
+	return (x->addr < y->addr ? -1 : (x->addr > y->addr ? 1 : 0));
+}
+
+static int
+find_code(struct flow *flow, long addr)
+{
+	struct code_record key, *code;
+
+	key.addr = addr;
+	code = bsearch(&key, flow->code, flow->code_count, sizeof(struct code_record), compare_code);
+	return (code ? (int)(code - flow->code) : -1);
+}
+
+static int
+compare_block(const void *a, const void *b)
+{
+	const struct block *x = a, *y = b;
+
+	return (x->start < y->start ? -1 : (x->start > y->start ? 1 : 0));
+}
+
+static int
+find_block(struct flow *flow, long addr)
+{
+	struct block key, *block;
+
+	key.start = addr;
+	block = bsearch(&key, flow->block, flow->block_count, sizeof(struct block), compare_block);
+	return (block ? (int)(block - flow->block) : SUCC_OUTSIDE);
+}
+
+static int
+compare_target(const void *a, const void *b)
+{
+	const struct indirect_target *x = a, *y = b;
+
+	return (x->addr < y->addr ? -1 : (x->addr > y->addr ? 1 : 0));
+}
+
+/* Index of the first .CALLS target of the ijmp or icall at addr, -1 if none */
+static int
+find_target(struct flow *flow, long addr)
+{
+	int lo = 0, hi = flow->target_count;
+
+	while (lo < hi) {
+		if (flow->target[(lo + hi) / 2].addr < addr)
+			lo = (lo + hi) / 2 + 1;
+		else
+			hi = (lo + hi) / 2;
+	}
+	return (((lo < flow->target_count) && (flow->target[lo].addr == addr)) ? lo : -1);
+}
+
+/* Address the skip instruction at code[i] continues at when it skips */
+static long
+skip_target(struct flow *flow, int i)
+{
+	int next = find_code(flow, flow->code[i].addr + flow->code[i].size);
+
+	if (next < 0)
+		return (-1);
+	return (flow->code[next].addr + flow->code[next].size);
+}
+
+static void
+mark_leader(struct flow *flow, char *leader, long addr)
+{
+	int i = find_code(flow, addr);
+
+	if (i >= 0)
+		leader[i] = True;
+}
+
+static void
+add_edge(struct block *block, int succ, int cost)
+{
+	block->succ[block->succ_count] = succ;
+	block->cost[block->succ_count] = cost;
+	block->succ_count++;
+}
+
+static int
+build_flow(struct prog_info *pi, struct flow *flow)
+{
+	struct code_record *code;
+	struct block *block;
+	struct loop_bound *loop_bound;
+	struct keep *keep;
+	struct indirect_target *target;
+	char *leader;
+	int i, b;
+	long next;
+
+	memset(flow, 0, sizeof(struct flow));
+	flow->pi = pi;
+	if (pi->code_count == 0)
+		return (True);
+	for (target = pi->first_indirect_target; target; target = target->next)
+		flow->target_count++;
+	flow->code = malloc(pi->code_count * sizeof(struct code_record));
+	flow->target = malloc((flow->target_count + 1) * sizeof(struct indirect_target));
+	leader = calloc(pi->code_count, 1);
+	if (!flow->code || !flow->target || !leader) {
+		free(leader);
+		print_msg(pi, MSGTYPE_OUT_OF_MEM, NULL);
+		return (False);
+	}
+	memcpy(flow->code, pi->code, pi->code_count * sizeof(struct code_record));
+	flow->code_count = pi->code_count;
+	qsort(flow->code, flow->code_count, sizeof(struct code_record), compare_code);
+	for (target = pi->first_indirect_target, i = 0; target; target = target->next)
+		flow->target[i++] = *target;
+	qsort(flow->target, flow->target_count, sizeof(struct indirect_target), compare_target);
+
+	leader[0] = True;
+	for (i = 0; i < flow->code_count; i++) {
+		code = &flow->code[i];
+		if ((i > 0) && (code->addr != code[-1].addr + code[-1].size))
+			leader[i] = True;
+		switch (code->flow) {
+		case FLOW_SKIP:
+			mark_leader(flow, leader, skip_target(flow, i));
+		/* fall through */
+		case FLOW_BRANCH:
+		case FLOW_JUMP:
+		case FLOW_RETURN:
+		case FLOW_INDIRECT_JUMP:
+			if (i + 1 < flow->code_count)
+				leader[i + 1] = True;
+			break;
+		}
+		if (code->target >= 0)
+			mark_leader(flow, leader, code->target);
+	}
+	for (loop_bound = pi->first_loop_bound; loop_bound; loop_bound = loop_bound->next)
+		mark_leader(flow, leader, loop_bound->addr);
+	for (keep = pi->first_keep; keep; keep = keep->next)
+		mark_leader(flow, leader, keep->addr);
+	for (i = 0; i < flow->target_count; i++)
+		mark_leader(flow, leader, flow->target[i].target);
+
+	for (i = 0; i < flow->code_count; i++)
+		if (leader[i])
+			flow->block_count++;
+	flow->block = calloc(flow->block_count, sizeof(struct block));
+	if (!flow->block) {
+		free(leader);
+		print_msg(pi, MSGTYPE_OUT_OF_MEM, NULL);
+		return (False);
+	}
+	block = flow->block;
+	for (i = 0, b = -1; i < flow->code_count; i++) {
+		if (leader[i]) {
+			block = &flow->block[++b];
+			block->start = flow->code[i].addr;
+			block->first = i;
+		}
+		block->last = i;
+	}
+	free(leader);
+
+	for (loop_bound = pi->first_loop_bound; loop_bound; loop_bound = loop_bound->next) {
+		b = find_block(flow, loop_bound->addr);
+		if (b >= 0)
+			flow->block[b].bound = loop_bound->count;
+	}
+	for (b = 0; b < flow->block_count; b++) {
+		block = &flow->block[b];
+		code = &flow->code[block->last];
+		next = code->addr + code->size;
+		switch (code->flow) {
+		case FLOW_BRANCH:
+			add_edge(block, find_block(flow, next), code->min_cycles);
+			add_edge(block, find_block(flow, code->target), code->max_cycles);
+			break;
+		case FLOW_SKIP:
+			add_edge(block, find_block(flow, next), code->min_cycles);
+			add_edge(block, find_block(flow, skip_target(flow, block->last)), code->max_cycles);
+			break;
+		case FLOW_JUMP:
+			add_edge(block, find_block(flow, code->target), code->max_cycles);
+			break;
+		case FLOW_RETURN:
+			add_edge(block, SUCC_RETURN, code->max_cycles);
+			break;
+		case FLOW_INDIRECT_JUMP:
+			add_edge(block, SUCC_INDIRECT, code->max_cycles);
+			break;
+		default:
+			add_edge(block, find_block(flow, next), code->max_cycles);
+			break;
+		}
+	}
+	return (True);
+}
+
+static void
+note(struct routine *routine, int type, long addr)
+{
+	if (routine->note[type] < 0)
+		routine->note[type] = addr;
+}
+
+static void analyze_routine(struct flow *flow, struct routine *routine);
+
+/* Cycles of a block up to its last instruction, including called routines */
+static long
+block_base(struct walk *w, struct block *block)
+{
+	struct code_record *code;
+	struct routine *callee;
+	long cycles = 0, worst;
+	int i, n, t;
+
+	for (i = block->first; i <= block->last; i++) {
+		code = &w->flow->code[i];
+		if (i < block->last)
+			cycles += code->max_cycles;
+		t = -1;
+		if (code->flow == FLOW_INDIRECT_CALL) {
+			t = find_target(w->flow, code->addr);
+			if (t < 0)
+				note(w->routine, NOTE_INDIRECT_CALL, code->addr);
+		}
+		if (((code->flow != FLOW_CALL) || (code->target < 0)) && (t < 0))
+			continue;
+		/* The longest of the routines an icall may call */
+		worst = 0;
+		do {
+			callee = get_routine(w->flow, t < 0 ? code->target : w->flow->target[t].target);
+			if (!callee)
+				break;
+			if (callee->state == ROUTINE_BUSY) {
+				note(w->routine, NOTE_RECURSION, code->addr);
+				continue;
+			}
+			analyze_routine(w->flow, callee);
+			for (n = 0; n < NOTE_COUNT; n++)
+				if ((n != NOTE_ENDLESS) && (callee->note[n] >= 0))
+					note(w->routine, n, callee->note[n]);
+			if (callee->cycles == NO_PATH)
+				return (NO_PATH);
+			if (callee->cycles > worst)
+				worst = callee->cycles;
+		} while ((t >= 0) && (++t < w->flow->target_count) && (w->flow->target[t].addr == code->addr));
+		cycles += worst;
+	}
+	return (cycles);
+}
+
+/* Longest path from block b back to the loop header h, along edges that
+ * do not close a loop, except those into h */
+static long
+loop_path(struct walk *w, int h, int b)
+{
+	struct block *block = &w->flow->block[b];
+	long best = NO_PATH, cycles;
+	int e, s;
+
+	if (w->dist[b] != UNKNOWN)
+		return (w->dist[b]);
+	w->dist[b] = NO_PATH;
+	if (w->base[b] == NO_PATH)
+		return (NO_PATH);
+	for (e = 0; e < block->succ_count; e++) {
+		s = block->succ[e];
+		if (w->back[b] & (1 << e)) {
+			if (s != h)
+				continue;
+			cycles = w->base[b] + block->cost[e];
+		} else {
+			if (s < 0)
+				continue;
+			cycles = loop_path(w, h, s);
+			if (cycles == NO_PATH)
+				continue;
+			cycles += w->base[b] + block->cost[e];
+		}
+		if (cycles > best)
+			best = cycles;
+	}
+	if ((best != NO_PATH) && (b != h))
+		best += w->extra[b];
+	w->dist[b] = best;
+	return (best);
+}
+
+/* A loop headed by h is closed: find its .LOOPBOUND, preferring one on the
+ * header itself, and account for the further iterations */
+static void
+close_loop(struct walk *w, int h)
+{
+	long iteration;
+	int b, bound = 0;
+
+	for (b = 0; b < w->flow->block_count; b++)
+		w->dist[b] = UNKNOWN;
+	iteration = loop_path(w, h, h);
+	if (w->flow->block[h].bound && !w->bound_used[h]) {
+		bound = w->flow->block[h].bound;
+		w->bound_used[h] = True;
+	} else {
+		for (b = 0; b < w->flow->block_count; b++)
+			if ((w->dist[b] >= 0) && w->flow->block[b].bound && !w->bound_used[b]) {
+				bound = w->flow->block[b].bound;
+				w->bound_used[b] = True;
+				break;
+			}
+	}
+	if (!bound) {
+		note(w->routine, NOTE_LOOP, w->flow->block[h].start);
+		return;
+	}
+	if (iteration != NO_PATH)
+		w->extra[h] = (bound - 1) * iteration;
+}
+
+static void
+visit(struct walk *w, int b)
+{
+	struct block *block = &w->flow->block[b];
+	long best = NO_PATH, cycles;
+	int e, s;
+
+	w->state[b] = BLOCK_BUSY;
+	w->base[b] = block_base(w, block);
+	for (e = 0; e < block->succ_count; e++) {
+		s = block->succ[e];
+		cycles = NO_PATH;
+		if (s == SUCC_RETURN) {
+			cycles = 0;
+		} else if (s == SUCC_INDIRECT) {
+			note(w->routine, NOTE_INDIRECT_JUMP, w->flow->code[block->last].addr);
+			cycles = 0;
+		} else if (s == SUCC_OUTSIDE) {
+			note(w->routine, NOTE_OUTSIDE, w->flow->code[block->last].addr);
+			cycles = 0;
+		} else if (w->state[s] == BLOCK_BUSY) {
+			w->back[b] |= 1 << e;
+			w->header[s] = True;
+		} else {
+			if (w->state[s] == BLOCK_NEW)
+				visit(w, s);
+			cycles = w->wcet[s];
+		}
+		if ((cycles != NO_PATH) && (w->base[b] != NO_PATH)) {
+			cycles += w->base[b] + block->cost[e];
+			if (cycles > best)
+				best = cycles;
+		}
+	}
+	if (w->header[b])
+		close_loop(w, b);
+	if (best != NO_PATH)
+		best += w->extra[b];
+	w->wcet[b] = best;
+	w->state[b] = BLOCK_DONE;
+}
+
+static void
+analyze_routine(struct flow *flow, struct routine *routine)
+{
+	struct walk w;
+	char *mem;
+	int count = flow->block_count, b;
+
+	if (routine->state != ROUTINE_NEW)
+		return;
+	routine->state = ROUTINE_BUSY;
+	routine->cycles = NO_PATH;
+	b = find_block(flow, routine->addr);
+	if (b < 0) {
+		note(routine, NOTE_OUTSIDE, routine->addr);
+		routine->state = ROUTINE_DONE;
+		return;
+	}
+	mem = calloc(count, 4 * sizeof(long) + 4);
+	if (!mem) {
+		print_msg(flow->pi, MSGTYPE_OUT_OF_MEM, NULL);
+		routine->state = ROUTINE_DONE;
+		return;
+	}
+	w.flow = flow;
+	w.routine = routine;
+	w.base = (long *)mem;
+	w.wcet = w.base + count;
+	w.extra = w.wcet + count;
+	w.dist = w.extra + count;
+	w.state = (unsigned char *)(w.dist + count);
+	w.back = w.state + count;
+	w.header = w.back + count;
+	w.bound_used = w.header + count;
+	visit(&w, b);
+	routine->cycles = w.wcet[b];
+	if (routine->cycles == NO_PATH)
+		note(routine, NOTE_ENDLESS, routine->addr);
+	free(mem);
+	routine->state = ROUTINE_DONE;
+}
+
+static struct routine *
+get_routine(struct flow *flow, long addr)
+{
+	struct routine *routine;
+	int i;
+
+	for (i = 0; i < flow->routine_count; i++)
+		if (flow->routine[i].addr == addr)
+			return (&flow->routine[i]);
+	if (flow->routine_count == flow->routine_alloc) {
+		routine = realloc(flow->routine, (flow->routine_alloc + 64) * sizeof(struct routine));
+		if (!routine) {
+			print_msg(flow->pi, MSGTYPE_OUT_OF_MEM, NULL);
+			return (NULL);
+		}
+		flow->routine = routine;
+		flow->routine_alloc += 64;
+	}
+	routine = &flow->routine[flow->routine_count++];
+	routine->addr = addr;
+	routine->vector = -1;
+	routine->state = ROUTINE_NEW;
+	routine->cycles = NO_PATH;
+	for (i = 0; i < NOTE_COUNT; i++)
+		routine->note[i] = -1;
+	routine->stack_state = ROUTINE_NEW;
+	routine->stack = 0;
+	for (i = 0; i < STACK_NOTE_COUNT; i++)
+		routine->stack_note[i] = -1;
+	routine->clobbers = 0;
+	for (i = 0; i < CLOBBERS_NOTE_COUNT; i++)
+		routine->clobbers_note[i] = -1;
+	return (routine);
+}
+
+/* The code at the lowest address and the interrupt vectors up to
+ * INT_VECTORS_SIZE start routines. Without INT_VECTORS_SIZE, the vector
+ * table is taken to end at the first instruction which is not a jump. */
+static int
+find_entries(struct flow *flow)
+{
+	struct code_record *code;
+	struct routine *routine;
+	int i, n, vectors_size;
+	long vectors_end;
+
+	if (get_constant(flow->pi, "INT_VECTORS_SIZE", &vectors_size))
+		vectors_end = vectors_size;
+	else {
+		for (i = 0; i < flow->code_count; i++)
+			if ((flow->code[i].flow != FLOW_JUMP) && (flow->code[i].flow != FLOW_RETURN))
+				break;
+		vectors_end = i < flow->code_count ? flow->code[i].addr : flow->code[i - 1].addr + 1;
+	}
+	for (i = 0; i < flow->code_count; i++) {
+		code = &flow->code[i];
+		if ((i > 0) && (code->addr >= vectors_end))
+			break;
+		/* Code following a slot that falls through is not a vector */
+		if ((i > 0) && (code[-1].flow != FLOW_JUMP) && (code[-1].flow != FLOW_RETURN)
+		        && (code[-1].addr + code[-1].size == code->addr))
+			continue;
+		routine = get_routine(flow, code->flow == FLOW_JUMP ? code->target : code->addr);
+		if (!routine)
+			return (False);
+		if (routine->vector < 0)
+			routine->vector = code->addr;
+	}
+	for (i = 0; i < flow->code_count; i++)
+		if ((flow->code[i].flow == FLOW_CALL) && (flow->code[i].target >= 0))
+			if (!get_routine(flow, flow->code[i].target))
+				return (False);
+	for (i = 0; i < flow->target_count; i++) {
+		n = find_code(flow, flow->target[i].addr);
+		if ((n >= 0) && (flow->code[n].flow == FLOW_INDIRECT_CALL)
+		        && !get_routine(flow, flow->target[i].target))
+			return (False);
+	}
+	return (True);
+}
+
+static int
+compare_routine(const void *a, const void *b)
+{
+	const struct routine *x = a, *y = b;
+
+	return (x->addr < y->addr ? -1 : (x->addr > y->addr ? 1 : 0));
+}
+
+static const char *
+routine_name(struct prog_info *pi, long addr)
+{
+	struct label *label;
+
+	for (label = pi->first_label; label; label = label->next)
+		if ((label->segment == pi->cseg) && (label->value == addr))
+			return (label->name);
+	return ("");
+}
+
+static void
+print_routine(struct prog_info *pi, struct routine *routine)
+{
+	char cycles[32], notes[256];
+	int n, len = 0, lower = False;
+
+	/* Cycles not counted make the worst case a lower bound */
+	for (n = 0; n < NOTE_COUNT; n++)
+		if ((n != NOTE_ENDLESS) && (routine->note[n] >= 0))
+			lower = True;
+	if (routine->cycles == NO_PATH)
+		strcpy(cycles, "-");
+	else
+		sprintf(cycles, "%s%ld", lower ? ">=" : "", routine->cycles);
+	notes[0] = '\0';
+	if (routine->vector >= 0)
+		len += snprintf(notes + len, sizeof(notes) - len, "vector %06lx", routine->vector);
+	for (n = 0; (n < NOTE_COUNT) && (len < (int)sizeof(notes)); n++)
+		if (routine->note[n] >= 0) {
+			len += snprintf(notes + len, sizeof(notes) - len, "%s", len ? ", " : "");
+			if (len < (int)sizeof(notes))
+				len += snprintf(notes + len, sizeof(notes) - len, note_text[n], routine->note[n]);
+		}
+	if (notes[0])
+		printf("%06lx %10s  %-20s %s\n", routine->addr, cycles, routine_name(pi, routine->addr), notes);
+	else
+		printf("%06lx %10s  %s\n", routine->addr, cycles, routine_name(pi, routine->addr));
+}
+
+/* Worst case cycles from the entry of each routine to its return. Calls add
+ * the worst case of the callee. A loop adds its longest iteration for each
+ * further run allowed by .LOOPBOUND; loops without one are counted once. */
+void
+print_wcet_report(struct prog_info *pi)
+{
+	struct flow flow;
+	int i;
+
+	if (!GET_ARG_I(pi->args, ARG_WCET) || pi->error_count)
+		return;
+	if (build_flow(pi, &flow) && find_entries(&flow)) {
+		for (i = 0; i < flow.routine_count; i++)
+			analyze_routine(&flow, &flow.routine[i]);
+		qsort(flow.routine, flow.routine_count, sizeof(struct routine), compare_routine);
+		printf("Worst case execution times:\n");
+		printf("%-6s %10s  %-20s %s\n", "Entry", "Cycles", "Routine", "Notes");
+		for (i = 0; i < flow.routine_count; i++)
+			print_routine(pi, &flow.routine[i]);
+		printf("\n");
+	}
+	free(flow.code);
+	free(flow.block);
+	free(flow.target);
+	free(flow.routine);
+}
+
+static void
+stack_note(struct routine *routine, int type, long addr)
+{
+	if (routine->stack_note[type] < 0)
+		routine->stack_note[type] = addr;
+}
+
+/* State of the stack depth search in one routine */
+struct stack_walk {
+	struct flow *flow;
+	struct routine *routine;
+	long *depth;		/* Bytes pushed at the start of each block */
+	char *seen;
+	char *queued;
+	int *work;
+	int work_count;
+	long limit;		/* Deeper than this in a loop is unbounded */
+};
+
+static void
+stack_flow_to(struct stack_walk *w, int b, long depth, long addr)
+{
+	if (b < 0)
+		return;
+	if (w->seen[b] && (depth <= w->depth[b]))
+		return;
+	if (w->seen[b] && (depth > w->limit)) {
+		stack_note(w->routine, STACK_UNBOUNDED, addr);
+		return;
+	}
+	w->seen[b] = True;
+	w->depth[b] = depth;
+	if (!w->queued[b]) {
+		w->queued[b] = True;
+		w->work[w->work_count++] = b;
+	}
+}
+
+static void analyze_stack(struct flow *flow, struct routine *routine);
+
+/* Deepest stack of a call at depth, or of the deepest routine an icall
+ * with .CALLS may call */
+static long
+stack_call(struct stack_walk *w, struct code_record *code, long depth)
+{
+	struct flow *flow = w->flow;
+	struct routine *callee;
+	long deepest = depth;
+	int n, t = -1;
+
+	if (code->flow == FLOW_INDIRECT_CALL) {
+		t = find_target(flow, code->addr);
+		if (t < 0) {
+			stack_note(w->routine, STACK_INDIRECT, code->addr);
+			return (depth);
+		}
+	} else if (code->target < 0)
+		return (depth);
+	do {
+		callee = get_routine(flow, t < 0 ? code->target : flow->target[t].target);
+		if (!callee)
+			break;
+		if (callee->stack_state == ROUTINE_BUSY) {
+			stack_note(w->routine, STACK_RECURSION, code->addr);
+			continue;
+		}
+		analyze_stack(flow, callee);
+		for (n = 0; n < STACK_NOTE_COUNT; n++)
+			if (callee->stack_note[n] >= 0)
+				stack_note(w->routine, n, callee->stack_note[n]);
+		if (callee->stack == NO_PATH)
+			stack_note(w->routine, STACK_UNBOUNDED, code->addr);
+		else if (depth + RETURN_SIZE(flow->pi) + callee->stack > deepest)
+			deepest = depth + RETURN_SIZE(flow->pi) + callee->stack;
+	} while ((t >= 0) && (++t < flow->target_count) && (flow->target[t].addr == code->addr));
+	return (deepest);
+}
+
+/* The most bytes a routine pushes, following all paths from its entry. A
+ * call adds the return address and what the called routine pushes. */
+static void
+analyze_stack(struct flow *flow, struct routine *routine)
+{
+	struct stack_walk w;
+	struct code_record *code;
+	struct block *block;
+	long depth, called, deepest = 0;
+	int b, e, i, t, count = flow->block_count;
+
+	if (routine->stack_state != ROUTINE_NEW)
+		return;
+	routine->stack_state = ROUTINE_BUSY;
+	b = find_block(flow, routine->addr);
+	w.flow = flow;
+	w.routine = routine;
+	w.depth = malloc(count * sizeof(long));
+	w.work = malloc(count * sizeof(int));
+	w.seen = calloc(count, 2);
+	if (!w.depth || !w.work || !w.seen) {
+		print_msg(flow->pi, MSGTYPE_OUT_OF_MEM, NULL);
+		free(w.depth);
+		free(w.work);
+		free(w.seen);
+		routine->stack_state = ROUTINE_DONE;
+		return;
+	}
+	w.queued = w.seen + count;
+	w.work_count = 0;
+	w.limit = flow->pi->device->ram_size > 256 ? flow->pi->device->ram_size : 256;
+	stack_flow_to(&w, b, 0, routine->addr);
+	while (w.work_count) {
+		b = w.work[--w.work_count];
+		w.queued[b] = False;
+		block = &flow->block[b];
+		depth = w.depth[b];
+		for (i = block->first; i <= block->last; i++) {
+			code = &flow->code[i];
+			if (code->mnemonic == MNEMONIC_PUSH)
+				depth++;
+			else if (code->mnemonic == MNEMONIC_POP)
+				depth--;
+			else if ((code->flow == FLOW_CALL) || (code->flow == FLOW_INDIRECT_CALL)) {
+				called = stack_call(&w, code, depth);
+				if (called > deepest)
+					deepest = called;
+			} else if ((code->flow == FLOW_RETURN) && (depth != 0))
+				stack_note(routine, STACK_UNBALANCED, code->addr);
+			if (depth > deepest)
+				deepest = depth;
+		}
+		code = &flow->code[block->last];
+		for (e = 0; e < block->succ_count; e++) {
+			if (block->succ[e] != SUCC_INDIRECT) {
+				stack_flow_to(&w, block->succ[e], depth, block->start);
+				continue;
+			}
+			t = find_target(flow, code->addr);
+			if (t < 0)
+				stack_note(routine, STACK_INDIRECT, code->addr);
+			for (; (t >= 0) && (t < flow->target_count) && (flow->target[t].addr == code->addr); t++)
+				stack_flow_to(&w, find_block(flow, flow->target[t].target), depth, block->start);
+		}
+	}
+	routine->stack = routine->stack_note[STACK_UNBOUNDED] >= 0 ? NO_PATH : deepest;
+	free(w.depth);
+	free(w.work);
+	free(w.seen);
+	routine->stack_state = ROUTINE_DONE;
+}
+
+static void
+print_stack_routine(struct prog_info *pi, struct routine *routine)
+{
+	char bytes[32], notes[256];
+	int n, len = 0;
+
+	if (routine->stack == NO_PATH)
+		strcpy(bytes, "-");
+	else
+		sprintf(bytes, "%ld", routine->stack);
+	notes[0] = '\0';
+	if (routine->vector >= 0)
+		len += snprintf(notes + len, sizeof(notes) - len, "vector %06lx", routine->vector);
+	for (n = 0; (n < STACK_NOTE_COUNT) && (len < (int)sizeof(notes)); n++)
+		if (routine->stack_note[n] >= 0) {
+			len += snprintf(notes + len, sizeof(notes) - len, "%s", len ? ", " : "");
+			if (len < (int)sizeof(notes))
+				len += snprintf(notes + len, sizeof(notes) - len, stack_note_text[n], routine->stack_note[n]);
+		}
+	if (notes[0])
+		printf("%06lx %6s  %-20s %s\n", routine->addr, bytes, routine_name(pi, routine->addr), notes);
+	else
+		printf("%06lx %6s  %s\n", routine->addr, bytes, routine_name(pi, routine->addr));
+}
+
+/* The code at the lowest address runs with the stack empty, an interrupt
+ * adds its return address and its routine. Interrupts are taken not to
+ * nest, which holds unless a routine for one enables them again. */
+static void
+print_stack_total(struct prog_info *pi, struct flow *flow)
+{
+	struct routine *routine, *reset = NULL, *isr = NULL;
+	long total, data_end, ram_end;
+	int i;
+
+	for (i = 0; i < flow->routine_count; i++) {
+		routine = &flow->routine[i];
+		if (routine->vector < 0)
+			continue;
+		if (routine->vector == flow->code[0].addr)
+			reset = routine;
+		else if (!isr || (routine->stack == NO_PATH)
+		         || ((isr->stack != NO_PATH) && (routine->stack > isr->stack)))
+			isr = routine;
+	}
+	if (!reset || (reset->stack == NO_PATH) || (isr && (isr->stack == NO_PATH))) {
+		printf("Worst case: unbounded\n");
+		total = NO_PATH;
+	} else if (isr) {
+		total = reset->stack + RETURN_SIZE(pi) + isr->stack;
+		printf("Worst case: %ld bytes, %ld from %s and %ld in the interrupt at %s\n", total,
+		       reset->stack, routine_name(pi, reset->addr), RETURN_SIZE(pi) + isr->stack,
+		       routine_name(pi, isr->addr));
+	} else {
+		total = reset->stack;
+		printf("Worst case: %ld bytes\n", total);
+	}
+	if (pi->module || !pi->device->name || !pi->device->ram_size)
+		return;
+	ram_end = pi->device->ram_start + pi->device->ram_size;
+	data_end = pi->dseg->occupancy_size > pi->device->ram_start ? pi->dseg->occupancy_size : pi->device->ram_start;
+	printf("RAM %04lx-%04lx, data up to %04lx: %ld bytes free for the stack\n",
+	       pi->device->ram_start, ram_end - 1, data_end, ram_end - data_end);
+	if (total == NO_PATH)
+		print_msg(pi, MSGTYPE_WARNING, "Stack depth is unbounded, %ld bytes are free", ram_end - data_end);
+	else if (total > ram_end - data_end)
+		print_msg(pi, MSGTYPE_WARNING, "Stack needs %ld bytes, only %ld are free", total, ram_end - data_end);
+}
+
+/* Stack bytes each routine needs, from push, pop and the return addresses
+ * of calls, and the worst case of the program against the free RAM */
+void
+print_stack_report(struct prog_info *pi)
+{
+	struct flow flow;
+	int i;
+
+	if (!GET_ARG_I(pi->args, ARG_STACK) || pi->error_count)
+		return;
+	if (build_flow(pi, &flow) && flow.code_count && find_entries(&flow)) {
+		for (i = 0; i < flow.routine_count; i++)
+			analyze_stack(&flow, &flow.routine[i]);
+		qsort(flow.routine, flow.routine_count, sizeof(struct routine), compare_routine);
+		printf("Stack usage in bytes:\n");
+		printf("%-6s %6s  %-20s %s\n", "Entry", "Bytes", "Routine", "Notes");
+		for (i = 0; i < flow.routine_count; i++)
+			print_stack_routine(pi, &flow.routine[i]);
+		print_stack_total(pi, &flow);
+		printf("\n");
+	}
+	free(flow.code);
+	free(flow.block);
+	free(flow.target);
+	free(flow.routine);
+}
+
+static void
+reach(char *reached, int *stack, int *depth, int b)
+{
+	if ((b >= 0) && !reached[b]) {
+		reached[b] = True;
+		stack[(*depth)++] = b;
+	}
+}
+
+static int
+compare_label_value(const void *a, const void *b)
+{
+	const struct label *x = *(const struct label * const *)a, *y = *(const struct label * const *)b;
+
+	return (x->value < y->value ? -1 : (x->value > y->value ? 1 : 0));
+}
+
+/* Unreached code in address order, a range ends at a gap or a label */
+static void
+print_unused(struct prog_info *pi, struct flow *flow, const char *reached)
+{
+	struct code_record *code;
+	struct label *label, **labels;
+	long start = -1, end = 0, total = 0, words = 0;
+	int i, b = 0, count = 0, l = 0, name = -1;
+
+	for (label = pi->first_label; label; label = label->next)
+		if (label->segment == pi->cseg)
+			count++;
+	labels = malloc((count + 1) * sizeof(struct label *));
+	if (!labels) {
+		print_msg(pi, MSGTYPE_OUT_OF_MEM, NULL);
+		return;
+	}
+	count = 0;
+	for (label = pi->first_label; label; label = label->next)
+		if (label->segment == pi->cseg)
+			labels[count++] = label;
+	qsort(labels, count, sizeof(struct label *), compare_label_value);
+
+	printf("Unreachable code:\n");
+	printf("%-6s %-6s %6s  %s\n", "Start", "End", "Words", "Label");
+	for (i = 0; i <= flow->code_count; i++) {
+		code = &flow->code[i];
+		if (i < flow->code_count) {
+			if ((b + 1 < flow->block_count) && (i == flow->block[b + 1].first))
+				b++;
+			while ((l < count) && (labels[l]->value < code->addr))
+				name = l++;
+			words += code->size;
+		}
+		if ((start >= 0) && ((i == flow->code_count) || reached[b] || (code->addr != end)
+		                     || ((l < count) && (labels[l]->value == code->addr)))) {
+			if ((name >= 0) && (labels[name]->value == start))
+				printf("%06lx %06lx %6ld  %s\n", start, end - 1, end - start, labels[name]->name);
+			else if (name >= 0)
+				printf("%06lx %06lx %6ld  %s+%lx\n", start, end - 1, end - start,
+				       labels[name]->name, start - labels[name]->value);
+			else
+				printf("%06lx %06lx %6ld\n", start, end - 1, end - start);
+			total += end - start;
+			start = -1;
+		}
+		if ((i == flow->code_count) || reached[b])
+			continue;
+		if (start < 0) {
+			start = code->addr;
+			if ((l < count) && (labels[l]->value == start))
+				name = l++;
+		}
+		end = code->addr + code->size;
+	}
+	printf("%ld of %ld code words unreachable\n", total, words);
+	free(labels);
+}
+
+/* Code reached from the interrupt vectors, the .KEEP addresses and, in a
+ * module, the global labels, following branches, skips, jumps and calls.
+ * The targets of ijmp and icall come from .CALLS. */
+void
+print_unused_report(struct prog_info *pi)
+{
+	struct flow flow;
+	struct code_record *code;
+	struct keep *keep;
+	struct label *label;
+	char *reached = NULL;
+	int *stack = NULL;
+	int i, b, e, t, depth = 0;
+	long indirect = -1;
+
+	if (!GET_ARG_I(pi->args, ARG_UNUSED) || pi->error_count)
+		return;
+	if (!build_flow(pi, &flow) || !flow.code_count || !find_entries(&flow))
+		goto out;
+	reached = calloc(flow.block_count + 1, 1);
+	stack = malloc((flow.block_count + 1) * sizeof(int));
+	if (!reached || !stack) {
+		print_msg(pi, MSGTYPE_OUT_OF_MEM, NULL);
+		goto out;
+	}
+	for (i = 0; i < flow.routine_count; i++)
+		if (flow.routine[i].vector >= 0)
+			reach(reached, stack, &depth, find_block(&flow, flow.routine[i].vector));
+	for (keep = pi->first_keep; keep; keep = keep->next)
+		reach(reached, stack, &depth, find_block(&flow, keep->addr));
+	if (pi->module)
+		for (i = 1; i < pi->atom_count; i++) {
+			label = pi->atom[i].symbol[SYMBOL_LABEL];
+			if (pi->atom[i].global && label && (label->segment == pi->cseg))
+				reach(reached, stack, &depth, find_block(&flow, label->value));
+		}
+	while (depth) {
+		b = stack[--depth];
+		for (e = 0; e < flow.block[b].succ_count; e++)
+			reach(reached, stack, &depth, flow.block[b].succ[e]);
+		for (i = flow.block[b].first; i <= flow.block[b].last; i++) {
+			code = &flow.code[i];
+			if ((code->flow == FLOW_CALL) && (code->target >= 0))
+				reach(reached, stack, &depth, find_block(&flow, code->target));
+			if ((code->flow != FLOW_INDIRECT_CALL) && (code->flow != FLOW_INDIRECT_JUMP))
+				continue;
+			t = find_target(&flow, code->addr);
+			if ((t < 0) && ((indirect < 0) || (code->addr < indirect)))
+				indirect = code->addr;
+			for (; (t >= 0) && (t < flow.target_count) && (flow.target[t].addr == code->addr); t++)
+				reach(reached, stack, &depth, find_block(&flow, flow.target[t].target));
+		}
+	}
+	print_unused(pi, &flow, reached);
+	if (indirect >= 0)
+		printf("Indirect jump or call at %06lx: its targets are not followed, give them with .CALLS\n",
+		       indirect);
+	printf("\n");
+out:
+	free(reached);
+	free(stack);
+	free(flow.code);
+	free(flow.block);
+	free(flow.target);
+	free(flow.routine);
+}
+
+static void
+clobbers_note(struct routine *routine, int type, long addr)
+{
+	if (routine->clobbers_note[type] < 0)
+		routine->clobbers_note[type] = addr;
+}
+
+/* State of the clobber search */
+struct clobbers_walk {
+	struct flow *flow;
+	char *reached;
+	int *stack;
+	int *call;		/* Pairs of caller and callee indices */
+	int call_count;
+	int call_alloc;
+};
+
+static int
+add_call(struct clobbers_walk *w, struct routine *routine, long target)
+{
+	int *call, i;
+
+	for (i = 0; i < w->flow->routine_count; i++)
+		if (w->flow->routine[i].addr == target)
+			break;
+	if (i == w->flow->routine_count)
+		return (True);
+	if (w->call_count == w->call_alloc) {
+		call = realloc(w->call, (w->call_alloc + 64) * 2 * sizeof(int));
+		if (!call) {
+			print_msg(w->flow->pi, MSGTYPE_OUT_OF_MEM, NULL);
+			return (False);
+		}
+		w->call = call;
+		w->call_alloc += 64;
+	}
+	w->call[w->call_count * 2] = (int)(routine - w->flow->routine);
+	w->call[w->call_count * 2 + 1] = i;
+	w->call_count++;
+	return (True);
+}
+
+/* Registers written by the blocks reached from the entry of a routine, and
+ * the routines it calls */
+static int
+clobbers_local(struct clobbers_walk *w, struct routine *routine)
+{
+	struct flow *flow = w->flow;
+	struct code_record *code;
+	struct block *block;
+	int b, e, i, t, depth = 0;
+
+	memset(w->reached, 0, flow->block_count);
+	b = find_block(flow, routine->addr);
+	if (b < 0)
+		clobbers_note(routine, CLOBBERS_OUTSIDE, routine->addr);
+	reach(w->reached, w->stack, &depth, b);
+	while (depth) {
+		block = &flow->block[w->stack[--depth]];
+		for (i = block->first; i <= block->last; i++) {
+			code = &flow->code[i];
+			routine->clobbers |= code->written;
+			if (code->flow == FLOW_CALL) {
+				if (code->target < 0)
+					clobbers_note(routine, CLOBBERS_OUTSIDE, code->addr);
+				else if (!add_call(w, routine, code->target))
+					return (False);
+			} else if (code->flow == FLOW_INDIRECT_CALL) {
+				t = find_target(flow, code->addr);
+				if (t < 0)
+					clobbers_note(routine, CLOBBERS_INDIRECT, code->addr);
+				for (; (t >= 0) && (t < flow->target_count) && (flow->target[t].addr == code->addr); t++)
+					if (!add_call(w, routine, flow->target[t].target))
+						return (False);
+			}
+		}
+		code = &flow->code[block->last];
+		for (e = 0; e < block->succ_count; e++) {
+			if (block->succ[e] == SUCC_OUTSIDE)
+				clobbers_note(routine, CLOBBERS_OUTSIDE, code->addr);
+			else if (block->succ[e] != SUCC_INDIRECT)
+				reach(w->reached, w->stack, &depth, block->succ[e]);
+			else {
+				t = find_target(flow, code->addr);
+				if (t < 0)
+					clobbers_note(routine, CLOBBERS_INDIRECT, code->addr);
+				for (; (t >= 0) && (t < flow->target_count) && (flow->target[t].addr == code->addr); t++) {
+					b = find_block(flow, flow->target[t].target);
+					if (b < 0)
+						clobbers_note(routine, CLOBBERS_OUTSIDE, code->addr);
+					reach(w->reached, w->stack, &depth, b);
+				}
+			}
+		}
+	}
+	return (True);
+}
+
+/* Registers each routine writes. The calls are followed until no set
+ * grows, which also settles recursion. Where the code can't be followed,
+ * all registers are taken to be written. */
+static int
+analyze_clobbers(struct flow *flow)
+{
+	struct clobbers_walk w;
+	struct routine *caller, *callee;
+	int i, n, changed, ok = True;
+
+	w.flow = flow;
+	w.reached = malloc(flow->block_count + 1);
+	w.stack = malloc((flow->block_count + 1) * sizeof(int));
+	w.call = NULL;
+	w.call_count = w.call_alloc = 0;
+	if (!w.reached || !w.stack) {
+		print_msg(flow->pi, MSGTYPE_OUT_OF_MEM, NULL);
+		ok = False;
+	}
+	for (i = 0; ok && (i < flow->routine_count); i++)
+		ok = clobbers_local(&w, &flow->routine[i]);
+	do {
+		changed = False;
+		for (i = 0; ok && (i < w.call_count); i++) {
+			caller = &flow->routine[w.call[i * 2]];
+			callee = &flow->routine[w.call[i * 2 + 1]];
+			for (n = 0; n < CLOBBERS_NOTE_COUNT; n++)
+				if (callee->clobbers_note[n] >= 0)
+					clobbers_note(caller, n, callee->clobbers_note[n]);
+			if ((caller->clobbers | callee->clobbers) != caller->clobbers) {
+				caller->clobbers |= callee->clobbers;
+				changed = True;
+			}
+		}
+	} while (changed);
+	for (i = 0; i < flow->routine_count; i++)
+		for (n = 0; n < CLOBBERS_NOTE_COUNT; n++)
+			if (flow->routine[i].clobbers_note[n] >= 0)
+				flow->routine[i].clobbers = ALL_REGISTERS;
+	free(w.reached);
+	free(w.stack);
+	free(w.call);
+	return (ok);
+}
+
+/* Routines for the entries and for the labels given to clobbers() */
+static int
+find_clobbers_entries(struct prog_info *pi, struct flow *flow)
+{
+	int i;
+
+	if (flow->code_count && !find_entries(flow))
+		return (False);
+	for (i = 0; i < pi->clobbers_count; i++)
+		if (!get_routine(flow, pi->clobbers[i].addr))
+			return (False);
+	return (True);
+}
+
+/* Register ranges like "r16-r18, r30-r31" */
+static void
+format_registers(char *buf, int size, unsigned long registers)
+{
+	int r, first, len = 0;
+
+	buf[0] = '\0';
+	if (!registers) {
+		snprintf(buf, size, "none");
+		return;
+	}
+	for (r = 0; (r < 32) && (len < size); r++) {
+		if (!(registers & (1UL << r)))
+			continue;
+		for (first = r; (r < 31) && (registers & (1UL << (r + 1))); r++)
+			;
+		if (first == r)
+			len += snprintf(buf + len, size - len, "%sr%d", len ? ", " : "", r);
+		else
+			len += snprintf(buf + len, size - len, "%sr%d-r%d", len ? ", " : "", first, r);
+	}
+}
+
+static void
+print_clobbers_routine(struct prog_info *pi, struct routine *routine)
+{
+	char registers[160], notes[256];
+	int n, len = 0;
+
+	format_registers(registers, sizeof(registers), routine->clobbers);
+	notes[0] = '\0';
+	if (routine->vector >= 0)
+		len += snprintf(notes + len, sizeof(notes) - len, "vector %06lx", routine->vector);
+	for (n = 0; (n < CLOBBERS_NOTE_COUNT) && (len < (int)sizeof(notes)); n++)
+		if (routine->clobbers_note[n] >= 0) {
+			len += snprintf(notes + len, sizeof(notes) - len, "%s", len ? ", " : "");
+			if (len < (int)sizeof(notes))
+				len += snprintf(notes + len, sizeof(notes) - len, clobbers_note_text[n], routine->clobbers_note[n]);
+		}
+	if (notes[0])
+		printf("%06lx %-20s %-24s %s\n", routine->addr, routine_name(pi, routine->addr), registers, notes);
+	else
+		printf("%06lx %-20s %s\n", routine->addr, routine_name(pi, routine->addr), registers);
+}
+
+/* Registers each routine writes, including those written by the routines
+ * it calls. A pop writes its register, so a routine which saves and
+ * restores a register still lists it. */
+void
+print_clobbers_report(struct prog_info *pi)
+{
+	struct flow flow;
+	int i;
+
+	if (!GET_ARG_I(pi->args, ARG_CLOBBERS) || pi->error_count)
+		return;
+	if (build_flow(pi, &flow) && flow.code_count && find_clobbers_entries(pi, &flow)
+	        && analyze_clobbers(&flow)) {
+		qsort(flow.routine, flow.routine_count, sizeof(struct routine), compare_routine);
+		printf("Registers written:\n");
+		printf("%-6s %-20s %-24s %s\n", "Entry", "Routine", "Registers", "Notes");
+		for (i = 0; i < flow.routine_count; i++)
+			print_clobbers_routine(pi, &flow.routine[i]);
+		printf("\n");
+	}
+	free(flow.code);
+	free(flow.block);
+	free(flow.target);
+	free(flow.routine);
+}
+
+/* clobbers(name): bit n is set if the routine at addr writes Rn. The set
+ * comes from the code of the previous layout pass and is 0 until known.
+ * Sets are kept by the label the expression used, as the same name is a
+ * different label in each expansion of a macro, and by name without one. */
+int
+get_clobbers(struct prog_info *pi, const char *name, struct label *label, long addr, int *value)
+{
+	struct clobber_set *clobbers;
+	int i;
+
+	*value = 0;
+	for (i = 0; i < pi->clobbers_count; i++)
+		if (label ? (pi->clobbers[i].label == label) && (pi->clobbers[i].offset == addr - label->value)
+		          : !pi->clobbers[i].label && !nocase_strcmp(pi->clobbers[i].name, name))
+			break;
+	if (i < pi->clobbers_count) {
+		clobbers = &pi->clobbers[i];
+		clobbers->addr = addr;
+		if (clobbers->known)
+			*value = (int)clobbers->registers;
+		else if (!pi->layout)
+			print_msg(pi, MSGTYPE_ERROR, "The registers written by %s are not known", name);
+		return (True);
+	}
+	if (!pi->layout) {
+		print_msg(pi, MSGTYPE_ERROR, "The registers written by %s are not known", name);
+		return (True);
+	}
+	if (pi->clobbers_count == pi->clobbers_alloc) {
+		clobbers = realloc(pi->clobbers, (pi->clobbers_alloc + CLOBBERS_ALLOC_STEP) * sizeof(struct clobber_set));
+		if (!clobbers) {
+			print_msg(pi, MSGTYPE_OUT_OF_MEM, NULL);
+			return (False);
+		}
+		pi->clobbers = clobbers;
+		pi->clobbers_alloc += CLOBBERS_ALLOC_STEP;
+	}
+	clobbers = &pi->clobbers[pi->clobbers_count];
+	clobbers->name = malloc(strlen(name) + 1);
+	if (!clobbers->name) {
+		print_msg(pi, MSGTYPE_OUT_OF_MEM, NULL);
+		return (False);
+	}
+	strcpy(clobbers->name, name);
+	clobbers->label = label;
+	clobbers->offset = label ? addr - label->value : 0;
+	clobbers->addr = addr;
+	clobbers->registers = 0;
+	clobbers->known = False;
+	pi->clobbers_count++;
+	return (True);
+}
+
+/* After a layout pass: the registers written by the routines clobbers()
+ * asked for, from the code of that pass. True if any set changed. */
+int
+update_clobbers(struct prog_info *pi)
+{
+	struct flow flow;
+	struct routine *routine;
+	char *buf;
+	int i, addr, changed = False;
+
+	if (!pi->clobbers_count)
+		return (False);
+	/* A label used before its definition had its address of the pass before */
+	for (i = 0; i < pi->clobbers_count; i++) {
+		if (pi->clobbers[i].label) {
+			pi->clobbers[i].addr = pi->clobbers[i].label->value + pi->clobbers[i].offset;
+			continue;
+		}
+		buf = malloc(strlen(pi->clobbers[i].name) + 1);
+		if (!buf) {
+			print_msg(pi, MSGTYPE_OUT_OF_MEM, NULL);
+			return (False);
+		}
+		strcpy(buf, pi->clobbers[i].name);
+		if (get_expr(pi, buf, &addr))
+			pi->clobbers[i].addr = addr;
+		free(buf);
+	}
+	if (build_flow(pi, &flow) && find_clobbers_entries(pi, &flow) && analyze_clobbers(&flow)) {
+		for (i = 0; i < pi->clobbers_count; i++) {
+			routine = get_routine(&flow, pi->clobbers[i].addr);
+			if (!routine)
+				break;
+			if (!pi->clobbers[i].known || (pi->clobbers[i].registers != routine->clobbers))
+				changed = True;
+			pi->clobbers[i].registers = routine->clobbers;
+			pi->clobbers[i].known = True;
+		}
+	}
+	free(flow.code);
+	free(flow.block);
+	free(flow.target);
+	free(flow.routine);
+	return (changed);
+}
+
+int
+add_keep(struct prog_info *pi, long addr)
+{
+	struct keep *keep;
+
+	keep = malloc(sizeof(struct keep));
+	if (!keep) {
+		print_msg(pi, MSGTYPE_OUT_OF_MEM, NULL);
+		return (False);
+	}
+	keep->next = NULL;
+	keep->addr = addr;
+	if (pi->last_keep)
+		pi->last_keep->next = keep;
+	else
+		pi->first_keep = keep;
+	pi->last_keep = keep;
+	return (True);
+}
+
+int
+add_indirect_target(struct prog_info *pi, long addr, long target)
+{
+	struct indirect_target *indirect_target;
+
+	indirect_target = malloc(sizeof(struct indirect_target));
+	if (!indirect_target) {
+		print_msg(pi, MSGTYPE_OUT_OF_MEM, NULL);
+		return (False);
+	}
+	indirect_target->next = NULL;
+	indirect_target->addr = addr;
+	indirect_target->target = target;
+	if (pi->last_indirect_target)
+		pi->last_indirect_target->next = indirect_target;
+	else
+		pi->first_indirect_target = indirect_target;
+	pi->last_indirect_target = indirect_target;
+	return (True);
+}
+
+int
+add_loop_bound(struct prog_info *pi, long addr, int count)
+{
+	struct loop_bound *loop_bound;
+
+	loop_bound = malloc(sizeof(struct loop_bound));
+	if (!loop_bound) {
+		print_msg(pi, MSGTYPE_OUT_OF_MEM, NULL);
+		return (False);
+	}
+	loop_bound->next = NULL;
+	loop_bound->addr = addr;
+	loop_bound->count = count;
+	if (pi->last_loop_bound)
+		pi->last_loop_bound->next = loop_bound;
+	else
+		pi->first_loop_bound = loop_bound;
+	pi->last_loop_bound = loop_bound;
+	return (True);
+}
+
+/* .LOOPBOUND, .KEEP and .CALLS are collected again by each pass 2 */
+void
+reset_flow(struct prog_info *pi)
+{
+	struct loop_bound *loop_bound, *temp_loop_bound;
+	struct keep *keep, *temp_keep;
+	struct indirect_target *indirect_target, *temp_indirect_target;
+
+	for (loop_bound = pi->first_loop_bound; loop_bound;) {
+		temp_loop_bound = loop_bound;
+		loop_bound = loop_bound->next;
+		free(temp_loop_bound);
+	}
+	pi->first_loop_bound = NULL;
+	pi->last_loop_bound = NULL;
+	for (keep = pi->first_keep; keep;) {
+		temp_keep = keep;
+		keep = keep->next;
+		free(temp_keep);
+	}
+	pi->first_keep = NULL;
+	pi->last_keep = NULL;
+	for (indirect_target = pi->first_indirect_target; indirect_target;) {
+		temp_indirect_target = indirect_target;
+		indirect_target = indirect_target->next;
+		free(temp_indirect_target);
+	}
+	pi->first_indirect_target = NULL;
+	pi->last_indirect_target = NULL;
+}
+
+void
+free_flow(struct prog_info *pi)
+{
+	int i;
+
+	reset_flow(pi);
+	for (i = 0; i < pi->clobbers_count; i++)
+		free(pi->clobbers[i].name);
+	free(pi->clobbers);
+	pi->clobbers = NULL;
+	pi->clobbers_count = pi->clobbers_alloc = 0;
+}
+
+/* end of flow.c */
@@ -0,0 +1,649 @@
+/***********************************************************************
+ *
+ *  AVRA - Assembler for the Atmel AVR microcontroller series
+ *
+ *  Copyright (C) 1998-2020 The AVRA Authors
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; see the file COPYING.  If not, write to
+ *  the Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ *  Boston, MA 02111-1307, USA.
+ *
+ *
+ *  Authors of AVRA can be reached at:
+ *     email: jonah@omegav.ntnu.no, tobiw@suprafluid.com
+ *     www: https://github.com/Ro5bert/avra
+ */
+
+/*
+ * avra-ld: links modules written by avra --module into hex files.
+ *
+ * The sections of the modules are placed one after the other in the
+ * order of the command line: code from address 0, data from the start
+ * of RAM and EEPROM from 0. Every module is read three times, for its
+ * sizes, for its symbols and contents and for its relocations.
+ *
+ * With --drop_unused only the first module, which holds the vectors, the
+ * modules with .KEEP code and the modules defining their externs, and so
+ * on, are linked.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "misc.h"
+#include "args.h"
+#include "avra.h"
+#include "device.h"
+
+#define MODULE_LINE_LENGTH 256
+
+enum {
+	LD_SIZES = 0,
+	LD_SYMBOLS,
+	LD_RELOCS
+};
+
+struct module {
+	struct module *next;
+	struct include_file include_file;	/* For messages and the map file */
+	long base[3];				/* Of each section, SEGMENT_xxx */
+	long size[3];
+	int keep;				/* Has .KEEP code */
+	int used;				/* Reached from the kept modules */
+	int *uses;				/* Atoms of its externs */
+	int use_count;
+	int use_alloc;
+};
+
+extern const char *const reloc_type_list[];
+extern const char *const reloc_function_list[];
+extern const char *const section_list[];
+
+const char *ld_title = "AVRA linker (version %s)\n";
+
+const char *ld_usage =
+    "usage: avra-ld [-o <filename>] output file name\n"
+    "               [-e <filename>] file name to output EEPROM contents\n"
+    "               [-m <mapfile>] generate map file\n"
+    "               [--drop_unused] leave out modules nothing uses\n"
+    "               [-h] [--help] general help\n"
+    "               <modules to link>\n"
+    "\n"
+    "Links the .rel files written by avra --module.\n";
+
+static struct prog_info PROG_INFO;
+static unsigned short *flash;
+static unsigned char *eeprom;
+static long flash_size;		/* Of the images: up to the end of the placed */
+static long eeprom_size;	/* sections, at most the device's */
+static struct module **owner;	/* Module defining each atom, for --drop_unused */
+static int owner_size;
+
+static struct segment_info *
+section_segment(struct prog_info *pi, int section)
+{
+	if (section == SEGMENT_CODE)
+		return (pi->cseg);
+	if (section == SEGMENT_DATA)
+		return (pi->dseg);
+	return (pi->eseg);
+}
+
+static int
+find_name(const char *const *list, const char *name)
+{
+	int i;
+
+	for (i = 0; list[i]; i++)
+		if (!strcmp(list[i], name))
+			return (i);
+	return (-1);
+}
+
+static long
+get_hex(struct prog_info *pi, const char *s)
+{
+	char *end;
+	long value;
+
+	if (!s) {
+		print_msg(pi, MSGTYPE_ERROR, "Module is truncated");
+		return (0);
+	}
+	value = strtol(s, &end, 16);
+	if (*end != '\0')
+		print_msg(pi, MSGTYPE_ERROR, "Bad number %s in module", s);
+	return (value);
+}
+
+static int
+set_device(struct prog_info *pi, char *name)
+{
+	struct device *device;
+
+	device = get_device(pi, name);
+	if (!device) {
+		print_msg(pi, MSGTYPE_ERROR, "Unknown device: %s", name);
+		return (False);
+	}
+	if (pi->device->name == NULL) {
+		pi->device = device;
+		init_segment_size(pi, pi->device);
+	} else if (device != pi->device)
+		print_msg(pi, MSGTYPE_ERROR, "Module is for %s, not %s", device->name, pi->device->name);
+	return (True);
+}
+
+/* A global label of a module */
+static int
+def_ld_label(struct prog_info *pi, char *name, struct segment_info *si, int value)
+{
+	struct label *label;
+
+	label = malloc(sizeof(struct label));
+	if (!label) {
+		print_msg(pi, MSGTYPE_OUT_OF_MEM, NULL);
+		return (False);
+	}
+	label->next = NULL;
+	label->name = malloc(strlen(name) + 1);
+	if (!label->name) {
+		free(label);
+		print_msg(pi, MSGTYPE_OUT_OF_MEM, NULL);
+		return (False);
+	}
+	strcpy(label->name, name);
+	label->value = value;
+	set_symbol_origin(pi, label, si);
+	if (pi->last_label)
+		pi->last_label->next = label;
+	else
+		pi->first_label = label;
+	pi->last_label = label;
+	return (bind_symbol(pi, SYMBOL_LABEL, label));
+}
+
+static int
+def_global_symbol(struct prog_info *pi, struct module *module, char *name, char *section, long value)
+{
+	int i;
+
+	if (test_label(pi, name, "%s is defined by more than one module")
+	        || test_constant(pi, name, "%s is defined by more than one module"))
+		return (True);
+	if (!strcmp(section, "abs"))
+		return (def_const(pi, name, value));
+	i = find_name(section_list, section);
+	if (i < 0) {
+		print_msg(pi, MSGTYPE_ERROR, "Unknown section %s", section);
+		return (True);
+	}
+	return (def_ld_label(pi, name, section_segment(pi, i), module->base[i] + value));
+}
+
+/* A line of code words or EEPROM bytes */
+static void
+load_contents(struct prog_info *pi, struct module *module, int section, char *line)
+{
+	struct segment_info *si = section_segment(pi, section);
+	char *s;
+	long addr;
+	int value;
+
+	addr = module->base[section] + get_hex(pi, strtok(line, " \t\r\n"));
+	si->addr = addr;
+	def_orglist(si);
+	while ((s = strtok(NULL, " \t\r\n")) != NULL) {
+		value = get_hex(pi, s);
+		if ((section == SEGMENT_CODE) && (addr < flash_size))
+			flash[addr] = value;
+		else if ((section == SEGMENT_EEPROM) && (addr < eeprom_size))
+			eeprom[addr] = value;
+		addr++;
+	}
+	advance_ip(si, addr - si->addr);
+	fix_orglist(si);
+}
+
+static int
+get_word(long offset)
+{
+	return (flash[offset / 2]);
+}
+
+static void
+put_word(long offset, int value)
+{
+	flash[offset / 2] = value;
+}
+
+/* Fill in a field, like mnemonic.c and directiv.c would have done */
+static void
+apply_reloc(struct prog_info *pi, struct module *module, int section, long offset,
+            int type, int value)
+{
+	long pc;
+	int i;
+
+	if (section == SEGMENT_EEPROM) {
+		offset += module->base[SEGMENT_EEPROM];
+		if (offset + (type == RELOC_WORD ? 1 : 0) >= eeprom_size)
+			return;
+		if (type == RELOC_BYTE) {
+			if ((value < -128) || (value > 255))
+				print_msg(pi, MSGTYPE_WARNING, "Value %d is out of range (-128 <= k <= 255). Will be masked", value);
+			eeprom[offset] = value;
+		} else {
+			if ((value < -32768) || (value > 65535))
+				print_msg(pi, MSGTYPE_WARNING, "Value %d is out of range (-32768 <= k <= 65535). Will be masked", value);
+			eeprom[offset] = value;
+			eeprom[offset + 1] = value >> 8;
+		}
+		return;
+	}
+	offset += module->base[SEGMENT_CODE] * 2;
+	if ((offset / 2 + (type == RELOC_JMP ? 1 : 0)) >= flash_size)
+		return;
+	pc = offset / 2 + 1;
+	switch (type) {
+	case RELOC_BRANCH:
+		i = value - pc;
+		if ((i < -64) || (i > 63))
+			print_msg(pi, MSGTYPE_ERROR, "Branch out of range (-64 <= k <= 63)");
+		put_word(offset, (get_word(offset) & ~0x03f8) | ((i & 0x7f) << 3));
+		break;
+	case RELOC_RJMP:
+		i = value - pc;
+		if (((i < -2048) || (i > 2047)) && (pi->device->flash_size != 4096))
+			print_msg(pi, MSGTYPE_ERROR, "Relative address out of range (-2048 <= k <= 2047)");
+		put_word(offset, (get_word(offset) & ~0x0fff) | (i & 0x0fff));
+		break;
+	case RELOC_JMP:
+		if ((value < 0) || (value > 4194303))
+			print_msg(pi, MSGTYPE_ERROR, "Address out of range (0 <= k <= 4194303)");
+		put_word(offset, (get_word(offset) & ~0x01f1)
+		         | ((value & 0x3e0000) >> 13) | ((value & 0x010000) >> 16));
+		put_word(offset + 2, value & 0xffff);
+		break;
+	case RELOC_LDI:
+		if ((value < -128) || (value > 255))
+			print_msg(pi, MSGTYPE_WARNING, "Constant out of range (-128 <= k <= 255). Will be masked");
+		put_word(offset, (get_word(offset) & ~0x0f0f) | ((value & 0xf0) << 4) | (value & 0x0f));
+		break;
+	case RELOC_WORD:
+		if ((value < -32768) || (value > 65535))
+			print_msg(pi, MSGTYPE_WARNING, "Value %d is out of range (-32768 <= k <= 65535). Will be masked", value);
+		put_word(offset, value & 0xffff);
+		break;
+	case RELOC_BYTE:
+		if ((value < -128) || (value > 255))
+			print_msg(pi, MSGTYPE_WARNING, "Value %d is out of range (-128 <= k <= 255). Will be masked", value);
+		if (offset % 2)
+			put_word(offset, (get_word(offset) & 0x00ff) | ((value & 0xff) << 8));
+		else
+			put_word(offset, (get_word(offset) & 0xff00) | (value & 0xff));
+		break;
+	}
+}
+
+/* reloc code|eeprom OFFSET TYPE TARGET SCALE FUNCTION ADDEND */
+static void
+do_reloc(struct prog_info *pi, struct module *module, char *line)
+{
+	char *field[7];
+	struct label *label;
+	int i, section, type, function;
+	long base, value;
+
+	field[0] = strtok(line, " \t\r\n");
+	for (i = 1; i < 7; i++)
+		field[i] = strtok(NULL, " \t\r\n");
+	if (!field[6]) {
+		print_msg(pi, MSGTYPE_ERROR, "Module is truncated");
+		return;
+	}
+	section = !strcmp(field[0], "code") ? SEGMENT_CODE : SEGMENT_EEPROM;
+	type = find_name(reloc_type_list, field[2]);
+	function = find_name(reloc_function_list, field[5]);
+	if ((type < 0) || (function < 0)) {
+		print_msg(pi, MSGTYPE_ERROR, "Unknown relocation %s %s", field[2], field[5]);
+		return;
+	}
+	i = find_name(section_list, field[3]);
+	if (i >= 0)
+		base = module->base[i];
+	else {
+		label = test_label(pi, field[3], NULL);
+		if (!label)
+			label = test_constant(pi, field[3], NULL);
+		if (!label) /* Reported at its extern line */
+			return;
+		base = label->value;
+	}
+	value = strtol(field[6], NULL, 16) + base * strtol(field[4], NULL, 10);
+	if (function == RELOC_FN_LOW)
+		value &= 0xff;
+	else if (function == RELOC_FN_HIGH)
+		value = (value >> 8) & 0xff;
+	apply_reloc(pi, module, section, get_hex(pi, field[1]), type, value);
+}
+
+static void
+set_owner(struct prog_info *pi, struct module *module, char *name)
+{
+	struct module **temp;
+	int atom = intern(pi, name);
+
+	if (!atom)
+		return;
+	if (atom >= owner_size) {
+		temp = realloc(owner, pi->atom_size * sizeof(struct module *));
+		if (!temp) {
+			print_msg(pi, MSGTYPE_OUT_OF_MEM, NULL);
+			return;
+		}
+		memset(temp + owner_size, 0, (pi->atom_size - owner_size) * sizeof(struct module *));
+		owner = temp;
+		owner_size = pi->atom_size;
+	}
+	owner[atom] = module;
+}
+
+static void
+add_use(struct prog_info *pi, struct module *module, char *name)
+{
+	int *temp, atom = intern(pi, name);
+
+	if (!atom)
+		return;
+	if (module->use_count == module->use_alloc) {
+		temp = realloc(module->uses, (module->use_alloc + 16) * sizeof(int));
+		if (!temp) {
+			print_msg(pi, MSGTYPE_OUT_OF_MEM, NULL);
+			return;
+		}
+		module->uses = temp;
+		module->use_alloc += 16;
+	}
+	module->uses[module->use_count++] = atom;
+}
+
+static void
+mark_used(struct module *module)
+{
+	int i;
+
+	if (module->used)
+		return;
+	module->used = True;
+	for (i = 0; i < module->use_count; i++)
+		if ((module->uses[i] < owner_size) && owner[module->uses[i]])
+			mark_used(owner[module->uses[i]]);
+}
+
+/* Take the modules that the first one and the kept ones don't need out of
+ * the list, before their sections are placed */
+static void
+drop_unused(struct module *first_module)
+{
+	struct module *module, **prev;
+
+	mark_used(first_module);
+	for (module = first_module; module; module = module->next)
+		if (module->keep)
+			mark_used(module);
+	for (prev = &first_module->next; (module = *prev) != NULL;) {
+		if (module->used) {
+			prev = &module->next;
+			continue;
+		}
+		printf("Dropped unused module %s (%ld code words)\n", module->include_file.name,
+		       module->size[SEGMENT_CODE]);
+		*prev = module->next;
+		free(module->uses);
+		free(module);
+	}
+}
+
+static int
+read_module(struct prog_info *pi, struct module *module, int pass)
+{
+	FILE *fp;
+	char line[MODULE_LINE_LENGTH], *keyword, *name, *section, *value;
+	int i;
+
+	fp = fopen(module->include_file.name, "r");
+	if (!fp) {
+		perror(module->include_file.name);
+		pi->error_count++;
+		return (False);
+	}
+	pi->fi->include_file = &module->include_file;
+	pi->fi->line_number = 0;
+	while (fgets(line, sizeof(line), fp)) {
+		pi->fi->line_number++;
+		if (pi->fi->line_number == 1) {
+			if (strncmp(line, "AVRA module 1", 13)) {
+				print_msg(pi, MSGTYPE_ERROR, "Not a module written by avra --module");
+				break;
+			}
+			continue;
+		}
+		keyword = strtok(line, " \t\r\n");
+		if (!keyword)
+			continue;
+		if (!strcmp(keyword, "reloc")) {
+			if (pass == LD_RELOCS)
+				do_reloc(pi, module, keyword + strlen(keyword) + 1);
+		} else if (!strcmp(keyword, "code") || !strcmp(keyword, "eeprom")) {
+			if (pass == LD_SYMBOLS)
+				load_contents(pi, module, !strcmp(keyword, "code") ? SEGMENT_CODE : SEGMENT_EEPROM,
+				              keyword + strlen(keyword) + 1);
+		} else {
+			name = strtok(NULL, " \t\r\n");
+			section = strtok(NULL, " \t\r\n");
+			value = strtok(NULL, " \t\r\n");
+			if (!name) {
+				print_msg(pi, MSGTYPE_ERROR, "Module is truncated");
+				break;
+			}
+			if (!strcmp(keyword, "device")) {
+				if (pass == LD_SIZES)
+					set_device(pi, name);
+			} else if (!strcmp(keyword, "size")) {
+				i = find_name(section_list, name);
+				if ((pass == LD_SIZES) && (i >= 0))
+					module->size[i] = get_hex(pi, section);
+			} else if (!strcmp(keyword, "global")) {
+				if ((pass == LD_SIZES) && GET_ARG_I(pi->args, ARG_DROP_UNUSED))
+					set_owner(pi, module, name);
+				if ((pass == LD_SYMBOLS) && section)
+					def_global_symbol(pi, module, name, section, get_hex(pi, value));
+			} else if (!strcmp(keyword, "extern")) {
+				if ((pass == LD_SIZES) && GET_ARG_I(pi->args, ARG_DROP_UNUSED))
+					add_use(pi, module, name);
+				if ((pass == LD_RELOCS) && !test_label(pi, name, NULL) && !test_constant(pi, name, NULL))
+					print_msg(pi, MSGTYPE_ERROR, "%s is not defined by any module", name);
+			} else if (!strcmp(keyword, "keep")) {
+				if (pass == LD_SIZES)
+					module->keep = True;
+			} else if (strcmp(keyword, "source"))
+				print_msg(pi, MSGTYPE_ERROR, "Unknown line %s in module", keyword);
+		}
+	}
+	fclose(fp);
+	return (True);
+}
+
+/* Sections in the order of the command line */
+static void
+place_sections(struct prog_info *pi, struct module *first_module)
+{
+	struct module *module;
+	long next[3];
+	int i;
+
+	next[SEGMENT_CODE] = pi->cseg->lo_addr;
+	next[SEGMENT_DATA] = pi->dseg->lo_addr;
+	next[SEGMENT_EEPROM] = pi->eseg->lo_addr;
+	for (module = first_module; module; module = module->next)
+		for (i = SEGMENT_CODE; i <= SEGMENT_EEPROM; i++) {
+			module->base[i] = next[i];
+			next[i] += module->size[i];
+		}
+	flash_size = next[SEGMENT_CODE] < pi->device->flash_size ? next[SEGMENT_CODE] : pi->device->flash_size;
+	eeprom_size = next[SEGMENT_EEPROM] < pi->device->eeprom_size ? next[SEGMENT_EEPROM] : pi->device->eeprom_size;
+	for (module = first_module; module; module = module->next) {
+		if (!module->size[SEGMENT_DATA])
+			continue;
+		pi->dseg->addr = module->base[SEGMENT_DATA];
+		def_orglist(pi->dseg);
+		advance_ip(pi->dseg, module->size[SEGMENT_DATA]);
+		fix_orglist(pi->dseg);
+	}
+}
+
+static int
+write_hex_files(struct prog_info *pi, const char *basename)
+{
+	char *buff;
+	int length = strlen(basename);
+	long addr;
+
+	buff = malloc(length + 9);
+	if (!buff) {
+		print_msg(pi, MSGTYPE_OUT_OF_MEM, NULL);
+		return (False);
+	}
+	strcpy(buff, basename);
+	if ((length >= 4) && !nocase_strcmp(&buff[length - 4], ".rel"))
+		length -= 4;
+	strcpy(&buff[length], ".hex");
+	pi->cseg->hfi = open_hex_file(GET_ARG_P(pi->args, ARG_OUTFILE) ? GET_ARG_P(pi->args, ARG_OUTFILE) : buff);
+	strcpy(&buff[length], ".eep.hex");
+	pi->eseg->hfi = open_hex_file(GET_ARG_P(pi->args, ARG_EEPFILE) ? GET_ARG_P(pi->args, ARG_EEPFILE) : buff);
+	free(buff);
+	if (!pi->cseg->hfi || !pi->eseg->hfi) {
+		print_msg(pi, MSGTYPE_ERROR, "Could not create output hex file!");
+		close_out_files(pi);
+		return (False);
+	}
+	for (addr = 0; (addr < pi->cseg->occupancy_size) && (addr < flash_size); addr++)
+		if (cell_used(pi->cseg, addr))
+			write_prog_word(pi, addr, flash[addr]);
+	for (addr = 0; (addr < pi->eseg->occupancy_size) && (addr < eeprom_size); addr++)
+		if (cell_used(pi->eseg, addr))
+			write_ee_byte(pi, addr, eeprom[addr]);
+	close_out_files(pi);
+	return (True);
+}
+
+static int
+link_modules(struct prog_info *pi)
+{
+	struct file_info fi;
+	struct module *first_module = NULL, **last_module = &first_module, *module;
+	struct data_list *data;
+	int pass, ok = False;
+
+	memset(&fi, 0, sizeof(fi));
+	pi->fi = &fi;
+	for (data = pi->args->first_data; data; data = data->next) {
+		module = calloc(1, sizeof(struct module));
+		if (!module) {
+			print_msg(pi, MSGTYPE_OUT_OF_MEM, NULL);
+			goto out;
+		}
+		module->include_file.name = (char *)data->data;
+		*last_module = module;
+		last_module = &module->next;
+	}
+	for (pass = LD_SIZES; pass <= LD_RELOCS; pass++) {
+		if (pass == LD_SYMBOLS) {
+			place_sections(pi, first_module);
+			flash = malloc((flash_size + 1) * sizeof(unsigned short));
+			eeprom = malloc(eeprom_size + 1);
+			if (!flash || !eeprom) {
+				print_msg(pi, MSGTYPE_OUT_OF_MEM, NULL);
+				goto out;
+			}
+			memset(flash, 0xff, (flash_size + 1) * sizeof(unsigned short));
+			memset(eeprom, 0xff, eeprom_size + 1);
+		}
+		for (module = first_module; module; module = module->next)
+			read_module(pi, module, pass);
+		if (pi->error_count)
+			goto out;
+		if ((pass == LD_SIZES) && GET_ARG_I(pi->args, ARG_DROP_UNUSED))
+			drop_unused(first_module);
+	}
+	pi->fi = NULL;
+	test_orglist(pi->cseg);
+	test_orglist(pi->dseg);
+	test_orglist(pi->eseg);
+	if (pi->error_count == 0)
+		ok = write_hex_files(pi, first_module->include_file.name);
+	write_map_file(pi);
+out:
+	pi->fi = NULL;
+	free(flash);
+	free(eeprom);
+	flash = NULL;
+	eeprom = NULL;
+	free(owner);
+	owner = NULL;
+	owner_size = 0;
+	while (first_module) {
+		module = first_module;
+		first_module = module->next;
+		free(module->uses);
+		free(module);
+	}
+	return (ok);
+}
+
+int
+main(int argc, const char *argv[])
+{
+	struct prog_info *pi;
+	struct args *args;
+	int ok = False;
+
+	printf(ld_title, VERSION);
+	args = alloc_args(ARG_COUNT);
+	if (!args) {
+		printf("%s", ld_usage);
+		exit(EXIT_FAILURE);
+	}
+	define_args(args);
+	if (read_args(args, argc, argv) && !GET_ARG_I(args, ARG_HELP) && args->first_data) {
+		pi = init_prog_info(&PROG_INFO, args);
+		pi->root_path = "";
+		ok = link_modules(pi);
+		if (pi->error_count)
+			printf("\nLinking aborted with %d errors and %d warnings.\n", pi->error_count, pi->warning_count);
+		else if (pi->warning_count)
+			printf("\nLinking complete with no errors (%d warnings).\n", pi->warning_count);
+		else
+			printf("\nLinking complete with no errors.\n");
+		free_pi(pi);
+	} else
+		printf("%s", ld_usage);
+	free_args(args);
+	exit(ok ? EXIT_SUCCESS : EXIT_FAILURE);
+	return (0);
+}
+
+/* end of ld.c */
@@ -116,6 +116,11 @@ read_macro(struct prog_info *pi, char *name)
 			return (False);
 		}
 		strcpy(macro->name, name);
+		macro->atom = intern(pi, name);
+		if (!macro->atom)
+			return (False);
+		if (!pi->atom[macro->atom].macro)
+			pi->atom[macro->atom].macro = macro;
 		macro->include_file = pi->fi->include_file;
 		macro->first_line_number = pi->fi->line_number;
 		last_macro_line = &macro->first_macro_line;
@@ -215,19 +220,15 @@ read_macro(struct prog_info *pi, char *name)
 
 struct macro *get_macro(struct prog_info *pi, char *name)
 {
-	struct macro *macro;
+	int atom = find_atom(pi, name);
 
-	for (macro = pi->first_macro; macro; macro = macro->next)
-		if (!nocase_strcmp(macro->name, name))
-			return (macro);
-	return (NULL);
+	return (atom ? pi->atom[atom].macro : NULL);
 }
 
 void
 append_type(struct prog_info *pi, char *name, int c, char *value)
 {
 	int p, l;
-	struct def *def;
 
 	p = strlen(name);
 	name[p++] = '_';
@@ -245,11 +246,10 @@ append_type(struct prog_info *pi, char *name, int c, char *value)
 	}
 
 
-	for (def = pi->first_def; def; def = def->next)
-		if (!nocase_strcmp(def->name, value)) {
-			itoa((c*8),&name[p],10);
-			return;
-		}
+	if (search_def(pi, value)) {
+		itoa((c*8),&name[p],10);
+		return;
+	}
 
 	name[p++] = 'i';
 	name[p] = '\0';
@@ -435,6 +435,8 @@ expand_macro(struct prog_info *pi, struct macro *macro, char *rest_line)
 		}
 	}
 
+	if ((pi->pass == PASS_2) && pi->elf && !pi->layout)
+		write_elf_macro_begin(pi, macro);
 	macro_call->line_index = 0;
 	pi->macro_call = macro_call;
 	old_macro_line = pi->macro_line;
@@ -520,6 +522,8 @@ expand_macro(struct prog_info *pi, struct macro *macro, char *rest_line)
 
 	pi->macro_line = old_macro_line;
 	pi->macro_call = macro_call->prev_on_stack;
+	if ((pi->pass == PASS_2) && pi->elf && !pi->layout)
+		write_elf_macro_end(pi);
 	if (rest_line)
 		free(line);
 	return (ok);
@@ -26,53 +26,272 @@
  */
 
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
+
+#include "misc.h"
 #include "avra.h"
 #include "args.h"
+#include "device.h"
+
+#define MAP_BUFFER_SIZE 65536
+#define REFS_PER_LINE 6
+
+struct map_entry {
+	struct label *label;
+	char type;	/* C, V or L */
+	long size;	/* cells covered by a label, up to the next one */
+};
+
+static int
+compare_name(const void *a, const void *b)
+{
+	const struct map_entry *x = a, *y = b;
+	int i;
+
+	i = nocase_strcmp(x->label->name, y->label->name);
+	if (i != 0)
+		return (i);
+	return (x->type - y->type);
+}
+
+static int
+compare_address(const void *a, const void *b)
+{
+	const struct map_entry *x = a, *y = b;
+
+	if (x->label->segment != y->label->segment)
+		return (x->label->segment->ident < y->label->segment->ident ? -1 : 1);
+	if (x->label->value != y->label->value)
+		return (x->label->value < y->label->value ? -1 : 1);
+	return (nocase_strcmp(x->label->name, y->label->name));
+}
+
+/* End of the programmed block containing addr, or addr itself if there is none */
+static long
+block_end(struct segment_info *si, long addr)
+{
+	struct orglist *orglist;
+
+	for (orglist = si->first_orglist; orglist; orglist = orglist->next)
+		if ((addr >= orglist->start) && (addr < orglist->start + orglist->length))
+			return (orglist->start + orglist->length);
+	return (addr);
+}
 
-char *Space(char *n);
+static void
+fprint_location(FILE *fp, struct include_file *include_file, int line_number)
+{
+	if (include_file)
+		fprintf(fp, "%s(%d)", include_file->name, line_number);
+	else
+		fprintf(fp, "-");
+}
+
+static int
+add_entries(struct map_entry *entry, struct label *first, char type)
+{
+	struct label *label;
+	int count = 0;
+
+	for (label = first; label; label = label->next) {
+		entry[count].label = label;
+		entry[count].type = type;
+		entry[count].size = 0;
+		count++;
+	}
+	return (count);
+}
+
+/* Labels are sorted by address here. Each label covers the cells up to the
+ * next label, but never beyond the end of its .ORG block. */
+static void
+fix_label_sizes(struct map_entry *entry, int count)
+{
+	int i;
+	long end;
+
+	for (i = 0; i < count; i++) {
+		end = block_end(entry[i].label->segment, entry[i].label->value);
+		if ((i + 1 < count) && (entry[i + 1].label->segment == entry[i].label->segment)
+		        && (entry[i + 1].label->value < end))
+			end = entry[i + 1].label->value;
+		entry[i].size = end - entry[i].label->value;
+	}
+}
+
+static void
+fprint_density(FILE *fp, struct prog_info *pi, struct segment_info *si,
+               struct map_entry *entry, int count)
+{
+	int i, labels = 0;
+	long labeled = 0;
+	struct map_entry *largest = NULL;
+
+	for (i = 0; i < count; i++) {
+		if (entry[i].label->segment != si)
+			continue;
+		labels++;
+		labeled += entry[i].size;
+		if (!largest || (entry[i].size > largest->size))
+			largest = &entry[i];
+	}
+	fprintf(fp, "%-7s %7ld %-5s", si->name, si->count, si->cellnames);
+	if (pi->device->name != NULL && si->hi_addr > si->lo_addr)
+		fprintf(fp, " %5.1f%%", 100.0 * si->count / (si->hi_addr - si->lo_addr));
+	else
+		fprintf(fp, "      -");
+	fprintf(fp, " %7d", labels);
+	if (labels > 0)
+		fprintf(fp, " %9.1f", (double)labeled / labels);
+	else
+		fprintf(fp, " %9s", "-");
+	fprintf(fp, " %9ld", si->count > labeled ? si->count - labeled : 0);
+	if (largest && largest->size > 0)
+		fprintf(fp, "  %s (%ld %s)", largest->label->name, largest->size,
+		        largest->size == 1 ? si->cellname : si->cellnames);
+	fprintf(fp, "\n");
+}
+
+static void
+fprint_refs(FILE *fp, struct label *label, int indent)
+{
+	struct symbol_ref *ref;
+	int n = 0;
+
+	for (ref = label->first_ref; ref; ref = ref->next) {
+		if (n == REFS_PER_LINE) {
+			fprintf(fp, "\n%*s", indent, "");
+			n = 0;
+		}
+		fprintf(fp, " ");
+		fprint_location(fp, ref->include_file, ref->line_number);
+		n++;
+	}
+	fprintf(fp, "\n");
+}
 
 void
 write_map_file(struct prog_info *pi)
 {
 	FILE *fp;
 	struct label *label;
-	char Filename[200];
+	struct map_entry *by_name, *by_address;
+	int i, count, label_count, width;
+	char *kind;
 
 	if (!pi->map_on) {
 		return;
 	}
 
-	strcpy(Filename, GET_ARG_P(pi->args, ARG_MAPFILE));
-	fp = fopen(Filename,"w");
+	count = 0;
+	for (label = pi->first_constant; label; label = label->next)
+		count++;
+	for (label = pi->first_variable; label; label = label->next)
+		count++;
+	label_count = 0;
+	for (label = pi->first_label; label; label = label->next)
+		label_count++;
+	count += label_count;
+
+	by_name = malloc((count + 1) * sizeof(struct map_entry));
+	by_address = malloc((label_count + 1) * sizeof(struct map_entry));
+	if (!by_name || !by_address) {
+		free(by_name);
+		free(by_address);
+		print_msg(pi, MSGTYPE_OUT_OF_MEM, NULL);
+		return;
+	}
+
+	fp = fopen(GET_ARG_P(pi->args, ARG_MAPFILE), "w");
 	if (fp == NULL) {
 		fprintf(stderr,"Error: cannot create map file\n");
+		free(by_name);
+		free(by_address);
 		return;
 	}
-	for (label = pi->first_constant; label; label = label->next)
-		fprintf(fp,"%s%sC\t%04x\t%d\n",label->name,Space(label->name),label->value,label->value);
+	setvbuf(fp, NULL, _IOFBF, MAP_BUFFER_SIZE);
 
-	for (label = pi->first_variable; label; label = label->next)
-		fprintf(fp,"%s%sV\t%04x\t%d\n",label->name,Space(label->name),label->value,label->value);
+	add_entries(by_address, pi->first_label, 'L');
+	qsort(by_address, label_count, sizeof(struct map_entry), compare_address);
+	fix_label_sizes(by_address, label_count);
 
-	for (label = pi->first_label; label; label = label->next)
-		fprintf(fp,"%s%sL\t%04x\t%d\n",label->name,Space(label->name),label->value,label->value);
+	i = add_entries(by_name, pi->first_constant, 'C');
+	i += add_entries(&by_name[i], pi->first_variable, 'V');
+	memcpy(&by_name[i], by_address, label_count * sizeof(struct map_entry));
+	qsort(by_name, count, sizeof(struct map_entry), compare_name);
+
+	width = 4;
+	for (i = 0; i < count; i++)
+		if ((int)strlen(by_name[i].label->name) > width)
+			width = strlen(by_name[i].label->name);
+
+	fprintf(fp, "AVRA map file for %s\n", (char *)pi->args->first_data->data);
+	fprintf(fp, "Device: %s\n\n", pi->device->name ? pi->device->name : "none");
+
+	fprintf(fp, "Segment usage and symbol density:\n");
+	fprintf(fp, "Segment    Used        Full  Labels  Avg.size Unlabeled  Largest label\n");
+	fprint_density(fp, pi, pi->cseg, by_address, label_count);
+	fprint_density(fp, pi, pi->dseg, by_address, label_count);
+	fprint_density(fp, pi, pi->eseg, by_address, label_count);
+	if (pi->device->name != NULL) {
+		fprintf(fp, "\nFree memory blocks:\n");
+		fprint_free_ranges(fp, pi->cseg);
+		fprint_free_ranges(fp, pi->dseg);
+		fprint_free_ranges(fp, pi->eseg);
+	}
+
+	fprintf(fp, "\nSymbols by name:\n");
+	fprintf(fp, "%-*s  Type  Seg  Hex       Decimal  Defined at\n", width, "Name");
+	for (i = 0; i < count; i++) {
+		label = by_name[i].label;
+		fprintf(fp, "%-*s  %c     %c    %08x %8d  ", width, label->name, by_name[i].type,
+		        label->segment ? label->segment->ident : '-', label->value, label->value);
+		fprint_location(fp, label->include_file, label->line_number);
+		fprintf(fp, "\n");
+	}
+
+	fprintf(fp, "\nLabels by address:\n");
+	fprintf(fp, "Seg  Address   Size  %-*s  Defined at\n", width, "Name");
+	for (i = 0; i < label_count; i++) {
+		label = by_address[i].label;
+		fprintf(fp, "%c    %08x %5ld  %-*s  ", label->segment->ident, label->value,
+		        by_address[i].size, width, label->name);
+		fprint_location(fp, label->include_file, label->line_number);
+		fprintf(fp, "\n");
+	}
+
+	/* Predefined symbols are only listed when they are actually used */
+	fprintf(fp, "\nCross reference:\n");
+	for (i = 0; i < count; i++) {
+		label = by_name[i].label;
+		if (!label->include_file && !label->first_ref)
+			continue;
+		switch (by_name[i].type) {
+		case 'C':
+			kind = "constant";
+			break;
+		case 'V':
+			kind = "variable";
+			break;
+		default:
+			kind = "label";
+			break;
+		}
+		fprintf(fp, "%-*s  %-8s  defined at ", width, label->name, kind);
+		fprint_location(fp, label->include_file, label->line_number);
+		if (label->first_ref) {
+			fprintf(fp, "\n%*s  used at   ", width + 10, "");
+			fprint_refs(fp, label, width + 20);
+		} else
+			fprintf(fp, " (unreferenced)\n");
+	}
 
 	fprintf(fp,"\n");
 	fclose(fp);
+	free(by_name);
+	free(by_address);
 	return;
 }
 
-char *
-Space(char *n)
-{
-	int i;
-
-	i = strlen(n);
-	if (i < 1) return "\t\t\t";
-	if (i < 8) return "\t\t";
-	return "\t";
-}
-
 /* end of map.c */
-
@@ -31,314 +31,402 @@
 #include <ctype.h>
 
 #include "misc.h"
+#include "args.h"
 #include "avra.h"
 #include "device.h"
+#include "mnemonic.h"
 
 #define MAX_MNEMONIC_LEN	8	/* Maximum mnemonic length */
 
-enum {
-	MNEMONIC_NOP = 0,  /*          0000 0000 0000 0000 */
-	MNEMONIC_SEC,      /*          1001 0100 0000 1000 */
-	MNEMONIC_CLC,      /*          1001 0100 1000 1000 */
-	MNEMONIC_SEN,      /*          1001 0100 0010 1000 */
-	MNEMONIC_CLN,      /*          1001 0100 1010 1000 */
-	MNEMONIC_SEZ,      /*          1001 0100 0001 1000 */
-	MNEMONIC_CLZ,      /*          1001 0100 1001 1000 */
-	MNEMONIC_SEI,      /*          1001 0100 0111 1000 */
-	MNEMONIC_CLI,      /*          1001 0100 1111 1000 */
-	MNEMONIC_SES,      /*          1001 0100 0100 1000 */
-	MNEMONIC_CLS,      /*          1001 0100 1100 1000 */
-	MNEMONIC_SEV,      /*          1001 0100 0011 1000 */
-	MNEMONIC_CLV,      /*          1001 0100 1011 1000 */
-	MNEMONIC_SET,      /*          1001 0100 0110 1000 */
-	MNEMONIC_CLT,      /*          1001 0100 1110 1000 */
-	MNEMONIC_SEH,      /*          1001 0100 0101 1000 */
-	MNEMONIC_CLH,      /*          1001 0100 1101 1000 */
-	MNEMONIC_SLEEP,    /*          1001 0101 1000 1000 */
-	MNEMONIC_WDR,      /*          1001 0101 1010 1000 */
-	MNEMONIC_IJMP,     /*          1001 0100 0000 1001 */
-	MNEMONIC_EIJMP,    /*          1001 0100 0001 1001 */
-	MNEMONIC_ICALL,    /*          1001 0101 0000 1001 */
-	MNEMONIC_EICALL,   /*          1001 0101 0001 1001 */
-	MNEMONIC_RET,      /*          1001 0101 0000 1000 */
-	MNEMONIC_RETI,     /*          1001 0101 0001 1000 */
-	MNEMONIC_SPM,      /*          1001 0101 1110 1000 */
-	MNEMONIC_ESPM,     /*          1001 0101 1111 1000 */
-	MNEMONIC_BREAK,    /*          1001 0101 1001 1000 */
-	MNEMONIC_LPM,      /*          1001 0101 1100 1000 */
-	MNEMONIC_ELPM,     /*          1001 0101 1101 1000 */
-	MNEMONIC_BSET,     /* s        1001 0100 0sss 1000 */
-	MNEMONIC_BCLR,     /* s        1001 0100 1sss 1000 */
-	MNEMONIC_SER,      /* Rd       1110 1111 dddd 1111 */
-	MNEMONIC_COM,      /* Rd       1001 010d dddd 0000 */
-	MNEMONIC_NEG,      /* Rd       1001 010d dddd 0001 */
-	MNEMONIC_INC,      /* Rd       1001 010d dddd 0011 */
-	MNEMONIC_DEC,      /* Rd       1001 010d dddd 1010 */
-	MNEMONIC_LSR,      /* Rd       1001 010d dddd 0110 */
-	MNEMONIC_ROR,      /* Rd       1001 010d dddd 0111 */
-	MNEMONIC_ASR,      /* Rd       1001 010d dddd 0101 */
-	MNEMONIC_SWAP,     /* Rd       1001 010d dddd 0010 */
-	MNEMONIC_PUSH,     /* Rr       1001 001r rrrr 1111 */
-	MNEMONIC_POP,      /* Rd       1001 000d dddd 1111 */
-	MNEMONIC_TST,      /* Rd       0010 00dd dddd dddd */
-	MNEMONIC_CLR,      /* Rd       0010 01dd dddd dddd */
-	MNEMONIC_LSL,      /* Rd       0000 11dd dddd dddd */
-	MNEMONIC_ROL,      /* Rd       0001 11dd dddd dddd */
-	MNEMONIC_BREQ,     /* k        1111 00kk kkkk k001 */
-	MNEMONIC_BRNE,     /* k        1111 01kk kkkk k001 */
-	MNEMONIC_BRCS,     /* k        1111 00kk kkkk k000 */
-	MNEMONIC_BRCC,     /* k        1111 01kk kkkk k000 */
-	MNEMONIC_BRSH,     /* k        1111 01kk kkkk k000 */
-	MNEMONIC_BRLO,     /* k        1111 00kk kkkk k000 */
-	MNEMONIC_BRMI,     /* k        1111 00kk kkkk k010 */
-	MNEMONIC_BRPL,     /* k        1111 01kk kkkk k010 */
-	MNEMONIC_BRGE,     /* k        1111 01kk kkkk k100 */
-	MNEMONIC_BRLT,     /* k        1111 00kk kkkk k100 */
-	MNEMONIC_BRHS,     /* k        1111 00kk kkkk k101 */
-	MNEMONIC_BRHC,     /* k        1111 01kk kkkk k101 */
-	MNEMONIC_BRTS,     /* k        1111 00kk kkkk k110 */
-	MNEMONIC_BRTC,     /* k        1111 01kk kkkk k110 */
-	MNEMONIC_BRVS,     /* k        1111 00kk kkkk k011 */
-	MNEMONIC_BRVC,     /* k        1111 01kk kkkk k011 */
-	MNEMONIC_BRIE,     /* k        1111 00kk kkkk k111 */
-	MNEMONIC_BRID,     /* k        1111 01kk kkkk k111 */
-	MNEMONIC_RJMP,     /* k        1100 kkkk kkkk kkkk */
-	MNEMONIC_RCALL,    /* k        1101 kkkk kkkk kkkk */
-	MNEMONIC_JMP,      /* k        1001 010k kkkk 110k + 16k */
-	MNEMONIC_CALL,     /* k        1001 010k kkkk 111k + 16k */
-	MNEMONIC_BRBS,     /* s, k     1111 00kk kkkk ksss */
-	MNEMONIC_BRBC,     /* s, k     1111 01kk kkkk ksss */
-	MNEMONIC_ADD,      /* Rd, Rr   0000 11rd dddd rrrr */
-	MNEMONIC_ADC,      /* Rd, Rr   0001 11rd dddd rrrr */
-	MNEMONIC_SUB,      /* Rd, Rr   0001 10rd dddd rrrr */
-	MNEMONIC_SBC,      /* Rd, Rr   0000 10rd dddd rrrr */
-	MNEMONIC_AND,      /* Rd, Rr   0010 00rd dddd rrrr */
-	MNEMONIC_OR,       /* Rd, Rr   0010 10rd dddd rrrr */
-	MNEMONIC_EOR,      /* Rd, Rr   0010 01rd dddd rrrr */
-	MNEMONIC_CP,       /* Rd, Rr   0001 01rd dddd rrrr */
-	MNEMONIC_CPC,      /* Rd, Rr   0000 01rd dddd rrrr */
-	MNEMONIC_CPSE,     /* Rd, Rr   0001 00rd dddd rrrr */
-	MNEMONIC_MOV,      /* Rd, Rr   0010 11rd dddd rrrr */
-	MNEMONIC_MUL,      /* Rd, Rr   1001 11rd dddd rrrr */
-	MNEMONIC_MOVW,     /* Rd, Rr   0000 0001 dddd rrrr */
-	MNEMONIC_MULS,     /* Rd, Rr   0000 0010 dddd rrrr */
-	MNEMONIC_MULSU,    /* Rd, Rr   0000 0011 0ddd 0rrr */
-	MNEMONIC_FMUL,     /* Rd, Rr   0000 0011 0ddd 1rrr */
-	MNEMONIC_FMULS,    /* Rd, Rr   0000 0011 1ddd 0rrr */
-	MNEMONIC_FMULSU,   /* Rd, Rr   0000 0011 1ddd 1rrr */
-	MNEMONIC_ADIW,     /* Rd, K    1001 0110 KKdd KKKK */
-	MNEMONIC_SBIW,     /* Rd, K    1001 0111 KKdd KKKK */
-	MNEMONIC_SUBI,     /* Rd, K    0101 KKKK dddd KKKK */
-	MNEMONIC_SBCI,     /* Rd, K    0100 KKKK dddd KKKK */
-	MNEMONIC_ANDI,     /* Rd, K    0111 KKKK dddd KKKK */
-	MNEMONIC_ORI,      /* Rd, K    0110 KKKK dddd KKKK */
-	MNEMONIC_SBR,      /* Rd, K    0110 KKKK dddd KKKK */
-	MNEMONIC_CPI,      /* Rd, K    0011 KKKK dddd KKKK */
-	MNEMONIC_LDI,      /* Rd, K    1110 KKKK dddd KKKK */
-	MNEMONIC_CBR,      /* Rd, K    0111 KKKK dddd KKKK ~K */
-	MNEMONIC_SBRC,     /* Rr, b    1111 110r rrrr 0bbb */
-	MNEMONIC_SBRS,     /* Rr, b    1111 111r rrrr 0bbb */
-	MNEMONIC_BST,      /* Rr, b    1111 101d dddd 0bbb */
-	MNEMONIC_BLD,      /* Rd, b    1111 100d dddd 0bbb */
-	MNEMONIC_IN,       /* Rd, P    1011 0PPd dddd PPPP */
-	MNEMONIC_OUT,      /* P, Rr    1011 1PPr rrrr PPPP */
-	MNEMONIC_SBIC,     /* P, b     1001 1001 PPPP Pbbb */
-	MNEMONIC_SBIS,     /* P, b     1001 1011 PPPP Pbbb */
-	MNEMONIC_SBI,      /* P, b     1001 1010 PPPP Pbbb */
-	MNEMONIC_CBI,      /* P, b     1001 1000 PPPP Pbbb */
-	MNEMONIC_LDS,      /* Rd, k    1001 000d dddd 0000 + 16k */
-	MNEMONIC_STS,      /* k, Rr    1001 001d dddd 0000 + 16k */
-	MNEMONIC_LD,       /* Rd, __   dummy */
-	MNEMONIC_ST,       /* __, Rr   dummy */
-	MNEMONIC_LDD,      /* Rd, _+q  dummy */
-	MNEMONIC_STD,      /* _+q, Rr  dummy */
-	MNEMONIC_COUNT,
-	MNEMONIC_LPM_Z,    /* Rd, Z    1001 000d dddd 0100 */
-	MNEMONIC_LPM_ZP,   /* Rd, Z+   1001 000d dddd 0101 */
-	MNEMONIC_ELPM_Z,   /* Rd, Z    1001 000d dddd 0110 */
-	MNEMONIC_ELPM_ZP,  /* Rd, Z+   1001 000d dddd 0111 */
-	MNEMONIC_LD_X,     /* Rd, X    1001 000d dddd 1100 */
-	MNEMONIC_LD_XP,    /* Rd, X+   1001 000d dddd 1101 */
-	MNEMONIC_LD_MX,    /* Rd, -X   1001 000d dddd 1110 */
-	MNEMONIC_LD_Y,     /* Rd, Y    1000 000d dddd 1000 */
-	MNEMONIC_LD_YP,    /* Rd, Y+   1001 000d dddd 1001 */
-	MNEMONIC_LD_MY,    /* Rd, -Y   1001 000d dddd 1010 */
-	MNEMONIC_LD_Z,     /* Rd, Z    1000 000d dddd 0000 */
-	MNEMONIC_LD_ZP,    /* Rd, Z+   1001 000d dddd 0001 */
-	MNEMONIC_LD_MZ,    /* Rd, -Z   1001 000d dddd 0010 */
-	MNEMONIC_ST_X,     /* X, Rr    1001 001d dddd 1100 */
-	MNEMONIC_ST_XP,    /* X+, Rr   1001 001d dddd 1101 */
-	MNEMONIC_ST_MX,    /* -X, Rr   1001 001d dddd 1110 */
-	MNEMONIC_ST_Y,     /* Y, Rr    1000 001d dddd 1000 */
-	MNEMONIC_ST_YP,    /* Y+, Rr   1001 001d dddd 1001 */
-	MNEMONIC_ST_MY,    /* -Y, Rr   1001 001d dddd 1010 */
-	MNEMONIC_ST_Z,     /* Z, Rr    1000 001d dddd 0000 */
-	MNEMONIC_ST_ZP,    /* Z+, Rr   1001 001d dddd 0001 */
-	MNEMONIC_ST_MZ,    /* -Z, Rr   1001 001d dddd 0010 */
-	MNEMONIC_LDD_Y,    /* Rd, Y+q  10q0 qq0d dddd 1qqq */
-	MNEMONIC_LDD_Z,    /* Rd, Z+q  10q0 qq0d dddd 0qqq */
-	MNEMONIC_STD_Y,    /* Y+q, Rr  10q0 qq1r rrrr 1qqq */
-	MNEMONIC_STD_Z,    /* Z+q, Rr  10q0 qq1r rrrr 0qqq */
-	MNEMONIC_LDS_AVR8L,/* Rd, k    1010 0kkk dddd kkkk */
-	MNEMONIC_STS_AVR8L,/* Rd, k    1010 1kkk dddd kkkk */
-	MNEMONIC_END
-};
-
 struct instruction {
 	char *mnemonic;
 	int opcode;
-	int flag;	/* Device flags meaning the instruction is not supported */
+	int mask;	/* Fixed bits of the opcode, for decoding; 0 if none */
+	long flag;	/* Device flags meaning the instruction is not supported */
+	unsigned char cycles[CORE_COUNT];	/* Classic, XMEGA, AVR8L; see get_cycles() */
 };
 
+/* Cycle counts are taken from the AVR instruction set manual for the three
+ * core families. They assume a 16 bit PC and internal SRAM; get_cycles()
+ * adds the cycles for taken branches, skips and 22 bit PC calls/returns. */
 struct instruction instruction_list[] = {
-	{"nop",   0x0000,          0},
-	{"sec",   0x9408,          0},
-	{"clc",   0x9488,          0},
-	{"sen",   0x9428,          0},
-	{"cln",   0x94a8,          0},
-	{"sez",   0x9418,          0},
-	{"clz",   0x9498,          0},
-	{"sei",   0x9478,          0},
-	{"cli",   0x94f8,          0},
-	{"ses",   0x9448,          0},
-	{"cls",   0x94c8,          0},
-	{"sev",   0x9438,          0},
-	{"clv",   0x94b8,          0},
-	{"set",   0x9468,          0},
-	{"clt",   0x94e8,          0},
-	{"seh",   0x9458,          0},
-	{"clh",   0x94d8,          0},
-	{"sleep", 0x9588,          0},
-	{"wdr",   0x95a8,          0},
-	{"ijmp",  0x9409,  DF_TINY1X},
-	{"eijmp", 0x9419, DF_NO_EIJMP},
-	{"icall", 0x9509,  DF_TINY1X},
-	{"eicall",0x9519, DF_NO_EICALL},
-	{"ret",   0x9508,          0},
-	{"reti",  0x9518,          0},
-	{"spm",   0x95e8, DF_NO_SPM},
-	{"espm",  0x95f8, DF_NO_ESPM},
-	{"break", 0x9598, DF_NO_BREAK},
-	{"lpm",   0x95c8, DF_NO_LPM},
-	{"elpm",  0x95d8, DF_NO_ELPM},
-	{"bset",  0x9408,          0},
-	{"bclr",  0x9488,          0},
-	{"ser",   0xef0f,          0},
-	{"com",   0x9400,          0},
-	{"neg",   0x9401,          0},
-	{"inc",   0x9403,          0},
-	{"dec",   0x940a,          0},
-	{"lsr",   0x9406,          0},
-	{"ror",   0x9407,          0},
-	{"asr",   0x9405,          0},
-	{"swap",  0x9402,          0},
-	{"push",  0x920f,  DF_TINY1X},
-	{"pop",   0x900f,  DF_TINY1X},
-	{"tst",   0x2000,          0},
-	{"clr",   0x2400,          0},
-	{"lsl",   0x0c00,          0},
-	{"rol",   0x1c00,          0},
-	{"breq",  0xf001,          0},
-	{"brne",  0xf401,          0},
-	{"brcs",  0xf000,          0},
-	{"brcc",  0xf400,          0},
-	{"brsh",  0xf400,          0},
-	{"brlo",  0xf000,          0},
-	{"brmi",  0xf002,          0},
-	{"brpl",  0xf402,          0},
-	{"brge",  0xf404,          0},
-	{"brlt",  0xf004,          0},
-	{"brhs",  0xf005,          0},
-	{"brhc",  0xf405,          0},
-	{"brts",  0xf006,          0},
-	{"brtc",  0xf406,          0},
-	{"brvs",  0xf003,          0},
-	{"brvc",  0xf403,          0},
-	{"brie",  0xf007,          0},
-	{"brid",  0xf407,          0},
-	{"rjmp",  0xc000,          0},
-	{"rcall", 0xd000,          0},
-	{"jmp",   0x940c,  DF_NO_JMP},
-	{"call",  0x940e,  DF_NO_JMP},
-	{"brbs",  0xf000,          0},
-	{"brbc",  0xf400,          0},
-	{"add",   0x0c00,          0},
-	{"adc",   0x1c00,          0},
-	{"sub",   0x1800,          0},
-	{"sbc",   0x0800,          0},
-	{"and",   0x2000,          0},
-	{"or",    0x2800,          0},
-	{"eor",   0x2400,          0},
-	{"cp",    0x1400,          0},
-	{"cpc",   0x0400,          0},
-	{"cpse",  0x1000,          0},
-	{"mov",   0x2c00,          0},
-	{"mul",   0x9c00, DF_NO_MUL},
-	{"movw",  0x0100, DF_NO_MOVW},
-	{"muls",  0x0200, DF_NO_MUL},
-	{"mulsu", 0x0300, DF_NO_MUL},
-	{"fmul",  0x0308, DF_NO_MUL},
-	{"fmuls", 0x0380, DF_NO_MUL},
-	{"fmulsu",0x0388, DF_NO_MUL},
-	{"adiw",  0x9600,  DF_TINY1X | DF_AVR8L},
-	{"sbiw",  0x9700,  DF_TINY1X | DF_AVR8L},
-	{"subi",  0x5000,          0},
-	{"sbci",  0x4000,          0},
-	{"andi",  0x7000,          0},
-	{"ori",   0x6000,          0},
-	{"sbr",   0x6000,          0},
-	{"cpi",   0x3000,          0},
-	{"ldi",   0xe000,          0},
-	{"cbr",   0x7000,          0},
-	{"sbrc",  0xfc00,          0},
-	{"sbrs",  0xfe00,          0},
-	{"bst",   0xfa00,          0},
-	{"bld",   0xf800,          0},
-	{"in",    0xb000,          0},
-	{"out",   0xb800,          0},
-	{"sbic",  0x9900,          0},
-	{"sbis",  0x9b00,          0},
-	{"sbi",   0x9a00,          0},
-	{"cbi",   0x9800,          0},
-	{"lds",   0x9000,  DF_TINY1X | DF_AVR8L},
-	{"sts",   0x9200,  DF_TINY1X | DF_AVR8L},
-	{"ld",    0,          0},
-	{"st",    0,          0},
-	{"ldd",   0,  DF_TINY1X},
-	{"std",   0,  DF_TINY1X},
-	{"count", 0,          0},
-	{"lpm",   0x9004, DF_NO_LPM|DF_NO_LPM_X},
-	{"lpm",   0x9005, DF_NO_LPM|DF_NO_LPM_X},
-	{"elpm",  0x9006, DF_NO_ELPM|DF_NO_ELPM_X},
-	{"elpm",  0x9007, DF_NO_ELPM|DF_NO_ELPM_X},
-	{"ld",    0x900c, DF_NO_XREG},
-	{"ld",    0x900d, DF_NO_XREG},
-	{"ld",    0x900e, DF_NO_XREG},
-	{"ld",    0x8008, DF_NO_YREG},
-	{"ld",    0x9009, DF_NO_YREG},
-	{"ld",    0x900a, DF_NO_YREG},
-	{"ld",    0x8000,          0},
-	{"ld",    0x9001, DF_TINY1X},
-	{"ld",    0x9002, DF_TINY1X},
-	{"st",    0x920c, DF_NO_XREG},
-	{"st",    0x920d, DF_NO_XREG},
-	{"st",    0x920e, DF_NO_XREG},
-	{"st",    0x8208, DF_NO_YREG},
-	{"st",    0x9209, DF_NO_YREG},
-	{"st",    0x920a, DF_NO_YREG},
-	{"st",    0x8200,          0},
-	{"st",    0x9201, DF_TINY1X},
-	{"st",    0x9202, DF_TINY1X},
-	{"ldd",   0x8008, DF_TINY1X},
-	{"ldd",   0x8000, DF_TINY1X},
-	{"std",   0x8208, DF_TINY1X},
-	{"std",   0x8200, DF_TINY1X},
-	{"lds",   0xa000, DF_TINY1X},
-	{"sts",   0xa800, DF_TINY1X},
+	{"nop",   0x0000, 0xffff,          0, {1, 1, 1}},
+	{"sec",   0x9408, 0xffff,          0, {1, 1, 1}},
+	{"clc",   0x9488, 0xffff,          0, {1, 1, 1}},
+	{"sen",   0x9428, 0xffff,          0, {1, 1, 1}},
+	{"cln",   0x94a8, 0xffff,          0, {1, 1, 1}},
+	{"sez",   0x9418, 0xffff,          0, {1, 1, 1}},
+	{"clz",   0x9498, 0xffff,          0, {1, 1, 1}},
+	{"sei",   0x9478, 0xffff,          0, {1, 1, 1}},
+	{"cli",   0x94f8, 0xffff,          0, {1, 1, 1}},
+	{"ses",   0x9448, 0xffff,          0, {1, 1, 1}},
+	{"cls",   0x94c8, 0xffff,          0, {1, 1, 1}},
+	{"sev",   0x9438, 0xffff,          0, {1, 1, 1}},
+	{"clv",   0x94b8, 0xffff,          0, {1, 1, 1}},
+	{"set",   0x9468, 0xffff,          0, {1, 1, 1}},
+	{"clt",   0x94e8, 0xffff,          0, {1, 1, 1}},
+	{"seh",   0x9458, 0xffff,          0, {1, 1, 1}},
+	{"clh",   0x94d8, 0xffff,          0, {1, 1, 1}},
+	{"sleep", 0x9588, 0xffff,          0, {1, 1, 1}},
+	{"wdr",   0x95a8, 0xffff,          0, {1, 1, 1}},
+	{"ijmp",  0x9409, 0xffff,  DF_TINY1X, {2, 2, 2}},
+	{"eijmp", 0x9419, 0xffff, DF_NO_EIJMP, {2, 2, 2}},
+	{"icall", 0x9509, 0xffff,  DF_TINY1X, {3, 2, 3}},
+	{"eicall",0x9519, 0xffff, DF_NO_EICALL, {3, 2, 3}},
+	{"ret",   0x9508, 0xffff,          0, {4, 4, 6}},
+	{"reti",  0x9518, 0xffff,          0, {4, 4, 6}},
+	{"spm",   0x95e8, 0xffff, DF_NO_SPM, {1, 1, 1}},
+	{"espm",  0x95f8, 0xffff, DF_NO_ESPM, {1, 1, 1}},
+	{"break", 0x9598, 0xffff, DF_NO_BREAK, {1, 1, 1}},
+	{"lpm",   0x95c8, 0xffff, DF_NO_LPM, {3, 3, 3}},
+	{"elpm",  0x95d8, 0xffff, DF_NO_ELPM, {3, 3, 3}},
+	{"bset",  0x9408, 0xff8f,          0, {1, 1, 1}},
+	{"bclr",  0x9488, 0xff8f,          0, {1, 1, 1}},
+	{"ser",   0xef0f, 0xff0f,          0, {1, 1, 1}},
+	{"com",   0x9400, 0xfe0f,          0, {1, 1, 1}},
+	{"neg",   0x9401, 0xfe0f,          0, {1, 1, 1}},
+	{"inc",   0x9403, 0xfe0f,          0, {1, 1, 1}},
+	{"dec",   0x940a, 0xfe0f,          0, {1, 1, 1}},
+	{"lsr",   0x9406, 0xfe0f,          0, {1, 1, 1}},
+	{"ror",   0x9407, 0xfe0f,          0, {1, 1, 1}},
+	{"asr",   0x9405, 0xfe0f,          0, {1, 1, 1}},
+	{"swap",  0x9402, 0xfe0f,          0, {1, 1, 1}},
+	{"push",  0x920f, 0xfe0f,  DF_TINY1X, {2, 1, 1}},
+	{"pop",   0x900f, 0xfe0f,  DF_TINY1X, {2, 2, 3}},
+	{"tst",   0x2000, 0xfc00,          0, {1, 1, 1}},
+	{"clr",   0x2400, 0xfc00,          0, {1, 1, 1}},
+	{"lsl",   0x0c00, 0xfc00,          0, {1, 1, 1}},
+	{"rol",   0x1c00, 0xfc00,          0, {1, 1, 1}},
+	{"breq",  0xf001, 0xfc07,          0, {1, 1, 1}},
+	{"brne",  0xf401, 0xfc07,          0, {1, 1, 1}},
+	{"brcs",  0xf000, 0xfc07,          0, {1, 1, 1}},
+	{"brcc",  0xf400, 0xfc07,          0, {1, 1, 1}},
+	{"brsh",  0xf400, 0xfc07,          0, {1, 1, 1}},
+	{"brlo",  0xf000, 0xfc07,          0, {1, 1, 1}},
+	{"brmi",  0xf002, 0xfc07,          0, {1, 1, 1}},
+	{"brpl",  0xf402, 0xfc07,          0, {1, 1, 1}},
+	{"brge",  0xf404, 0xfc07,          0, {1, 1, 1}},
+	{"brlt",  0xf004, 0xfc07,          0, {1, 1, 1}},
+	{"brhs",  0xf005, 0xfc07,          0, {1, 1, 1}},
+	{"brhc",  0xf405, 0xfc07,          0, {1, 1, 1}},
+	{"brts",  0xf006, 0xfc07,          0, {1, 1, 1}},
+	{"brtc",  0xf406, 0xfc07,          0, {1, 1, 1}},
+	{"brvs",  0xf003, 0xfc07,          0, {1, 1, 1}},
+	{"brvc",  0xf403, 0xfc07,          0, {1, 1, 1}},
+	{"brie",  0xf007, 0xfc07,          0, {1, 1, 1}},
+	{"brid",  0xf407, 0xfc07,          0, {1, 1, 1}},
+	{"rjmp",  0xc000, 0xf000,          0, {2, 2, 2}},
+	{"rcall", 0xd000, 0xf000,          0, {3, 2, 4}},
+	{"jmp",   0x940c, 0xfe0e,  DF_NO_JMP, {3, 3, 3}},
+	{"call",  0x940e, 0xfe0e,  DF_NO_JMP, {4, 3, 4}},
+	{"brbs",  0xf000, 0xfc00,          0, {1, 1, 1}},
+	{"brbc",  0xf400, 0xfc00,          0, {1, 1, 1}},
+	{"add",   0x0c00, 0xfc00,          0, {1, 1, 1}},
+	{"adc",   0x1c00, 0xfc00,          0, {1, 1, 1}},
+	{"sub",   0x1800, 0xfc00,          0, {1, 1, 1}},
+	{"sbc",   0x0800, 0xfc00,          0, {1, 1, 1}},
+	{"and",   0x2000, 0xfc00,          0, {1, 1, 1}},
+	{"or",    0x2800, 0xfc00,          0, {1, 1, 1}},
+	{"eor",   0x2400, 0xfc00,          0, {1, 1, 1}},
+	{"cp",    0x1400, 0xfc00,          0, {1, 1, 1}},
+	{"cpc",   0x0400, 0xfc00,          0, {1, 1, 1}},
+	{"cpse",  0x1000, 0xfc00,          0, {1, 1, 1}},
+	{"mov",   0x2c00, 0xfc00,          0, {1, 1, 1}},
+	{"mul",   0x9c00, 0xfc00, DF_NO_MUL, {2, 2, 2}},
+	{"movw",  0x0100, 0xff00, DF_NO_MOVW, {1, 1, 1}},
+	{"muls",  0x0200, 0xff00, DF_NO_MUL, {2, 2, 2}},
+	{"mulsu", 0x0300, 0xff88, DF_NO_MUL, {2, 2, 2}},
+	{"fmul",  0x0308, 0xff88, DF_NO_MUL, {2, 2, 2}},
+	{"fmuls", 0x0380, 0xff88, DF_NO_MUL, {2, 2, 2}},
+	{"fmulsu",0x0388, 0xff88, DF_NO_MUL, {2, 2, 2}},
+	{"adiw",  0x9600, 0xff00,  DF_TINY1X | DF_AVR8L, {2, 2, 2}},
+	{"sbiw",  0x9700, 0xff00,  DF_TINY1X | DF_AVR8L, {2, 2, 2}},
+	{"subi",  0x5000, 0xf000,          0, {1, 1, 1}},
+	{"sbci",  0x4000, 0xf000,          0, {1, 1, 1}},
+	{"andi",  0x7000, 0xf000,          0, {1, 1, 1}},
+	{"ori",   0x6000, 0xf000,          0, {1, 1, 1}},
+	{"sbr",   0x6000, 0xf000,          0, {1, 1, 1}},
+	{"cpi",   0x3000, 0xf000,          0, {1, 1, 1}},
+	{"ldi",   0xe000, 0xf000,          0, {1, 1, 1}},
+	{"cbr",   0x7000, 0xf000,          0, {1, 1, 1}},
+	{"sbrc",  0xfc00, 0xfe08,          0, {1, 1, 1}},
+	{"sbrs",  0xfe00, 0xfe08,          0, {1, 1, 1}},
+	{"bst",   0xfa00, 0xfe08,          0, {1, 1, 1}},
+	{"bld",   0xf800, 0xfe08,          0, {1, 1, 1}},
+	{"in",    0xb000, 0xf800,          0, {1, 1, 1}},
+	{"out",   0xb800, 0xf800,          0, {1, 1, 1}},
+	{"sbic",  0x9900, 0xff00,          0, {1, 2, 1}},
+	{"sbis",  0x9b00, 0xff00,          0, {1, 2, 1}},
+	{"sbi",   0x9a00, 0xff00,          0, {2, 1, 1}},
+	{"cbi",   0x9800, 0xff00,          0, {2, 1, 1}},
+	{"lds",   0x9000, 0xfe0f,  DF_TINY1X | DF_AVR8L, {2, 3, 2}},
+	{"sts",   0x9200, 0xfe0f,  DF_TINY1X | DF_AVR8L, {2, 2, 2}},
+	{"ld",    0, 0x0000,          0, {0, 0, 0}},
+	{"st",    0, 0x0000,          0, {0, 0, 0}},
+	{"ldd",   0, 0x0000,  DF_TINY1X, {0, 0, 0}},
+	{"std",   0, 0x0000,  DF_TINY1X, {0, 0, 0}},
+	{"count", 0, 0x0000,          0, {0, 0, 0}},
+	{"lpm",   0x9004, 0xfe0f, DF_NO_LPM|DF_NO_LPM_X, {3, 3, 3}},
+	{"lpm",   0x9005, 0xfe0f, DF_NO_LPM|DF_NO_LPM_X, {3, 3, 3}},
+	{"elpm",  0x9006, 0xfe0f, DF_NO_ELPM|DF_NO_ELPM_X, {3, 3, 3}},
+	{"elpm",  0x9007, 0xfe0f, DF_NO_ELPM|DF_NO_ELPM_X, {3, 3, 3}},
+	{"ld",    0x900c, 0xfe0f, DF_NO_XREG, {2, 2, 2}},
+	{"ld",    0x900d, 0xfe0f, DF_NO_XREG, {2, 2, 3}},
+	{"ld",    0x900e, 0xfe0f, DF_NO_XREG, {2, 3, 3}},
+	{"ld",    0x8008, 0xfe0f, DF_NO_YREG, {2, 2, 2}},
+	{"ld",    0x9009, 0xfe0f, DF_NO_YREG, {2, 2, 3}},
+	{"ld",    0x900a, 0xfe0f, DF_NO_YREG, {2, 3, 3}},
+	{"ld",    0x8000, 0xfe0f,          0, {2, 2, 2}},
+	{"ld",    0x9001, 0xfe0f, DF_TINY1X, {2, 2, 3}},
+	{"ld",    0x9002, 0xfe0f, DF_TINY1X, {2, 3, 3}},
+	{"st",    0x920c, 0xfe0f, DF_NO_XREG, {2, 1, 1}},
+	{"st",    0x920d, 0xfe0f, DF_NO_XREG, {2, 1, 1}},
+	{"st",    0x920e, 0xfe0f, DF_NO_XREG, {2, 2, 2}},
+	{"st",    0x8208, 0xfe0f, DF_NO_YREG, {2, 1, 1}},
+	{"st",    0x9209, 0xfe0f, DF_NO_YREG, {2, 1, 1}},
+	{"st",    0x920a, 0xfe0f, DF_NO_YREG, {2, 2, 2}},
+	{"st",    0x8200, 0xfe0f,          0, {2, 1, 1}},
+	{"st",    0x9201, 0xfe0f, DF_TINY1X, {2, 1, 1}},
+	{"st",    0x9202, 0xfe0f, DF_TINY1X, {2, 2, 2}},
+	{"ldd",   0x8008, 0xd208, DF_TINY1X, {2, 3, 2}},
+	{"ldd",   0x8000, 0xd208, DF_TINY1X, {2, 3, 2}},
+	{"std",   0x8208, 0xd208, DF_TINY1X, {2, 2, 2}},
+	{"std",   0x8200, 0xd208, DF_TINY1X, {2, 2, 2}},
+	{"lds",   0xa000, 0xf800, DF_TINY1X, {2, 2, 2}},
+	{"sts",   0xa800, 0xf800, DF_TINY1X, {1, 1, 1}},
 	{"end", 0, 0}
 };
 
 
+/* Registers an assembled instruction writes, bit n for Rn. A pointer
+ * register incremented or decremented by LD, ST or LPM is written too. */
+static unsigned long
+written_registers(int mnemonic, int opcode)
+{
+	unsigned long rd = 1UL << ((opcode >> 4) & 0x1f);
+
+	switch (mnemonic) {
+	case MNEMONIC_LPM:
+	case MNEMONIC_ELPM:
+		return (1UL);
+	case MNEMONIC_SER:
+	case MNEMONIC_SUBI:
+	case MNEMONIC_SBCI:
+	case MNEMONIC_ANDI:
+	case MNEMONIC_ORI:
+	case MNEMONIC_SBR:
+	case MNEMONIC_LDI:
+	case MNEMONIC_CBR:
+	case MNEMONIC_LDS_AVR8L:
+		return (1UL << (16 + ((opcode >> 4) & 0x0f)));
+	case MNEMONIC_COM:
+	case MNEMONIC_NEG:
+	case MNEMONIC_INC:
+	case MNEMONIC_DEC:
+	case MNEMONIC_LSR:
+	case MNEMONIC_ROR:
+	case MNEMONIC_ASR:
+	case MNEMONIC_SWAP:
+	case MNEMONIC_POP:
+	case MNEMONIC_CLR:
+	case MNEMONIC_LSL:
+	case MNEMONIC_ROL:
+	case MNEMONIC_ADD:
+	case MNEMONIC_ADC:
+	case MNEMONIC_SUB:
+	case MNEMONIC_SBC:
+	case MNEMONIC_AND:
+	case MNEMONIC_OR:
+	case MNEMONIC_EOR:
+	case MNEMONIC_MOV:
+	case MNEMONIC_BLD:
+	case MNEMONIC_IN:
+	case MNEMONIC_LDS:
+	case MNEMONIC_LPM_Z:
+	case MNEMONIC_ELPM_Z:
+	case MNEMONIC_LD_X:
+	case MNEMONIC_LD_Y:
+	case MNEMONIC_LD_Z:
+	case MNEMONIC_LDD_Y:
+	case MNEMONIC_LDD_Z:
+		return (rd);
+	case MNEMONIC_MUL:
+	case MNEMONIC_MULS:
+	case MNEMONIC_MULSU:
+	case MNEMONIC_FMUL:
+	case MNEMONIC_FMULS:
+	case MNEMONIC_FMULSU:
+		return (3UL);	/* R1:R0 */
+	case MNEMONIC_MOVW:
+		return (3UL << (((opcode >> 4) & 0x0f) * 2));
+	case MNEMONIC_ADIW:
+	case MNEMONIC_SBIW:
+		return (3UL << (24 + ((opcode >> 4) & 0x03) * 2));
+	case MNEMONIC_LD_XP:
+	case MNEMONIC_LD_MX:
+		return (rd | (3UL << 26));
+	case MNEMONIC_LD_YP:
+	case MNEMONIC_LD_MY:
+		return (rd | (3UL << 28));
+	case MNEMONIC_LPM_ZP:
+	case MNEMONIC_ELPM_ZP:
+	case MNEMONIC_LD_ZP:
+	case MNEMONIC_LD_MZ:
+		return (rd | (3UL << 30));
+	case MNEMONIC_ST_XP:
+	case MNEMONIC_ST_MX:
+		return (3UL << 26);
+	case MNEMONIC_ST_YP:
+	case MNEMONIC_ST_MY:
+		return (3UL << 28);
+	case MNEMONIC_ST_ZP:
+	case MNEMONIC_ST_MZ:
+		return (3UL << 30);
+	default:
+		return (0);
+	}
+}
+
+/* Write an assembled instruction in pass 2: list file, code record and output files */
+static int
+emit_instruction(struct prog_info *pi, int mnemonic, int opcode, int opcode2, int instruction_long, long target)
+{
+	struct code_record *code;
+	char temp[MAX_MNEMONIC_LEN + 1];
+
+	if (pi->device->flag & instruction_list[mnemonic].flag)	{
+		strncpy(temp, instruction_list[mnemonic].mnemonic, MAX_MNEMONIC_LEN);
+		print_msg(pi, MSGTYPE_ERROR, "%s instruction is not supported on %s",
+		          my_strupr(temp), pi->device->name);
+	}
+	opcode |= instruction_list[mnemonic].opcode;
+	code = add_code_record(pi, mnemonic, instruction_long ? 2 : 1);
+	if (!code)
+		return (False);
+	code->target = target;
+	code->written = written_registers(mnemonic, opcode) & 0xffffffffUL;
+	if (pi->list_on && pi->list_line) {
+		if (instruction_long)
+			fprintf(pi->list_file, "%c:%06lx %04x %04x ",
+			        pi->cseg->ident, pi->cseg->addr, opcode, opcode2);
+		else
+			fprintf(pi->list_file, "%c:%06lx %04x      ",
+			        pi->cseg->ident, pi->cseg->addr, opcode);
+		if (GET_ARG_I(pi->args, ARG_LISTCYCLES))
+			fprint_cycles(pi->list_file, pi, code);
+		fprintf(pi->list_file, "%s\n", pi->list_line);
+		pi->list_line = NULL;
+	}
+	if (pi->cseg->hfi || pi->flash_image) {
+		write_prog_word(pi, pi->cseg->addr, opcode);
+		if (instruction_long)
+			write_prog_word(pi, pi->cseg->addr + 1, opcode2);
+	}
+	/* Layout passes of --relax collect the two word instructions again */
+	if (pi->layout && instruction_long)
+		if (!add_long_insn(pi, pi->cseg->addr))
+			return (False);
+	advance_ip(pi->cseg, instruction_long ? 2 : 1);
+	cycles_flow(pi, code);
+	return (True);
+}
+
+static int
+is_relaxable(int mnemonic)
+{
+	return ((get_flow(mnemonic) == FLOW_BRANCH)
+	        || ((mnemonic >= MNEMONIC_RJMP) && (mnemonic <= MNEMONIC_CALL)));
+}
+
+static int
+rjmp_in_range(struct prog_info *pi, int k)
+{
+	return (((k >= -2048) && (k <= 2047)) || (pi->device->flash_size == 4096));
+}
+
+/* The branch with the opposite condition: bit 10 of the opcode */
+static int
+invert_branch(int mnemonic)
+{
+	int i;
+
+	if (mnemonic == MNEMONIC_BRBS)
+		return (MNEMONIC_BRBC);
+	if (mnemonic == MNEMONIC_BRBC)
+		return (MNEMONIC_BRBS);
+	for (i = MNEMONIC_BREQ; i <= MNEMONIC_BRID; i++)
+		if (instruction_list[i].opcode == (instruction_list[mnemonic].opcode ^ 0x0400))
+			break;
+	return (i);
+}
+
+/* --relax: choose the size of a jump, call or branch from its target. A jump
+ * or call is turned into RJMP/RCALL or JMP/CALL and assembled as usual. A
+ * branch out of range is emitted here as an inverted branch skipping an RJMP
+ * or JMP to the target; *emitted tells the caller so. */
+static int
+relax_mnemonic(struct prog_info *pi, int *mnemonic, char *operand1, int *emitted)
+{
+	struct relax *relax;
+	char operand[LINEBUFFER_LENGTH], buf[64], *k;
+	long addr = pi->cseg->addr;
+	int i, need, bit = 0, listed;
+	int far = !(pi->device->flag & DF_NO_JMP);
+
+	*emitted = False;
+	relax = next_relax(pi);
+	if (!relax || relax->fixed || !operand1)
+		return (True);
+	strcpy(operand, operand1);
+	k = operand;
+	if ((*mnemonic == MNEMONIC_BRBS) || (*mnemonic == MNEMONIC_BRBC)) {
+		k = get_next_token(operand, TERM_COMMA);
+		if (!k)
+			return (True);
+		if (!get_bitnum(pi, operand, &bit))
+			return (False);
+	}
+	get_next_token(k, TERM_END);
+	if (!get_expr(pi, k, &i))
+		return (False);
+
+	if (!relax->branch)
+		need = (!far || rjmp_in_range(pi, i - (addr + 1))) ? 1 : 2;
+	else if ((i - (addr + 1) >= -64) && (i - (addr + 1) <= 63))
+		need = 1;
+	else
+		need = (!far || rjmp_in_range(pi, i - (addr + 2))) ? 2 : 3;
+	if (pi->layout && (need > relax->size)) {
+		relax->size = need;
+		pi->relax_changed = True;
+	}
+
+	if (!relax->branch) {
+		if ((*mnemonic == MNEMONIC_RJMP) || (*mnemonic == MNEMONIC_JMP))
+			*mnemonic = relax->size == 1 ? MNEMONIC_RJMP : MNEMONIC_JMP;
+		else
+			*mnemonic = relax->size == 1 ? MNEMONIC_RCALL : MNEMONIC_CALL;
+		return (True);
+	}
+	if (relax->size == 1)
+		return (True);
+	*emitted = True;
+	listed = pi->list_on && (pi->list_line != NULL);
+	if (!emit_instruction(pi, invert_branch(*mnemonic), bit | ((relax->size - 1) << 3), 0, False, addr + relax->size))
+		return (False);
+	if (listed) {
+		snprintf(buf, sizeof(buf), "          ; %s 0x%06x (relaxed)", relax->size == 2 ? "rjmp" : "jmp", i);
+		pi->list_line = buf;
+	}
+	if (relax->size == 2) {
+		if (!rjmp_in_range(pi, i - (addr + 2)))
+			print_msg(pi, MSGTYPE_ERROR, "Relative address out of range (-2048 <= k <= 2047)");
+		return (emit_instruction(pi, MNEMONIC_RJMP, (i - (addr + 2)) & 0x0fff, 0, False, i));
+	}
+	return (emit_instruction(pi, MNEMONIC_JMP, ((i & 0x3e0000) >> 13) | ((i & 0x010000) >> 16), i & 0xffff, True, i));
+}
+
+
 /* We try to parse the command name. Is it a assembler mnemonic or anything else ?
  * If so, it may be a macro. */
 
@@ -350,10 +438,10 @@ parse_mnemonic(struct prog_info *pi)
 	int opcode = 0;
 	int opcode2 = 0;
 	int instruction_long = False;
+	long target = -1;
 	char *operand1;
 	char *operand2;
 	struct macro *macro;
-	char temp[MAX_MNEMONIC_LEN + 1];
 
 	operand1 = get_next_token(pi->fi->scratch, TERM_SPACE);  /* we get the first word on line */
 	mnemonic = get_mnemonic_type(pi);
@@ -366,7 +454,17 @@ parse_mnemonic(struct prog_info *pi)
 			return (True);
 		}
 	}
+	if (pi->pool) {
+		print_msg(pi, MSGTYPE_ERROR, "Only .DB and .DW are allowed in a .POOL");
+		return (True);
+	}
 	if (pi->pass == PASS_2) {
+		if (GET_ARG_I(pi->args, ARG_RELAX) && is_relaxable(mnemonic)) {
+			if (!relax_mnemonic(pi, &mnemonic, operand1, &i))
+				return (False);
+			if (i) /* Emitted as an inverted branch and a jump */
+				return (True);
+		}
 		if (mnemonic <= MNEMONIC_BREAK) {
 			if (operand1) {
 				print_msg(pi, MSGTYPE_WARNING, "Garbage after instruction %s: %s", instruction_list[mnemonic].mnemonic, operand1);
@@ -426,8 +524,12 @@ parse_mnemonic(struct prog_info *pi)
 				if (mnemonic >= MNEMONIC_TST)
 					opcode |= ((i & 0x10) << 5) | (i & 0x0f);
 			} else if (mnemonic <= MNEMONIC_RCALL) {
-				if (!get_expr(pi, operand1, &i))
+				if (!get_reloc_expr(pi, operand1, &i))
 					return (False);
+				target = i;
+				if (reloc_operand(pi, mnemonic <= MNEMONIC_BRID ? RELOC_BRANCH : RELOC_RJMP,
+				                  pi->cseg, pi->cseg->addr * 2))
+					i = pi->cseg->addr + 1; /* avra-ld fills in the distance */
 				i -= pi->cseg->addr + 1;
 				if (mnemonic <= MNEMONIC_BRID) {
 					if ((i < -64) || (i > 63))
@@ -439,10 +541,12 @@ parse_mnemonic(struct prog_info *pi)
 					opcode = i & 0x0fff;
 				}
 			} else if (mnemonic <= MNEMONIC_CALL) {
-				if (!get_expr(pi, operand1, &i))
+				if (!get_reloc_expr(pi, operand1, &i))
 					return (False);
+				reloc_operand(pi, RELOC_JMP, pi->cseg, pi->cseg->addr * 2);
 				if ((i < 0) || (i > 4194303))
 					print_msg(pi, MSGTYPE_ERROR, "Address out of range (0 <= k <= 4194303)");
+				target = i;
 				opcode = ((i & 0x3e0000) >> 13) | ((i & 0x010000) >> 16);
 				opcode2 = i & 0xffff;
 				instruction_long = True;
@@ -450,8 +554,11 @@ parse_mnemonic(struct prog_info *pi)
 				if (!get_bitnum(pi, operand1, &i))
 					return (False);
 				opcode = i;
-				if (!get_expr(pi, operand2, &i))
+				if (!get_reloc_expr(pi, operand2, &i))
 					return (False);
+				target = i;
+				if (reloc_operand(pi, RELOC_BRANCH, pi->cseg, pi->cseg->addr * 2))
+					i = pi->cseg->addr + 1;
 				i -= pi->cseg->addr + 1;
 				if ((i < -64) || (i > 63))
 					print_msg(pi, MSGTYPE_ERROR, "Branch out of range (-64 <= k <= 63)");
@@ -503,8 +610,14 @@ parse_mnemonic(struct prog_info *pi)
 				if (i < 16)
 					print_msg(pi, MSGTYPE_ERROR, "%s can only use a high register (r16 - r31)", instruction_list[mnemonic].mnemonic);
 				opcode = (i & 0x0f) << 4;
-				if (!get_expr(pi, operand2, &i))
-					return (False);
+				if (mnemonic == MNEMONIC_CBR) {
+					if (!get_expr(pi, operand2, &i))
+						return (False);
+				} else {
+					if (!get_reloc_expr(pi, operand2, &i))
+						return (False);
+					reloc_operand(pi, RELOC_LDI, pi->cseg, pi->cseg->addr * 2);
+				}
 				if ((i < -128) || (i > 255))
 					print_msg(pi, MSGTYPE_WARNING, "Constant out of range (-128 <= k <= 255). Will be masked");
 				if (mnemonic == MNEMONIC_CBR)
@@ -548,9 +661,13 @@ parse_mnemonic(struct prog_info *pi)
 				if (pi->device->flag & DF_AVR8L) {
 					mnemonic = MNEMONIC_LDS_AVR8L;
 					opcode &= 0x00f0;
+					if (!get_expr(pi, operand2, &i))
+						return (False);
+				} else {
+					if (!get_reloc_expr(pi, operand2, &i))
+						return (False);
+					reloc_operand(pi, RELOC_WORD, pi->cseg, (pi->cseg->addr + 1) * 2);
 				}
-				if (!get_expr(pi, operand2, &i))
-					return (False);
 				if (pi->device->flag & DF_AVR8L) {
 					if ((i < 0x40) || (i > 0xbf))
 						print_msg(pi, MSGTYPE_ERROR, "SRAM out of range (0x40 <= k <= 0xbf)");
@@ -562,8 +679,14 @@ parse_mnemonic(struct prog_info *pi)
 					instruction_long = True;
 				}
 			} else if (mnemonic == MNEMONIC_STS) {
-				if (!get_expr(pi, operand1, &i))
-					return (False);
+				if (pi->device->flag & DF_AVR8L) {
+					if (!get_expr(pi, operand1, &i))
+						return (False);
+				} else {
+					if (!get_reloc_expr(pi, operand1, &i))
+						return (False);
+					reloc_operand(pi, RELOC_WORD, pi->cseg, (pi->cseg->addr + 1) * 2);
+				}
 				/* AVR8L has one word STS. High nibble of k in funny order */
 				if (pi->device->flag & DF_AVR8L) {
 					mnemonic = MNEMONIC_STS_AVR8L;
@@ -632,35 +755,25 @@ parse_mnemonic(struct prog_info *pi)
 			} else
 				print_msg(pi, MSGTYPE_ERROR, "Shit! Missing opcode check [%d]...", mnemonic);
 		}
-		if (pi->device->flag & instruction_list[mnemonic].flag)	{
-			strncpy(temp, instruction_list[mnemonic].mnemonic, MAX_MNEMONIC_LEN);
-			print_msg(pi, MSGTYPE_ERROR, "%s instruction is not supported on %s",
-			          my_strupr(temp), pi->device->name);
-		}
-		opcode |= instruction_list[mnemonic].opcode;
-		if (pi->list_on && pi->list_line) {
-			if (instruction_long)
-				fprintf(pi->list_file, "%c:%06lx %04x %04x %s\n",
-				        pi->cseg->ident, pi->cseg->addr, opcode, opcode2, pi->list_line);
-			else
-				fprintf(pi->list_file, "%c:%06lx %04x      %s\n",
-				        pi->cseg->ident, pi->cseg->addr, opcode, pi->list_line);
-			pi->list_line = NULL;
-		}
-		if (pi->cseg->hfi) {
-			write_prog_word(pi, pi->cseg->addr, opcode);
-			if (instruction_long)
-				write_prog_word(pi, pi->cseg->addr + 1, opcode2);
-		}
-		if (instruction_long)
-			pi->cseg->addr += 2; /* XXX advance */
-		else
-			pi->cseg->addr ++;
+		if (!emit_instruction(pi, mnemonic, opcode, opcode2, instruction_long, target))
+			return (False);
 	} else { /* Pass 1 */
+		if (GET_ARG_I(pi->args, ARG_RELAX) && is_relaxable(mnemonic)) {
+			if (!add_relax(pi, (mnemonic == MNEMONIC_JMP) || (mnemonic == MNEMONIC_CALL) ? 2 : 1,
+			               get_flow(mnemonic) == FLOW_BRANCH))
+				return (False);
+			if (!pi->relax[pi->relax_count - 1].fixed) {
+				pi->cseg->addr++;
+				pi->cseg->count++;
+				return (True);
+			}
+		}
 		if (pi->device->flag & DF_AVR8L)
 			mnemonic = MNEMONIC_LDS_AVR8L;
 		if ((mnemonic == MNEMONIC_JMP) || (mnemonic == MNEMONIC_CALL)
 		        || (mnemonic == MNEMONIC_LDS) || (mnemonic == MNEMONIC_STS)) {
+			if (!add_long_insn(pi, pi->cseg->addr))
+				return (False);
 			pi->cseg->addr += 2;
 			pi->cseg->count += 2;
 		} else {
@@ -688,6 +801,14 @@ get_mnemonic_type(struct prog_info *pi)
 }
 
 
+/* True for r0 - r99: an r followed by one or two digits */
+int
+is_register_name(const char *name)
+{
+	return ((tolower((unsigned char)name[0]) == 'r') && isdigit((unsigned char)name[1])
+	        && ((name[2] == '\0') || (isdigit((unsigned char)name[2]) && (name[3] == '\0'))));
+}
+
 int
 get_register(struct prog_info *pi, char *data)
 {
@@ -700,11 +821,16 @@ get_register(struct prog_info *pi, char *data)
 	if (second_reg != NULL)
 		data = second_reg + 1;
 
-	for (def = pi->first_def; def; def = def->next)
-		if (!nocase_strcmp(def->name, data)) {
-			reg = def->reg;
-			return (reg);
-		}
+	/* Literal registers can't be aliases, so they need no lookup */
+	if (is_register_name(data)) {
+		reg = atoi(&data[1]);
+		if (reg > 31)
+			print_msg(pi, MSGTYPE_ERROR, "R%d is not a valid register", reg);
+		return (reg);
+	}
+	def = search_def(pi, data);
+	if (def)
+		return (def->reg);
 	if ((tolower(data[0]) == 'r') && isdigit(data[1])) {
 		reg = atoi(&data[1]);
 		if (reg > 31)
@@ -829,7 +955,7 @@ is_supported(struct prog_info *pi, char *name)
 }
 
 int
-count_supported_instructions(int flags)
+count_supported_instructions(long flags)
 {
 	int i = 0, count = 0;
 	while (i < MNEMONIC_END) {
@@ -841,5 +967,103 @@ count_supported_instructions(int flags)
 	return (count);
 }
 
+int
+get_core(struct prog_info *pi)
+{
+	if (pi->device->flag & DF_AVR8L)
+		return (CORE_AVR8L);
+	if (pi->device->flag & DF_XMEGA)
+		return (CORE_XMEGA);
+	return (CORE_CLASSIC);
+}
+
+int
+get_flow(int mnemonic)
+{
+	if (((mnemonic >= MNEMONIC_BREQ) && (mnemonic <= MNEMONIC_BRID))
+	        || (mnemonic == MNEMONIC_BRBS) || (mnemonic == MNEMONIC_BRBC))
+		return (FLOW_BRANCH);
+	switch (mnemonic) {
+	case MNEMONIC_SBRC:
+	case MNEMONIC_SBRS:
+	case MNEMONIC_CPSE:
+	case MNEMONIC_SBIC:
+	case MNEMONIC_SBIS:
+		return (FLOW_SKIP);
+	case MNEMONIC_RJMP:
+	case MNEMONIC_JMP:
+		return (FLOW_JUMP);
+	case MNEMONIC_RCALL:
+	case MNEMONIC_CALL:
+		return (FLOW_CALL);
+	case MNEMONIC_IJMP:
+	case MNEMONIC_EIJMP:
+		return (FLOW_INDIRECT_JUMP);
+	case MNEMONIC_ICALL:
+	case MNEMONIC_EICALL:
+		return (FLOW_INDIRECT_CALL);
+	case MNEMONIC_RET:
+	case MNEMONIC_RETI:
+		return (FLOW_RETURN);
+	}
+	return (FLOW_NEXT);
+}
+
+/* Cycles of the instruction at addr. max is the cost of a taken branch or
+ * of a skip, which depends on the size of the skipped instruction. */
+void
+get_cycles(struct prog_info *pi, int mnemonic, long addr, int *min, int *max)
+{
+	int core = get_core(pi);
+
+	*min = *max = instruction_list[mnemonic].cycles[core];
+	switch (get_flow(mnemonic)) {
+	case FLOW_BRANCH:
+		(*max)++;
+		break;
+	case FLOW_SKIP:
+		*max += is_long_insn(pi, addr + 1) ? 2 : 1;
+		break;
+	case FLOW_CALL:
+	case FLOW_INDIRECT_CALL:
+	case FLOW_RETURN:
+		/* A 22 bit PC needs a third byte on the stack */
+		if ((core != CORE_AVR8L) && (pi->device->flash_size > 65536)) {
+			(*min)++;
+			(*max)++;
+		}
+		break;
+	}
+}
+
+const char *
+get_mnemonic_name(int mnemonic)
+{
+	return (instruction_list[mnemonic].mnemonic);
+}
+
+/* Mnemonic of an opcode on the current device, -1 if there is none. Aliases
+ * come before the instructions they stand for, so AND r1,r1 decodes as TST
+ * and BRBS 1,k as BREQ; LD Y and LD Z also decode before LDD with q = 0. */
+int
+decode_opcode(struct prog_info *pi, int opcode)
+{
+	int i;
+	int avr8l = (pi->device->flag & DF_AVR8L) != 0;
+
+	for (i = 0; i < MNEMONIC_END; i++) {
+		if ((instruction_list[i].mask == 0)
+		        || ((opcode & instruction_list[i].mask) != instruction_list[i].opcode)
+		        || (instruction_list[i].flag & pi->device->flag))
+			continue;
+		/* LDS/STS of AVR8L share their opcodes with LDD/STD */
+		if (avr8l ? ((i >= MNEMONIC_LDD_Y) && (i <= MNEMONIC_STD_Z))
+		        : ((i == MNEMONIC_LDS_AVR8L) || (i == MNEMONIC_STS_AVR8L)))
+			continue;
+		return (i);
+	}
+	return (-1);
+}
+
 /* end of mnemonic.c */
 
@@ -0,0 +1,333 @@
+/***********************************************************************
+ *
+ *  AVRA - Assembler for the Atmel AVR microcontroller series
+ *
+ *  Copyright (C) 1998-2020 The AVRA Authors
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; see the file COPYING.  If not, write to
+ *  the Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ *  Boston, MA 02111-1307, USA.
+ *
+ *
+ *  Authors of AVRA can be reached at:
+ *     email: jonah@omegav.ntnu.no, tobiw@suprafluid.com
+ *     www: https://github.com/Ro5bert/avra
+ */
+
+/*
+ * Relocatable modules (--module) and their relocations.
+ *
+ * In a module every segment starts at 0 and avra-ld decides where it
+ * goes. Labels are relative to their section, .EXTERN symbols are 0.
+ * get_expr() keeps track of values that depend on either in
+ * pi->expr_ref, and reloc_operand() records a relocation for the
+ * field that takes such a value.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "misc.h"
+#include "avra.h"
+#include "args.h"
+#include "device.h"
+
+#define MODULE_WORDS_PER_LINE 8
+#define MODULE_BYTES_PER_LINE 16
+
+/* Also read by avra-ld */
+const char *const reloc_type_list[] = {
+	"branch",
+	"rjmp",
+	"jmp",
+	"ldi",
+	"word",
+	"byte",
+	NULL
+};
+
+const char *const reloc_function_list[] = {
+	"-",
+	"lo",
+	"hi",
+	NULL
+};
+
+const char *const section_list[] = {
+	".code",
+	".data",
+	".eeprom",
+	NULL
+};
+
+int
+is_relocatable(const struct reloc_ref *ref)
+{
+	return ((ref->segment != NULL) || (ref->symbol != NULL));
+}
+
+static int
+section_number(struct prog_info *pi, struct segment_info *si)
+{
+	if (si == pi->cseg)
+		return (SEGMENT_CODE);
+	if (si == pi->dseg)
+		return (SEGMENT_DATA);
+	return (SEGMENT_EEPROM);
+}
+
+/* Set pi->expr_ref to what the value of a symbol depends on */
+void
+symbol_ref(struct prog_info *pi, struct label *label)
+{
+	memset(&pi->expr_ref, 0, sizeof(struct reloc_ref));
+	if (!pi->module)
+		return;
+	if (label->segment) {
+		pi->expr_ref.segment = label->segment;
+		pi->expr_ref.scale = 1;
+		pi->expr_ref.addend = label->value;
+	} else
+		pi->expr_ref = label->ref;
+}
+
+/* get_expr() for a field that reloc_operand() handles next */
+int
+get_reloc_expr(struct prog_info *pi, char *data, int *value)
+{
+	int ok, expr_reloc = pi->expr_reloc;
+
+	pi->expr_reloc = True;
+	ok = get_expr(pi, data, value);
+	pi->expr_reloc = expr_reloc;
+	return (ok);
+}
+
+/* Record a relocation for the value of the last get_reloc_expr(), to be
+ * stored at offset bytes into si. Return True if the linker fills in the
+ * field, False if the value is final. */
+int
+reloc_operand(struct prog_info *pi, int type, struct segment_info *si, long offset)
+{
+	struct reloc *reloc;
+	struct reloc_ref *ref = &pi->expr_ref;
+
+	if (!pi->module || !is_relocatable(ref))
+		return (False);
+	if ((type == RELOC_BRANCH) || (type == RELOC_RJMP)) {
+		/* The distance within the code section is known already */
+		if ((ref->segment == pi->cseg) && (ref->scale == 1) && (ref->function == RELOC_FN_NONE))
+			return (False);
+		if (ref->segment || (ref->scale != 1) || (ref->function != RELOC_FN_NONE)) {
+			print_msg(pi, MSGTYPE_ERROR, "Relative jump to something that is no code address");
+			return (True);
+		}
+	}
+	if ((pi->pass != PASS_2) || pi->layout)
+		return (True);
+	reloc = malloc(sizeof(struct reloc));
+	if (!reloc) {
+		print_msg(pi, MSGTYPE_OUT_OF_MEM, NULL);
+		return (True);
+	}
+	reloc->next = NULL;
+	reloc->type = type;
+	reloc->segment = si;
+	reloc->offset = offset;
+	reloc->ref = *ref;
+	if (pi->last_reloc)
+		pi->last_reloc->next = reloc;
+	else
+		pi->first_reloc = reloc;
+	pi->last_reloc = reloc;
+	return (True);
+}
+
+/* .EXTERN: a symbol of another module. Without --module it has to be
+ * defined in the same assembly. */
+int
+def_extern(struct prog_info *pi, char *name)
+{
+	struct label *label;
+
+	if ((pi->pass != PASS_1) || !pi->module)
+		return (True);
+	if (test_label(pi, name, "%s is defined here and can't be external")
+	        || test_variable(pi, name, "%s is defined here and can't be external")
+	        || test_constant(pi, name, "%s is defined here and can't be external"))
+		return (True);
+	if (def_const(pi, name, 0) == False)
+		return (False);
+	label = pi->last_constant;
+	label->ref.symbol = label;
+	label->ref.scale = 1;
+	return (True);
+}
+
+/* .GLOBAL: export a label or constant from a module */
+int
+def_global(struct prog_info *pi, char *name)
+{
+	int atom;
+
+	if (pi->pass != PASS_1)
+		return (True);
+	atom = intern(pi, name);
+	if (!atom)
+		return (False);
+	pi->atom[atom].global = True;
+	return (True);
+}
+
+static void
+write_globals(FILE *fp, struct prog_info *pi)
+{
+	struct label *label;
+	int atom;
+
+	for (atom = 1; atom < pi->atom_count; atom++) {
+		if (!pi->atom[atom].global)
+			continue;
+		label = pi->atom[atom].symbol[SYMBOL_LABEL];
+		if (label) {
+			fprintf(fp, "global %s %s %x\n", label->name,
+			        section_list[section_number(pi, label->segment)], label->value);
+			continue;
+		}
+		label = pi->atom[atom].symbol[SYMBOL_CONSTANT];
+		if (!label) {
+			print_msg(pi, MSGTYPE_ERROR, "Global symbol %s is not defined", pi->atom[atom].name);
+			continue;
+		}
+		if (!eval_constant(pi, label))
+			continue;
+		if (label->ref.symbol) {
+			print_msg(pi, MSGTYPE_ERROR, "%s is external and can't be global", label->name);
+		} else if (label->ref.segment) {
+			if ((label->ref.scale != 1) || (label->ref.function != RELOC_FN_NONE))
+				print_msg(pi, MSGTYPE_ERROR, "Global constant %s must be an address or a number", label->name);
+			else
+				fprintf(fp, "global %s %s %x\n", label->name,
+				        section_list[section_number(pi, label->ref.segment)], label->value);
+		} else
+			fprintf(fp, "global %s abs %x\n", label->name, label->value);
+	}
+	for (label = pi->first_constant; label; label = label->next)
+		if (label->ref.symbol == label)
+			fprintf(fp, "extern %s\n", label->name);
+}
+
+static void
+write_contents(FILE *fp, struct prog_info *pi, struct segment_info *si)
+{
+	long addr;
+	int n = 0, per_line;
+
+	per_line = (si == pi->cseg) ? MODULE_WORDS_PER_LINE : MODULE_BYTES_PER_LINE;
+	for (addr = 0; addr < si->occupancy_size; addr++) {
+		if (!cell_used(si, addr)) {
+			n = 0;
+			continue;
+		}
+		if (n == per_line)
+			n = 0;
+		if (n == 0)
+			fprintf(fp, "%s%s %lx", addr ? "\n" : "", si == pi->cseg ? "code" : "eeprom", addr);
+		if (si == pi->cseg)
+			fprintf(fp, " %04x", pi->flash_image[addr]);
+		else
+			fprintf(fp, " %02x", pi->eeprom_image[addr]);
+		n++;
+	}
+	if (si->occupancy_size)
+		fprintf(fp, "\n");
+}
+
+static void
+write_relocs(FILE *fp, struct prog_info *pi)
+{
+	struct reloc *reloc;
+
+	for (reloc = pi->first_reloc; reloc; reloc = reloc->next) {
+		fprintf(fp, "reloc %s %lx %s %s %d %s %x\n",
+		        reloc->segment == pi->cseg ? "code" : "eeprom", reloc->offset,
+		        reloc_type_list[reloc->type],
+		        reloc->ref.symbol ? reloc->ref.symbol->name
+		        : section_list[section_number(pi, reloc->ref.segment)],
+		        reloc->ref.scale, reloc_function_list[reloc->ref.function],
+		        reloc->ref.addend);
+	}
+}
+
+/* Write the module for avra-ld: name.rel, or the --outfile */
+int
+write_module_file(struct prog_info *pi, const char *basename)
+{
+	struct keep *keep;
+	FILE *fp;
+	char *buff;
+	int length = strlen(basename), error_count = pi->error_count;
+
+	buff = malloc(length + 5);
+	if (!buff) {
+		print_msg(pi, MSGTYPE_OUT_OF_MEM, NULL);
+		return (False);
+	}
+	strcpy(buff, basename);
+	if ((length >= 4) && !nocase_strcmp(&buff[length - 4], ".asm"))
+		length -= 4;
+	strcpy(&buff[length], ".rel");
+	fp = fopen(GET_ARG_P(pi->args, ARG_OUTFILE) ? GET_ARG_P(pi->args, ARG_OUTFILE) : buff, "w");
+	if (!fp) {
+		print_msg(pi, MSGTYPE_ERROR, "Could not create module file!");
+		free(buff);
+		return (False);
+	}
+	fprintf(fp, "AVRA module 1\n");
+	fprintf(fp, "source %s\n", basename);
+	if (pi->device->name)
+		fprintf(fp, "device %s\n", pi->device->name);
+	fprintf(fp, "size .code %lx\n", pi->cseg->occupancy_size);
+	fprintf(fp, "size .data %lx\n", pi->dseg->occupancy_size);
+	fprintf(fp, "size .eeprom %lx\n", pi->eseg->occupancy_size);
+	write_globals(fp, pi);
+	for (keep = pi->first_keep; keep; keep = keep->next)
+		fprintf(fp, "keep .code %lx\n", keep->addr);
+	write_contents(fp, pi, pi->cseg);
+	write_contents(fp, pi, pi->eseg);
+	write_relocs(fp, pi);
+	fclose(fp);
+	if (pi->error_count != error_count)
+		unlink(GET_ARG_P(pi->args, ARG_OUTFILE) ? GET_ARG_P(pi->args, ARG_OUTFILE) : buff);
+	free(buff);
+	return (pi->error_count == error_count);
+}
+
+void
+free_relocs(struct prog_info *pi)
+{
+	struct reloc *reloc, *temp_reloc;
+
+	for (reloc = pi->first_reloc; reloc;) {
+		temp_reloc = reloc;
+		reloc = reloc->next;
+		free(temp_reloc);
+	}
+	pi->first_reloc = NULL;
+	pi->last_reloc = NULL;
+}
+
+/* end of module.c */
@@ -85,6 +85,62 @@ fgets_new(struct prog_info *pi, char *s, int size, FILE *stream)
 }
 
 
+/* A source file read by the assembly, in pass 1 */
+struct include_file *
+add_include_file(struct prog_info *pi, const char *filename)
+{
+	struct include_file *include_file;
+
+	if ((include_file = malloc(sizeof(struct include_file)))==NULL) {
+		print_msg(pi, MSGTYPE_OUT_OF_MEM, NULL);
+		return (NULL);
+	}
+	include_file->next = NULL;
+	memset(include_file->bytes, 0, sizeof(include_file->bytes));
+	if ((include_file->name = malloc(strlen(filename) + 1))==NULL) {
+		print_msg(pi, MSGTYPE_OUT_OF_MEM, NULL);
+		free(include_file);
+		return (NULL);
+	}
+	strcpy(include_file->name, filename);
+	if (pi->last_include_file) {
+		pi->last_include_file->next = include_file;
+		include_file->num = pi->last_include_file->num + 1;
+	} else {
+		pi->first_include_file = include_file;
+		include_file->num = 0;
+	}
+	pi->last_include_file = include_file;
+	return (include_file);
+}
+
+/* A file read by .INCBIN, in pass 1. It is kept apart from the sources,
+ * which the object file and the debug info list, and only listed once. */
+int
+add_binary_file(struct prog_info *pi, const char *filename)
+{
+	struct include_file *binary_file;
+
+	for (binary_file = pi->first_binary_file; binary_file; binary_file = binary_file->next)
+		if (!strcmp(binary_file->name, filename))
+			return (True);
+	binary_file = calloc(1, sizeof(struct include_file));
+	if (binary_file)
+		binary_file->name = malloc(strlen(filename) + 1);
+	if (!binary_file || !binary_file->name) {
+		print_msg(pi, MSGTYPE_OUT_OF_MEM, NULL);
+		free(binary_file);
+		return (False);
+	}
+	strcpy(binary_file->name, filename);
+	if (pi->last_binary_file)
+		pi->last_binary_file->next = binary_file;
+	else
+		pi->first_binary_file = binary_file;
+	pi->last_binary_file = binary_file;
+	return (True);
+}
+
 /* Parse given assembler file. */
 int
 parse_file(struct prog_info *pi, const char *filename)
@@ -103,26 +159,10 @@ parse_file(struct prog_info *pi, const char *filename)
 	}
 	pi->fi = fi;
 	if (pi->pass == PASS_1) {
-		if ((include_file = malloc(sizeof(struct include_file)))==NULL) {
-			print_msg(pi, MSGTYPE_OUT_OF_MEM, NULL);
+		if ((include_file = add_include_file(pi, filename))==NULL) {
 			free(fi);
 			return (False);
 		}
-		include_file->next = NULL;
-		if (pi->last_include_file) {
-			pi->last_include_file->next = include_file;
-			include_file->num = pi->last_include_file->num + 1;
-		} else {
-			pi->first_include_file = include_file;
-			include_file->num = 0;
-		}
-		pi->last_include_file = include_file;
-		if ((include_file->name = malloc(strlen(filename) + 1))==NULL) {
-			print_msg(pi, MSGTYPE_OUT_OF_MEM, NULL);
-			free(fi);
-			return (False);
-		}
-		strcpy(include_file->name, filename);
 	} else { /* PASS 2 */
 		for (include_file = pi->first_include_file; include_file; include_file = include_file->next) {
 			if (!strcmp(include_file->name, filename))
@@ -174,6 +214,7 @@ parse_file(struct prog_info *pi, const char *filename)
 	}
 	fclose(fi->fp);
 	free(fi);
+	pi->fi = NULL;
 	return (ok);
 }
 
@@ -185,7 +226,6 @@ parse_line(struct prog_info *pi, char *line)
 	int k;
 	int flag=0, i;
 	int global_label = False;
-	char temp[LINEBUFFER_LENGTH];
 	struct label *label = NULL;
 	struct macro_call *macro_call;
 	int len;
@@ -195,15 +235,12 @@ parse_line(struct prog_info *pi, char *line)
 		return (True);
 	/* Filter out .stab debugging information */
 	/* .stabs sometimes contains colon : symbol - might be interpreted as label */
-	if (*line == '.') {					/* minimal slowdown of existing code */
-		if (strncmp(line,".stabs ",7) == 0) {		/* compiler output is always lower case */
-			strcpy(temp,line);			/* TODO : Do we need this temp variable ? Please check */
-			return parse_stabs(pi, temp);
-		}
-		if (strncmp(line,".stabn ",7) == 0) {
-			strcpy(temp,line);
-			return parse_stabn(pi, temp);
-		}
+	if ((*line == '.') && (strncmp(line, ".stab", 5) == 0)) {	/* compiler output is always lower case */
+		/* Only read with --coff in pass 2, the line is not changed */
+		if ((line[5] == 's') && IS_HOR_SPACE(line[6]))
+			return parse_stabs(pi, line);
+		if ((line[5] == 'n') && IS_HOR_SPACE(line[6]))
+			return parse_stabn(pi, line);
 	}
 	/* Meta information translation */
 	ptr=line;
@@ -237,7 +274,9 @@ parse_line(struct prog_info *pi, char *line)
 			len -= 6-k;
 		} else {
 			ptr++;
+			continue;
 		}
+		pi->uses_time = True;	/* The output changes with the time */
 	}
 
 	strcpy(pi->fi->scratch,line);
@@ -247,12 +286,8 @@ parse_line(struct prog_info *pi, char *line)
 			pi->fi->scratch[i] = '\0';
 			if (pi->pass == PASS_1) {
 				for (macro_call = pi->macro_call; macro_call; macro_call = macro_call->prev_on_stack) {
-					for (label = pi->macro_call->first_label; label; label = label->next) {
-						if (!nocase_strcmp(label->name, &pi->fi->scratch[0])) {
-							print_msg(pi, MSGTYPE_ERROR, "Can't redefine local label %s", &pi->fi->scratch[0]);
-							break;
-						}
-					}
+					if (search_local(pi, &pi->fi->scratch[0]))
+						print_msg(pi, MSGTYPE_ERROR, "Can't redefine local label %s", &pi->fi->scratch[0]);
 				}
 				if (test_label(pi,&pi->fi->scratch[0],"Can't redefine label %s")!=NULL)
 					break;
@@ -273,6 +308,9 @@ parse_line(struct prog_info *pi, char *line)
 				}
 				strcpy(label->name, &pi->fi->scratch[0]);
 				label->value = pi->segment->addr;
+				set_symbol_origin(pi, label, pi->segment);
+				if (!bind_symbol(pi, (pi->macro_call && !global_label) ? SYMBOL_LOCAL : SYMBOL_LABEL, label))
+					return (False);
 
 				if (pi->macro_call && !global_label) {
 					if (pi->macro_call->last_label)
@@ -287,6 +325,16 @@ parse_line(struct prog_info *pi, char *line)
 						pi->first_label = label;
 					pi->last_label = label;
 				}
+				if (pi->pool) {
+					if (pi->macro_call && !global_label)
+						print_msg(pi, MSGTYPE_ERROR, "Macro labels can't be used in a .POOL");
+					else if (!pool_label(pi, label))
+						return (False);
+				}
+			} else {
+				if (pi->layout)
+					label = relax_label(pi, &pi->fi->scratch[0]);
+				cycles_label(pi);
 			}
 			i++;
 			while (IS_HOR_SPACE(pi->fi->scratch[i]) && !IS_END_OR_COMMENT(pi->fi->scratch[i])) i++;
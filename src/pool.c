@@ -0,0 +1,322 @@
+/***********************************************************************
+ *
+ *  AVRA - Assembler for the Atmel AVR microcontroller series
+ *
+ *  Copyright (C) 1998-2020 The AVRA Authors
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; see the file COPYING.  If not, write to
+ *  the Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ *  Boston, MA 02111-1307, USA.
+ *
+ *
+ *  Authors of AVRA can be reached at:
+ *     email: jonah@omegav.ntnu.no, tobiw@suprafluid.com
+ *     www: https://github.com/Ro5bert/avra
+ */
+
+/*
+ * Constant pools (.POOL ... .ENDPOOL).
+ *
+ * Each label in a pool starts an entry holding the .DB and .DW data up to
+ * the next label. Pass 1 evaluates the data, which must not depend on
+ * labels, and lays the pool out at .ENDPOOL: an entry equal to another, or
+ * to the end of a longer one, is not stored and its label points into the
+ * copy that is. The layout passes and pass 2 only place the pool, and pass
+ * 2 writes the stored entries at .ENDPOOL.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "misc.h"
+#include "args.h"
+#include "avra.h"
+
+#define POOL_ALLOC_STEP 64
+
+static struct pool_entry *
+add_entry(struct prog_info *pi, struct pool *pool, struct label *label)
+{
+	struct pool_entry *entry;
+
+	if (pool->entry_count == pool->entry_alloc) {
+		entry = realloc(pool->entry, (pool->entry_alloc + POOL_ALLOC_STEP) * sizeof(struct pool_entry));
+		if (!entry) {
+			print_msg(pi, MSGTYPE_OUT_OF_MEM, NULL);
+			return (NULL);
+		}
+		pool->entry = entry;
+		pool->entry_alloc += POOL_ALLOC_STEP;
+	}
+	entry = &pool->entry[pool->entry_count++];
+	memset(entry, 0, sizeof(struct pool_entry));
+	entry->label = label;
+	entry->host = pool->entry_count - 1;
+	return (entry);
+}
+
+static int
+add_byte(struct prog_info *pi, struct pool_entry *entry, int byte)
+{
+	unsigned char *data;
+
+	if (entry->size == entry->alloc) {
+		data = realloc(entry->data, entry->alloc + POOL_ALLOC_STEP);
+		if (!data) {
+			print_msg(pi, MSGTYPE_OUT_OF_MEM, NULL);
+			return (False);
+		}
+		entry->data = data;
+		entry->alloc += POOL_ALLOC_STEP;
+	}
+	entry->data[entry->size++] = byte;
+	return (True);
+}
+
+/* .POOL */
+int
+begin_pool(struct prog_info *pi)
+{
+	struct pool *pool;
+	int i;
+
+	if (pi->pool) {
+		print_msg(pi, MSGTYPE_ERROR, ".POOL can't be nested");
+		return (True);
+	}
+	if (pi->segment != pi->cseg) {
+		print_msg(pi, MSGTYPE_ERROR, ".POOL is only allowed in the code segment");
+		return (True);
+	}
+	if (pi->pass == PASS_1) {
+		pool = calloc(1, sizeof(struct pool));
+		if (!pool) {
+			print_msg(pi, MSGTYPE_OUT_OF_MEM, NULL);
+			return (False);
+		}
+		if (pi->last_pool)
+			pi->last_pool->next = pool;
+		else
+			pi->first_pool = pool;
+		pi->last_pool = pool;
+	} else {
+		for (pool = pi->first_pool, i = 0; pool && (i < pi->pool_index); pool = pool->next)
+			i++;
+		if (!pool) {
+			print_msg(pi, MSGTYPE_ERROR, ".POOL differs between pass 1 and pass 2");
+			return (False);
+		}
+		pi->pool_index++;
+	}
+	pool->start = pi->cseg->addr;
+	pi->pool = pool;
+	return (True);
+}
+
+/* A label in a pool, in pass 1 */
+int
+pool_label(struct prog_info *pi, struct label *label)
+{
+	return (add_entry(pi, pi->pool, label) != NULL);
+}
+
+/* .DB or .DW in a pool. Only pass 1 reads the data. */
+int
+pool_data(struct prog_info *pi, char *next, int word)
+{
+	struct pool_entry *entry;
+	char *data;
+	int i, count = 0;
+
+	if (pi->pass == PASS_2) {
+		if (pi->list_line && pi->list_on) {
+			fprintf(pi->list_file, "          %s\n", pi->list_line);
+			pi->list_line = NULL;
+		}
+		return (True);
+	}
+	if (pi->pool->entry_count)
+		entry = &pi->pool->entry[pi->pool->entry_count - 1];
+	else if (!(entry = add_entry(pi, pi->pool, NULL)))
+		return (False);
+	while (next) {
+		data = get_next_token(next, TERM_COMMA);
+		if (!word && (next[0] == '\"')) {
+			for (next = term_string(pi, next); *next != '\0'; next++, count++)
+				if (!add_byte(pi, entry, (unsigned char)*next))
+					return (False);
+		} else {
+			pi->expr_labels = False;
+			if (!get_expr(pi, next, &i))
+				return (False);
+			if (pi->expr_labels) {
+				print_msg(pi, MSGTYPE_ERROR, "The data of a .POOL can't depend on labels");
+				return (True);
+			}
+			if (word) {
+				if ((i < -32768) || (i > 65535))
+					print_msg(pi, MSGTYPE_WARNING, "Value %d is out of range (-32768 <= k <= 65535). Will be masked", i);
+				if (!add_byte(pi, entry, i & 0xff) || !add_byte(pi, entry, (i >> 8) & 0xff))
+					return (False);
+			} else {
+				if ((i < -128) || (i > 255))
+					print_msg(pi, MSGTYPE_WARNING, "Value %d is out of range (-128 <= k <= 255). Will be masked", i);
+				if (!add_byte(pi, entry, i & 0xff))
+					return (False);
+				count++;
+			}
+		}
+		next = data;
+	}
+	if ((count % 2) == 1) {
+		print_msg(pi, MSGTYPE_WARNING, "A .DB segment with an odd number of bytes is detected. A zero byte is added.");
+		if (!add_byte(pi, entry, 0))
+			return (False);
+	}
+	return (True);
+}
+
+/* Find the entry each entry is stored in, longest first so that a host is
+ * always stored itself, then place the stored entries in source order */
+static void
+layout_pool(struct pool *pool)
+{
+	struct pool_entry *entry, *host;
+	int *order, i, j, swap;
+
+	order = malloc((pool->entry_count + 1) * sizeof(int));
+	if (order) {
+		for (i = 0; i < pool->entry_count; i++)
+			order[i] = i;
+		/* Insertion sort keeps the source order of equal sizes */
+		for (i = 1; i < pool->entry_count; i++)
+			for (j = i; (j > 0) && (pool->entry[order[j]].size > pool->entry[order[j - 1]].size); j--) {
+				swap = order[j];
+				order[j] = order[j - 1];
+				order[j - 1] = swap;
+			}
+		for (i = 1; i < pool->entry_count; i++) {
+			entry = &pool->entry[order[i]];
+			if (!entry->size)
+				continue;
+			for (j = 0; j < i; j++) {
+				host = &pool->entry[order[j]];
+				if ((host->host == order[j])
+				        && !memcmp(host->data + host->size - entry->size, entry->data, entry->size)) {
+					entry->host = order[j];
+					break;
+				}
+			}
+		}
+		free(order);
+	}
+	pool->size = 0;
+	for (i = 0; i < pool->entry_count; i++) {
+		entry = &pool->entry[i];
+		if (entry->host == i) {
+			entry->offset = pool->size;
+			pool->size += entry->size / 2;
+		}
+	}
+	for (i = 0; i < pool->entry_count; i++) {
+		entry = &pool->entry[i];
+		host = &pool->entry[entry->host];
+		if (entry->host != i)
+			entry->offset = host->offset + (host->size - entry->size) / 2;
+	}
+}
+
+static void
+list_pool(struct prog_info *pi, struct pool *pool)
+{
+	struct pool_entry *entry;
+	long stored = 0, total = 0;
+	int i;
+
+	for (i = 0; i < pool->entry_count; i++) {
+		entry = &pool->entry[i];
+		total += entry->size;
+		if (entry->host == i)
+			stored += entry->size;
+		if (!entry->label)
+			continue;
+		if ((entry->host == i) || !pool->entry[entry->host].label)
+			fprintf(pi->list_file, "%c:%06lx %-20s %d bytes%s\n", pi->cseg->ident,
+			        pool->start + entry->offset, entry->label->name, entry->size,
+			        entry->host == i ? "" : ", shared");
+		else
+			fprintf(pi->list_file, "%c:%06lx %-20s %d bytes, shared with %s\n", pi->cseg->ident,
+			        pool->start + entry->offset, entry->label->name, entry->size,
+			        pool->entry[entry->host].label->name);
+	}
+	fprintf(pi->list_file, "          ; .POOL: %ld of %ld bytes stored\n", stored, total);
+}
+
+/* .ENDPOOL */
+int
+end_pool(struct prog_info *pi)
+{
+	struct pool *pool = pi->pool;
+	struct pool_entry *entry;
+	int i;
+
+	if (!pool) {
+		print_msg(pi, MSGTYPE_ERROR, ".ENDPOOL without .POOL");
+		return (True);
+	}
+	pi->pool = NULL;
+	if (pi->pass == PASS_1)
+		layout_pool(pool);
+	if ((pi->pass == PASS_1) || pi->layout) {
+		for (i = 0; i < pool->entry_count; i++)
+			if (pool->entry[i].label)
+				pool->entry[i].label->value = pool->start + pool->entry[i].offset;
+	} else {
+		if (pi->list_line && pi->list_on) {
+			fprintf(pi->list_file, "          %s\n", pi->list_line);
+			pi->list_line = NULL;
+		}
+		if (pi->list_on)
+			list_pool(pi, pool);
+		for (i = 0; i < pool->entry_count; i++) {
+			entry = &pool->entry[i];
+			if (entry->host == i)
+				write_prog_data(pi, pool->start + entry->offset, entry->data, entry->size);
+		}
+	}
+	advance_ip(pi->cseg, pool->size);
+	return (True);
+}
+
+void
+free_pools(struct prog_info *pi)
+{
+	struct pool *pool, *temp_pool;
+	int i;
+
+	for (pool = pi->first_pool; pool;) {
+		for (i = 0; i < pool->entry_count; i++)
+			free(pool->entry[i].data);
+		free(pool->entry);
+		temp_pool = pool;
+		pool = pool->next;
+		free(temp_pool);
+	}
+	pi->first_pool = NULL;
+	pi->last_pool = NULL;
+	pi->pool = NULL;
+}
+
+/* end of pool.c */
@@ -0,0 +1,200 @@
+/***********************************************************************
+ *
+ *  AVRA - Assembler for the Atmel AVR microcontroller series
+ *
+ *  Copyright (C) 1998-2020 The AVRA Authors
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; see the file COPYING.  If not, write to
+ *  the Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ *  Boston, MA 02111-1307, USA.
+ *
+ *
+ *  Authors of AVRA can be reached at:
+ *     email: jonah@omegav.ntnu.no, tobiw@suprafluid.com
+ *     www: https://github.com/Ro5bert/avra
+ */
+
+/*
+ * Branch and call relaxation (--relax).
+ *
+ * Pass 1 assembles every jump, call and branch in one word. The layout
+ * passes then run pass 2 without output and grow each instruction whose
+ * target is out of reach: RJMP/RCALL become JMP/CALL, and a conditional
+ * branch becomes an inverted branch around an RJMP or JMP. Sizes only grow,
+ * so the layout passes reach a fixed point, and the final pass 2 uses the
+ * sizes of the last one.
+ *
+ * The layout passes also run, with or without --relax, when the source uses
+ * clobbers(). Each pass takes the registers written from the code of the
+ * one before, until they no longer change.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "misc.h"
+#include "args.h"
+#include "avra.h"
+#include "device.h"
+
+#define RELAX_ALLOC_STEP 256
+
+/* Layout passes in which clobbers() may change before giving up */
+#define MAX_CLOBBERS_PASSES 16
+
+/* Whether a jump or call is an interrupt vector, whose size places the
+ * vectors after it: below INT_VECTORS_SIZE or, without it, one of the
+ * jumps and calls from address 0 on */
+static int
+is_vector(struct prog_info *pi, int written)
+{
+	int vectors_size;
+
+	if (get_constant(pi, "INT_VECTORS_SIZE", &vectors_size))
+		return (pi->cseg->addr < vectors_size);
+	if (pi->cseg->addr != pi->relax_vectors_end)
+		return (False);
+	pi->relax_vectors_end += written;
+	return (True);
+}
+
+int
+add_relax(struct prog_info *pi, int written, int branch)
+{
+	struct relax *relax;
+
+	if (pi->relax_count == pi->relax_alloc) {
+		relax = realloc(pi->relax, (pi->relax_alloc + RELAX_ALLOC_STEP) * sizeof(struct relax));
+		if (!relax) {
+			print_msg(pi, MSGTYPE_OUT_OF_MEM, NULL);
+			return (False);
+		}
+		pi->relax = relax;
+		pi->relax_alloc += RELAX_ALLOC_STEP;
+	}
+	relax = &pi->relax[pi->relax_count++];
+	relax->written = written;
+	relax->branch = branch;
+	relax->fixed = !branch && is_vector(pi, written);
+	relax->size = relax->fixed ? written : 1;
+	return (True);
+}
+
+/* The entry of the next jump, call or branch in pass 2 */
+struct relax *
+next_relax(struct prog_info *pi)
+{
+	if (pi->relax_index >= pi->relax_count) {
+		print_msg(pi, MSGTYPE_ERROR, "Jumps and branches differ between pass 1 and pass 2");
+		return (NULL);
+	}
+	return (&pi->relax[pi->relax_index++]);
+}
+
+/* Move a label to the current address in a layout pass */
+struct label *
+relax_label(struct prog_info *pi, char *name)
+{
+	struct label *label;
+
+	label = search_local(pi, name);
+	if (!label)
+		label = test_label(pi, name, NULL);
+	if (label)
+		label->value = pi->segment->addr;
+	return (label);
+}
+
+static void
+reset_layout(struct prog_info *pi)
+{
+	struct include_file *include_file;
+
+	free_orglist(pi);
+	for (include_file = pi->first_include_file; include_file; include_file = include_file->next)
+		memset(include_file->bytes, 0, sizeof(include_file->bytes));
+	pi->cseg->count = 0;
+	pi->dseg->count = 0;
+	pi->eseg->count = 0;
+	pi->segment = pi->cseg;
+	pi->segment_overlap = SEG_DONT_OVERLAP;
+	pi->macro_call = NULL;
+	rewind_segments(pi);
+	pi->relax_index = 0;
+	pi->pool = NULL;
+	pi->pool_index = 0;
+	pi->code_count = 0;
+	pi->long_insn_count = 0;
+	pi->block_start = -1;
+	reset_flow(pi);
+}
+
+/* Run layout passes until no instruction grows and clobbers() is settled.
+ * Errors are not reported here; pass 2 runs anyway and reports them. */
+void
+relax_code(struct prog_info *pi, const char *filename)
+{
+	int list_on = pi->list_on, passes = 0, ok, i, saved = 0, lengthened = 0, extended = 0;
+	int clobbers_changed, clobbers_passes = 0;
+
+	if (GET_ARG_I(pi->args, ARG_RELAX))
+		printf("Relaxing...\n");
+	pi->pass = PASS_2;
+	pi->layout = True;
+	pi->list_on = False;
+	do {
+		passes++;
+		pi->relax_changed = False;
+		reset_layout(pi);
+		def_orglist(pi->cseg);
+		ok = load_arg_defines(pi) && predef_dev(pi) && parse_file(pi, filename);
+		fix_orglist(pi->segment);
+		clobbers_changed = update_clobbers(pi);
+		if (clobbers_changed)
+			clobbers_passes++;
+	} while (ok && (pi->relax_changed || (clobbers_changed && (clobbers_passes < MAX_CLOBBERS_PASSES))));
+	pi->layout = False;
+	pi->list_on = list_on;
+	pi->code_count = 0;
+	pi->block_start = -1;
+	reset_flow(pi);
+	if (ok && clobbers_changed)
+		print_msg(pi, MSGTYPE_ERROR, "clobbers() still changes after %d layout passes", passes);
+	if (!GET_ARG_I(pi->args, ARG_RELAX))
+		return;
+
+	for (i = 0; i < pi->relax_count; i++) {
+		if (pi->relax[i].branch) {
+			if (pi->relax[i].size > 1)
+				extended++;
+		} else if (pi->relax[i].size < pi->relax[i].written)
+			saved += pi->relax[i].written - pi->relax[i].size;
+		else if (pi->relax[i].size > pi->relax[i].written)
+			lengthened++;
+	}
+	printf("%d layout pass%s, %d word%s saved on jumps and calls, %d lengthened, %d branch%s extended\n",
+	       passes, passes == 1 ? "" : "es", saved, saved == 1 ? "" : "s", lengthened,
+	       extended, extended == 1 ? "" : "es");
+}
+
+void
+free_relax(struct prog_info *pi)
+{
+	free(pi->relax);
+	pi->relax = NULL;
+	pi->relax_count = pi->relax_alloc = pi->relax_index = 0;
+}
+
+/* end of relax.c */
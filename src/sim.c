@@ -0,0 +1,1284 @@
+/***********************************************************************
+ *
+ *  AVRA - Assembler for the Atmel AVR microcontroller series
+ *
+ *  Copyright (C) 1998-2020 The AVRA Authors
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; see the file COPYING.  If not, write to
+ *  the Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ *  Boston, MA 02111-1307, USA.
+ *
+ *
+ *  Authors of AVRA can be reached at:
+ *     email: jonah@omegav.ntnu.no, tobiw@suprafluid.com
+ *     www: https://github.com/Ro5bert/avra
+ */
+
+/*
+ * avra-sim: assembles a program like avra, but keeps the flash and EEPROM
+ * images in memory and runs them on a simple instruction set simulator.
+ *
+ * Opcodes are decoded with the table of mnemonic.c on first execution and
+ * kept in a decode cache with one entry per flash word, up to the end of
+ * the code or the last breakpoint; erased flash beyond it is decoded each
+ * time it is reached. Cycles are those
+ * of the cycle counter (--listcycles). Peripherals are not simulated: I/O
+ * registers are plain memory, except SREG and the stack pointer.
+ *
+ * A script drives the simulation. Addresses and values are assembler
+ * expressions, so labels and constants of the program can be used.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+
+#include "misc.h"
+#include "args.h"
+#include "avra.h"
+#include "device.h"
+#include "mnemonic.h"
+
+#define SIM_LINE_LENGTH 256
+#define SIM_DATA_SIZE 0x10000
+
+/* I/O addresses */
+#define SIM_RAMPZ 0x3b
+#define SIM_EIND  0x3c
+#define SIM_SPL   0x3d
+#define SIM_SPH   0x3e
+#define SIM_SREG  0x3f
+
+#define SREG_C 0x01
+#define SREG_Z 0x02
+#define SREG_N 0x04
+#define SREG_V 0x08
+#define SREG_S 0x10
+#define SREG_H 0x20
+#define SREG_T 0x40
+#define SREG_I 0x80
+
+#define IO(sim, addr) ((sim)->data[(sim)->io_base + (addr)])
+#define REG_PAIR(sim, n) ((sim)->reg[n] | ((sim)->reg[(n) + 1] << 8))
+/* Of LD and ST: plain, post-increment, pre-decrement */
+#define POINTER_UPDATE(op, first) (((op) - (first) == 2) ? -1 : (op) - (first))
+
+enum {
+	SIM_ARG_SCRIPT = ARG_COUNT,
+	SIM_ARG_MAX_CYCLES,
+	SIM_ARG_TRACE,
+	SIM_ARG_COUNT
+};
+
+enum {
+	STOP_NONE = 0,
+	STOP_STEPS,
+	STOP_BREAK,
+	STOP_SLEEP,
+	STOP_BREAKPOINT,
+	STOP_UNTIL,
+	STOP_RETURN,
+	STOP_INVALID,
+	STOP_OUTSIDE,
+	STOP_MAX_CYCLES
+};
+
+static const char *stop_reason[] = {
+	"running",
+	"steps done",
+	"break",
+	"sleep",
+	"breakpoint",
+	"address reached",
+	"returned",
+	"invalid opcode",
+	"outside of flash",
+	"cycle limit reached"
+};
+
+/* Locations of set and expect */
+enum {
+	LOC_REG = 0,
+	LOC_PAIR,
+	LOC_SREG,
+	LOC_SP,
+	LOC_PC,
+	LOC_CYCLES,
+	LOC_MEM
+};
+
+struct decoded {
+	short mnemonic;			/* As decoded, -1 if invalid */
+	short op;			/* What it does: aliases are the instruction they stand for */
+	unsigned char size;		/* Words, 0 if not decoded yet */
+	unsigned char cycles;
+	unsigned char taken;		/* Extra cycles of a taken branch */
+	unsigned char breakpoint;
+	unsigned char d;		/* Register fields */
+	unsigned char r;
+	unsigned char b;		/* Bit number */
+	long k;				/* Constant, address, offset or I/O port */
+};
+
+struct sim {
+	struct prog_info *pi;
+	struct decoded *code;		/* Decode cache, one entry per flash word */
+	long code_size;
+	struct decoded erased;		/* Beyond the decode cache */
+	long flash_size;
+	unsigned char reg[32];
+	unsigned char *data;		/* Data space, registers are separate */
+	int io_base;
+	int regs_mapped;		/* Registers at data addresses 0 - 31 */
+	int pc_bytes;			/* Of return addresses on the stack */
+	long ramend;
+	long pc;
+	unsigned long cycles;
+	unsigned long max_cycles;
+	long until;			/* Stop address, -1 if none */
+	long sentinel;			/* Return address of call, -1 if none */
+	int trace;
+	const char *script_name;
+	int line_number;
+	int expect_count;
+	int failures;
+};
+
+static const char *usage =
+    "usage: avra-sim [-s <script>] [--max_cycles <number>] [--trace]\n"
+    "                [avra options] <file to assemble>\n"
+    "\n"
+    "   --script      -s : Run the commands of a script.\n"
+    "   --max_cycles     : Stop after this many cycles (default: 10000000)\n"
+    "   --trace          : Print each instruction executed.\n";
+
+static struct prog_info PROG_INFO;
+
+static int
+read_data(struct sim *sim, long addr)
+{
+	addr &= SIM_DATA_SIZE - 1;
+	if (sim->regs_mapped && (addr < 32))
+		return (sim->reg[addr]);
+	return (sim->data[addr]);
+}
+
+static void
+write_data(struct sim *sim, long addr, int value)
+{
+	addr &= SIM_DATA_SIZE - 1;
+	if (sim->regs_mapped && (addr < 32))
+		sim->reg[addr] = value;
+	else
+		sim->data[addr] = value;
+}
+
+/* A word of flash, erased beyond the end of the code */
+static int
+flash_word(struct sim *sim, long addr)
+{
+	if (addr >= sim->pi->flash_image_size)
+		return (0xffff);
+	return (sim->pi->flash_image[addr]);
+}
+
+static int
+read_flash(struct sim *sim, long addr)
+{
+	if ((addr >> 1) >= sim->flash_size)
+		return (0xff);
+	return ((flash_word(sim, addr >> 1) >> ((addr & 1) * 8)) & 0xff);
+}
+
+static long
+get_sp(struct sim *sim)
+{
+	return (IO(sim, SIM_SPL) | (IO(sim, SIM_SPH) << 8));
+}
+
+static void
+set_sp(struct sim *sim, long sp)
+{
+	IO(sim, SIM_SPL) = sp & 0xff;
+	IO(sim, SIM_SPH) = (sp >> 8) & 0xff;
+}
+
+static void
+push(struct sim *sim, int value)
+{
+	long sp = get_sp(sim);
+
+	write_data(sim, sp, value);
+	set_sp(sim, sp - 1);
+}
+
+static int
+pop(struct sim *sim)
+{
+	long sp = get_sp(sim) + 1;
+
+	set_sp(sim, sp);
+	return (read_data(sim, sp));
+}
+
+static void
+push_pc(struct sim *sim, long pc)
+{
+	push(sim, pc & 0xff);
+	push(sim, (pc >> 8) & 0xff);
+	if (sim->pc_bytes == 3)
+		push(sim, (pc >> 16) & 0xff);
+}
+
+static long
+pop_pc(struct sim *sim)
+{
+	long pc = 0;
+
+	if (sim->pc_bytes == 3)
+		pc = (long)pop(sim) << 16;
+	pc |= pop(sim) << 8;
+	return (pc | pop(sim));
+}
+
+static void
+set_flags(struct sim *sim, int mask, int flags)
+{
+	IO(sim, SIM_SREG) = (IO(sim, SIM_SREG) & ~mask) | (flags & mask);
+}
+
+/* N, Z and S of a result; V and C are given */
+static void
+result_flags(struct sim *sim, int mask, int res, int flags)
+{
+	if (res & 0x80)
+		flags |= SREG_N;
+	if ((res & 0xff) == 0)
+		flags |= SREG_Z;
+	if (((flags & SREG_N) != 0) != ((flags & SREG_V) != 0))
+		flags |= SREG_S;
+	set_flags(sim, mask | SREG_N | SREG_Z | SREG_S, flags);
+}
+
+static int
+add8(struct sim *sim, int d, int r, int c)
+{
+	int res = (d + r + c) & 0xff;
+	int carries = (d & r) | (r & ~res) | (~res & d);
+	int flags = 0;
+
+	if (carries & 0x08)
+		flags |= SREG_H;
+	if (carries & 0x80)
+		flags |= SREG_C;
+	if (((d & r & ~res) | (~d & ~r & res)) & 0x80)
+		flags |= SREG_V;
+	result_flags(sim, SREG_H | SREG_V | SREG_C, res, flags);
+	return (res);
+}
+
+/* keep_z: SBC, SBCI and CPC only clear Z */
+static int
+sub8(struct sim *sim, int d, int r, int c, int keep_z)
+{
+	int res = (d - r - c) & 0xff;
+	int borrows = (~d & r) | (r & res) | (res & ~d);
+	int flags = 0;
+	int z = IO(sim, SIM_SREG) & SREG_Z;
+
+	if (borrows & 0x08)
+		flags |= SREG_H;
+	if (borrows & 0x80)
+		flags |= SREG_C;
+	if (((d & ~r & ~res) | (~d & r & res)) & 0x80)
+		flags |= SREG_V;
+	result_flags(sim, SREG_H | SREG_V | SREG_C, res, flags);
+	if (keep_z && !z)
+		set_flags(sim, SREG_Z, 0);
+	return (res);
+}
+
+static int
+logic(struct sim *sim, int res)
+{
+	result_flags(sim, SREG_V, res, 0);
+	return (res & 0xff);
+}
+
+/* LSR, ROR and ASR */
+static int
+shift_right(struct sim *sim, int res, int c)
+{
+	int flags = c ? SREG_C : 0;
+
+	if (((res & 0x80) != 0) != c)
+		flags |= SREG_V;
+	result_flags(sim, SREG_V | SREG_C, res, flags);
+	return (res);
+}
+
+static void
+multiply(struct sim *sim, long product, int fractional)
+{
+	int flags = 0;
+
+	if (product & 0x8000)
+		flags |= SREG_C;
+	if (fractional)
+		product <<= 1;
+	if ((product & 0xffff) == 0)
+		flags |= SREG_Z;
+	sim->reg[0] = product & 0xff;
+	sim->reg[1] = (product >> 8) & 0xff;
+	set_flags(sim, SREG_C | SREG_Z, flags);
+}
+
+static void
+adiw(struct sim *sim, int d, long k, int subtract)
+{
+	long rd = REG_PAIR(sim, d);
+	long res = (subtract ? rd - k : rd + k) & 0xffff;
+	int flags = 0;
+
+	if ((subtract ? (rd & ~res) : (~rd & res)) & 0x8000)
+		flags |= SREG_V;
+	if ((subtract ? (res & ~rd) : (~res & rd)) & 0x8000)
+		flags |= SREG_C;
+	if (res & 0x8000)
+		flags |= SREG_N;
+	if (res == 0)
+		flags |= SREG_Z;
+	if (((flags & SREG_N) != 0) != ((flags & SREG_V) != 0))
+		flags |= SREG_S;
+	set_flags(sim, SREG_S | SREG_V | SREG_N | SREG_Z | SREG_C, flags);
+	sim->reg[d] = res & 0xff;
+	sim->reg[d + 1] = res >> 8;
+}
+
+/* The instruction an alias stands for */
+static int
+canonical(int mnemonic, int opcode)
+{
+	if ((mnemonic >= MNEMONIC_SEC) && (mnemonic <= MNEMONIC_CLH))
+		return ((opcode & 0x0080) ? MNEMONIC_BCLR : MNEMONIC_BSET);
+	if ((mnemonic >= MNEMONIC_BREQ) && (mnemonic <= MNEMONIC_BRID))
+		return ((opcode & 0x0400) ? MNEMONIC_BRBC : MNEMONIC_BRBS);
+	switch (mnemonic) {
+	case MNEMONIC_TST:
+		return (MNEMONIC_AND);
+	case MNEMONIC_CLR:
+		return (MNEMONIC_EOR);
+	case MNEMONIC_LSL:
+		return (MNEMONIC_ADD);
+	case MNEMONIC_ROL:
+		return (MNEMONIC_ADC);
+	case MNEMONIC_SER:
+		return (MNEMONIC_LDI);
+	case MNEMONIC_SBR:
+		return (MNEMONIC_ORI);
+	case MNEMONIC_CBR:
+		return (MNEMONIC_ANDI);
+	}
+	return (mnemonic);
+}
+
+static struct decoded *
+decode(struct sim *sim, long addr, struct decoded *insn)
+{
+	int opcode = flash_word(sim, addr);
+	int next = (addr + 1 < sim->flash_size) ? flash_word(sim, addr + 1) : 0xffff;
+	int min, max;
+
+	insn->mnemonic = decode_opcode(sim->pi, opcode);
+	insn->op = canonical(insn->mnemonic, opcode);
+	insn->size = 1;
+	insn->cycles = 1;
+	insn->taken = 0;
+	insn->d = (opcode >> 4) & 0x1f;
+	insn->r = (opcode & 0x0f) | ((opcode >> 5) & 0x10);
+	insn->b = opcode & 0x07;
+	insn->k = 0;
+	if (insn->mnemonic < 0)
+		return (insn);
+	get_cycles(sim->pi, insn->mnemonic, addr, &min, &max);
+	insn->cycles = min;
+	switch (insn->op) {
+	case MNEMONIC_BSET:
+	case MNEMONIC_BCLR:
+		insn->b = (opcode >> 4) & 0x07;
+		break;
+	case MNEMONIC_BRBS:
+	case MNEMONIC_BRBC:
+		insn->taken = max - min;
+		insn->k = (opcode >> 3) & 0x7f;
+		if (insn->k & 0x40)
+			insn->k -= 0x80;
+		break;
+	case MNEMONIC_RJMP:
+	case MNEMONIC_RCALL:
+		insn->k = opcode & 0x0fff;
+		if (insn->k & 0x0800)
+			insn->k -= 0x1000;
+		break;
+	case MNEMONIC_JMP:
+	case MNEMONIC_CALL:
+		insn->k = ((long)(((opcode >> 3) & 0x3e) | (opcode & 0x01)) << 16) | next;
+		insn->size = 2;
+		break;
+	case MNEMONIC_LDS:
+	case MNEMONIC_STS:
+		insn->k = next;
+		insn->size = 2;
+		break;
+	case MNEMONIC_MOVW:
+		insn->d = ((opcode >> 4) & 0x0f) * 2;
+		insn->r = (opcode & 0x0f) * 2;
+		break;
+	case MNEMONIC_MULS:
+		insn->d = 16 + ((opcode >> 4) & 0x0f);
+		insn->r = 16 + (opcode & 0x0f);
+		break;
+	case MNEMONIC_MULSU:
+	case MNEMONIC_FMUL:
+	case MNEMONIC_FMULS:
+	case MNEMONIC_FMULSU:
+		insn->d = 16 + ((opcode >> 4) & 0x07);
+		insn->r = 16 + (opcode & 0x07);
+		break;
+	case MNEMONIC_ADIW:
+	case MNEMONIC_SBIW:
+		insn->d = 24 + ((opcode >> 3) & 0x06);
+		insn->k = (opcode & 0x0f) | ((opcode >> 2) & 0x30);
+		break;
+	case MNEMONIC_SUBI:
+	case MNEMONIC_SBCI:
+	case MNEMONIC_ANDI:
+	case MNEMONIC_ORI:
+	case MNEMONIC_CPI:
+	case MNEMONIC_LDI:
+		insn->d = 16 + ((opcode >> 4) & 0x0f);
+		insn->k = (opcode & 0x0f) | ((opcode >> 4) & 0xf0);
+		break;
+	case MNEMONIC_IN:
+	case MNEMONIC_OUT:
+		insn->k = (opcode & 0x0f) | ((opcode >> 5) & 0x30);
+		break;
+	case MNEMONIC_SBIC:
+	case MNEMONIC_SBIS:
+	case MNEMONIC_SBI:
+	case MNEMONIC_CBI:
+		insn->k = (opcode >> 3) & 0x1f;
+		break;
+	case MNEMONIC_LDD_Y:
+	case MNEMONIC_LDD_Z:
+	case MNEMONIC_STD_Y:
+	case MNEMONIC_STD_Z:
+		insn->k = (opcode & 0x07) | ((opcode >> 7) & 0x18) | ((opcode >> 8) & 0x20);
+		break;
+	case MNEMONIC_LDS_AVR8L:
+	case MNEMONIC_STS_AVR8L:
+		insn->d = 16 + ((opcode >> 4) & 0x0f);
+		insn->k = (opcode & 0x0f) | ((opcode >> 5) & 0x30)
+		          | ((opcode >> 2) & 0x40) | ((~opcode >> 1) & 0x80);
+		break;
+	}
+	return (insn);
+}
+
+static struct decoded *
+get_decoded(struct sim *sim, long addr)
+{
+	if (addr >= sim->code_size)
+		return (decode(sim, addr, &sim->erased));
+	if (sim->code[addr].size == 0)
+		return (decode(sim, addr, &sim->code[addr]));
+	return (&sim->code[addr]);
+}
+
+/* Extend the decode cache up to addr, for a breakpoint */
+static int
+grow_code(struct sim *sim, long addr)
+{
+	struct decoded *code;
+
+	if (addr < sim->code_size)
+		return (True);
+	code = realloc(sim->code, (addr + 1) * sizeof(struct decoded));
+	if (!code) {
+		print_msg(sim->pi, MSGTYPE_OUT_OF_MEM, NULL);
+		return (False);
+	}
+	memset(&code[sim->code_size], 0, (addr + 1 - sim->code_size) * sizeof(struct decoded));
+	sim->code = code;
+	sim->code_size = addr + 1;
+	return (True);
+}
+
+/* Address of a load or store through X, Y or Z, with pre-decrement (-1) or
+ * post-increment (1) */
+static long
+pointer(struct sim *sim, int n, int update)
+{
+	long addr = REG_PAIR(sim, n);
+
+	if (update < 0)
+		addr = (addr - 1) & 0xffff;
+	if (update != 0) {
+		sim->reg[n] = ((update > 0) ? addr + 1 : addr) & 0xff;
+		sim->reg[n + 1] = (((update > 0) ? addr + 1 : addr) >> 8) & 0xff;
+	}
+	return (addr);
+}
+
+static long
+elpm_pointer(struct sim *sim, int increment)
+{
+	long addr = ((long)IO(sim, SIM_RAMPZ) << 16) | REG_PAIR(sim, 30);
+
+	if (increment) {
+		sim->reg[30] = (addr + 1) & 0xff;
+		sim->reg[31] = ((addr + 1) >> 8) & 0xff;
+		IO(sim, SIM_RAMPZ) = ((addr + 1) >> 16) & 0xff;
+	}
+	return (addr);
+}
+
+static int
+execute(struct sim *sim, struct decoded *insn)
+{
+	struct decoded *skipped;
+	unsigned char *reg = sim->reg;
+	int sreg = IO(sim, SIM_SREG);
+	int d = reg[insn->d];
+	int r = reg[insn->r];
+	int c = sreg & SREG_C;
+	int skip = False;
+	long next = sim->pc + insn->size;
+
+	sim->cycles += insn->cycles;
+	switch (insn->op) {
+	case MNEMONIC_NOP:
+	case MNEMONIC_WDR:
+	case MNEMONIC_SPM:
+	case MNEMONIC_ESPM:
+		break;
+	case MNEMONIC_SLEEP:
+		sim->pc = next;
+		return (STOP_SLEEP);
+	case MNEMONIC_BREAK:
+		sim->pc = next;
+		return (STOP_BREAK);
+	case MNEMONIC_BSET:
+		IO(sim, SIM_SREG) |= 1 << insn->b;
+		break;
+	case MNEMONIC_BCLR:
+		IO(sim, SIM_SREG) &= ~(1 << insn->b);
+		break;
+	case MNEMONIC_BRBS:
+	case MNEMONIC_BRBC:
+		if (((sreg >> insn->b) & 1) == (insn->op == MNEMONIC_BRBS)) {
+			next = sim->pc + 1 + insn->k;
+			sim->cycles += insn->taken;
+		}
+		break;
+	case MNEMONIC_RCALL:
+		push_pc(sim, next);
+		/* fall through */
+	case MNEMONIC_RJMP:
+		next = sim->pc + 1 + insn->k;
+		break;
+	case MNEMONIC_CALL:
+		push_pc(sim, next);
+		/* fall through */
+	case MNEMONIC_JMP:
+		next = insn->k;
+		break;
+	case MNEMONIC_ICALL:
+		push_pc(sim, next);
+		/* fall through */
+	case MNEMONIC_IJMP:
+		next = REG_PAIR(sim, 30);
+		break;
+	case MNEMONIC_EICALL:
+		push_pc(sim, next);
+		/* fall through */
+	case MNEMONIC_EIJMP:
+		next = ((long)IO(sim, SIM_EIND) << 16) | REG_PAIR(sim, 30);
+		break;
+	case MNEMONIC_RETI:
+		IO(sim, SIM_SREG) |= SREG_I;
+		/* fall through */
+	case MNEMONIC_RET:
+		next = pop_pc(sim);
+		break;
+	case MNEMONIC_ADD:
+		reg[insn->d] = add8(sim, d, r, 0);
+		break;
+	case MNEMONIC_ADC:
+		reg[insn->d] = add8(sim, d, r, c);
+		break;
+	case MNEMONIC_SUB:
+		reg[insn->d] = sub8(sim, d, r, 0, False);
+		break;
+	case MNEMONIC_SBC:
+		reg[insn->d] = sub8(sim, d, r, c, True);
+		break;
+	case MNEMONIC_SUBI:
+		reg[insn->d] = sub8(sim, d, insn->k, 0, False);
+		break;
+	case MNEMONIC_SBCI:
+		reg[insn->d] = sub8(sim, d, insn->k, c, True);
+		break;
+	case MNEMONIC_CP:
+		sub8(sim, d, r, 0, False);
+		break;
+	case MNEMONIC_CPC:
+		sub8(sim, d, r, c, True);
+		break;
+	case MNEMONIC_CPI:
+		sub8(sim, d, insn->k, 0, False);
+		break;
+	case MNEMONIC_AND:
+		reg[insn->d] = logic(sim, d & r);
+		break;
+	case MNEMONIC_ANDI:
+		reg[insn->d] = logic(sim, d & insn->k);
+		break;
+	case MNEMONIC_OR:
+		reg[insn->d] = logic(sim, d | r);
+		break;
+	case MNEMONIC_ORI:
+		reg[insn->d] = logic(sim, d | insn->k);
+		break;
+	case MNEMONIC_EOR:
+		reg[insn->d] = logic(sim, d ^ r);
+		break;
+	case MNEMONIC_COM:
+		reg[insn->d] = logic(sim, ~d);
+		IO(sim, SIM_SREG) |= SREG_C;
+		break;
+	case MNEMONIC_NEG:
+		reg[insn->d] = sub8(sim, 0, d, 0, False);
+		break;
+	case MNEMONIC_INC:
+		reg[insn->d] = (d + 1) & 0xff;
+		result_flags(sim, SREG_V, reg[insn->d], (reg[insn->d] == 0x80) ? SREG_V : 0);
+		break;
+	case MNEMONIC_DEC:
+		reg[insn->d] = (d - 1) & 0xff;
+		result_flags(sim, SREG_V, reg[insn->d], (reg[insn->d] == 0x7f) ? SREG_V : 0);
+		break;
+	case MNEMONIC_LSR:
+		reg[insn->d] = shift_right(sim, d >> 1, d & 1);
+		break;
+	case MNEMONIC_ROR:
+		reg[insn->d] = shift_right(sim, (d >> 1) | (c << 7), d & 1);
+		break;
+	case MNEMONIC_ASR:
+		reg[insn->d] = shift_right(sim, (d >> 1) | (d & 0x80), d & 1);
+		break;
+	case MNEMONIC_SWAP:
+		reg[insn->d] = ((d << 4) | (d >> 4)) & 0xff;
+		break;
+	case MNEMONIC_MOV:
+		reg[insn->d] = r;
+		break;
+	case MNEMONIC_MOVW:
+		reg[insn->d] = r;
+		reg[insn->d + 1] = reg[insn->r + 1];
+		break;
+	case MNEMONIC_LDI:
+		reg[insn->d] = insn->k;
+		break;
+	case MNEMONIC_MUL:
+		multiply(sim, (long)d * r, False);
+		break;
+	case MNEMONIC_MULS:
+		multiply(sim, (long)(signed char)d * (signed char)r, False);
+		break;
+	case MNEMONIC_MULSU:
+		multiply(sim, (long)(signed char)d * r, False);
+		break;
+	case MNEMONIC_FMUL:
+		multiply(sim, (long)d * r, True);
+		break;
+	case MNEMONIC_FMULS:
+		multiply(sim, (long)(signed char)d * (signed char)r, True);
+		break;
+	case MNEMONIC_FMULSU:
+		multiply(sim, (long)(signed char)d * r, True);
+		break;
+	case MNEMONIC_ADIW:
+		adiw(sim, insn->d, insn->k, False);
+		break;
+	case MNEMONIC_SBIW:
+		adiw(sim, insn->d, insn->k, True);
+		break;
+	case MNEMONIC_CPSE:
+		skip = (d == r);
+		break;
+	case MNEMONIC_SBRC:
+		skip = !((d >> insn->b) & 1);
+		break;
+	case MNEMONIC_SBRS:
+		skip = (d >> insn->b) & 1;
+		break;
+	case MNEMONIC_SBIC:
+		skip = !((IO(sim, insn->k) >> insn->b) & 1);
+		break;
+	case MNEMONIC_SBIS:
+		skip = (IO(sim, insn->k) >> insn->b) & 1;
+		break;
+	case MNEMONIC_SBI:
+		IO(sim, insn->k) |= 1 << insn->b;
+		break;
+	case MNEMONIC_CBI:
+		IO(sim, insn->k) &= ~(1 << insn->b);
+		break;
+	case MNEMONIC_BST:
+		set_flags(sim, SREG_T, ((d >> insn->b) & 1) ? SREG_T : 0);
+		break;
+	case MNEMONIC_BLD:
+		if (sreg & SREG_T)
+			reg[insn->d] = d | (1 << insn->b);
+		else
+			reg[insn->d] = d & ~(1 << insn->b);
+		break;
+	case MNEMONIC_IN:
+		reg[insn->d] = IO(sim, insn->k);
+		break;
+	case MNEMONIC_OUT:
+		IO(sim, insn->k) = d;
+		break;
+	case MNEMONIC_PUSH:
+		push(sim, d);
+		break;
+	case MNEMONIC_POP:
+		reg[insn->d] = pop(sim);
+		break;
+	case MNEMONIC_LD_X:
+	case MNEMONIC_LD_XP:
+	case MNEMONIC_LD_MX:
+		reg[insn->d] = read_data(sim, pointer(sim, 26, POINTER_UPDATE(insn->op, MNEMONIC_LD_X)));
+		break;
+	case MNEMONIC_LD_Y:
+	case MNEMONIC_LD_YP:
+	case MNEMONIC_LD_MY:
+		reg[insn->d] = read_data(sim, pointer(sim, 28, POINTER_UPDATE(insn->op, MNEMONIC_LD_Y)));
+		break;
+	case MNEMONIC_LD_Z:
+	case MNEMONIC_LD_ZP:
+	case MNEMONIC_LD_MZ:
+		reg[insn->d] = read_data(sim, pointer(sim, 30, POINTER_UPDATE(insn->op, MNEMONIC_LD_Z)));
+		break;
+	case MNEMONIC_ST_X:
+	case MNEMONIC_ST_XP:
+	case MNEMONIC_ST_MX:
+		write_data(sim, pointer(sim, 26, POINTER_UPDATE(insn->op, MNEMONIC_ST_X)), d);
+		break;
+	case MNEMONIC_ST_Y:
+	case MNEMONIC_ST_YP:
+	case MNEMONIC_ST_MY:
+		write_data(sim, pointer(sim, 28, POINTER_UPDATE(insn->op, MNEMONIC_ST_Y)), d);
+		break;
+	case MNEMONIC_ST_Z:
+	case MNEMONIC_ST_ZP:
+	case MNEMONIC_ST_MZ:
+		write_data(sim, pointer(sim, 30, POINTER_UPDATE(insn->op, MNEMONIC_ST_Z)), d);
+		break;
+	case MNEMONIC_LDD_Y:
+		reg[insn->d] = read_data(sim, REG_PAIR(sim, 28) + insn->k);
+		break;
+	case MNEMONIC_LDD_Z:
+		reg[insn->d] = read_data(sim, REG_PAIR(sim, 30) + insn->k);
+		break;
+	case MNEMONIC_STD_Y:
+		write_data(sim, REG_PAIR(sim, 28) + insn->k, d);
+		break;
+	case MNEMONIC_STD_Z:
+		write_data(sim, REG_PAIR(sim, 30) + insn->k, d);
+		break;
+	case MNEMONIC_LDS:
+	case MNEMONIC_LDS_AVR8L:
+		reg[insn->d] = read_data(sim, insn->k);
+		break;
+	case MNEMONIC_STS:
+	case MNEMONIC_STS_AVR8L:
+		write_data(sim, insn->k, d);
+		break;
+	case MNEMONIC_LPM:
+		reg[0] = read_flash(sim, REG_PAIR(sim, 30));
+		break;
+	case MNEMONIC_LPM_Z:
+	case MNEMONIC_LPM_ZP:
+		reg[insn->d] = read_flash(sim, pointer(sim, 30, insn->op == MNEMONIC_LPM_ZP));
+		break;
+	case MNEMONIC_ELPM:
+		reg[0] = read_flash(sim, elpm_pointer(sim, False));
+		break;
+	case MNEMONIC_ELPM_Z:
+	case MNEMONIC_ELPM_ZP:
+		reg[insn->d] = read_flash(sim, elpm_pointer(sim, insn->op == MNEMONIC_ELPM_ZP));
+		break;
+	default:
+		sim->cycles -= insn->cycles;
+		return (STOP_INVALID);
+	}
+	if (skip && (next < sim->flash_size)) {
+		skipped = get_decoded(sim, next);
+		sim->cycles += skipped->size;
+		next += skipped->size;
+	}
+	sim->pc = next;
+	return (STOP_NONE);
+}
+
+/* Runs until something stops it; steps < 0 means no limit */
+static int
+run(struct sim *sim, long steps)
+{
+	struct decoded *insn;
+	int stop;
+	int first = True;
+
+	for (;; first = False) {
+		if (sim->pc == sim->sentinel)
+			return (STOP_RETURN);
+		if ((sim->pc < 0) || (sim->pc >= sim->flash_size))
+			return (STOP_OUTSIDE);
+		if (steps-- == 0)
+			return (STOP_STEPS);
+		if (sim->cycles >= sim->max_cycles)
+			return (STOP_MAX_CYCLES);
+		insn = get_decoded(sim, sim->pc);
+		if (!first && insn->breakpoint)
+			return (STOP_BREAKPOINT);
+		if (!first && (sim->pc == sim->until))
+			return (STOP_UNTIL);
+		if (sim->trace)
+			printf("%06lx %-6s %10lu\n", sim->pc,
+			       (insn->mnemonic < 0) ? "?" : get_mnemonic_name(insn->mnemonic), sim->cycles);
+		stop = execute(sim, insn);
+		if (stop != STOP_NONE)
+			return (stop);
+	}
+}
+
+static void
+reset(struct sim *sim)
+{
+	memset(sim->reg, 0, sizeof(sim->reg));
+	memset(sim->data, 0, SIM_DATA_SIZE);
+	set_sp(sim, sim->ramend);
+	sim->pc = 0;
+	sim->cycles = 0;
+}
+
+/* Label at or before a flash address, "name+0x12" */
+static void
+describe_address(struct sim *sim, long addr, char *buff)
+{
+	struct label *label, *best = NULL;
+
+	for (label = sim->pi->first_label; label; label = label->next)
+		if ((label->segment == sim->pi->cseg) && (label->value <= addr)
+		        && (!best || (label->value > best->value)))
+			best = label;
+	if (!best)
+		sprintf(buff, "0x%06lx", addr);
+	else if (best->value == addr)
+		sprintf(buff, "0x%06lx %s", addr, best->name);
+	else
+		sprintf(buff, "0x%06lx %s+0x%lx", addr, best->name, addr - best->value);
+}
+
+static void
+sim_error(struct sim *sim, const char *fmt, const char *arg)
+{
+	if (sim->script_name)
+		fprintf(stderr, "%s(%d) : ", sim->script_name, sim->line_number);
+	fprintf(stderr, "Error   : ");
+	fprintf(stderr, fmt, arg);
+	fprintf(stderr, "\n");
+	sim->failures++;
+}
+
+static void
+print_stop(struct sim *sim, int stop)
+{
+	char buff[SIM_LINE_LENGTH];
+
+	describe_address(sim, sim->pc, buff);
+	printf("Stopped at %s after %lu cycles: %s\n", buff, sim->cycles, stop_reason[stop]);
+}
+
+static void
+print_regs(struct sim *sim)
+{
+	int i;
+	int sreg = IO(sim, SIM_SREG);
+
+	for (i = 0; i < 32; i++)
+		printf("r%-2d=%02x%c", i, sim->reg[i], ((i % 8) == 7) ? '\n' : ' ');
+	printf("X=%04x Y=%04x Z=%04x SP=%04lx SREG=", REG_PAIR(sim, 26), REG_PAIR(sim, 28),
+	       REG_PAIR(sim, 30), get_sp(sim));
+	for (i = 7; i >= 0; i--)
+		putchar(((sreg >> i) & 1) ? "CZNVSHTI"[i] : '-');
+	printf(" PC=%06lx cycles=%lu\n", sim->pc, sim->cycles);
+}
+
+/* Of EEPROM, or of the data space if mem is NULL */
+static void
+print_memory(struct sim *sim, const unsigned char *mem, long addr, long length, long size)
+{
+	long i;
+
+	for (i = 0; (i < length) && (addr + i < size); i++) {
+		if ((i % 16) == 0)
+			printf("%s%04lx:", (i == 0) ? "" : "\n", addr + i);
+		printf(" %02x", mem ? mem[addr + i] : read_data(sim, addr + i));
+	}
+	printf("\n");
+}
+
+static int
+eval(struct sim *sim, char *expr, long *value)
+{
+	int i;
+
+	while (isspace((unsigned char)*expr))
+		expr++;
+	if ((*expr == '\0') || !get_expr(sim->pi, expr, &i)) {
+		sim_error(sim, "Invalid expression: %s", expr);
+		return (False);
+	}
+	*value = i;
+	return (True);
+}
+
+/* Location of set and expect: a register, X, Y, Z, SREG, SP, PC, cycles or
+ * a data address in brackets */
+static int
+get_location(struct sim *sim, char *name, int *kind, long *addr)
+{
+	static const char *names[] = {"sreg", "sp", "pc", "cycles", "x", "y", "z", NULL};
+	static const int kinds[] = {LOC_SREG, LOC_SP, LOC_PC, LOC_CYCLES, LOC_PAIR, LOC_PAIR, LOC_PAIR};
+	struct def *def;
+	char *end;
+	int i;
+
+	while (isspace((unsigned char)*name))
+		name++;
+	for (end = name + strlen(name); (end > name) && isspace((unsigned char)end[-1]); end--)
+		;
+	*end = '\0';
+	if (*name == '[') {
+		end = strrchr(name, ']');
+		if (end)
+			*end = '\0';
+		*kind = LOC_MEM;
+		return (eval(sim, name + 1, addr));
+	}
+	for (i = 0; names[i]; i++)
+		if (!nocase_strcmp(name, names[i])) {
+			*kind = kinds[i];
+			*addr = 26 + (i - 4) * 2;
+			return (True);
+		}
+	*kind = LOC_REG;
+	def = search_def(sim->pi, name);
+	if (def) {
+		*addr = def->reg;
+		return (True);
+	}
+	if ((tolower((unsigned char)name[0]) == 'r') && isdigit((unsigned char)name[1])) {
+		*addr = strtol(name + 1, &end, 10);
+		if ((*end == '\0') && (*addr < 32))
+			return (True);
+	}
+	sim_error(sim, "Unknown location: %s", name);
+	return (False);
+}
+
+static unsigned long
+get_value(struct sim *sim, int kind, long addr)
+{
+	switch (kind) {
+	case LOC_REG:
+		return (sim->reg[addr]);
+	case LOC_PAIR:
+		return (REG_PAIR(sim, addr));
+	case LOC_SREG:
+		return (IO(sim, SIM_SREG));
+	case LOC_SP:
+		return (get_sp(sim));
+	case LOC_PC:
+		return (sim->pc);
+	case LOC_CYCLES:
+		return (sim->cycles);
+	}
+	return (read_data(sim, addr));
+}
+
+static void
+set_value(struct sim *sim, int kind, long addr, long value)
+{
+	switch (kind) {
+	case LOC_REG:
+		sim->reg[addr] = value & 0xff;
+		break;
+	case LOC_PAIR:
+		sim->reg[addr] = value & 0xff;
+		sim->reg[addr + 1] = (value >> 8) & 0xff;
+		break;
+	case LOC_SREG:
+		IO(sim, SIM_SREG) = value & 0xff;
+		break;
+	case LOC_SP:
+		set_sp(sim, value);
+		break;
+	case LOC_PC:
+		sim->pc = value;
+		break;
+	case LOC_CYCLES:
+		sim->cycles = value;
+		break;
+	default:
+		write_data(sim, addr, value & 0xff);
+	}
+}
+
+static unsigned long
+location_mask(int kind)
+{
+	switch (kind) {
+	case LOC_PAIR:
+	case LOC_SP:
+		return (0xffff);
+	case LOC_PC:
+	case LOC_CYCLES:
+		return (~0UL);
+	}
+	return (0xff);
+}
+
+/* Runs a subroutine until it returns */
+static int
+call(struct sim *sim, long addr)
+{
+	long sp = get_sp(sim);
+	long pc = sim->pc;
+	int stop;
+
+	sim->sentinel = (1L << (sim->pc_bytes * 8)) - 1;
+	push_pc(sim, sim->sentinel);
+	sim->pc = addr;
+	stop = run(sim, -1);
+	if (stop == STOP_RETURN)
+		sim->pc = pc;
+	set_sp(sim, sp);
+	sim->sentinel = -1;
+	return (stop);
+}
+
+static void
+do_command(struct sim *sim, char *line)
+{
+	char *command = line;
+	char *operand, *value;
+	char buff[SIM_LINE_LENGTH];
+	unsigned long start, actual;
+	long addr, length, expected;
+	int kind, stop;
+
+	while (isspace((unsigned char)*command))
+		command++;
+	for (operand = command; isalnum((unsigned char)*operand) || (*operand == '_'); operand++)
+		;
+	if (operand == command)
+		return;
+	if (*operand != '\0')
+		*operand++ = '\0';
+	value = strchr(operand, ',');
+	if (value)
+		*value++ = '\0';
+
+	if (!nocase_strcmp(command, "break")) {
+		if (eval(sim, operand, &addr) && (addr >= 0) && (addr < sim->flash_size) && grow_code(sim, addr))
+			sim->code[addr].breakpoint = True;
+	} else if (!nocase_strcmp(command, "run")) {
+		print_stop(sim, run(sim, -1));
+	} else if (!nocase_strcmp(command, "until")) {
+		if (eval(sim, operand, &sim->until)) {
+			stop = run(sim, -1);
+			if (stop != STOP_UNTIL)
+				sim_error(sim, "Address not reached: %s", stop_reason[stop]);
+			print_stop(sim, stop);
+			sim->until = -1;
+		}
+	} else if (!nocase_strcmp(command, "step")) {
+		length = 1;
+		if ((*operand == '\0') || eval(sim, operand, &length))
+			print_stop(sim, run(sim, length));
+	} else if (!nocase_strcmp(command, "call")) {
+		if (eval(sim, operand, &addr)) {
+			start = sim->cycles;
+			stop = call(sim, addr);
+			describe_address(sim, addr, buff);
+			if (stop == STOP_RETURN)
+				printf("Call %s returned after %lu cycles\n", buff, sim->cycles - start);
+			else {
+				sim_error(sim, "Call did not return: %s", stop_reason[stop]);
+				print_stop(sim, stop);
+			}
+		}
+	} else if (!nocase_strcmp(command, "set") || !nocase_strcmp(command, "expect")) {
+		if (!value)
+			sim_error(sim, "%s needs a location and a value", command);
+		else if (get_location(sim, operand, &kind, &addr) && eval(sim, value, &expected)) {
+			if (tolower((unsigned char)command[0]) == 's')
+				set_value(sim, kind, addr, expected);
+			else {
+				sim->expect_count++;
+				actual = get_value(sim, kind, addr);
+				if (actual != ((unsigned long)expected & location_mask(kind))) {
+					snprintf(buff, sizeof(buff), "%s is 0x%lx, expected 0x%lx",
+					         operand, actual, (unsigned long)expected & location_mask(kind));
+					sim_error(sim, "%s", buff);
+				}
+			}
+		}
+	} else if (!nocase_strcmp(command, "regs")) {
+		print_regs(sim);
+	} else if (!nocase_strcmp(command, "mem") || !nocase_strcmp(command, "eeprom")) {
+		length = 16;
+		if (eval(sim, operand, &addr) && (!value || eval(sim, value, &length))) {
+			if (tolower((unsigned char)command[0]) == 'm')
+				print_memory(sim, NULL, addr, length, SIM_DATA_SIZE);
+			else
+				print_memory(sim, sim->pi->eeprom_image, addr, length, sim->pi->device->eeprom_size);
+		}
+	} else if (!nocase_strcmp(command, "cycles")) {
+		printf("%lu cycles\n", sim->cycles);
+	} else if (!nocase_strcmp(command, "reset")) {
+		reset(sim);
+	} else if (!nocase_strcmp(command, "print")) {
+		if (eval(sim, operand, &addr))
+			printf("%s= %ld (0x%lx)\n", operand, addr, addr);
+	} else
+		sim_error(sim, "Unknown command: %s", command);
+}
+
+static int
+run_script(struct sim *sim, const char *filename)
+{
+	FILE *fp;
+	char line[SIM_LINE_LENGTH];
+	char *comment;
+
+	fp = fopen(filename, "r");
+	if (!fp) {
+		fprintf(stderr, "Error: Cannot open script file %s\n", filename);
+		return (False);
+	}
+	sim->script_name = filename;
+	while (fgets(line, sizeof(line), fp)) {
+		sim->line_number++;
+		comment = strpbrk(line, ";#\r\n");
+		if (comment)
+			*comment = '\0';
+		do_command(sim, line);
+	}
+	fclose(fp);
+	return (True);
+}
+
+static int
+simulate(struct prog_info *pi, const char *script)
+{
+	struct sim sim;
+	int ok = True;
+
+	memset(&sim, 0, sizeof(sim));
+	sim.pi = pi;
+	sim.flash_size = pi->device->flash_size;
+	sim.code_size = pi->flash_image_size;
+	sim.code = calloc(sim.code_size + 1, sizeof(struct decoded));
+	sim.data = malloc(SIM_DATA_SIZE);
+	if (!sim.code || !sim.data) {
+		print_msg(pi, MSGTYPE_OUT_OF_MEM, NULL);
+		free(sim.code);
+		free(sim.data);
+		return (False);
+	}
+	if (get_core(pi) == CORE_CLASSIC) {
+		sim.io_base = 0x20;
+		sim.regs_mapped = True;
+	}
+	sim.pc_bytes = ((get_core(pi) != CORE_AVR8L) && (sim.flash_size > 65536)) ? 3 : 2;
+	sim.ramend = pi->device->ram_start + pi->device->ram_size - 1;
+	if (sim.ramend >= SIM_DATA_SIZE)
+		sim.ramend = SIM_DATA_SIZE - 1;
+	sim.max_cycles = GET_ARG_I(pi->args, SIM_ARG_MAX_CYCLES);
+	sim.trace = GET_ARG_I(pi->args, SIM_ARG_TRACE);
+	sim.until = -1;
+	sim.sentinel = -1;
+	reset(&sim);
+
+	if (script) {
+		ok = run_script(&sim, script);
+		if (sim.expect_count)
+			printf("%d of %d expectations met\n", sim.expect_count - sim.failures, sim.expect_count);
+	} else {
+		print_stop(&sim, run(&sim, -1));
+		print_regs(&sim);
+	}
+	free(sim.code);
+	free(sim.data);
+	return (ok && (sim.failures == 0));
+}
+
+int
+main(int argc, const char *argv[])
+{
+	struct prog_info *pi;
+	struct args *args;
+	int ok = False;
+
+	args = alloc_args(SIM_ARG_COUNT);
+	if (!args)
+		exit(EXIT_FAILURE);
+	define_args(args);
+	define_arg(args, SIM_ARG_SCRIPT,         ARGTYPE_STRING,  's', "script",      NULL, NULL);
+	define_arg_int(args, SIM_ARG_MAX_CYCLES, ARGTYPE_NUMERIC,  0,  "max_cycles",  10000000, NULL);
+	define_arg(args, SIM_ARG_TRACE,          ARGTYPE_BOOLEAN,  0,  "trace",       NULL, NULL);
+
+	if (read_args(args, argc, argv) && !GET_ARG_I(args, ARG_HELP) && args->first_data) {
+		pi = init_prog_info(&PROG_INFO, args);
+		if (pi) {
+			pi->in_memory = True;
+			get_rootpath(pi, args);
+			if (assemble(pi) == 0)
+				ok = simulate(pi, GET_ARG_P(args, SIM_ARG_SCRIPT));
+			free_pi(pi);
+		}
+	} else
+		printf("%s", usage);
+	free_args(args);
+	exit(ok ? EXIT_SUCCESS : EXIT_FAILURE);
+	return (0);
+}
+
+/* end of sim.c */
@@ -42,6 +42,17 @@ nocase_strcmp(const char *s, const char *t)
 	return (tolower(s[i]) - tolower(t[i]));
 }
 
+/* Hash of a string that doesn't depend on case (FNV-1a) */
+unsigned int
+nocase_hash(const char *s)
+{
+	unsigned int hash = 2166136261u;
+
+	for (; *s != '\0'; s++)
+		hash = (hash ^ (unsigned char)tolower((unsigned char)*s)) * 16777619u;
+	return (hash);
+}
+
 /* Case insensetive strncmp() */
 int
 nocase_strncmp(char *s, char *t, int n)
@@ -157,6 +168,22 @@ my_strupr(char *in)
 	return (in);
 }
 
+/* The bytes as upper case hex digits, without printf. buf holds
+ * 2 * count + 1 characters. */
+char *
+hex_string(char *buf, const unsigned char *data, int count)
+{
+	static const char digits[] = "0123456789ABCDEF";
+	char *ptr = buf;
+
+	while (count-- > 0) {
+		*ptr++ = digits[*data >> 4];
+		*ptr++ = digits[*data++ & 0x0f];
+	}
+	*ptr = '\0';
+	return (buf);
+}
+
 static int
 snprint(char **buf, size_t *limit, const char *const str)
 {
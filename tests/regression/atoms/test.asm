@@ -0,0 +1,20 @@
+; Symbols, macros and directives are found whatever their case
+.Device ATmega8
+.EQU Count = 3
+.set Step = 1
+.DEF Temp = r16
+
+.Macro Wait
+	LDI temp, @0
+Loop:
+	SUBI TEMP, STEP
+	brne loop
+.ENDMACRO
+
+.cseg
+.ORG 0
+	rjmp START
+start:
+	wait count
+	WAIT COUNT + 1
+	rjmp Start
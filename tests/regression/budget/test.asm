@@ -0,0 +1,19 @@
+; Budgets per segment, label range and include file
+.device ATtiny13A
+.dseg
+buffer:	.byte 16
+.cseg
+.org 0
+	rjmp	main
+main:
+	ldi	r16, 1
+	rcall	boot
+	rjmp	main
+boot:
+	nop
+	nop
+	ret
+boot_end:
+.include "font.inc"
+; After the last label of font.inc, but not in it
+	.dw 0
@@ -0,0 +1,6 @@
+; Assembled several times with --cache
+.device ATmega8
+.include "value.inc"
+
+	ldi r16, VALUE
+	rjmp PC
@@ -0,0 +1,21 @@
+; clobbers() of a macro label is that of the label in each expansion
+.device ATmega8
+
+.macro handler
+.if clobbers(body) & (1 << 16)
+	push	r16
+.endif
+.if clobbers(body) & (1 << 17)
+	push	r17
+.endif
+	rcall	body
+	reti
+body:
+	ldi	r@0, 1
+	ret
+.endm
+
+.cseg
+.org 0
+	handler 16
+	handler 17
@@ -0,0 +1,13 @@
+; A routine whose registers depend on its own clobbers() never settles
+.device ATmega8
+.cseg
+	rcall	flip
+forever:
+	rjmp	forever
+flip:
+.if clobbers(flip) & (1 << 16)
+	nop
+.else
+	ldi	r16, 1
+.endif
+	ret
@@ -0,0 +1,72 @@
+; clobbers() saves exactly the registers an interrupt routine writes
+.device ATmega8
+
+.macro save_reg
+.if clobbers(@0) & (1 << @1)
+	push	r@1
+.endif
+.endm
+
+.macro restore_reg
+.if clobbers(@0) & (1 << @1)
+	pop	r@1
+.endif
+.endm
+
+.macro save
+	save_reg @0, 0
+	save_reg @0, 1
+	save_reg @0, 16
+	save_reg @0, 17
+	save_reg @0, 18
+	save_reg @0, 30
+	save_reg @0, 31
+.endm
+
+.macro restore
+	restore_reg @0, 31
+	restore_reg @0, 30
+	restore_reg @0, 18
+	restore_reg @0, 17
+	restore_reg @0, 16
+	restore_reg @0, 1
+	restore_reg @0, 0
+.endm
+
+.cseg
+.org 0
+	rjmp	reset
+	rjmp	int0_isr
+	rjmp	int1_isr
+reset:
+	ldi	r16, 0x5f
+	out	0x3d, r16
+	ldi	r16, 0x04
+	out	0x3e, r16
+	sei
+forever:
+	rjmp	forever
+
+int0_isr:
+	save	int0_body
+	rcall	int0_body
+	restore	int0_body
+	reti
+int0_body:
+	ldi	r16, 1
+	rcall	scale
+	ret
+scale:
+	mul	r16, r16
+	movw	r30, r0
+	ret
+
+int1_isr:
+	save	int1_body
+	rcall	int1_body
+	restore	int1_body
+	reti
+int1_body:
+	in	r17, 0x10
+	lpm	r18, Z+
+	ret
@@ -0,0 +1,6 @@
+	rjmp	start
+.org 0x300
+start:	ldi r16, 1
+	rjmp	start
+.org 0x1234
+	.dw 0x5678
@@ -0,0 +1,43 @@
+.device ATmega8
+.stabs "/home/user/project/",100,0,0,Ltext0
+.stabs "a_rather_long_source_name.c",100,0,0,Ltext0
+.stabs "int:t1=r1;-32768;32767;",128,0,0,0
+.stabs "char:t2=r2;0;127;",128,0,0,0
+.stabs "unsigned int:t3=r3;0;65535;",128,0,0,0
+.stabs "pint:t20=*1",128,0,0,0
+.stabs "buf:t21=ar1;0;9;2",128,0,0,0
+.stabs "point:T22=s4x_coordinate:1,0,16;y_coordinate:1,16,16;;",128,0,0,0
+.stabs "colour:T23=ered:0,green:1,blue:2,;",128,0,0,0
+.stabs "counter:G1",32,0,0,0
+.stabs "table:G21=ar1;0;3;2",32,0,0,0
+.stabs "main_function:F1",36,0,0,_main
+.stabs "x:P1",64,0,0,16
+.stabs "local_value:1",128,0,0,4
+.stabs "st:S1",38,0,0,_st
+.stabs "helper:F1",36,0,0,_helper
+.stabs "x_coordinate:1",128,0,0,6
+.stabs "linktag:T24=s6next_item:1,0,16;\\",128,0,0,0
+.stabs "last_item:1,16,16;c:2,32,8;;",128,0,0,0
+.dseg
+_counter: .byte 2
+_table:	.byte 4
+.cseg
+Ltext0:
+_main:
+L1:	ldi r16, 1
+L2:	ldi r17, 2
+	.stabn 68,0,10,L1-_main
+	.stabn 192,0,1,L2-_main
+	.stabn 68,0,11,L2-_main
+L3:	rcall _helper
+	.stabn 68,0,12,L3-_main
+	.stabn 224,0,1,L3-_main
+L4:	ret
+	.stabn 224,0,0,L4-_main
+_st:	.dw 0
+_helper:
+L5:	nop
+	.stabn 68,0,20,L5-_helper
+L6:	ret
+	.stabn 68,0,21,L6-_helper
+	.stabn 224,0,0,L6-_helper
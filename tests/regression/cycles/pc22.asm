@@ -0,0 +1,7 @@
+; A 22 bit PC adds a cycle to calls and returns
+.device ATmega2560
+.cseg
+.org 0
+	icall
+	eicall
+	ret
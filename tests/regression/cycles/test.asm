@@ -0,0 +1,22 @@
+; Cycle counts of a delay loop and of a skip over a two word instruction
+.device ATmega8
+.cseg
+.org 0
+	rjmp reset
+reset:
+	ldi r16, 10
+	rcall delay
+	sbrs r16, 2
+	lds r17, 0x100
+forever:
+	rjmp forever
+delay:
+	push r16
+delay_loop:
+	dec r16
+	brne delay_loop
+	pop r16
+	ret
+delay_end:
+.cycles delay, delay_end
+.cycles reset, forever
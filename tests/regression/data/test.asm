@@ -0,0 +1,15 @@
+; Test .DB and .DW lines written as one span each
+.device ATmega2560
+
+	jmp start
+text:	.db "Hello", 0
+words:	.dw 0x1234, text, -1
+
+; A line crossing 64 KB starts a new hex segment
+.org 0x7ffc
+cross:	.db "0123456789abcdef"
+start:	rjmp start
+
+.eseg
+ee:	.db "EEPROM data over more than one hex line", 0
+ee_w:	.dw 0xbeef, 0xcafe
@@ -0,0 +1,2 @@
+.device ATmega8
+.def r5 = r16
@@ -0,0 +1,10 @@
+.device ATmega8
+.def temp = r16
+.def Count = r17
+.def other = r16	; r16 already has an alias, so this is ignored
+	ldi TEMP, 1
+	mov count, temp
+.def count = r18	; later uses get the new register
+	mov COUNT, r16
+	mov r1, r0
+	movw r1:r0, r25:r24
@@ -0,0 +1,7 @@
+; -MD lists every included file once
+.include "inc/defs.inc"
+.include "inc/defs.inc"
+.include "macros.inc"
+
+	ldi r16, VALUE
+	delay1
@@ -0,0 +1,20 @@
+; Device symbols are answered on demand, in any case
+.device ATmega8
+
+.if __ATmega8__ != __DEVICE__
+.error "__ATmega8__ is not the current device"
+.endif
+.if __atmega8__ != __ATMEGA8__
+.error "Device symbols depend on case"
+.endif
+.if __DEFAULT__ != 0
+.error "__DEFAULT__ is not 0"
+.endif
+.ifndef __AT94K__
+.error "__AT94K__ is not defined"
+.endif
+.ifdef __ATmega9__
+.error "__ATmega9__ is defined"
+.endif
+
+	ldi r16, __ATtiny13__ - __ATtiny13__
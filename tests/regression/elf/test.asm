@@ -0,0 +1,33 @@
+.device ATmega328P
+.equ	BAUD = 9600
+.set	count = 3
+.dseg
+buffer:	.byte 16
+.cseg
+.org 0
+	rjmp	reset
+.org 0x34
+.global reset
+reset:
+	ldi	r16, low(BAUD)
+	ldi	r17, count
+loop:
+	dec	r17
+	brne	loop
+	rjmp	reset
+.macro	pause
+	nop
+	nop
+.endm
+wait:
+	pause
+	ret
+.macro	pause2
+	pause
+	pause
+.endm
+wait2:
+	pause2
+	ret
+.eseg
+table:	.db 1, 2, 3
@@ -0,0 +1,4 @@
+.device ATmega8
+.equ UNUSED = not_defined_anywhere
+.equ USED = also_missing + 1
+	ldi r16, USED
@@ -0,0 +1,4 @@
+.device ATmega8
+.equ ONE = TWO
+.equ TWO = ONE + 1
+	ldi r16, ONE
@@ -0,0 +1,21 @@
+; .EQU constants are evaluated when first used
+.device ATmega8
+
+.equ FORWARD = LATER + 1	; may use a constant defined later
+.equ LATER = 2
+.set VAR = 1
+.equ CAPTURED = VAR		; uses .SET, so evaluated at once
+.set VAR = 2
+.equ ADDRESS = here * 2
+
+.if FORWARD != 3
+.error "FORWARD is not 3"
+.endif
+.if CAPTURED != 1
+.error "CAPTURED is not 1"
+.endif
+
+	ldi r16, FORWARD
+	nop
+here:
+	ldi r17, low(ADDRESS)
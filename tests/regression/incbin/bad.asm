@@ -0,0 +1,6 @@
+.device ATmega8
+	.incbin "missing.bin"
+	.incbin "table.bin", 20
+	.incbin "table.bin", 4, 16
+.dseg
+	.incbin "table.bin"
@@ -0,0 +1,12 @@
+; Test .INCBIN in the code and EEPROM segments
+.device ATmega8
+
+	ldi r30, low(part*2)
+	rjmp start
+table:	.incbin "table.bin"		; 19 bytes, padded to 10 words
+part:	.incbin "table.bin", 16, 3
+start:	rjmp start
+
+.eseg
+ee:	.incbin "eeprom.bin"		; Found with -I data
+ee_end:	.db 0x42
@@ -0,0 +1,16 @@
+.extern counter
+.global delay, table_len
+.equ table_len = 4
+
+.cseg
+delay:
+	lds r16, counter
+	dec r16
+	brne delay
+	ret
+
+.dseg
+buffer: .byte 8
+
+.eseg
+	.dw delay
@@ -0,0 +1,34 @@
+; Assembled alone with --module and linked with lib.asm, or included
+; by whole.asm. Both must give the same hex files.
+.device ATmega328P
+.extern delay, table_len
+.global main, counter
+
+.cseg
+.org 0
+	rjmp main
+.org 0x001		; INT0
+	reti
+main:
+	ldi r16, low(0x8ff)
+	out 0x3d, r16
+	ldi r16, high(0x8ff)
+	out 0x3e, r16
+	ldi r30, low(table*2)
+	ldi r31, high(table*2)
+	ldi r17, table_len
+	rcall delay
+	lds r18, counter
+	inc r18
+	sts counter, r18
+	brne main
+	jmp main
+table:
+	.db 1, 2, 3, 4
+	.dw main, delay
+
+.dseg
+counter: .byte 1
+
+.eseg
+	.db low(counter), high(counter)
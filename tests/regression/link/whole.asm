@@ -0,0 +1,2 @@
+.include "main.asm"
+.include "lib.asm"
@@ -0,0 +1,15 @@
+.device ATmega8
+.equ COUNT = 3
+.cseg
+.org 0
+	rjmp reset
+.org 0x13
+reset:
+	ldi r16, COUNT
+	rcall delay
+forever:
+	rjmp forever
+delay:
+	dec r16
+	brne delay
+	ret
@@ -0,0 +1,19 @@
+; Blocks are defined out of address order. Only the first and the last
+; block overlap, in words 0x0011-0x0012.
+.device ATmega8
+
+.org 0x0010
+	nop
+	nop
+	nop
+
+.org 0x0000
+	rjmp start
+
+.org 0x0100
+start:
+	rjmp start
+
+.org 0x0011
+	nop
+	nop
@@ -0,0 +1,18 @@
+; Blocks are defined out of address order and one is OVERLAP.
+.device ATmega8
+
+.org 0x0010
+	nop
+	nop
+	nop
+
+.org 0x0000
+	rjmp start
+
+.org 0x0100
+start:
+	rjmp start
+
+.overlap
+.org 0x0011
+	nop
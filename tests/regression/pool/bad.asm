@@ -0,0 +1,7 @@
+.device ATmega8
+.pool
+a:	.db 1, 2
+	nop
+b:	.dw a
+	.org 0x100
+.pool
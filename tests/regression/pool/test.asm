@@ -0,0 +1,19 @@
+; Test .POOL: identical data and suffixes of longer data are stored once
+.device ATmega8
+
+	ldi r30, low(world*2)
+	ldi r31, high(world*2)
+	ldi r16, low(ok2*2)
+	rjmp done
+
+.pool
+hello:	.db "Hello, world!", 0
+world:	.db "world!", 0		; Padded, so it can't start inside hello
+tail:	.db "o, world!", 0
+msg_ok:	.db "Ok"
+ok2:	.db "Ok"
+table:	.dw 0x1234, 0x5678
+last:	.dw 0x5678
+.endpool
+
+done:	rjmp done
@@ -0,0 +1,24 @@
+.device ATmega128
+.cseg
+.org 0
+	jmp reset
+	call sub
+reset:
+	ldi r16, 1
+	cpi r16, 1
+	breq far_away
+	brbs 1, far_away
+	rjmp far2
+loop:
+	dec r16
+	brne loop
+	call sub
+.org 0x100
+sub:
+	ret
+.org 0x1000
+far_away:
+	nop
+	rjmp reset
+far2:
+	ret
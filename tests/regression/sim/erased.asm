@@ -0,0 +1,3 @@
+; No .DEVICE: runs into the erased flash after the code
+	ldi r16, 1
+	nop
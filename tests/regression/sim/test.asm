@@ -0,0 +1,55 @@
+.device ATmega8
+
+.equ SPL = 0x3d
+.equ SPH = 0x3e
+.equ SREG = 0x3f
+.equ RAMEND = 0x045f
+
+.dseg
+buffer:	.byte 4
+
+.cseg
+.org 0
+	rjmp reset
+
+reset:
+	ldi r16, low(RAMEND)
+	out SPL, r16
+	ldi r16, high(RAMEND)
+	out SPH, r16
+	rcall fill
+	ldi r24, 10
+	rcall delay
+	ldi r16, 200
+	ldi r17, 100
+	add r16, r17
+	mov r20, r16
+	in r21, SREG
+	ldi r30, low(table * 2)
+	ldi r31, high(table * 2)
+	lpm r22, Z+
+	lpm r23, Z
+	ldi r18, 7
+	ldi r19, 9
+	mul r18, r19
+done:
+	sleep
+
+; r24 iterations, 3 * r24 + 3 cycles with the return
+delay:
+	dec r24
+	brne delay
+	ret
+
+fill:
+	ldi r26, low(buffer)
+	ldi r27, high(buffer)
+	ldi r16, 4
+fill_loop:
+	st X+, r16
+	dec r16
+	brne fill_loop
+	ret
+
+table:
+	.db 0x12, 0x34
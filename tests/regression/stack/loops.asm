@@ -0,0 +1,19 @@
+.device ATmega8
+.org 0
+	rjmp	reset
+reset:
+	rcall	grow
+	rcall	unbalanced
+	ldi	r30, low(reset)
+	ldi	r31, high(reset)
+	icall
+forever:
+	rjmp	forever
+grow:
+	push	r16
+	dec	r17
+	brne	grow
+	ret
+unbalanced:
+	push	r16
+	ret
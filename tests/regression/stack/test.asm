@@ -0,0 +1,44 @@
+.device ATtiny13A
+.dseg
+buffer:	.byte 60
+.cseg
+.org 0
+	rjmp	reset
+	rjmp	int0_isr
+reset:
+	ldi	r30, low(handler_a)
+	ldi	r31, high(handler_a)
+.calls handler_a, handler_b
+	icall
+	rcall	deep
+forever:
+	rjmp	forever
+handler_a:
+	push	r16
+	pop	r16
+	ret
+handler_b:
+	push	r16
+	push	r17
+	rcall	handler_a
+	pop	r17
+	pop	r16
+	ret
+deep:
+	push	r0
+	push	r1
+	push	r2
+	push	r3
+	push	r4
+	push	r5
+	pop	r5
+	pop	r4
+	pop	r3
+	pop	r2
+	pop	r1
+	pop	r0
+	ret
+int0_isr:
+	push	r16
+	pop	r16
+	reti
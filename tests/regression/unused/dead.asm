@@ -0,0 +1,6 @@
+.device ATmega328P
+.global unused_fn
+unused_fn:
+	nop
+	nop
+	ret
@@ -0,0 +1,5 @@
+.device ATmega328P
+.global hook
+.keep hook
+hook:
+	ret
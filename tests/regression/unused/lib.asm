@@ -0,0 +1,5 @@
+.device ATmega328P
+.global delay
+delay:
+	nop
+	ret
@@ -0,0 +1,6 @@
+.device ATmega328P
+.extern delay
+	rjmp	start
+start:
+	rcall	delay
+	rjmp	start
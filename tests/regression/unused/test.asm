@@ -0,0 +1,30 @@
+.device ATmega328P
+.org 0
+	rjmp	reset
+	rjmp	isr
+reset:
+	rcall	used
+	ldi	r30, low(table_a)
+	ldi	r31, high(table_a)
+	icall
+loop:
+	rjmp	loop
+used:
+	nop
+	brne	used_1
+	ret
+used_1:
+	ret
+isr:
+	reti
+old_routine:
+	nop
+	rcall	also_old
+	ret
+also_old:
+	ret
+.keep
+table_a:
+	ret
+table_b:
+	nop
@@ -0,0 +1,58 @@
+.device ATmega8
+
+.cseg
+.org 0
+	rjmp reset
+	rjmp int0_isr
+	reti
+
+reset:
+	ldi r16, 0x5f
+	out 0x3d, r16
+	rcall delay
+	rcall wait
+forever:
+	rcall poll
+	rjmp forever
+
+; 1 + 4 * (1 + 2) - 1 + 4 = 16 cycles
+delay:
+	ldi r16, 4
+delay_loop:
+.loopbound 4
+	dec r16
+	brne delay_loop
+	ret
+
+; Not bounded
+wait:
+	sbis 0x10, 0
+	rjmp wait
+	ret
+
+poll:
+	sbic 0x10, 1
+	rcall delay
+	ret
+
+int0_isr:
+	push r16
+	in r16, 0x3f
+	rcall delay
+	out 0x3f, r16
+	pop r16
+	reti
+
+; Lower bounds: recursion and an indirect jump
+rec:
+	rcall rec
+	ret
+
+ind:
+	ldi r30, 0
+	ijmp
+
+extra:
+	rcall rec
+	rcall ind
+	ret